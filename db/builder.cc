@@ -4,6 +4,7 @@
 
 #include "db/builder.h"
 
+#include <algorithm>
 #include "db/filename.h"
 #include "db/dbformat.h"
 #include "db/table_cache.h"
@@ -19,13 +20,16 @@ Status BuildTable(const std::string& dbname,
                   const Options& options,
                   TableCache* table_cache,
                   Iterator* iter,
+                  Iterator* range_tombstones,
                   FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_deletions = false;
   iter->SeekToFirst();
+  range_tombstones->SeekToFirst();
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || range_tombstones->Valid()) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
@@ -33,13 +37,51 @@ Status BuildTable(const std::string& dbname,
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    const bool has_entries = iter->Valid();
+    if (has_entries) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
+    meta->smallest_seq = kMaxSequenceNumber;
+    meta->largest_seq = 0;
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
+      ParsedInternalKey ikey;
+      if (ParseInternalKey(key, &ikey)) {
+        meta->smallest_seq = std::min(meta->smallest_seq, ikey.sequence);
+        meta->largest_seq = std::max(meta->largest_seq, ikey.sequence);
+      } else {
+        meta->smallest_seq = 0;
+        meta->largest_seq = kMaxSequenceNumber;
+      }
       builder->Add(key, iter->value());
     }
 
+    // The key range of the file is widened to cover its range tombstones.
+    const Comparator* icmp = options.comparator;
+    for (; range_tombstones->Valid(); range_tombstones->Next()) {
+      Slice key = range_tombstones->key();
+      ParsedInternalKey begin;
+      if (!ParseInternalKey(key, &begin)) {
+        s = Status::Corruption("corrupted range tombstone");
+        break;
+      }
+      InternalKey end(range_tombstones->value(), kMaxSequenceNumber,
+                      kValueTypeForSeek);
+      if ((!has_entries && !meta->has_range_deletions) ||
+          icmp->Compare(key, meta->smallest.Encode()) < 0) {
+        meta->smallest.DecodeFrom(key);
+      }
+      if ((!has_entries && !meta->has_range_deletions) ||
+          icmp->Compare(end.Encode(), meta->largest.Encode()) > 0) {
+        meta->largest = end;
+      }
+      meta->smallest_seq = std::min(meta->smallest_seq, begin.sequence);
+      meta->largest_seq = std::max(meta->largest_seq, begin.sequence);
+      meta->has_range_deletions = true;
+      builder->AddRangeTombstone(key, range_tombstones->value());
+    }
+
     // Finish and check for builder errors
     if (s.ok()) {
       s = builder->Finish();
@@ -75,6 +117,8 @@ Status BuildTable(const std::string& dbname,
   // Check for input iterator errors
   if (!iter->status().ok()) {
     s = iter->status();
+  } else if (!range_tombstones->status().ok()) {
+    s = range_tombstones->status();
   }
 
   if (s.ok() && meta->file_size > 0) {
@@ -17,16 +17,18 @@ class Iterator;
 class TableCache;
 class VersionEdit;
 
-// Build a Table file from the contents of *iter.  The generated file
-// will be named according to meta->number.  On success, the rest of
-// *meta will be filled with metadata about the generated table.
-// If no data is present in *iter, meta->file_size will be set to
-// zero, and no Table file will be produced.
+// Build a Table file from the contents of *iter and the range
+// tombstones of *range_tombstones (see db/range_tombstone.h).  The
+// generated file will be named according to meta->number.  On success,
+// the rest of *meta will be filled with metadata about the generated
+// table.  If no data is present in either iterator, meta->file_size will
+// be set to zero, and no Table file will be produced.
 extern Status BuildTable(const std::string& dbname,
                          Env* env,
                          const Options& options,
                          TableCache* table_cache,
                          Iterator* iter,
+                         Iterator* range_tombstones,
                          FileMetaData* meta);
 
 }  // namespace leveldb
@@ -15,15 +15,27 @@
 #include "db/builder.h"
 #include "db/db_iter.h"
 #include "db/dbformat.h"
+#include "db/document.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge.h"
+#include "db/range_tombstone.h"
+#include "db/secondary_aggregate.h"
+#include "db/secondary_index_table.h"
+#include "db/secondary_key.h"
+#include "db/secondary_lookup.h"
+#include "db/secondary_result_cache.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
+#include "leveldb/document.h"
 #include "leveldb/env.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/secondary_key_extractor.h"
+#include "leveldb/secondary_query.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
@@ -44,6 +56,10 @@ namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+// DeleteBySecondaryKey() deletes this many records per secondary lookup
+// and write batch.
+static const int kDeletePageSize = 10000;
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   Status status;
@@ -69,6 +85,8 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    SequenceNumber smallest_seq, largest_seq;
+    bool has_range_deletions;
   };
   std::vector<Output> outputs;
 
@@ -76,6 +94,21 @@ struct DBImpl::CompactionState {
   WritableFile* outfile;
   TableBuilder* builder;
 
+  // The user key of the last entry written to the current output.  Once
+  // close_pending is set the output is closed before the next user key,
+  // so that the entries of a key never straddle two files.
+  std::string last_user_key;
+  bool close_pending;
+
+  // The range tombstones of the input files, and the ones among them
+  // that the output keeps.  Each output file holds the parts of those
+  // that fall between its lower bound and the next file's: the user key
+  // of the input entry at which the file before it was closed.
+  const RangeTombstoneList* input_tombstones;
+  std::vector<RangeTombstone> tombstones;
+  std::string output_lower;
+  bool has_output_lower;
+
   uint64_t total_bytes;
 
   Output* current_output() { return &outputs[outputs.size()-1]; }
@@ -84,6 +117,9 @@ struct DBImpl::CompactionState {
       : compaction(c),
         outfile(NULL),
         builder(NULL),
+        close_pending(false),
+        input_tombstones(NULL),
+        has_output_lower(false),
         total_bytes(0) {
   }
 };
@@ -117,6 +153,16 @@ Options SanitizeOptions(const std::string& dbname,
   if (result.block_cache == NULL) {
     result.block_cache = NewLRUCache(8 << 20);
   }
+  if (result.secondary_key_extractor != NULL) {
+    result.secondaryTrailingAtt.clear();
+    if (result.secondaryAtt.empty()) {
+      result.secondaryAtt = result.secondary_key_extractor->Name();
+    }
+  } else if (!result.secondaryAtt.empty()) {
+    result.secondary_key_extractor = NewJsonSecondaryKeyExtractor(
+        result.secondaryAtt, result.secondaryTrailingAtt,
+        result.document_schema);
+  }
   return result;
 }
 
@@ -128,12 +174,19 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
                                &internal_filter_policy_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
+      owns_secondary_key_extractor_(
+          options_.secondary_key_extractor !=
+          raw_options.secondary_key_extractor),
+      merge_operator_(
+          options_.secondary_index_table == kSecondaryPostingIndexTable
+          ? NewIndexTableMergeOperator() : options_.merge_operator),
       dbname_(dbname),
       db_lock_(NULL),
       shutting_down_(NULL),
       bg_cv_(&mutex_),
       //SECONDARY MEMTABLE
-      mem_(new MemTable(internal_comparator_, raw_options.secondaryAtt)),
+      mem_(new MemTable(internal_comparator_,
+                        options_.secondary_key_extractor)),
       imm_(NULL),
       logfile_(NULL),
       logfile_number_(0),
@@ -149,6 +202,11 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
   // Reserve ten files or so for other uses and give the rest to TableCache.
   const int table_cache_size = options_.max_open_files - kNumNonTableCacheFiles;
   table_cache_ = new TableCache(dbname_, &options_, table_cache_size);
+  result_cache_ = NULL;
+  if (options_.secondary_result_cache != NULL &&
+      options_.secondary_key_extractor != NULL) {
+    result_cache_ = new SecondaryResultCache(options_);
+  }
 
   versions_ = new VersionSet(dbname_, &options_, table_cache_,
                              &internal_comparator_);
@@ -161,6 +219,14 @@ DBImpl::~DBImpl() {
   while (bg_compaction_scheduled_) {
     bg_cv_.Wait();
   }
+  if (db_lock_ != NULL && RecordsKeyHashes(options_)) {
+    // Best effort: a table missing from the sidecar is read on reopening.
+    Status s = versions_->SaveKeyHashes();
+    if (!s.ok()) {
+      Log(options_.info_log, "Saving secondary key hashes: %s\n",
+          s.ToString().c_str());
+    }
+  }
   mutex_.Unlock();
 
   if (db_lock_ != NULL) {
@@ -174,6 +240,7 @@ DBImpl::~DBImpl() {
   delete log_;
   delete logfile_;
   delete table_cache_;
+  delete result_cache_;
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -181,6 +248,12 @@ DBImpl::~DBImpl() {
   if (owns_cache_) {
     delete options_.block_cache;
   }
+  if (owns_secondary_key_extractor_) {
+    delete options_.secondary_key_extractor;
+  }
+  if (merge_operator_ != options_.merge_operator) {
+    delete merge_operator_;
+  }
 }
 
 Status DBImpl::NewDB() {
@@ -257,6 +330,7 @@ void DBImpl::DeleteObsoleteFiles() {
         case kCurrentFile:
         case kDBLockFile:
         case kInfoLogFile:
+        case kSecondarySummaryFile:
           keep = true;
           break;
       }
@@ -420,7 +494,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
 
     if (mem == NULL) {
       //SECONDARY MEMTABLE
-      mem = new MemTable(internal_comparator_, this->options_.secondaryAtt);
+      mem = new MemTable(internal_comparator_,
+                         this->options_.secondary_key_extractor);
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -466,13 +541,15 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
   Iterator* iter = mem->NewIterator();
+  Iterator* range_tombstones = mem->NewRangeTombstoneIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long) meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                   range_tombstones, &meta);
     mutex_.Lock();
   }
 
@@ -480,6 +557,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long) meta.number,
       (unsigned long long) meta.file_size,
       s.ToString().c_str());
+  delete range_tombstones;
   delete iter;
   pending_outputs_.erase(meta.number);
 
@@ -494,7 +572,9 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
     edit->AddFile(level, meta.number, meta.file_size,
-                  meta.smallest, meta.largest);
+                  meta.smallest, meta.largest,
+                  meta.smallest_seq, meta.largest_seq,
+                  meta.has_range_deletions);
   }
 
   CompactionStats stats;
@@ -698,7 +778,9 @@ Status DBImpl::BackgroundCompaction() {
     FileMetaData* f = c->input(0, 0);
     c->edit()->DeleteFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
+                       f->smallest, f->largest,
+                       f->smallest_seq, f->largest_seq,
+                       f->has_range_deletions);
     status = versions_->LogAndApply(c->edit(), &mutex_);
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
@@ -773,6 +855,9 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.smallest_seq = kMaxSequenceNumber;
+    out.largest_seq = 0;
+    out.has_range_deletions = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -786,8 +871,76 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   return s;
 }
 
+namespace {
+struct TombstonePartOrder {
+  const InternalKeyComparator* icmp;
+  explicit TombstonePartOrder(const InternalKeyComparator* c) : icmp(c) { }
+  bool operator()(const std::pair<std::string, std::string>& a,
+                  const std::pair<std::string, std::string>& b) const {
+    return icmp->Compare(a.first, b.first) < 0;
+  }
+};
+}  // namespace
+
+// Add to the current output the parts of the kept range tombstones that
+// fall in [compact->output_lower, *limit), or are unbounded above if
+// "limit" is NULL, and widen its key range to cover them.
+void DBImpl::AddOutputRangeTombstones(CompactionState* compact,
+                                      const Slice* limit) {
+  const Comparator* ucmp = user_comparator();
+  std::vector<std::pair<std::string, std::string> > parts;
+  for (size_t i = 0; i < compact->tombstones.size(); i++) {
+    const RangeTombstone& t = compact->tombstones[i];
+    Slice begin = t.begin;
+    Slice end = t.end;
+    if (compact->has_output_lower &&
+        ucmp->Compare(begin, compact->output_lower) < 0) {
+      begin = compact->output_lower;
+    }
+    if (limit != NULL && ucmp->Compare(*limit, end) < 0) {
+      end = *limit;
+    }
+    if (ucmp->Compare(begin, end) < 0) {
+      std::string key;
+      AppendInternalKey(&key, ParsedInternalKey(begin, t.sequence,
+                                                kTypeRangeDeletion));
+      parts.push_back(std::make_pair(key, end.ToString()));
+    }
+  }
+  std::sort(parts.begin(), parts.end(),
+            TombstonePartOrder(&internal_comparator_));
+
+  CompactionState::Output* out = compact->current_output();
+  for (size_t i = 0; i < parts.size(); i++) {
+    const Slice key = parts[i].first;
+    if (i > 0 && key == Slice(parts[i - 1].first)) {
+      continue;
+    }
+    InternalKey end(parts[i].second, kMaxSequenceNumber, kValueTypeForSeek);
+    const bool first = (compact->builder->NumEntries() == 0 &&
+                        !out->has_range_deletions);
+    if (first || internal_comparator_.Compare(key, out->smallest.Encode()) < 0) {
+      out->smallest.DecodeFrom(key);
+    }
+    if (first || internal_comparator_.Compare(end, out->largest) > 0) {
+      out->largest = end;
+    }
+    const SequenceNumber seq = DecodeFixed64(key.data() + key.size() - 8) >> 8;
+    out->smallest_seq = std::min(out->smallest_seq, seq);
+    out->largest_seq = std::max(out->largest_seq, seq);
+    out->has_range_deletions = true;
+    compact->builder->AddRangeTombstone(key, parts[i].second);
+  }
+
+  if (limit != NULL) {
+    compact->output_lower = limit->ToString();
+    compact->has_output_lower = true;
+  }
+}
+
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* limit) {
   assert(compact != NULL);
   assert(compact->outfile != NULL);
   assert(compact->builder != NULL);
@@ -799,6 +952,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
   if (s.ok()) {
+    AddOutputRangeTombstones(compact, limit);
     s = compact->builder->Finish();
   } else {
     compact->builder->Abandon();
@@ -854,11 +1008,119 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
     const CompactionState::Output& out = compact->outputs[i];
     compact->compaction->edit()->AddFile(
         level + 1,
-        out.number, out.file_size, out.smallest, out.largest);
+        out.number, out.file_size, out.smallest, out.largest,
+        out.smallest_seq, out.largest_seq, out.has_range_deletions);
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
 }
 
+// Add "key" -> "value" to the output of "compact", where "ikey" is the
+// parsed key or NULL if it could not be parsed.
+Status DBImpl::AddCompactionEntry(CompactionState* compact, Iterator* input,
+                                  const Slice& key, const Slice& value,
+                                  const ParsedInternalKey* ikey) {
+  Status status;
+  // Open output file if necessary
+  if (compact->builder == NULL) {
+    status = OpenCompactionOutputFile(compact);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  CompactionState::Output* out = compact->current_output();
+  if (compact->builder->NumEntries() == 0) {
+    out->smallest.DecodeFrom(key);
+  }
+  out->largest.DecodeFrom(key);
+  if (ikey != NULL) {
+    out->smallest_seq = std::min(out->smallest_seq, ikey->sequence);
+    out->largest_seq = std::max(out->largest_seq, ikey->sequence);
+  } else {
+    // Unparseable key: the sequence range of this output is unknown
+    out->smallest_seq = 0;
+    out->largest_seq = kMaxSequenceNumber;
+  }
+  compact->builder->Add(key, value);
+  const Slice user_key = (ikey != NULL ? ikey->user_key : key);
+  compact->last_user_key.assign(user_key.data(), user_key.size());
+
+  // Close output file before the next user key if it is big enough
+  if (compact->builder->FileSize() >=
+      compact->compaction->MaxOutputFileSize()) {
+    compact->close_pending = true;
+  }
+  return status;
+}
+
+// "input" is at the newest merge operand of a key, and no snapshot needs
+// the entries of the key apart from it.  Advance "input" past the key's
+// operands and the value or deletion below them, if any, and store in
+// *entries what to write in their place: one value holding the merged
+// result if it can be computed here, else the entries unchanged.  An
+// entry deleted by a range tombstone ends the operands like a deletion,
+// but is left for the caller to drop.  Returns the sequence number below
+// which older entries of the key are hidden.
+SequenceNumber DBImpl::CollapseMerges(
+    CompactionState* compact, Iterator* input,
+    std::vector<std::pair<std::string, std::string> >* entries) {
+  ParsedInternalKey ikey;
+  ParseInternalKey(input->key(), &ikey);
+  const std::string user_key = ikey.user_key.ToString();
+  const SequenceNumber newest = ikey.sequence;
+
+  std::vector<std::string> operands;
+  bool has_base = false;
+  bool has_bottom = false;     // Reached a value or deletion
+  SequenceNumber bottom = kMaxSequenceNumber;
+  for (; input->Valid(); input->Next()) {
+    if (!ParseInternalKey(input->key(), &ikey) ||
+        user_comparator()->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (compact->input_tombstones->Covers(ikey.user_key, ikey.sequence,
+                                          compact->smallest_snapshot)) {
+      has_bottom = true;  // Deleted by a range tombstone: no value is left
+      break;
+    }
+    entries->push_back(std::make_pair(input->key().ToString(),
+                                      input->value().ToString()));
+    if (ikey.type != kTypeMerge) {
+      has_base = (ikey.type == kTypeValue);
+      has_bottom = true;
+      bottom = ikey.sequence;
+      input->Next();
+      break;
+    }
+    operands.push_back(entries->back().second);
+  }
+
+  // The value the operands apply to may be in a deeper level.  Only the
+  // posting lists of the index table, which are merged by concatenation,
+  // can be merged without it, into a single operand.
+  const bool partial =
+      !has_bottom && !compact->compaction->IsBaseLevelForKey(user_key);
+  if (partial && !IsIndexTableKey(user_key)) {
+    return kMaxSequenceNumber;
+  }
+  std::string merged;
+  Slice base;
+  if (has_base) {
+    base = entries->back().second;
+  }
+  Status s = ApplyMergeOperands(merge_operator_, user_key,
+                                has_base ? &base : NULL, operands, &merged);
+  if (!s.ok()) {
+    return partial ? kMaxSequenceNumber : bottom;
+  }
+  entries->clear();
+  std::string key;
+  AppendInternalKey(&key, ParsedInternalKey(user_key, newest,
+                                            partial ? kTypeMerge
+                                                    : kTypeValue));
+  entries->push_back(std::make_pair(key, merged));
+  return newest;
+}
+
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
   int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
@@ -880,14 +1142,29 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
+
+  // Range tombstones that every snapshot sees, and below whose range no
+  // older data is left, have deleted all they ever will once this
+  // compaction drops the entries they cover.
+  RangeTombstoneList input_tombstones(user_comparator());
+  Status status =
+      compact->compaction->AddInputRangeTombstones(&input_tombstones);
+  compact->input_tombstones = &input_tombstones;
+  for (size_t i = 0; i < input_tombstones.tombstones().size(); i++) {
+    const RangeTombstone& t = input_tombstones.tombstones()[i];
+    if (t.sequence > compact->smallest_snapshot ||
+        !compact->compaction->IsBaseLevelForRange(t.begin, t.end)) {
+      compact->tombstones.push_back(t);
+    }
+  }
+
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
   input->SeekToFirst();
-  Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
-  for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
+  for (; status.ok() && input->Valid() && !shutting_down_.Acquire_Load(); ) {
     // Prioritize immutable compaction work
     if (has_imm_.NoBarrier_Load() != NULL) {
       const uint64_t imm_start = env_->NowMicros();
@@ -903,9 +1180,16 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     Slice key = input->key();
     if (compact->compaction->ShouldStopBefore(key) &&
         compact->builder != NULL) {
-      status = FinishCompactionOutputFile(compact, input);
-      if (!status.ok()) {
-        break;
+      compact->close_pending = true;
+    }
+    if (compact->close_pending) {
+      const Slice user_key = (key.size() >= 8 ? ExtractUserKey(key) : key);
+      if (user_comparator()->Compare(user_key, compact->last_user_key) != 0) {
+        compact->close_pending = false;
+        status = FinishCompactionOutputFile(compact, input, &user_key);
+        if (!status.ok()) {
+          break;
+        }
       }
     }
 
@@ -940,9 +1224,17 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (input_tombstones.Covers(ikey.user_key, ikey.sequence,
+                                         compact->smallest_snapshot)) {
+        // Deleted by a range tombstone that every snapshot sees
+        drop = true;
       }
 
-      last_sequence_for_key = ikey.sequence;
+      // A merge operand hides nothing: the entries below it are the
+      // value it applies to.
+      if (ikey.type != kTypeMerge) {
+        last_sequence_for_key = ikey.sequence;
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -954,27 +1246,29 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
-    if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == NULL) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
-        }
+    if (!drop && has_current_user_key && ikey.type == kTypeMerge &&
+        ikey.sequence <= compact->smallest_snapshot) {
+      // No snapshot tells the operands apart, so apply them now.  This
+      // moves input past them.
+      std::vector<std::pair<std::string, std::string> > entries;
+      last_sequence_for_key = CollapseMerges(compact, input, &entries);
+      for (size_t i = 0; status.ok() && i < entries.size(); i++) {
+        ParsedInternalKey entry;
+        ParseInternalKey(entries[i].first, &entry);
+        status = AddCompactionEntry(compact, input, entries[i].first,
+                                    entries[i].second, &entry);
       }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+      if (!status.ok()) {
+        break;
       }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
+      continue;
+    }
 
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+    if (!drop) {
+      status = AddCompactionEntry(compact, input, key, input->value(),
+                                  has_current_user_key ? &ikey : NULL);
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -984,8 +1278,19 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.Acquire_Load()) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok() && compact->builder == NULL) {
+    // Kept range tombstones past the last entry need a file of their own.
+    for (size_t i = 0; i < compact->tombstones.size(); i++) {
+      if (!compact->has_output_lower ||
+          user_comparator()->Compare(compact->tombstones[i].end,
+                                     compact->output_lower) > 0) {
+        status = OpenCompactionOutputFile(compact);
+        break;
+      }
+    }
+  }
   if (status.ok() && compact->builder != NULL) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, NULL);
   }
   if (status.ok()) {
     status = input->status();
@@ -1035,9 +1340,29 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 }
 }  // namespace
 
+// Add the range tombstones of "mem", "imm" (unless NULL) and "version",
+// which the caller keeps referenced, to *tombstones.
+static Status AddRangeTombstones(MemTable* mem, MemTable* imm,
+                                 Version* version,
+                                 RangeTombstoneList* tombstones) {
+  Iterator* iter = mem->NewRangeTombstoneIterator();
+  Status s = tombstones->AddAll(iter);
+  delete iter;
+  if (s.ok() && imm != NULL) {
+    iter = imm->NewRangeTombstoneIterator();
+    s = tombstones->AddAll(iter);
+    delete iter;
+  }
+  if (s.ok()) {
+    s = version->AddRangeTombstones(tombstones);
+  }
+  return s;
+}
+
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+                                      uint32_t* seed,
+                                      RangeTombstoneList* tombstones) {
   IterState* cleanup = new IterState;
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
@@ -1063,6 +1388,15 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
 
   *seed = ++seed_;
   mutex_.Unlock();
+
+  if (tombstones != NULL) {
+    Status s = AddRangeTombstones(cleanup->mem, cleanup->imm,
+                                  cleanup->version, tombstones);
+    if (!s.ok()) {
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+  }
   return internal_iter;
 }
 
@@ -1080,6 +1414,17 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
+  Status s = GetLive(options, key, value, NULL);
+  if (s.ok() && options.json_documents && IsBinaryDocument(*value)) {
+    std::string json;
+    s = DocumentToJson(options_, *value, &json);
+    value->swap(json);
+  }
+  return s;
+}
+
+Status DBImpl::GetLive(const ReadOptions& options, const Slice& key,
+                       std::string* value, SequenceNumber* sequence) {
   Status s;
   MutexLock l(&mutex_);
   SequenceNumber snapshot;
@@ -1104,14 +1449,17 @@ Status DBImpl::Get(const ReadOptions& options,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
+    if (mem->Get(lkey, value, &s, sequence)) {
       // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
+    } else if (imm != NULL && imm->Get(lkey, value, &s, sequence)) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
+      s = current->Get(options, lkey, value, &stats, sequence);
       have_stat_update = true;
     }
+    if (s.IsIncomplete()) {
+      s = GetMerged(options, snapshot, key, value);
+    }
     mutex_.Lock();
   }
 
@@ -1123,20 +1471,140 @@ Status DBImpl::Get(const ReadOptions& options,
   current->Unref();
   return s;
 }
-static bool NewestFirst(const leveldb::SKeyReturnVal& a,const leveldb::SKeyReturnVal& b)
-{
-   return a.sequence_number<b.sequence_number?false:true;
+Status DBImpl::GetMerged(const ReadOptions& options, SequenceNumber snapshot,
+                         const Slice& key, std::string* value) {
+  SequenceNumber latest_snapshot;
+  uint32_t seed;
+  ReadOptions merge_options = options;
+  merge_options.secondary_key.clear();    // Must not skip any block
+  RangeTombstoneList* tombstones = new RangeTombstoneList(user_comparator());
+  Iterator* iter = NewRangeDeletingIterator(
+      NewInternalIterator(merge_options, &latest_snapshot, &seed, tombstones),
+      tombstones, snapshot);
+  LookupKey lkey(key, snapshot);
+  std::vector<std::string> operands;
+  Slice base;
+  bool has_base = false;
+  Status s;
+  for (iter->Seek(lkey.internal_key()); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey)) {
+      s = Status::Corruption("corrupted key for ", key);
+      break;
+    }
+    if (user_comparator()->Compare(ikey.user_key, key) != 0) {
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      operands.push_back(iter->value().ToString());
+    } else {
+      if (ikey.type == kTypeValue) {
+        base = iter->value();
+        has_base = true;
+      }
+      break;
+    }
+  }
+  if (s.ok()) {
+    s = iter->status();
+  }
+  if (s.ok()) {
+    s = ApplyMergeOperands(merge_operator_, key,
+                           has_base ? &base : NULL, operands, value);
+  }
+  delete iter;
+  return s;
+}
+
+namespace {
+struct PinnedMemTable {
+  port::Mutex* mu;
+  MemTable* mem;
+};
+
+static void UnrefPinnedMemTable(void* arg1, void* arg2) {
+  PinnedMemTable* state = reinterpret_cast<PinnedMemTable*>(arg1);
+  state->mu->Lock();
+  state->mem->Unref();
+  state->mu->Unlock();
+  delete state;
+}
+}  // namespace
+
+// Hand our reference on "mem" over to *result, which drops it on release.
+void DBImpl::PinMemTable(MemTable* mem, SecondaryResultSet* result) {
+  PinnedMemTable* state = new PinnedMemTable;
+  state->mu = &mutex_;
+  state->mem = mem;
+  result->RegisterCleanup(&UnrefPinnedMemTable, state, NULL);
 }
- 
 
 //New Get method implementation for read on secondary key
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& skey,
                    std::vector<SKeyReturnVal>* value, int kNoOfOutputs) {
-    //ofstream outputFile;
-    //outputFile.open("/Users/nakshikatha/Desktop/test codes/debug3.txt");
+  if (result_cache_ == NULL || !SecondaryResultCache::Cacheable(options)) {
+    return Get(options, SecondaryQuery::Equals(options_.secondaryAtt, skey),
+               value, kNoOfOutputs);
+  }
+  std::string cache_key;
+  result_cache_->MakeKey(options, skey, kNoOfOutputs, &cache_key);
+  SequenceNumber sequence;
+  Cache::Handle* handle;
+  {
+    MutexLock l(&mutex_);
+    sequence = versions_->LastSequence();
+    handle = result_cache_->Lookup(cache_key);
+  }
+  if (handle != NULL) {
+    return result_cache_->Read(handle, value) ? Status::OK()
+                                              : Status::NotFound(Slice());
+  }
+
+  const size_t start = value->size();
+  Status s = Get(options, SecondaryQuery::Equals(options_.secondaryAtt, skey),
+                 value, kNoOfOutputs);
+  if (s.ok() || s.IsNotFound()) {
+    result_cache_->Insert(cache_key, skey, sequence, value->data() + start,
+                          value->size() - start);
+  }
+  return s;
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   const Slice& skey,
+                   SecondaryResultSet* result, int kNoOfOutputs) {
+  return Get(options, SecondaryQuery::Equals(options_.secondaryAtt, skey),
+             result, kNoOfOutputs);
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   const SecondaryQuery& query,
+                   std::vector<SKeyReturnVal>* value, int kNoOfOutputs) {
+  SecondaryResultSet result;
+  Status s = Get(options, query, &result, kNoOfOutputs);
+  value->reserve(value->size() + result.size());
+  for (size_t i = 0; i < result.size(); i++) {
+    SKeyReturnVal val;
+    val.key = result[i].key.ToString();
+    if (options.json_documents) {
+      Status js = DocumentToJson(options_, result[i].value, &val.value);
+      if (!js.ok() && s.ok()) s = js;
+    } else {
+      val.value = result[i].value.ToString();
+    }
+    val.sequence_number = result[i].sequence_number;
+    val.rank_value = result[i].rank_value;
+    value->push_back(std::move(val));
+  }
+  return s;
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   const SecondaryQuery& query,
+                   SecondaryResultSet* result, int kNoOfOutputs) {
   Status s;
-  //outputFile<<"innnn\n";
+  result->Clear();
   MutexLock l(&mutex_);
   SequenceNumber snapshot;
   if (options.snapshot != NULL) {
@@ -1144,7 +1612,7 @@ Status DBImpl::Get(const ReadOptions& options,
   } else {
     snapshot = versions_->LastSequence();
   }
-  
+
   MemTable* mem = mem_;
   MemTable* imm = imm_;
   Version* current = versions_->current();
@@ -1152,71 +1620,195 @@ Status DBImpl::Get(const ReadOptions& options,
   if (imm != NULL) imm->Ref();
   current->Ref();
 
-  bool have_stat_update = false;
+  bool mem_pinned = false;
+  bool imm_pinned = false;
   Version::GetStats stats;
-  
-  //outputFile<<"in\n";
+
   // Unlock while reading from files and memtables
   {
     mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
-    //outputFile<<"in\n";
-    LookupKey lkey(skey, snapshot);
-    //outputFile<<"in\n";
-    
-    std::unordered_set<std::string> resultSetofKeysFound;
-     //SECONDARY MEMTABLE
-    //outputFile<<"memGet\n";
-    mem->Get(skey, snapshot, value, &s ,&resultSetofKeysFound , kNoOfOutputs) ;
-    
-    //if(value->size()>kNoOfOutputs)
-    //std::sort(value->begin(), value->end(), NewestFirst);
-    
-    
-    if(imm != NULL && kNoOfOutputs-value->size()>0) {
-      //outputFile<<"immGet\n";  
-      int memsize = value->size(); 
+    ReadOptions lookup_options = options;
+    lookup_options.cache_priority = options.secondary_cache_priority;
+    SecondaryLookup lookup(this, env_, options_, lookup_options, query,
+                           snapshot, kNoOfOutputs, result);
+    RangeTombstoneList tombstones(user_comparator());
+
+    if (lookup.bad_cursor()) {
+      s = Status::InvalidArgument("bad secondary lookup resume cursor");
+    } else {
+      s = AddRangeTombstones(mem, imm, current, &tombstones);
+    }
+    if (s.ok()) {
+      lookup.set_range_tombstones(&tombstones);
+      // First look in the memtable, then in the immutable memtable (if
+      // any).  A resumed lookup has read both already.
       //SECONDARY MEMTABLE
-      imm->Get(skey, snapshot, value, &s ,&resultSetofKeysFound , kNoOfOutputs) ;
-      //if(value->size()>kNoOfOutputs)
-       // std::sort(value->begin()+memsize, value->end(), NewestFirst);
-    
-    }  
-    
-    if(kNoOfOutputs>value->size())
-    {
-        //outputFile<<"sstget\n";
-        s = current->Get(options, lkey, value, &stats,this->options_.secondaryAtt,kNoOfOutputs,&resultSetofKeysFound,this);
-        //outputFile<<"in\n";
-    }
-     
-    
-    std::sort_heap(value->begin(),value->end(),NewestFirst);
-    //outputFile<<"in\n";
+      std::vector<std::string> index_keys;
+      if (options_.secondary_index_table != kNoSecondaryIndexTable &&
+          !lookup.resuming() && lookup.CoveringKeys(&index_keys)) {
+        s = GetFromIndexTable(lookup_options, snapshot, index_keys, &lookup);
+      } else {
+        if (!lookup.resuming()) {
+          mem_pinned = mem->Get(&lookup, false);
+          if (imm != NULL && !lookup.Done()) {
+            imm_pinned = imm->Get(&lookup, true);
+          }
+        }
+
+        if (!lookup.Done()) {
+          s = current->Get(lookup_options, &lookup, &stats);
+        }
+      }
+      lookup.Finish();
+      if (lookup.incomplete() && (s.ok() || s.IsNotFound())) {
+        s = Status::Incomplete("secondary lookup budget exhausted");
+      }
+    }
     mutex_.Lock();
-    //outputFile<<"in\n";
   }
 
-  /*if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
-  }*/
-  mem->Unref();
-  if (imm != NULL) imm->Unref();
-  //current->Unref();
-  //outputFile.close();
+  // Memtables that hits point into stay referenced until *result is
+  // released; the others are released here as usual.
+  if (mem_pinned) {
+    PinMemTable(mem, result);
+  } else {
+    mem->Unref();
+  }
+  if (imm != NULL) {
+    if (imm_pinned) {
+      PinMemTable(imm, result);
+    } else {
+      imm->Unref();
+    }
+  }
+  current->Unref();
+  if (s.ok() && result->empty()) {
+    s = Status::NotFound(Slice());
+  }
   return s;
 }
 
+Status DBImpl::GetFromIndexTable(const ReadOptions& options,
+                                 SequenceNumber snapshot,
+                                 const std::vector<std::string>& index_keys,
+                                 SecondaryLookup* lookup) {
+  ReadOptions index_options = options;
+  index_options.secondary_key.clear();
+  SequenceNumber latest_snapshot;
+  uint32_t seed;
+  RangeTombstoneList* tombstones = new RangeTombstoneList(user_comparator());
+  Iterator* iter = NewInternalIterator(index_options, &latest_snapshot, &seed,
+                                       tombstones);
+  iter = NewDBIterator(
+      this, user_comparator(), merge_operator_,
+      NewRangeDeletingIterator(iter, tombstones, snapshot), snapshot, seed);
+  Status s = ReadIndexTable(options_, iter, index_keys, lookup);
+  delete iter;
+  return s;
+}
+
+Status DBImpl::GetSecondaryAggregate(const ReadOptions& options,
+                                     const Slice& skey,
+                                     SecondaryAggregate* result) {
+  if (options_.secondary_key_extractor == NULL) {
+    return Status::InvalidArgument("no secondary index to aggregate over");
+  }
+  // Records are checked against their live version as of the snapshot.
+  ReadOptions aggregate_options = options;
+  aggregate_options.cache_priority = options.secondary_cache_priority;
+  const Snapshot* implicit_snapshot = NULL;
+  if (options.snapshot == NULL) {
+    implicit_snapshot = GetSnapshot();
+    aggregate_options.snapshot = implicit_snapshot;
+  }
+
+  Status s;
+  {
+    MutexLock l(&mutex_);
+    MemTable* mem = mem_;
+    MemTable* imm = imm_;
+    Version* current = versions_->current();
+    mem->Ref();
+    if (imm != NULL) imm->Ref();
+    current->Ref();
+
+    // Unlock while reading from files and memtables
+    {
+      mutex_.Unlock();
+      RangeTombstoneList tombstones(user_comparator());
+      s = AddRangeTombstones(mem, imm, current, &tombstones);
+      if (s.ok()) {
+        SecondaryAggregator aggregator(this, options_, aggregate_options,
+                                       skey, mem, imm, current, &tombstones);
+        mem->Get(&aggregator);
+        if (imm != NULL) {
+          imm->Get(&aggregator);
+        }
+        s = current->Get(aggregate_options, &aggregator);
+        if (s.ok()) {
+          aggregator.Finish(result);
+        }
+      }
+      mutex_.Lock();
+    }
+
+    mem->Unref();
+    if (imm != NULL) imm->Unref();
+    current->Unref();
+  }
+  if (implicit_snapshot != NULL) {
+    ReleaseSnapshot(implicit_snapshot);
+  }
+  return s;
+}
+
+static void ReleaseScanSnapshot(void* arg1, void* arg2) {
+  reinterpret_cast<DB*>(arg1)->ReleaseSnapshot(
+      reinterpret_cast<const Snapshot*>(arg2));
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
+  const bool by_secondary_key = !options.secondary_key.empty();
+  ReadOptions scan_options = options;
+  const Snapshot* scan_snapshot = NULL;
+  if (by_secondary_key) {
+    if (options_.secondary_key_extractor == NULL) {
+      return NewErrorIterator(
+          Status::InvalidArgument("no secondary index to scan by"));
+    }
+    scan_options.cache_priority = options.secondary_cache_priority;
+    if (options.snapshot == NULL) {
+      // Records are checked against their live version as of the scan.
+      scan_snapshot = GetSnapshot();
+      scan_options.snapshot = scan_snapshot;
+    }
+  }
+
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
-  return NewDBIterator(
-      this, user_comparator(), iter,
-      (options.snapshot != NULL
-       ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
-       : latest_snapshot),
-      seed);
+  RangeTombstoneList* tombstones = new RangeTombstoneList(user_comparator());
+  Iterator* iter = NewInternalIterator(scan_options, &latest_snapshot, &seed,
+                                       tombstones);
+  const SequenceNumber sequence =
+      (scan_options.snapshot != NULL
+       ? reinterpret_cast<const SnapshotImpl*>(scan_options.snapshot)->number_
+       : latest_snapshot);
+  iter = NewDBIterator(
+      this, user_comparator(), merge_operator_,
+      NewRangeDeletingIterator(iter, tombstones, sequence), sequence, seed);
+  if (options_.secondary_index_table != kNoSecondaryIndexTable) {
+    iter = NewIndexTableHidingIterator(iter);
+  }
+  if (by_secondary_key) {
+    // Only tables with a secondary filter skip blocks.
+    iter = NewSecondaryKeyIterator(this, options_, scan_options, iter,
+                                   options_.filter_policy != NULL);
+    if (scan_snapshot != NULL) {
+      iter->RegisterCleanup(&ReleaseScanSnapshot, this,
+                            const_cast<Snapshot*>(scan_snapshot));
+    }
+  }
+  return iter;
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1243,78 +1835,88 @@ Status DBImpl::Put(const WriteOptions& o, const Slice& key, const Slice& val) {
 
 //Custom Put Overload Method for inserting values with key on secondary attribute
 Status DBImpl::Put(const WriteOptions& o, const Slice& val) {
-  
- 
-  if(this->options_.PrimaryAtt.empty()) 
-      return Status::InvalidArgument("Primary Attribute Not Set");
-  rapidjson::Document docToParse;   
-  
-  docToParse.Parse<0>(val.ToString().c_str());   
-  const char* pKeyAtt = this->options_.PrimaryAtt.c_str();
-  
-  if(!docToParse.IsObject()||!docToParse.HasMember(pKeyAtt)||docToParse[pKeyAtt].IsNull())
-      return Status::InvalidArgument("Primary Attribute does not found");
-  
-  std::ostringstream pKey;
-  if(docToParse[pKeyAtt].IsNumber())
-  {
-        if(docToParse[pKeyAtt].IsUint64())
-        {
-            unsigned long long int tid = docToParse[pKeyAtt].GetUint64();
-            pKey<<tid;
-
-        }
-        else if (docToParse[pKeyAtt].IsInt64())
-        {
-            long long int tid = docToParse[pKeyAtt].GetInt64();
-            pKey<<tid;
-        }
-        else if (docToParse[pKeyAtt].IsDouble())
-        {
-            double tid = docToParse[pKeyAtt].GetDouble();
-            pKey<<tid;
-        }
-        
-        else if (docToParse[pKeyAtt].IsUint())
-        {
-            unsigned int tid = docToParse[pKeyAtt].GetUint();
-            pKey<<tid;
-        }
-        else if (docToParse[pKeyAtt].IsInt())
-        {
-            int tid = docToParse[pKeyAtt].GetInt();
-            pKey<<tid;             
-        }
-  }
-  else if (docToParse[pKeyAtt].IsString())
-  {
-        const char* tid = docToParse[pKeyAtt].GetString();
-        pKey<<tid;
-  }
-  else if(docToParse[pKeyAtt].IsBool())
-  {
-        bool tid = docToParse[pKeyAtt].GetBool();
-        pKey<<tid;
+  WriteBatch batch;
+  Status s = batch.PutDocument(options_, val);
+  if (s.ok()) {
+    s = Write(o, &batch);
   }
-  
-  Slice key = pKey.str();
-  docToParse.RemoveMember(this->options_.PrimaryAtt.c_str());
-  rapidjson::StringBuffer strbuf;
-  rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
-  docToParse.Accept(writer);
-  //ofstream outputFile;
-  //outputFile.open("/home/mohiuddin/Desktop/TestDB/debug3.txt" ,std::ofstream::out | std::ofstream::app);
-    
-  //outputFile<<pKey.str()<<endl;
-  
-  return DB::Put(o,  pKey.str(), strbuf.GetString());
+  return s;
 }
 
-
 Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  if (options_.merge_operator == NULL) {
+    return Status::NotSupported("no merge operator");
+  }
+  return DB::Merge(options, key, value);
+}
+
+Status DBImpl::DeleteRange(const WriteOptions& options, const Slice& begin,
+                           const Slice& end) {
+  if (user_comparator()->Compare(begin, end) >= 0) {
+    return Status::OK();  // Empty range
+  }
+  return DB::DeleteRange(options, begin, end);
+}
+
+Status DBImpl::DeleteBySecondaryKey(const WriteOptions& options,
+                                    const Slice& skey, uint64_t* deleted) {
+  *deleted = 0;
+  // Candidates are taken a page at a time, newest first: each lookup is
+  // confined to records written before the oldest one of the page before,
+  // so none is seen twice and the pinned results stay bounded.
+  ReadOptions read_options;
+  read_options.fill_cache = false;
+  read_options.snapshot = GetSnapshot();
+  ReadOptions live_options;
+  live_options.fill_cache = false;
+  SecondaryResultSet page;
+  WriteBatch batch;
+  std::string value;
+  SequenceNumber live;
+  Status s;
+  while (true) {
+    s = Get(read_options, skey, &page, kDeletePageSize);
+    if (!s.ok()) {
+      if (s.IsNotFound()) {
+        s = Status::OK();
+      }
+      break;
+    }
+    // Records rewritten or deleted since the snapshot are left alone.
+    // The check is made outside the writer queue, so a record rewritten
+    // between it and Write() below is deleted all the same.
+    batch.Clear();
+    SequenceNumber oldest = read_options.max_sequence;
+    int n_deleted = 0;
+    for (size_t i = 0; i < page.size(); i++) {
+      if (GetLive(live_options, page[i].key, &value, &live).ok() &&
+          live == page[i].sequence_number) {
+        batch.Delete(page[i].key);
+        n_deleted++;
+      }
+      oldest = std::min<SequenceNumber>(oldest, page[i].sequence_number);
+    }
+    const size_t n = page.size();
+    page.Clear();
+    s = Write(options, &batch);
+    if (!s.ok()) {
+      break;
+    }
+    *deleted += n_deleted;
+    if (n < static_cast<size_t>(kDeletePageSize) || oldest == 0) {
+      break;
+    }
+    read_options.max_sequence = oldest - 1;
+  }
+  ReleaseSnapshot(read_options.snapshot);
+  return s;
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   Writer w(&mutex_);
   w.batch = my_batch;
@@ -1336,8 +1938,14 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   Writer* last_writer = &w;
   if (status.ok() && my_batch != NULL) {  // NULL batch is for compactions
     WriteBatch* updates = BuildBatchGroup(&last_writer);
+    if (options_.secondary_index_table != kNoSecondaryIndexTable &&
+        updates != tmp_batch_) {
+      // The index table entries must not be added to the caller's batch.
+      WriteBatchInternal::Append(tmp_batch_, updates);
+      updates = tmp_batch_;
+    }
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
-    last_sequence += WriteBatchInternal::Count(updates);
+    SecondaryResultCache::Writes writes;
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1345,6 +1953,10 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
     // into mem_.
     {
       mutex_.Unlock();
+      // The index table entries take the sequence numbers that follow
+      // those of the records, in the same log record.
+      AppendIndexTableEntries(options_, updates);
+      last_sequence += WriteBatchInternal::Count(updates);
       status = log_->AddRecord(WriteBatchInternal::Contents(updates));
       if (status.ok() && options.sync) {
         status = logfile_->Sync();
@@ -1352,10 +1964,17 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
       if (status.ok()) {
         status = WriteBatchInternal::InsertInto(updates, mem_);
       }
+      if (result_cache_ != NULL) {
+        result_cache_->CollectWrites(updates, &writes);
+      }
       mutex_.Lock();
     }
     if (updates == tmp_batch_) tmp_batch_->Clear();
 
+    // Cached results the batch may change expire before it is visible.
+    if (result_cache_ != NULL) {
+      result_cache_->Note(writes, last_sequence);
+    }
     versions_->SetLastSequence(last_sequence);
   }
 
@@ -1484,7 +2103,8 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       imm_ = mem_;
       has_imm_.Release_Store(imm_);
       //SECONDARY MEMTABLE
-      mem_ = new MemTable(internal_comparator_, this->options_.secondaryAtt);
+      mem_ = new MemTable(internal_comparator_,
+                          this->options_.secondary_key_extractor);
       mem_->Ref();
       force = false;   // Do not force another compaction if have room
       MaybeScheduleCompaction();
@@ -1573,6 +2193,37 @@ void DBImpl::GetApproximateSizes(
   }
 }
 
+Status DBImpl::GetApproximateSecondaryCount(const Slice& skey,
+                                            uint64_t* count) {
+  if (options_.secondary_key_extractor == NULL) {
+    return Status::InvalidArgument("no secondary index to count");
+  }
+  std::string index_key;
+  AppendIndexKey(options_, skey, &index_key);
+  const bool composite = !options_.secondaryTrailingAtt.empty();
+
+  MutexLock l(&mutex_);
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* v = versions_->current();
+  mem->Ref();
+  if (imm != NULL) imm->Ref();
+  v->Ref();
+  {
+    mutex_.Unlock();
+    *count = mem->ApproximateSecondaryCount(index_key, composite);
+    if (imm != NULL) {
+      *count += imm->ApproximateSecondaryCount(index_key, composite);
+    }
+    *count += versions_->ApproximateSecondaryCount(v, index_key);
+    mutex_.Lock();
+  }
+  mem->Unref();
+  if (imm != NULL) imm->Unref();
+  v->Unref();
+  return Status::OK();
+}
+
 // Default implementations of convenience methods that subclasses of DB
 // can call if they wish
 Status DB::Put(const WriteOptions& opt, const Slice& key, const Slice& value) {
@@ -1608,12 +2259,39 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
                 DB** dbptr) {
   *dbptr = NULL;
 
+  if (options.secondary_index_table != kNoSecondaryIndexTable &&
+      (options.comparator != BytewiseComparator() ||
+       options.merge_operator != NULL)) {
+    return Status::InvalidArgument(
+        "secondary index tables need the bytewise comparator and no "
+        "merge operator");
+  }
+  if (options.binary_documents && options.merge_operator != NULL &&
+      IsJsonMergeOperator(options.merge_operator)) {
+    return Status::InvalidArgument(
+        "the JSON merge operator needs documents stored as JSON text");
+  }
+
   DBImpl* impl = new DBImpl(options, dbname);
   //Add options in DB
   //this->options = options;
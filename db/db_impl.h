@@ -7,6 +7,8 @@
 
 #include <deque>
 #include <set>
+#include <utility>
+#include <vector>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
@@ -18,6 +20,9 @@
 namespace leveldb {
 
 class MemTable;
+class RangeTombstoneList;
+class SecondaryLookup;
+class SecondaryResultCache;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -32,6 +37,12 @@ class DBImpl : public DB {
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Put(const WriteOptions& o, const Slice& val);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  virtual Status Merge(const WriteOptions&, const Slice& key,
+                       const Slice& value);
+  virtual Status DeleteRange(const WriteOptions&, const Slice& begin,
+                             const Slice& end);
+  virtual Status DeleteBySecondaryKey(const WriteOptions& options,
+                                      const Slice& skey, uint64_t* deleted);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
@@ -39,11 +50,25 @@ class DBImpl : public DB {
   virtual Status Get(const ReadOptions& options,
                    const Slice& skey,
                    std::vector<SKeyReturnVal>* value,int kNoOfOutputs);
+  virtual Status Get(const ReadOptions& options,
+                   const Slice& skey,
+                   SecondaryResultSet* result, int kNoOfOutputs);
+  virtual Status Get(const ReadOptions& options,
+                     const SecondaryQuery& query,
+                     std::vector<SKeyReturnVal>* value, int kNoOfOutputs);
+  virtual Status Get(const ReadOptions& options,
+                     const SecondaryQuery& query,
+                     SecondaryResultSet* result, int kNoOfOutputs);
+  virtual Status GetSecondaryAggregate(const ReadOptions& options,
+                                       const Slice& skey,
+                                       SecondaryAggregate* result);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
+  virtual Status GetApproximateSecondaryCount(const Slice& skey,
+                                              uint64_t* count);
   virtual void CompactRange(const Slice* begin, const Slice* end);
 
   // Extra methods (for testing) that are not in the public DB interface
@@ -70,15 +95,41 @@ class DBImpl : public DB {
 
  private:
   friend class DB;
+  friend class SecondaryAggregator;
+  friend class SecondaryLookup;
   struct CompactionState;
   struct Writer;
 
+  // If "tombstones" is non-NULL, the range tombstones of the memtables
+  // and files the iterator reads are added to it.  The iterator does not
+  // apply them.
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeTombstoneList* tombstones = NULL);
+
+  // Same as Get(options, key, value), but binary documents are returned
+  // as stored and, if "sequence" is non-NULL, the sequence number of the
+  // newest entry of key is stored in *sequence when one is found.
+  Status GetLive(const ReadOptions& options, const Slice& key,
+                 std::string* value, SequenceNumber* sequence);
+
+  // Store in *value the value of "key" at "snapshot", whose newest entry
+  // is a merge operand, by applying the operands to the value below them.
+  Status GetMerged(const ReadOptions& options, SequenceNumber snapshot,
+                   const Slice& key, std::string* value);
+
+  // Offer to *lookup the records the secondary index table lists under
+  // "index_keys" at "snapshot".
+  Status GetFromIndexTable(const ReadOptions& options,
+                           SequenceNumber snapshot,
+                           const std::vector<std::string>& index_keys,
+                           SecondaryLookup* lookup);
 
   Status NewDB();
 
+  void PinMemTable(MemTable* mem, SecondaryResultSet* result);
+
   // Recover the descriptor from persistent storage.  May do a significant
   // amount of work to recover recently logged updates.  Any changes to
   // be made to the descriptor are added to *edit.
@@ -116,7 +167,15 @@ class DBImpl : public DB {
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* limit);
+  void AddOutputRangeTombstones(CompactionState* compact, const Slice* limit);
+  Status AddCompactionEntry(CompactionState* compact, Iterator* input,
+                            const Slice& key, const Slice& value,
+                            const ParsedInternalKey* ikey);
+  SequenceNumber CollapseMerges(
+      CompactionState* compact, Iterator* input,
+      std::vector<std::pair<std::string, std::string> >* entries);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -127,11 +186,20 @@ class DBImpl : public DB {
   const Options options_;  // options_.comparator == &internal_comparator_
   bool owns_info_log_;
   bool owns_cache_;
+  bool owns_secondary_key_extractor_;
+
+  // The merge operator of options_ or, with a posting index table, the
+  // one of the index table.  Owned iff it is the latter.
+  const MergeOperator* merge_operator_;
   const std::string dbname_;
 
   // table_cache_ provides its own synchronization
   TableCache* table_cache_;
 
+  // NULL unless options_.secondary_result_cache is set.  What it notes
+  // of the writes is protected by mutex_.
+  SecondaryResultCache* result_cache_;
+
   // Lock over the persistent DB state.  Non-NULL iff successfully acquired.
   FileLock* db_lock_;
 
@@ -7,8 +7,11 @@
 #include "db/filename.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
+#include "db/merge.h"
+#include "db/secondary_key.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/merge_operator.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -35,12 +38,15 @@ namespace {
 // (userkey,seq,type) => uservalue entries.  DBIter
 // combines multiple entries for the same userkey found in the DB
 // representation into a single entry while accounting for sequence
-// numbers, deletion markers, overwrites, etc.
+// numbers, deletion markers, overwrites, merge operands, etc.
 class DBIter: public Iterator {
  public:
   // Which direction is the iterator currently moving?
   // (1) When moving forward, the internal iterator is positioned at
-  //     the exact entry that yields this->key(), this->value()
+  //     the exact entry that yields this->key(), this->value(), unless
+  //     that entry is a merge operand: then the key and the merged value
+  //     are saved, and the internal iterator is positioned after the
+  //     operands (at the entry they apply to, if any).
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
   enum Direction {
@@ -48,14 +54,16 @@ class DBIter: public Iterator {
     kReverse
   };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+  DBIter(DBImpl* db, const Comparator* cmp, const MergeOperator* merge,
+         Iterator* iter, SequenceNumber s, uint32_t seed)
       : db_(db),
         user_comparator_(cmp),
+        merge_operator_(merge),
         iter_(iter),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        merged_(false),
         rnd_(seed),
         bytes_counter_(RandomPeriod()) {
   }
@@ -65,11 +73,13 @@ class DBIter: public Iterator {
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ?
+        ExtractUserKey(iter_->key()) : saved_key_;
   }
   virtual Slice value() const {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_) ?
+        iter_->value() : saved_value_;
   }
   virtual Status status() const {
     if (status_.ok()) {
@@ -87,6 +97,7 @@ class DBIter: public Iterator {
 
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
+  void MergeForward();
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
@@ -110,6 +121,7 @@ class DBIter: public Iterator {
 
   DBImpl* db_;
   const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
 
@@ -118,6 +130,7 @@ class DBIter: public Iterator {
   std::string saved_value_;   // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool merged_;               // saved_key_, saved_value_ hold a merged entry
 
   Random rnd_;
   ssize_t bytes_counter_;
@@ -162,6 +175,16 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // saved_key_ already contains the key to skip past, and iter_ has
+    // been advanced over the operands.
+    if (!iter_->Valid()) {
+      valid_ = false;
+      merged_ = false;
+      saved_key_.clear();
+      ClearSavedValue();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -174,6 +197,7 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  merged_ = false;
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
@@ -194,6 +218,18 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else {
+            MergeForward();
+            return;
+          }
+          break;
+        case kTypeRangeDeletion:
+          // Kept apart from the entries this iterator reads
+          break;
       }
     }
     iter_->Next();
@@ -202,14 +238,60 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+void DBIter::MergeForward() {
+  // iter_ is at the newest visible operand for a key: gather the older
+  // ones down to the value or deletion they apply to.
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  std::vector<std::string> operands;
+  operands.push_back(iter_->value().ToString());
+  Slice base;
+  bool has_base = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey) ||
+        user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      operands.push_back(iter_->value().ToString());
+    } else {
+      if (ikey.type == kTypeValue) {
+        base = iter_->value();
+        has_base = true;
+      }
+      break;
+    }
+  }
+  Status s = ApplyMergeOperands(merge_operator_, saved_key_,
+                                has_base ? &base : NULL, operands,
+                                &saved_value_);
+  if (!s.ok()) {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    return;
+  }
+  merged_ = true;
+  valid_ = true;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
   if (direction_ == kForward) {  // Switch directions?
-    // iter_ is pointing at the current entry.  Scan backwards until
-    // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    // iter_ is pointing at the current entry, or after it if the entry
+    // was merged.  Scan backwards until the key changes so we can use
+    // the normal reverse scanning code.
+    if (merged_) {
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -242,6 +324,28 @@ void DBIter::FindPrevUserEntry() {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
+        if (ikey.type == kTypeMerge) {
+          // Entries are met oldest first, so apply the operand to the
+          // value gathered so far for this key (if any).
+          std::string merged;
+          Slice existing(saved_value_);
+          if (merge_operator_ == NULL ||
+              !merge_operator_->Merge(
+                  ikey.user_key,
+                  value_type == kTypeDeletion ? NULL : &existing,
+                  iter_->value(), &merged)) {
+            status_ = Status::Corruption("merge failed in DBIter");
+            value_type = kTypeDeletion;
+            saved_key_.clear();
+            ClearSavedValue();
+            break;
+          }
+          SaveKey(ikey.user_key, &saved_key_);
+          saved_value_.swap(merged);
+          value_type = kTypeValue;
+          iter_->Prev();
+          continue;
+        }
         value_type = ikey.type;
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
@@ -273,6 +377,7 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(
@@ -287,6 +392,7 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -298,20 +404,124 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
 }
 
+// Yields the records of a DBIter that carry ReadOptions::secondary_key.
+// The tables below may have skipped data blocks that hold a newer
+// version of a record, or its deletion, so unless "validate" is false a
+// record is only yielded once a point lookup shows that its live
+// version still carries the key.
+class SecondaryKeyIter: public Iterator {
+ public:
+  SecondaryKeyIter(DB* db, const Options& options,
+                   const ReadOptions& read_options, Iterator* iter,
+                   bool validate)
+      : db_(db),
+        options_(options),
+        read_options_(read_options),
+        iter_(iter),
+        validate_(validate),
+        valid_(false) {
+    AppendIndexKey(options, read_options.secondary_key, &index_key_);
+    read_options_.secondary_key.clear();
+    read_options_.json_documents = false;
+  }
+  virtual ~SecondaryKeyIter() {
+    delete iter_;
+  }
+  virtual bool Valid() const { return valid_; }
+  virtual Slice key() const {
+    assert(valid_);
+    return iter_->key();
+  }
+  virtual Slice value() const {
+    assert(valid_);
+    return validate_ ? Slice(value_) : iter_->value();
+  }
+  virtual Status status() const {
+    return status_.ok() ? iter_->status() : status_;
+  }
+
+  virtual void Next() { assert(valid_); iter_->Next(); FindLive(true); }
+  virtual void Prev() { assert(valid_); iter_->Prev(); FindLive(false); }
+  virtual void Seek(const Slice& target) {
+    iter_->Seek(target);
+    FindLive(true);
+  }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); FindLive(true); }
+  virtual void SeekToLast() { iter_->SeekToLast(); FindLive(false); }
+
+ private:
+  // Move iter_ in the given direction to the first record, starting
+  // with the current one, that carries the key.
+  void FindLive(bool forward) {
+    valid_ = false;
+    while (status_.ok() && iter_->Valid()) {
+      if (IsLive()) {
+        valid_ = true;
+        return;
+      }
+      if (forward) {
+        iter_->Next();
+      } else {
+        iter_->Prev();
+      }
+    }
+  }
+
+  bool IsLive() {
+    if (!HasIndexKey(options_, iter_->value(), index_key_)) {
+      return false;
+    }
+    if (!validate_) {
+      return true;
+    }
+    Status s = db_->Get(read_options_, iter_->key(), &value_);
+    if (s.IsNotFound()) {
+      return false;
+    } else if (!s.ok()) {
+      status_ = s;
+      return false;
+    }
+    return HasIndexKey(options_, value_, index_key_);
+  }
+
+  DB* const db_;
+  const Options& options_;
+  ReadOptions read_options_;
+  Iterator* const iter_;
+  const bool validate_;
+  std::string index_key_;
+  bool valid_;
+  std::string value_;     // The live value, if validate_
+  Status status_;
+
+  // No copying allowed
+  SecondaryKeyIter(const SecondaryKeyIter&);
+  void operator=(const SecondaryKeyIter&);
+};
+
 }  // anonymous namespace
 
 Iterator* NewDBIterator(
     DBImpl* db,
     const Comparator* user_key_comparator,
+    const MergeOperator* merge_operator,
     Iterator* internal_iter,
     SequenceNumber sequence,
     uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+  return new DBIter(db, user_key_comparator, merge_operator, internal_iter,
+                    sequence, seed);
+}
+
+Iterator* NewSecondaryKeyIterator(DB* db, const Options& options,
+                                  const ReadOptions& read_options,
+                                  Iterator* db_iter, bool validate) {
+  return new SecondaryKeyIter(db, options, read_options, db_iter, validate);
 }
 
 }  // namespace leveldb
@@ -12,17 +12,30 @@
 namespace leveldb {
 
 class DBImpl;
+class MergeOperator;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Merge operands are applied with
+// "merge_operator".
 extern Iterator* NewDBIterator(
     DBImpl* db,
     const Comparator* user_key_comparator,
+    const MergeOperator* merge_operator,
     Iterator* internal_iter,
     SequenceNumber sequence,
     uint32_t seed);
 
+// Return a new iterator over the records of the DB iterator "db_iter"
+// whose value carries read_options.secondary_key in the secondary index
+// of "options".  Unless "validate" is false, each record is checked with
+// db->Get(), under read_options.snapshot, to still carry the key, and
+// the value yielded is the one Get() returned.  "options" must outlive
+// the result, which takes ownership of db_iter.
+extern Iterator* NewSecondaryKeyIterator(DB* db, const Options& options,
+                                         const ReadOptions& read_options,
+                                         Iterator* db_iter, bool validate);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_DB_ITER_H_
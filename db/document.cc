@@ -0,0 +1,624 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/document.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+#include "db/secondary_key.h"
+#include "leveldb/document.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+namespace {
+
+enum ValueTag {
+  kNull = 0,
+  kFalse = 1,
+  kTrue = 2,
+  kUint = 3,
+  kNegativeInt = 4,
+  kDouble = 5,
+  kString = 6,
+  kArray = 7,
+  kObject = 8
+};
+
+static const uint32_t kAbsent = 0xffffffffu;
+
+typedef rapidjson::Document::AllocatorType Allocator;
+
+void EncodeValue(const rapidjson::Value& v, std::string* dst) {
+  switch (v.GetType()) {
+    case rapidjson::kNullType:
+      dst->push_back(kNull);
+      break;
+    case rapidjson::kFalseType:
+      dst->push_back(kFalse);
+      break;
+    case rapidjson::kTrueType:
+      dst->push_back(kTrue);
+      break;
+    case rapidjson::kNumberType:
+      if (v.IsUint64()) {
+        dst->push_back(kUint);
+        PutVarint64(dst, v.GetUint64());
+      } else if (v.IsInt64()) {
+        // Negative: the complement is small and non-negative.
+        dst->push_back(kNegativeInt);
+        PutVarint64(dst, ~static_cast<uint64_t>(v.GetInt64()));
+      } else {
+        double d = v.GetDouble();
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        dst->push_back(kDouble);
+        PutFixed64(dst, bits);
+      }
+      break;
+    case rapidjson::kStringType:
+      dst->push_back(kString);
+      PutLengthPrefixedSlice(dst, Slice(v.GetString(), v.GetStringLength()));
+      break;
+    case rapidjson::kArrayType:
+      dst->push_back(kArray);
+      PutVarint32(dst, v.Size());
+      for (rapidjson::SizeType i = 0; i < v.Size(); i++) {
+        EncodeValue(v[i], dst);
+      }
+      break;
+    case rapidjson::kObjectType:
+      dst->push_back(kObject);
+      PutVarint32(dst, v.MemberEnd() - v.MemberBegin());
+      for (rapidjson::Value::ConstMemberIterator m = v.MemberBegin();
+           m != v.MemberEnd(); ++m) {
+        PutLengthPrefixedSlice(
+            dst, Slice(m->name.GetString(), m->name.GetStringLength()));
+        EncodeValue(m->value, dst);
+      }
+      break;
+  }
+}
+
+// Decode the value at the start of *input into *v and advance *input
+// past it.  Strings point into the input.
+bool DecodeValue(Slice* input, rapidjson::Value* v, Allocator& allocator) {
+  if (input->empty()) {
+    return false;
+  }
+  const char tag = (*input)[0];
+  input->remove_prefix(1);
+  switch (tag) {
+    case kNull:
+      v->SetNull();
+      return true;
+    case kFalse:
+    case kTrue:
+      v->SetBool(tag == kTrue);
+      return true;
+    case kUint:
+    case kNegativeInt: {
+      uint64_t u;
+      if (!GetVarint64(input, &u)) return false;
+      if (tag == kUint) {
+        v->SetUint64(u);
+      } else {
+        v->SetInt64(static_cast<int64_t>(~u));
+      }
+      return true;
+    }
+    case kDouble: {
+      if (input->size() < 8) return false;
+      uint64_t bits = DecodeFixed64(input->data());
+      input->remove_prefix(8);
+      double d;
+      memcpy(&d, &bits, sizeof(d));
+      v->SetDouble(d);
+      return true;
+    }
+    case kString: {
+      Slice s;
+      if (!GetLengthPrefixedSlice(input, &s)) return false;
+      rapidjson::Value str(s.data(), static_cast<rapidjson::SizeType>(s.size()));
+      *v = str;
+      return true;
+    }
+    case kArray: {
+      uint32_t count;
+      if (!GetVarint32(input, &count)) return false;
+      v->SetArray();
+      for (uint32_t i = 0; i < count; i++) {
+        rapidjson::Value element;
+        if (!DecodeValue(input, &element, allocator)) return false;
+        v->PushBack(element, allocator);
+      }
+      return true;
+    }
+    case kObject: {
+      uint32_t count;
+      if (!GetVarint32(input, &count)) return false;
+      v->SetObject();
+      for (uint32_t i = 0; i < count; i++) {
+        Slice name;
+        rapidjson::Value member;
+        if (!GetLengthPrefixedSlice(input, &name) ||
+            !DecodeValue(input, &member, allocator)) {
+          return false;
+        }
+        rapidjson::Value n(name.data(),
+                           static_cast<rapidjson::SizeType>(name.size()));
+        v->AddMember(n, member, allocator);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+// Advance *input past the value at its start.
+bool SkipValue(Slice* input) {
+  if (input->empty()) {
+    return false;
+  }
+  const char tag = (*input)[0];
+  input->remove_prefix(1);
+  uint32_t count;
+  uint64_t u;
+  Slice s;
+  switch (tag) {
+    case kNull:
+    case kFalse:
+    case kTrue:
+      return true;
+    case kUint:
+    case kNegativeInt:
+      return GetVarint64(input, &u);
+    case kDouble:
+      if (input->size() < 8) return false;
+      input->remove_prefix(8);
+      return true;
+    case kString:
+      return GetLengthPrefixedSlice(input, &s);
+    case kArray:
+      if (!GetVarint32(input, &count)) return false;
+      for (uint32_t i = 0; i < count; i++) {
+        if (!SkipValue(input)) return false;
+      }
+      return true;
+    case kObject:
+      if (!GetVarint32(input, &count)) return false;
+      for (uint32_t i = 0; i < count; i++) {
+        if (!GetLengthPrefixedSlice(input, &s) || !SkipValue(input)) {
+          return false;
+        }
+      }
+      return true;
+  }
+  return false;
+}
+
+int FindSlot(const std::vector<std::string>& schema, const Slice& name) {
+  for (size_t i = 0; i < schema.size(); i++) {
+    if (Slice(schema[i]) == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// The parts of a binary document.
+struct BinaryDocument {
+  uint32_t num_slots;
+  const char* offsets;   // fixed32[num_slots + 1]; the last is extra_offset
+  Slice values;
+
+  bool Init(const Slice& value) {
+    Slice input = value;
+    if (!IsBinaryDocument(input)) return false;
+    input.remove_prefix(1);
+    if (!GetVarint32(&input, &num_slots) ||
+        (input.size() / 4) < static_cast<size_t>(num_slots) + 1) {
+      return false;
+    }
+    offsets = input.data();
+    input.remove_prefix(4 * (num_slots + 1));
+    values = input;
+    return true;
+  }
+
+  // Store in *input the values starting at "offset".
+  bool At(uint32_t offset, Slice* input) const {
+    if (offset > values.size()) return false;
+    *input = Slice(values.data() + offset, values.size() - offset);
+    return true;
+  }
+
+  uint32_t slot_offset(uint32_t slot) const {
+    return slot < num_slots ? DecodeFixed32(offsets + 4 * slot) : kAbsent;
+  }
+
+  uint32_t extra_offset() const {
+    return DecodeFixed32(offsets + 4 * num_slots);
+  }
+};
+
+// Decode the attribute "name" of "doc" under "schema" into *out, adding
+// it as a member named by the stable string "name".  Absent attributes
+// are skipped.
+bool DecodeAttribute(const std::vector<std::string>& schema,
+                     const BinaryDocument& doc, const std::string& name,
+                     rapidjson::Document* out) {
+  Allocator& allocator = out->GetAllocator();
+  const int slot = FindSlot(schema, name);
+  Slice input;
+  if (slot >= 0) {
+    const uint32_t offset = doc.slot_offset(slot);
+    if (offset == kAbsent) {
+      return true;
+    }
+    rapidjson::Value v;
+    if (!doc.At(offset, &input) || !DecodeValue(&input, &v, allocator)) {
+      return false;
+    }
+    rapidjson::Value n(name.data(),
+                       static_cast<rapidjson::SizeType>(name.size()));
+    out->AddMember(n, v, allocator);
+    return true;
+  }
+
+  // Not in the schema: look among the extra attributes.
+  uint32_t count;
+  if (!doc.At(doc.extra_offset(), &input) || input.empty() ||
+      input[0] != kObject) {
+    return false;
+  }
+  input.remove_prefix(1);
+  if (!GetVarint32(&input, &count)) return false;
+  for (uint32_t i = 0; i < count; i++) {
+    Slice member_name;
+    if (!GetLengthPrefixedSlice(&input, &member_name)) return false;
+    if (member_name == Slice(name)) {
+      rapidjson::Value v;
+      if (!DecodeValue(&input, &v, allocator)) return false;
+      rapidjson::Value n(member_name.data(),
+                         static_cast<rapidjson::SizeType>(member_name.size()));
+      out->AddMember(n, v, allocator);
+      return true;
+    }
+    if (!SkipValue(&input)) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool IsBinaryDocument(const Slice& value) {
+  return !value.empty() && value[0] == '\0';
+}
+
+void EncodeDocument(const std::vector<std::string>& schema,
+                    const rapidjson::Value& doc, const Slice& skip,
+                    std::string* dst) {
+  assert(doc.IsObject());
+
+  // Attributes of the schema go to their slots, the rest to the extra
+  // object.  A repeated attribute keeps its first value in the slot.
+  std::vector<const rapidjson::Value*> slots(schema.size(), NULL);
+  std::vector<rapidjson::Value::ConstMemberIterator> extra;
+  uint32_t num_slots = 0;
+  for (rapidjson::Value::ConstMemberIterator m = doc.MemberBegin();
+       m != doc.MemberEnd(); ++m) {
+    Slice name(m->name.GetString(), m->name.GetStringLength());
+    if (!skip.empty() && name == skip) {
+      continue;
+    }
+    const int slot = FindSlot(schema, name);
+    if (slot >= 0 && slots[slot] == NULL) {
+      slots[slot] = &m->value;
+      if (static_cast<uint32_t>(slot) >= num_slots) {
+        num_slots = slot + 1;
+      }
+    } else {
+      extra.push_back(m);
+    }
+  }
+
+  dst->push_back('\0');
+  PutVarint32(dst, num_slots);
+  const size_t offsets = dst->size();
+  dst->resize(offsets + 4 * (num_slots + 1));
+  const size_t base = dst->size();
+  for (uint32_t i = 0; i < num_slots; i++) {
+    uint32_t offset = kAbsent;
+    if (slots[i] != NULL) {
+      offset = dst->size() - base;
+      EncodeValue(*slots[i], dst);
+    }
+    EncodeFixed32(&(*dst)[offsets + 4 * i], offset);
+  }
+  EncodeFixed32(&(*dst)[offsets + 4 * num_slots], dst->size() - base);
+  dst->push_back(kObject);
+  PutVarint32(dst, extra.size());
+  for (size_t i = 0; i < extra.size(); i++) {
+    PutLengthPrefixedSlice(dst, Slice(extra[i]->name.GetString(),
+                                      extra[i]->name.GetStringLength()));
+    EncodeValue(extra[i]->value, dst);
+  }
+}
+
+bool ReadDocument(const std::vector<std::string>& schema,
+                  const Slice& value,
+                  const std::vector<std::string>* attributes,
+                  rapidjson::Document* doc) {
+  if (!IsBinaryDocument(value)) {
+    return ParseDocument(value, doc);
+  }
+  BinaryDocument binary;
+  if (!binary.Init(value)) {
+    return false;
+  }
+  doc->SetObject();
+  if (attributes != NULL) {
+    for (size_t i = 0; i < attributes->size(); i++) {
+      if (!DecodeAttribute(schema, binary, (*attributes)[i], doc)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  Allocator& allocator = doc->GetAllocator();
+  Slice input;
+  for (uint32_t i = 0; i < binary.num_slots; i++) {
+    const uint32_t offset = binary.slot_offset(i);
+    if (offset == kAbsent) {
+      continue;
+    }
+    rapidjson::Value v;
+    if (i >= schema.size() || !binary.At(offset, &input) ||
+        !DecodeValue(&input, &v, allocator)) {
+      return false;
+    }
+    rapidjson::Value n(schema[i].data(),
+                       static_cast<rapidjson::SizeType>(schema[i].size()));
+    doc->AddMember(n, v, allocator);
+  }
+  rapidjson::Value extra;
+  if (!binary.At(binary.extra_offset(), &input) ||
+      !DecodeValue(&input, &extra, allocator) || !extra.IsObject()) {
+    return false;
+  }
+  for (rapidjson::Value::MemberIterator m = extra.MemberBegin();
+       m != extra.MemberEnd(); ++m) {
+    doc->AddMember(m->name, m->value, allocator);
+  }
+  return true;
+}
+
+Slice TopLevelAttribute(const Slice& path) {
+  const char* dot = static_cast<const char*>(
+      memchr(path.data(), '.', path.size()));
+  return dot == NULL ? path : Slice(path.data(), dot - path.data());
+}
+
+namespace {
+
+// Checks JSON text while stepping over it.
+class JsonScanner {
+ public:
+  explicit JsonScanner(const Slice& text)
+      : p_(text.data()), limit_(text.data() + text.size()) { }
+
+  const char* position() const { return p_; }
+
+  void SkipSpace() {
+    while (p_ < limit_ &&
+           (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+      p_++;
+    }
+  }
+
+  // Skip white space, then consume "c" if it comes next.
+  bool Consume(char c) {
+    SkipSpace();
+    if (p_ < limit_ && *p_ == c) {
+      p_++;
+      return true;
+    }
+    return false;
+  }
+
+  bool AtEnd() {
+    SkipSpace();
+    return p_ == limit_;
+  }
+
+  // Step over a string, storing its contents (escapes left as written)
+  // in *raw and setting *escaped if it has any.
+  bool String(Slice* raw, bool* escaped) {
+    if (!Consume('"')) return false;
+    const char* start = p_;
+    *escaped = false;
+    while (p_ < limit_) {
+      const unsigned char c = *p_++;
+      if (c == '"') {
+        *raw = Slice(start, p_ - 1 - start);
+        return true;
+      } else if (c == '\\') {
+        *escaped = true;
+        if (p_ == limit_) return false;
+        const char e = *p_++;
+        if (e == 'u') {
+          for (int i = 0; i < 4; i++) {
+            if (p_ == limit_ || !isxdigit(static_cast<unsigned char>(*p_))) {
+              return false;
+            }
+            p_++;
+          }
+        } else if (strchr("\"\\/bfnrt", e) == NULL || e == '\0') {
+          return false;
+        }
+      } else if (c < 0x20) {
+        return false;
+      }
+    }
+    return false;
+  }
+
+  // Step over any value, checking it.
+  bool Value(int depth) {
+    SkipSpace();
+    if (p_ == limit_ || depth > kMaxDepth) return false;
+    Slice raw;
+    bool escaped;
+    switch (*p_) {
+      case '"':
+        return String(&raw, &escaped);
+      case '{':
+        p_++;
+        if (Consume('}')) return true;
+        do {
+          if (!String(&raw, &escaped) || !Consume(':') || !Value(depth + 1)) {
+            return false;
+          }
+        } while (Consume(','));
+        return Consume('}');
+      case '[':
+        p_++;
+        if (Consume(']')) return true;
+        do {
+          if (!Value(depth + 1)) return false;
+        } while (Consume(','));
+        return Consume(']');
+      case 't':
+        return Literal("true");
+      case 'f':
+        return Literal("false");
+      case 'n':
+        return Literal("null");
+      default:
+        return Number();
+    }
+  }
+
+ private:
+  enum { kMaxDepth = 512 };
+
+  bool Literal(const char* word) {
+    const size_t n = strlen(word);
+    if (static_cast<size_t>(limit_ - p_) < n || memcmp(p_, word, n) != 0) {
+      return false;
+    }
+    p_ += n;
+    return true;
+  }
+
+  bool Digits() {
+    const char* start = p_;
+    while (p_ < limit_ && *p_ >= '0' && *p_ <= '9') p_++;
+    return p_ > start;
+  }
+
+  bool Number() {
+    if (p_ < limit_ && *p_ == '-') p_++;
+    if (p_ < limit_ && *p_ == '0') {
+      p_++;
+    } else if (!Digits()) {
+      return false;
+    }
+    if (p_ < limit_ && *p_ == '.') {
+      p_++;
+      if (!Digits()) return false;
+    }
+    if (p_ < limit_ && (*p_ == 'e' || *p_ == 'E')) {
+      p_++;
+      if (p_ < limit_ && (*p_ == '+' || *p_ == '-')) p_++;
+      if (!Digits()) return false;
+    }
+    return true;
+  }
+
+  const char* p_;
+  const char* const limit_;
+};
+
+}  // namespace
+
+bool FindTopLevelAttribute(const Slice& json, const Slice& name,
+                           AttributeSpan* span) {
+  JsonScanner scanner(json);
+  if (!scanner.Consume('{')) return false;
+  bool found = false;
+  if (!scanner.Consume('}')) {
+    // Positions of the member found, of the end of the member before
+    // it, and of the start of the member after it.
+    const char* member_start = NULL;
+    const char* member_end = NULL;
+    const char* previous_end = NULL;
+    const char* next_start = NULL;
+    const char* last_end = NULL;
+    do {
+      scanner.SkipSpace();
+      const char* start = scanner.position();
+      if (found && next_start == NULL) {
+        next_start = start;
+      }
+      Slice raw;
+      bool escaped;
+      if (!scanner.String(&raw, &escaped) || escaped ||
+          !scanner.Consume(':')) {
+        return false;
+      }
+      scanner.SkipSpace();
+      const char* value_start = scanner.position();
+      if (!scanner.Value(1)) {
+        return false;
+      }
+      if (!found && raw == name) {
+        found = true;
+        member_start = start;
+        member_end = scanner.position();
+        previous_end = last_end;
+        span->value = Slice(value_start, member_end - value_start);
+      }
+      last_end = scanner.position();
+    } while (scanner.Consume(','));
+    if (!scanner.Consume('}')) return false;
+
+    if (found) {
+      if (next_start != NULL) {
+        span->member = Slice(member_start, next_start - member_start);
+      } else if (previous_end != NULL) {
+        span->member = Slice(previous_end, member_end - previous_end);
+      } else {
+        span->member = Slice(member_start, member_end - member_start);
+      }
+    }
+  }
+  return scanner.AtEnd() && found;
+}
+
+Status DocumentToJson(const Options& options, const Slice& value,
+                      std::string* json) {
+  if (!IsBinaryDocument(value)) {
+    json->assign(value.data(), value.size());
+    return Status::OK();
+  }
+  rapidjson::Document doc;
+  if (!ReadDocument(options.document_schema, value, NULL, &doc)) {
+    return Status::Corruption("bad binary document");
+  }
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  doc.Accept(writer);
+  json->assign(buffer.GetString(), buffer.Size());
+  return Status::OK();
+}
+
+}  // namespace leveldb
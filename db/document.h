@@ -0,0 +1,77 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Binary encoding of JSON documents (see Options::binary_documents):
+//
+//    document    := '\0' num_slots:varint32 slot_offset:fixed32[num_slots]
+//                   extra_offset:fixed32 values
+//    value       := tag:char payload
+//
+// Slot i holds the top-level attribute named Options::document_schema[i]:
+// its name is not stored, and its value is found without a scan at
+// slot_offset[i] within "values" (kAbsent if the document lacks it).
+// Attributes outside the schema are kept, with their names, in the
+// object at extra_offset.  Payloads are:
+//
+//    kNull, kFalse, kTrue    : empty
+//    kUint, kNegativeInt     : varint64 (the complement, for kNegativeInt)
+//    kDouble                 : fixed64 of the IEEE 754 bits
+//    kString                 : varint32 length, bytes
+//    kArray                  : varint32 count, value[count]
+//    kObject                 : varint32 count, (varint32 length, name
+//                              bytes, value)[count]
+//
+// A JSON text never starts with '\0', so both forms can be told apart.
+
+#ifndef STORAGE_LEVELDB_DB_DOCUMENT_H_
+#define STORAGE_LEVELDB_DB_DOCUMENT_H_
+
+#include <string>
+#include <vector>
+#include "leveldb/slice.h"
+#include "rapidjson/document.h"
+
+namespace leveldb {
+
+// Return true iff "value" holds a binary document.
+extern bool IsBinaryDocument(const Slice& value);
+
+// Append to *dst the binary encoding of the JSON object "doc" under
+// "schema", leaving out its top-level attribute "skip" if non-empty.
+extern void EncodeDocument(const std::vector<std::string>& schema,
+                           const rapidjson::Value& doc, const Slice& skip,
+                           std::string* dst);
+
+// Store in *doc the JSON object that "value", a JSON text or a binary
+// document written under "schema", holds.  If "attributes" is non-NULL
+// only those top-level attributes of a binary document are decoded,
+// each without looking at the others.  Strings of a binary document
+// point into "value", which must outlive *doc.  Returns true iff value
+// holds an object.
+extern bool ReadDocument(const std::vector<std::string>& schema,
+                         const Slice& value,
+                         const std::vector<std::string>* attributes,
+                         rapidjson::Document* doc);
+
+// Return the top-level attribute of the attribute path "path".
+extern Slice TopLevelAttribute(const Slice& path);
+
+// Where a top-level attribute sits in a JSON text document.
+struct AttributeSpan {
+  Slice value;    // The attribute's value as written
+  Slice member;   // The bytes to cut to remove the attribute, including
+                  // the comma that separates it from a neighbour
+};
+
+// Find the first top-level attribute "name" of the JSON text "json" by
+// scanning it in place, without building a DOM, and store its position
+// in *span.  The whole text is checked to be a single well-formed
+// object.  Returns false if it is not, if it lacks the attribute, or if
+// its member names use escapes (and so cannot be compared unparsed).
+extern bool FindTopLevelAttribute(const Slice& json, const Slice& name,
+                                  AttributeSpan* span);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_DOCUMENT_H_
@@ -0,0 +1,129 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/document.h"
+
+#include "db/secondary_key.h"
+#include "leveldb/document.h"
+#include "leveldb/options.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class DocumentTest {
+ public:
+  Options options_;
+
+  std::string Encode(const std::string& json, const std::string& skip) {
+    rapidjson::Document doc;
+    ASSERT_TRUE(ParseDocument(json, &doc));
+    std::string result;
+    EncodeDocument(options_.document_schema, doc, skip, &result);
+    return result;
+  }
+
+  std::string ToJson(const std::string& value) {
+    std::string json;
+    ASSERT_OK(DocumentToJson(options_, value, &json));
+    return json;
+  }
+};
+
+TEST(DocumentTest, RoundTrip) {
+  options_.document_schema.push_back("b");
+  options_.document_schema.push_back("unused");
+  options_.document_schema.push_back("a");
+  const std::string encoded = Encode(
+      "{\"a\": [1, -2, 1.5, true, null], \"b\": {\"c\": \"x\"},"
+      " \"d\": \"y\", \"id\": 7}", "id");
+  ASSERT_TRUE(IsBinaryDocument(encoded));
+  // Slots come first, in schema order, then the other attributes.
+  ASSERT_EQ("{\"b\":{\"c\":\"x\"},\"a\":[1,-2,1.5,true,null],\"d\":\"y\"}",
+            ToJson(encoded));
+}
+
+TEST(DocumentTest, NoSchema) {
+  const std::string encoded =
+      Encode("{\"s\": \"a\\u0000b\", \"n\": 18446744073709551615}", "");
+  ASSERT_EQ("{\"s\":\"a\\u0000b\",\"n\":18446744073709551615}",
+            ToJson(encoded));
+  ASSERT_EQ("{\"s\": 1}", ToJson("{\"s\": 1}"));
+}
+
+TEST(DocumentTest, ReadAttributes) {
+  options_.document_schema.push_back("a");
+  const std::string encoded =
+      Encode("{\"a\": 1, \"b\": {\"c\": [\"u\", \"v\"]}, \"e\": 2}", "");
+
+  std::vector<std::string> attributes;
+  attributes.push_back("b");
+  attributes.push_back("a");
+  attributes.push_back("missing");
+  rapidjson::Document doc;
+  ASSERT_TRUE(ReadDocument(options_.document_schema, encoded, &attributes,
+                           &doc));
+  ASSERT_TRUE(!doc.HasMember("e"));
+  ASSERT_EQ(1, doc["a"].GetInt());
+  std::vector<std::string> keys;
+  GetSecondaryKeys(doc, "b.c", &keys);
+  ASSERT_EQ(2, keys.size());
+  ASSERT_EQ("v", keys[1]);
+}
+
+TEST(DocumentTest, Corrupt) {
+  const std::string encoded = Encode("{\"a\": [1, 2, 3]}", "");
+  rapidjson::Document doc;
+  for (size_t n = 1; n < encoded.size(); n++) {
+    ASSERT_TRUE(!ReadDocument(options_.document_schema,
+                              Slice(encoded.data(), n), NULL, &doc));
+  }
+  std::string json;
+  ASSERT_TRUE(DocumentToJson(options_, Slice(encoded.data(), 3),
+                             &json).IsCorruption());
+}
+
+TEST(DocumentTest, TopLevelAttribute) {
+  ASSERT_EQ("a", TopLevelAttribute("a.b.c").ToString());
+  ASSERT_EQ("a", TopLevelAttribute("a").ToString());
+}
+
+// Return "json" with the member "name" cut out, or "(none)".
+static std::string Cut(const std::string& json, const std::string& name) {
+  AttributeSpan span;
+  if (!FindTopLevelAttribute(json, name, &span)) {
+    return "(none)";
+  }
+  const size_t start = span.member.data() - json.data();
+  return span.value.ToString() + " " +
+      json.substr(0, start) + json.substr(start + span.member.size());
+}
+
+TEST(DocumentTest, FindTopLevelAttribute) {
+  ASSERT_EQ("1 {\"b\": 2, \"c\": 3}", Cut("{\"a\": 1, \"b\": 2, \"c\": 3}", "a"));
+  ASSERT_EQ("2 {\"a\": 1, \"c\": 3}", Cut("{\"a\": 1, \"b\": 2, \"c\": 3}", "b"));
+  ASSERT_EQ("3 {\"a\": 1, \"b\": 2}", Cut("{\"a\": 1, \"b\": 2, \"c\": 3}", "c"));
+  ASSERT_EQ("\"x\" {  }", Cut("{ \"a\" : \"x\" }", "a"));
+  ASSERT_EQ("{\"a\":[1,{}]} {\"b\":true}",
+            Cut("{\"b\":true,\"a\":{\"a\":[1,{}]}}", "a"));
+  ASSERT_EQ("-1.5e+3 {}", Cut("{\"a\":-1.5e+3}", "a"));
+  ASSERT_EQ("\"\\\"\\u00e9\" {}", Cut("{\"a\":\"\\\"\\u00e9\"}", "a"));
+  ASSERT_EQ("1 {\"a\": 2}", Cut("{\"a\": 1, \"a\": 2}", "a"));
+
+  ASSERT_EQ("(none)", Cut("{\"b\": 1}", "a"));
+  ASSERT_EQ("(none)", Cut("{}", "a"));
+  ASSERT_EQ("(none)", Cut("[{\"a\": 1}]", "a"));
+  ASSERT_EQ("(none)", Cut("{\"a\": 1,}", "a"));
+  ASSERT_EQ("(none)", Cut("{\"a\": 01}", "a"));
+  ASSERT_EQ("(none)", Cut("{\"a\": [1, 2}", "a"));
+  ASSERT_EQ("(none)", Cut("{\"a\": tru}", "a"));
+  ASSERT_EQ("(none)", Cut("{\"a\": \"\\q\"}", "a"));
+  ASSERT_EQ("(none)", Cut("{\"a\": 1} x", "a"));
+  ASSERT_EQ("(none)", Cut("{\"\\u0061\": 1}", "a"));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
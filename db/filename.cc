@@ -70,12 +70,17 @@ std::string OldInfoLogFileName(const std::string& dbname) {
 }
 
 
+std::string SecondarySummaryFileName(const std::string& dbname) {
+  return dbname + "/SECONDARY-SUMMARY";
+}
+
 // Owned filenames have the form:
 //    dbname/CURRENT
 //    dbname/LOCK
 //    dbname/LOG
 //    dbname/LOG.old
 //    dbname/MANIFEST-[0-9]+
+//    dbname/SECONDARY-SUMMARY
 //    dbname/[0-9]+.(log|sst|ldb)
 bool ParseFileName(const std::string& fname,
                    uint64_t* number,
@@ -90,6 +95,9 @@ bool ParseFileName(const std::string& fname,
   } else if (rest == "LOG" || rest == "LOG.old") {
     *number = 0;
     *type = kInfoLogFile;
+  } else if (rest == "SECONDARY-SUMMARY") {
+    *number = 0;
+    *type = kSecondarySummaryFile;
   } else if (rest.starts_with("MANIFEST-")) {
     rest.remove_prefix(strlen("MANIFEST-"));
     uint64_t num;
@@ -34,6 +34,7 @@ TEST(FileNameTest, Parse) {
     { "MANIFEST-7",         7,     kDescriptorFile },
     { "LOG",                0,     kInfoLogFile },
     { "LOG.old",            0,     kInfoLogFile },
+    { "SECONDARY-SUMMARY",  0,     kSecondarySummaryFile },
     { "18446744073709551615.log", 18446744073709551615ull, kLogFile },
   };
   for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
@@ -62,6 +63,7 @@ TEST(FileNameTest, Parse) {
     "LOCKx",
     "LO",
     "LOGx",
+    "SECONDARY-SUMMARYx",
     "18446744073709551616.log",
     "184467440737095516150.log",
     "100",
@@ -103,6 +105,12 @@ TEST(FileNameTest, Construction) {
   ASSERT_EQ(200, number);
   ASSERT_EQ(kTableFile, type);
 
+  fname = SecondarySummaryFileName("foo");
+  ASSERT_EQ("foo/", std::string(fname.data(), 4));
+  ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
+  ASSERT_EQ(0, number);
+  ASSERT_EQ(kSecondarySummaryFile, type);
+
   fname = DescriptorFileName("bar", 100);
   ASSERT_EQ("bar/", std::string(fname.data(), 4));
   ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
@@ -7,12 +7,18 @@
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/secondary_key_extractor.h"
 #include "util/coding.h"
 #include <sstream>
 #include <fstream>
 #include <unordered_set>
 #include "rapidjson/document.h"
 #include "db_impl.h"
+#include "db/secondary_key.h"
+#include "db/range_tombstone.h"
+#include "db/secondary_aggregate.h"
+#include "db/secondary_index_table.h"
+#include "db/secondary_lookup.h"
 
 
 namespace leveldb {
@@ -24,11 +30,13 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator& cmp, std::string secAtt)
+MemTable::MemTable(const InternalKeyComparator& cmp,
+                   const SecondaryKeyExtractor* extractor)
     : comparator_(cmp),
       refs_(0),
-      table_(comparator_, &arena_) {
-    secAttribute = secAtt;
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      extractor_(extractor) {
 }
 
 MemTable::~MemTable() {
@@ -95,9 +103,14 @@ Iterator* MemTable::NewIterator() {
   return new MemTableIterator(&table_);
 }
 
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  return new MemTableIterator(&range_del_table_);
+}
+
 void MemTable::Add(SequenceNumber s, ValueType type,
                    const Slice& key,
-                   const Slice& value) {
+                   const Slice& value,
+                   const std::vector<std::string>* secondary_keys) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -118,84 +131,45 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert((p + val_size) - buf == encoded_len);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_.Insert(buf);
+    return;
+  }
   table_.Insert(buf);
   
   ////SECONDARY MEMTABLE
-  if(type == kTypeDeletion)
-      return;
-  rapidjson::Document docToParse; 
-
-  docToParse.Parse<0>(value.ToString().c_str());   
-
-    ///
-    const char* sKeyAtt = secAttribute.c_str();
-
-    if(!docToParse.IsObject()||!docToParse.HasMember(sKeyAtt)||docToParse[sKeyAtt].IsNull())
-        return;
-
-    std::ostringstream skey;
-    if(docToParse[sKeyAtt].IsNumber())
-    {
-          if(docToParse[sKeyAtt].IsUint64())
-          {
-              unsigned long long int tid = docToParse[sKeyAtt].GetUint64();
-              skey<<tid;
-
-          }
-          else if (docToParse[sKeyAtt].IsInt64())
-          {
-              long long int tid = docToParse[sKeyAtt].GetInt64();
-              skey<<tid;
-          }
-          else if (docToParse[sKeyAtt].IsDouble())
-          {
-              double tid = docToParse[sKeyAtt].GetDouble();
-              skey<<tid;
-          }
-
-          else if (docToParse[sKeyAtt].IsUint())
-          {
-              unsigned int tid = docToParse[sKeyAtt].GetUint();
-              skey<<tid;
-          }
-          else if (docToParse[sKeyAtt].IsInt())
-          {
-              int tid = docToParse[sKeyAtt].GetInt();
-             skey<<tid;             
-          }
-    }
-    else if (docToParse[sKeyAtt].IsString())
-    {
-          const char* tid = docToParse[sKeyAtt].GetString();
-          skey<<tid;
-    }
-    else if(docToParse[sKeyAtt].IsBool())
-    {
-          bool tid = docToParse[sKeyAtt].GetBool();
-          skey<<tid;
-    }
-
-    std::string secKey = skey.str();
-    SecMemTable::const_iterator lookup = secTable_.find(secKey);
+  if (type == kTypeDeletion || extractor_ == NULL || IsIndexTableKey(key))
+    return;
+
+  // A record carries one posting per distinct secondary key.
+  std::vector<std::string> extracted;
+  if (secondary_keys == NULL) {
+    extractor_->Extract(value, &extracted);
+    secondary_keys = &extracted;
+  }
+  const std::vector<std::string>& secKeys = *secondary_keys;
+  for (size_t i = 0; i < secKeys.size(); i++) {
+    SecMemTable::const_iterator lookup = secTable_.find(secKeys[i]);
     if (lookup == secTable_.end()) {
-        
-        vector<string> *invertedList = new vector<string>();
-        invertedList->push_back(key.ToString());
-
-         
-        secTable_.insert(std::make_pair( secKey , invertedList));
+      vector<string>* invertedList = new vector<string>();
+      invertedList->push_back(key.ToString());
+      secTable_.insert(std::make_pair(secKeys[i], invertedList));
+    } else {
+      lookup->second->push_back(key.ToString());
     }
-
-    else {
-        pair<string, vector<string> *> pr  =  *lookup;
-        pr.second->push_back(key.ToString());
-        
-    }
-    
-  
+  }
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   SequenceNumber* sequence) {
+  // The newest range tombstone covering key, if any, deletes the entries
+  // older than it.
+  const Slice ikey = key.internal_key();
+  MemTableIterator tombstones(&range_del_table_);
+  const SequenceNumber tombstone = MaxCoveringTombstone(
+      &tombstones, comparator_.comparator.user_comparator(),
+      key.user_key(), DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8);
+
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
@@ -217,35 +191,41 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
             key.user_key()) == 0) {
       // Correct user key
       const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
+      if (sequence != NULL) {
+        *sequence = tag >> 8;
+      }
+      switch ((tag >> 8) < tombstone ? kTypeDeletion
+              : static_cast<ValueType>(tag & 0xff)) {
         case kTypeValue: {
           Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
           value->assign(v.data(), v.size());
           return true;
         }
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           *s = Status::NotFound(Slice());
           return true;
+        case kTypeMerge:
+          *s = Status::Incomplete(Slice());
+          return true;
       }
     }
   }
+  if (tombstone > 0) {
+    *s = Status::NotFound(Slice());
+    return true;
+  }
   return false;
 }
 //SECONDARY MEMTABLE
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s, uint64_t *tag) {
+bool MemTable::Get(const LookupKey& key, Slice* ukey, Slice* value,
+                   uint64_t* tag) {
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
   if (iter.Valid()) {
-    // entry format is:
-    //    klength  varint32
-    //    userkey  char[klength]
-    //    tag      uint64
-    //    vlength  varint32
-    //    value    char[vlength]
-    // Check that it belongs to same user key.  We do not check the
-    // sequence number since the Seek() call above should have skipped
-    // all entries with overly large sequence numbers.
+    // See the entry format in Get() above.  The returned slices point
+    // into arena_ and stay valid while this memtable is referenced.
     const char* entry = iter.key();
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
@@ -254,143 +234,165 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s, uint64_t
             key.user_key()) == 0) {
       // Correct user key
       *tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(*tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
-          return true;
-        }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
-      }
+      *ukey = Slice(key_ptr, key_length - 8);
+      *value = GetLengthPrefixedSlice(key_ptr + key_length);
+      return true;
     }
   }
   return false;
 }
 //SECONDARY MEMTABLE
-void MemTable::Get(const Slice& skey, SequenceNumber snapshot, std::vector<SKeyReturnVal>* value, Status* s,  std::unordered_set<std::string>* resultSetofKeysFound, int topKOutput )
-{
-  
-    auto lookup = secTable_.find(skey.ToString());
-    if (lookup != secTable_.end()) 
-    {
-
-        pair<string, vector<string>* > pr  =  *lookup;
-        for(int i = pr.second->size()-1 ;i>=0; i--)
-        {
-            if(value->size()>= topKOutput)
-                return;
-                
-            Slice pkey = pr.second->at(i) ;
-            LookupKey lkey(pkey, snapshot);
-            std::string svalue;
-            Status s;
-            uint64_t tag;
-            if(this->Get(lkey, &svalue, &s, &tag))
-            {
-                if(!s.IsNotFound())
-                {
-                    rapidjson::Document docToParse; 
-
-                    docToParse.Parse<0>(svalue.c_str());   
-
-                      ///
-                    const char* sKeyAtt = secAttribute.c_str();
-
-                    if(!docToParse.IsObject()||!docToParse.HasMember(sKeyAtt)||docToParse[sKeyAtt].IsNull())
-                        return;
-
-                    std::ostringstream tempskey;
-                    if(docToParse[sKeyAtt].IsNumber())
-                    {
-                          if(docToParse[sKeyAtt].IsUint64())
-                          {
-                              unsigned long long int tid = docToParse[sKeyAtt].GetUint64();
-                              tempskey<<tid;
-
-                          }
-                          else if (docToParse[sKeyAtt].IsInt64())
-                          {
-                              long long int tid = docToParse[sKeyAtt].GetInt64();
-                              tempskey<<tid;
-                          }
-                          else if (docToParse[sKeyAtt].IsDouble())
-                          {
-                              double tid = docToParse[sKeyAtt].GetDouble();
-                              tempskey<<tid;
-                          }
-
-                          else if (docToParse[sKeyAtt].IsUint())
-                          {
-                              unsigned int tid = docToParse[sKeyAtt].GetUint();
-                              tempskey<<tid;
-                          }
-                          else if (docToParse[sKeyAtt].IsInt())
-                          {
-                              int tid = docToParse[sKeyAtt].GetInt();
-                             tempskey<<tid;             
-                          }
-                    }
-                    else if (docToParse[sKeyAtt].IsString())
-                    {
-                          const char* tid = docToParse[sKeyAtt].GetString();
-                          tempskey<<tid;
-                    }
-                    else if(docToParse[sKeyAtt].IsBool())
-                    {
-                          bool tid = docToParse[sKeyAtt].GetBool();
-                          tempskey<<tid;
-                    }
-
-                    Slice valsKey = tempskey.str();
-                    if (comparator_.comparator.user_comparator()->Compare(
-                    valsKey,
-                    skey) == 0) {
-                    struct SKeyReturnVal newVal;
-                    newVal.key = pr.second->at(i);
-                    std::string temp;
-
-                    if(resultSetofKeysFound->find(newVal.key)==resultSetofKeysFound->end())
-                    {
-                   
-                        newVal.value = svalue; 
-                        newVal.sequence_number = tag;
-
+bool MemTable::OfferLatest(SecondaryLookup* lookup, const Slice& pkey,
+                           bool validate, bool* pinned) {
+  LookupKey lkey(pkey, lookup->snapshot());
+  Slice ukey, svalue;
+  uint64_t tag;
+  if (!this->Get(lkey, &ukey, &svalue, &tag) ||
+      static_cast<ValueType>(tag & 0xff) == kTypeDeletion) {
+    return true;
+  }
+  const SequenceNumber seq = tag >> 8;
+  if (seq < lookup->min_sequence() || lookup->OlderThanResults(seq)) {
+    return false;
+  }
+  if (static_cast<ValueType>(tag & 0xff) == kTypeMerge) {
+    if (lookup->InWindow(seq)) {
+      lookup->OfferMerged(ukey, seq);
+    }
+    return true;
+  }
+  double rank;
+  if (lookup->InWindow(seq) &&
+      lookup->Matches(svalue, &rank) &&
+      lookup->Offer(ukey, svalue, seq, rank, validate, false)) {
+    *pinned = true;
+  }
+  return true;
+}
 
+bool MemTable::Get(SecondaryLookup* lookup, bool validate) {
+  bool pinned = false;
+  std::vector<std::string> skeys;
+  if (!lookup->CoveringKeys(&skeys)) {
+    // No index term narrows the query: examine the newest visible version
+    // of every record.
+    Iterator* iter = NewIterator();
+    std::string current;
+    bool has_current = false;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ParsedInternalKey ikey;
+      if (!ParseInternalKey(iter->key(), &ikey) ||
+          ikey.sequence > lookup->snapshot() ||
+          (has_current && ikey.user_key == Slice(current))) {
+        continue;
+      }
+      current.assign(ikey.user_key.data(), ikey.user_key.size());
+      has_current = true;
+      if (ikey.type == kTypeMerge) {
+        if (lookup->InWindow(ikey.sequence) &&
+            !lookup->OlderThanResults(ikey.sequence)) {
+          lookup->OfferMerged(ikey.user_key, ikey.sequence);
+        }
+        continue;
+      }
+      double rank;
+      if (ikey.type == kTypeValue &&
+          lookup->InWindow(ikey.sequence) &&
+          !lookup->OlderThanResults(ikey.sequence) &&
+          lookup->Matches(iter->value(), &rank) &&
+          lookup->Offer(ikey.user_key, iter->value(), ikey.sequence, rank,
+                        validate, false)) {
+        pinned = true;
+      }
+    }
+    delete iter;
+    return pinned;
+  }
 
-                        if(value->size()<topKOutput)
-                        {
-                            
-                            newVal.Push(value, newVal);
-                            resultSetofKeysFound->insert(newVal.key);
+  std::vector<const vector<string>*> lists;
+  for (size_t i = 0; i < skeys.size(); i++) {
+    if (lookup->composite()) {
+      // Composite keys sharing the prefix are contiguous.
+      const Slice prefix(skeys[i]);
+      for (SecMemTable::const_iterator it = secTable_.lower_bound(skeys[i]);
+           it != secTable_.end() && Slice(it->first).starts_with(prefix);
+           ++it) {
+        lists.push_back(it->second);
+      }
+    } else {
+      SecMemTable::const_iterator it = secTable_.find(skeys[i]);
+      if (it != secTable_.end()) {
+        lists.push_back(it->second);
+      }
+    }
+  }
 
-                        }
-                        else if(newVal.sequence_number>value->front().sequence_number)
-                        {
-                             
-                            newVal.Pop(value);
-                            newVal.Push(value,newVal);
-                            resultSetofKeysFound->insert(newVal.key);
-                            resultSetofKeysFound->erase(resultSetofKeysFound->find(value->front().key));
-                            
-                        }
-                         
-                        
-                         
+  if (lists.size() == 1) {
+    // Postings are appended in sequence order, so walk them newest first
+    // and stop at the first one that is too old.
+    const vector<string>* postings = lists[0];
+    for (int i = postings->size() - 1; i >= 0; i--) {
+      if (!OfferLatest(lookup, postings->at(i), validate, &pinned)) {
+        break;
+      }
+    }
+  } else if (!lists.empty()) {
+    // Several postings lists are not ordered with respect to each other,
+    // so every record on them is offered once.
+    std::unordered_set<Slice, SliceHash> seen;
+    for (size_t l = 0; l < lists.size(); l++) {
+      const vector<string>* postings = lists[l];
+      for (int i = postings->size() - 1; i >= 0; i--) {
+        if (seen.insert(Slice(postings->at(i))).second) {
+          OfferLatest(lookup, postings->at(i), validate, &pinned);
+        }
+      }
+    }
+  }
+  return pinned;
+}
 
-                    }
+uint64_t MemTable::ApproximateSecondaryCount(const Slice& index_key,
+                                             bool composite) const {
+  const std::string key = index_key.ToString();
+  std::unordered_set<Slice, SliceHash> seen;
+  for (SecMemTable::const_iterator it = secTable_.lower_bound(key);
+       it != secTable_.end() &&
+       (composite ? Slice(it->first).starts_with(index_key)
+                  : it->first == key);
+       ++it) {
+    const vector<string>* postings = it->second;
+    for (size_t i = 0; i < postings->size(); i++) {
+      seen.insert(Slice(postings->at(i)));
+    }
+  }
+  return seen.size();
+}
 
-                  }
-                }
-            }
-        }
-        
+void MemTable::Get(SecondaryAggregator* aggregator) {
+  // The postings of a record repeat for each of its versions, and for a
+  // composite index span every key sharing the prefix.
+  const std::string& index_key = aggregator->index_key();
+  std::unordered_set<Slice, SliceHash> seen;
+  for (SecMemTable::const_iterator it = secTable_.lower_bound(index_key);
+       it != secTable_.end() &&
+       (aggregator->composite() ? Slice(it->first).starts_with(index_key)
+                                : it->first == index_key);
+       ++it) {
+    const vector<string>* postings = it->second;
+    for (size_t i = 0; i < postings->size(); i++) {
+      if (!seen.insert(Slice(postings->at(i))).second) {
+        continue;
+      }
+      LookupKey lkey(postings->at(i), aggregator->snapshot());
+      Slice ukey, svalue;
+      uint64_t tag;
+      if (this->Get(lkey, &ukey, &svalue, &tag)) {
+        aggregator->Offer(ukey, svalue, tag >> 8,
+                          static_cast<ValueType>(tag & 0xff));
+      }
     }
-  
-  
-  
-}  
+  }
+}
 
-  
 } // namespace leveldb
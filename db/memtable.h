@@ -19,12 +19,19 @@ namespace leveldb {
 class InternalKeyComparator;
 class Mutex;
 class MemTableIterator;
+class SecondaryKeyExtractor;
+class SecondaryAggregator;
+class SecondaryLookup;
 
 class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
   // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator, std::string secAtt);
+  // Records are indexed under the keys "extractor" computes from their
+  // values, or not at all if it is NULL.  The extractor must outlive the
+  // memtable.
+  MemTable(const InternalKeyComparator& comparator,
+           const SecondaryKeyExtractor* extractor);
 
   // Increase reference count.
   void Ref() { ++refs_; }
@@ -53,28 +60,68 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones of the memtable, in the
+  // form described in db/range_tombstone.h.  Same requirements as above.
+  Iterator* NewRangeTombstoneIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  An entry of
+  // type kTypeRangeDeletion is a range tombstone, which deletes the keys
+  // in [key, value).
+  // The entry is indexed under "secondary_keys" if non-NULL, and else
+  // under the keys the extractor takes from value.
   void Add(SequenceNumber seq, ValueType type,
            const Slice& key,
-           const Slice& value);
+           const Slice& value,
+           const std::vector<std::string>* secondary_keys = NULL);
 
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
-  // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  // If memtable contains a deletion for key, or a range tombstone newer
+  // than its newest value, store a NotFound() error in *status and
+  // return true.
+  // If memtable contains a merge operand for key, store an Incomplete()
+  // status in *status and return true: the value must be merged.
+  // Else, return false.  If "sequence" is non-NULL and an entry for key
+  // was found, its sequence number is stored in *sequence.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           SequenceNumber* sequence = NULL);
 
   //Overload Get mothod for returning the list of key,value pairs for query on sec key
  //SECONDARY MEMTABLE
-  bool Get(const LookupKey& key, std::string* value, Status* s,uint64_t *tag);
-  void Get(const Slice& skey, SequenceNumber snapshot, std::vector<SKeyReturnVal>* value, Status* s,   std::unordered_set<std::string>* resultSetofKeysFound, int topKOutput);
+  // If memtable contains an entry for key, point *ukey and *value at it
+  // (without copying), store its packed sequence/type in *tag and return
+  // true.  The slices stay valid while this memtable is referenced.
+  bool Get(const LookupKey& key, Slice* ukey, Slice* value, uint64_t* tag);
+
+  // Feed the records that may satisfy the query of *lookup into the
+  // lookup's heap.  If "validate" is set, hits are checked against the
+  // whole DB (needed when a newer memtable may hold a later version of the
+  // record).  Returns true iff a retained hit points into this memtable,
+  // in which case the caller must keep it referenced for as long as the
+  // result.
+  bool Get(SecondaryLookup* lookup, bool validate);
+
+  // Offer the newest visible version of every record on the postings of
+  // aggregator->index_key() to *aggregator.
+  void Get(SecondaryAggregator* aggregator);
+
+  // Return the number of distinct records on the postings of the index
+  // key "index_key" (for a composite index, of every key it prefixes),
+  // whether or not they were since updated or deleted.
+  uint64_t ApproximateSecondaryCount(const Slice& index_key,
+                                     bool composite) const;
 
   
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
 
+  // Offer the newest visible version of "pkey" to *lookup, setting
+  // *pinned if it was retained.  Returns false if the version was older
+  // than the lookup can use, so that older postings can be skipped.
+  bool OfferLatest(SecondaryLookup* lookup, const Slice& pkey,
+                   bool validate, bool* pinned);
+
   struct KeyComparator {
     const InternalKeyComparator comparator;
     explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) { }
@@ -89,11 +136,12 @@ class MemTable {
   int refs_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;       // Entries of type kTypeRangeDeletion
 
   //SECONDARY MEMTABLE
   typedef btree::btree_map<string, vector<string>* > SecMemTable;
   SecMemTable secTable_;
-  std::string secAttribute;
+  const SecondaryKeyExtractor* extractor_;
   
   // No copying allowed
   MemTable(const MemTable&);
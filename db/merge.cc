@@ -0,0 +1,137 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge.h"
+
+#include <string.h>
+#include "db/document.h"
+#include "db/secondary_key.h"
+#include "leveldb/merge_operator.h"
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+namespace leveldb {
+
+MergeOperator::~MergeOperator() { }
+
+namespace {
+
+typedef rapidjson::Document::AllocatorType Allocator;
+
+const char kJsonMergeOperatorName[] = "leveldb.JsonMergePatch";
+
+rapidjson::Value* FindMember(rapidjson::Value* object,
+                             const rapidjson::Value& name) {
+  for (rapidjson::Value::MemberIterator m = object->MemberBegin();
+       m != object->MemberEnd(); ++m) {
+    if (m->name.GetStringLength() == name.GetStringLength() &&
+        memcmp(m->name.GetString(), name.GetString(),
+               name.GetStringLength()) == 0) {
+      return &m->value;
+    }
+  }
+  return NULL;
+}
+
+// Apply the merge patch "*patch" to "*target", moving values out of the
+// patch.
+void MergePatch(rapidjson::Value* target, rapidjson::Value* patch,
+                Allocator& allocator) {
+  if (!patch->IsObject()) {
+    *target = *patch;
+    return;
+  }
+  if (!target->IsObject()) {
+    target->SetObject();
+  }
+  for (rapidjson::Value::MemberIterator m = patch->MemberBegin();
+       m != patch->MemberEnd(); ++m) {
+    rapidjson::Value* existing = FindMember(target, m->name);
+    if (m->value.IsNull()) {
+      if (existing != NULL) {
+        target->RemoveMember(m->name.GetString());
+      }
+    } else if (existing != NULL) {
+      MergePatch(existing, &m->value, allocator);
+    } else {
+      // A new attribute is patched too, so that nulls nested in it are
+      // dropped.
+      rapidjson::Value value;
+      MergePatch(&value, &m->value, allocator);
+      target->AddMember(m->name, value, allocator);
+    }
+  }
+}
+
+class JsonMergeOperator : public MergeOperator {
+ public:
+  virtual const char* Name() const {
+    return kJsonMergeOperatorName;
+  }
+
+  virtual bool Merge(const Slice& key, const Slice* existing_value,
+                     const Slice& operand, std::string* new_value) const {
+    rapidjson::Document patch;
+    if (!ParseDocument(operand, &patch) && patch.HasParseError()) {
+      return false;
+    }
+    rapidjson::Document doc;
+    if (existing_value != NULL) {
+      if (IsBinaryDocument(*existing_value)) {
+        return false;
+      }
+      ParseDocument(*existing_value, &doc);
+    }
+    MergePatch(&doc, &patch, doc.GetAllocator());
+
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    doc.Accept(writer);
+    new_value->assign(buffer.GetString(), buffer.Size());
+    return true;
+  }
+};
+
+}  // namespace
+
+const MergeOperator* NewJsonMergeOperator() {
+  return new JsonMergeOperator;
+}
+
+bool IsJsonMergeOperator(const MergeOperator* merge_operator) {
+  return strcmp(merge_operator->Name(), kJsonMergeOperatorName) == 0;
+}
+
+Status ApplyMergeOperands(const MergeOperator* merge_operator,
+                          const Slice& key, const Slice* base,
+                          const std::vector<std::string>& operands,
+                          std::string* result) {
+  if (merge_operator == NULL) {
+    return Status::NotSupported("merge operand without a merge operator");
+  }
+  std::string merged;
+  Slice existing;
+  const Slice* current = base;
+  for (size_t i = operands.size(); i > 0; i--) {
+    if (!merge_operator->Merge(key, current, operands[i - 1], result)) {
+      return Status::Corruption("merge operand rejected for ", key);
+    }
+    merged.swap(*result);
+    existing = merged;
+    current = &existing;
+  }
+  if (current == base) {
+    if (base == NULL) {
+      result->clear();
+    } else {
+      result->assign(base->data(), base->size());
+    }
+  } else {
+    result->swap(merged);
+  }
+  return Status::OK();
+}
+
+}  // namespace leveldb
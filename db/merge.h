@@ -0,0 +1,32 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_H_
+#define STORAGE_LEVELDB_DB_MERGE_H_
+
+#include <string>
+#include <vector>
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class MergeOperator;
+
+// Store in *result the value of "key" that "operands", its merge
+// operands newest first, leave when applied to "*base", or to no value
+// if base is NULL.  Returns a non-OK status if there is no operator or
+// it rejects an operand.
+extern Status ApplyMergeOperands(const MergeOperator* merge_operator,
+                                 const Slice& key, const Slice* base,
+                                 const std::vector<std::string>& operands,
+                                 std::string* result);
+
+// Return true iff "merge_operator" is the one NewJsonMergeOperator()
+// returns, which needs documents stored as JSON text.
+extern bool IsJsonMergeOperator(const MergeOperator* merge_operator);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_H_
@@ -0,0 +1,149 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge.h"
+
+#include "db/db_impl.h"
+#include "leveldb/db.h"
+#include "leveldb/merge_operator.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class MergeTest {
+ public:
+  std::string dbname_;
+  const MergeOperator* merge_operator_;
+  Options options_;
+  DB* db_;
+
+  MergeTest() : merge_operator_(NewJsonMergeOperator()), db_(NULL) {
+    dbname_ = test::TmpDir() + "/merge_test";
+    DestroyDB(dbname_, options_);
+    options_.create_if_missing = true;
+    options_.merge_operator = merge_operator_;
+  }
+
+  ~MergeTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+    delete merge_operator_;
+  }
+
+  std::string Merge(const char* existing, const char* operand) {
+    std::string result;
+    Slice base(existing != NULL ? existing : "");
+    if (!merge_operator_->Merge("k", existing != NULL ? &base : NULL,
+                                operand, &result)) {
+      return "(rejected)";
+    }
+    return result;
+  }
+
+  std::string Get(const std::string& key) {
+    std::string value;
+    Status s = db_->Get(ReadOptions(), key, &value);
+    return s.ok() ? value : s.ToString();
+  }
+
+  // Return the contents of the database in both directions.
+  std::string Contents() {
+    std::string forward, reverse;
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      forward += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+    }
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      reverse = iter->key().ToString() + "=" + iter->value().ToString() +
+          " " + reverse;
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+    ASSERT_EQ(forward, reverse);
+    return forward;
+  }
+};
+
+TEST(MergeTest, JsonMergePatch) {
+  ASSERT_EQ("{\"a\":1,\"b\":3}", Merge("{\"a\": 1, \"b\": 2}", "{\"b\": 3}"));
+  ASSERT_EQ("{\"a\":1}", Merge("{\"a\": 1, \"b\": 2}", "{\"b\": null}"));
+  ASSERT_EQ("{\"a\":{\"c\":2,\"d\":3}}",
+            Merge("{\"a\": {\"b\": 1, \"c\": 2}}",
+                  "{\"a\": {\"b\": null, \"d\": 3}}"));
+  ASSERT_EQ("{\"a\":{\"c\":1}}", Merge(NULL, "{\"a\": {\"b\": null, \"c\": 1}}"));
+  ASSERT_EQ("[1,2]", Merge("{\"a\": 1}", "[1, 2]"));
+  ASSERT_EQ("{\"a\":1}", Merge("[1, 2]", "{\"a\": 1}"));
+  ASSERT_EQ("(rejected)", Merge("{}", "{\"a\": "));
+}
+
+TEST(MergeTest, ApplyOperands) {
+  std::vector<std::string> operands;
+  operands.push_back("{\"c\": 3}");   // Newest first
+  operands.push_back("{\"b\": 2, \"c\": 0}");
+  Slice base("{\"a\": 1}");
+  std::string result;
+  ASSERT_OK(ApplyMergeOperands(merge_operator_, "k", &base, operands,
+                               &result));
+  ASSERT_EQ("{\"a\":1,\"b\":2,\"c\":3}", result);
+  ASSERT_OK(ApplyMergeOperands(merge_operator_, "k", NULL, operands, &result));
+  ASSERT_EQ("{\"b\":2,\"c\":3}", result);
+  Status s = ApplyMergeOperands(NULL, "k", &base, operands, &result);
+  ASSERT_TRUE(s.ToString().find("Not implemented") == 0) << s.ToString();
+}
+
+TEST(MergeTest, ReadAndCompact) {
+  ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  DBImpl* dbi = reinterpret_cast<DBImpl*>(db_);
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "{\"n\": 1}"));
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "{\"n\": 2}"));
+  ASSERT_OK(dbi->TEST_CompactMemTable());
+
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "{\"m\": 1}"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "{\"n\": null}"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "c", "{\"n\": 3}"));
+  ASSERT_OK(db_->Delete(WriteOptions(), "b"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "{\"n\": 4}"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->Merge(WriteOptions(), "c", "{\"n\": 5}"));
+
+  const std::string expected = "a={\"m\":1} b={\"n\":4} c={\"n\":5} ";
+  ASSERT_EQ("{\"m\":1}", Get("a"));
+  ASSERT_EQ(expected, Contents());
+  ASSERT_OK(dbi->TEST_CompactMemTable());
+  ASSERT_EQ(expected, Contents());
+
+  std::string value;
+  ReadOptions options;
+  options.snapshot = snapshot;
+  ASSERT_OK(db_->Get(options, "c", &value));
+  ASSERT_EQ("{\"n\":3}", value);
+  db_->ReleaseSnapshot(snapshot);
+
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ(expected, Contents());
+  ASSERT_EQ("{\"n\":4}", Get("b"));
+}
+
+TEST(MergeTest, NoOperator) {
+  options_.merge_operator = NULL;
+  ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  Status s = db_->Merge(WriteOptions(), "a", "{}");
+  ASSERT_TRUE(s.ToString().find("Not implemented") == 0) << s.ToString();
+}
+
+TEST(MergeTest, NeedsTextDocuments) {
+  options_.binary_documents = true;
+  Status s = DB::Open(options_, dbname_, &db_);
+  ASSERT_TRUE(s.ToString().find("Invalid argument") == 0) << s.ToString();
+  ASSERT_TRUE(db_ == NULL);
+
+  options_.binary_documents = false;
+  ASSERT_OK(DB::Open(options_, dbname_, &db_));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,192 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <algorithm>
+#include <functional>
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+SequenceNumber MaxCoveringTombstone(Iterator* iter, const Comparator* ucmp,
+                                    const Slice& user_key,
+                                    SequenceNumber snapshot) {
+  SequenceNumber result = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey begin;
+    if (!ParseInternalKey(iter->key(), &begin)) {
+      continue;
+    }
+    if (ucmp->Compare(begin.user_key, user_key) > 0) {
+      break;
+    }
+    if (begin.sequence <= snapshot && begin.sequence > result &&
+        ucmp->Compare(user_key, iter->value()) < 0) {
+      result = begin.sequence;
+    }
+  }
+  return result;
+}
+
+RangeTombstoneList::RangeTombstoneList(const Comparator* user_comparator)
+    : ucmp_(user_comparator),
+      fragmented_(false) {
+}
+
+void RangeTombstoneList::Add(const Slice& begin, const Slice& end,
+                             SequenceNumber sequence) {
+  if (ucmp_->Compare(begin, end) >= 0) {
+    return;  // Covers nothing
+  }
+  RangeTombstone t;
+  t.begin = begin.ToString();
+  t.end = end.ToString();
+  t.sequence = sequence;
+  tombstones_.push_back(t);
+  fragmented_ = false;
+}
+
+Status RangeTombstoneList::AddAll(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey begin;
+    if (!ParseInternalKey(iter->key(), &begin)) {
+      return Status::Corruption("corrupted range tombstone");
+    }
+    Add(begin.user_key, iter->value(), begin.sequence);
+  }
+  return iter->status();
+}
+
+namespace {
+struct SliceLess {
+  const Comparator* ucmp;
+  explicit SliceLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const Slice& a, const Slice& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+}  // namespace
+
+void RangeTombstoneList::Fragment() const {
+  const SliceLess less(ucmp_);
+  points_.clear();
+  for (size_t i = 0; i < tombstones_.size(); i++) {
+    points_.push_back(tombstones_[i].begin);
+    points_.push_back(tombstones_[i].end);
+  }
+  std::sort(points_.begin(), points_.end(), less);
+  size_t n = 0;
+  for (size_t i = 0; i < points_.size(); i++) {
+    if (n == 0 || less(points_[n - 1], points_[i])) {
+      points_[n++] = points_[i];
+    }
+  }
+  points_.resize(n);
+
+  sequences_.assign(n > 0 ? n - 1 : 0, std::vector<SequenceNumber>());
+  for (size_t i = 0; i < tombstones_.size(); i++) {
+    const RangeTombstone& t = tombstones_[i];
+    size_t first = std::lower_bound(points_.begin(), points_.end(),
+                                    Slice(t.begin), less) - points_.begin();
+    size_t limit = std::lower_bound(points_.begin(), points_.end(),
+                                    Slice(t.end), less) - points_.begin();
+    for (size_t f = first; f < limit; f++) {
+      sequences_[f].push_back(t.sequence);
+    }
+  }
+  for (size_t f = 0; f < sequences_.size(); f++) {
+    std::sort(sequences_[f].begin(), sequences_[f].end(),
+              std::greater<SequenceNumber>());
+  }
+  fragmented_ = true;
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  if (tombstones_.empty()) {
+    return 0;
+  }
+  if (!fragmented_) {
+    Fragment();
+  }
+  size_t f = std::upper_bound(points_.begin(), points_.end(), user_key,
+                              SliceLess(ucmp_)) - points_.begin();
+  if (f == 0 || f > sequences_.size()) {
+    return 0;  // Before the first tombstone or after the last one
+  }
+  const std::vector<SequenceNumber>& seqs = sequences_[f - 1];
+  std::vector<SequenceNumber>::const_iterator visible =
+      std::lower_bound(seqs.begin(), seqs.end(), snapshot,
+                       std::greater<SequenceNumber>());
+  return visible == seqs.end() ? 0 : *visible;
+}
+
+namespace {
+class RangeDeletingIterator : public Iterator {
+ public:
+  RangeDeletingIterator(Iterator* iter, RangeTombstoneList* tombstones,
+                        SequenceNumber sequence)
+      : iter_(iter),
+        tombstones_(tombstones),
+        sequence_(sequence),
+        deleted_(false) {
+  }
+  virtual ~RangeDeletingIterator() {
+    delete iter_;
+    delete tombstones_;
+  }
+
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void Seek(const Slice& target) { iter_->Seek(target); Update(); }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); Update(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); Update(); }
+  virtual void Next() { iter_->Next(); Update(); }
+  virtual void Prev() { iter_->Prev(); Update(); }
+  virtual Slice key() const {
+    return deleted_ ? Slice(deleted_key_) : iter_->key();
+  }
+  virtual Slice value() const {
+    return deleted_ ? Slice() : iter_->value();
+  }
+  virtual Status status() const { return iter_->status(); }
+
+ private:
+  // Rewrite the current entry as a deletion if a tombstone covers it.
+  void Update() {
+    deleted_ = false;
+    ParsedInternalKey ikey;
+    if (iter_->Valid() && ParseInternalKey(iter_->key(), &ikey) &&
+        ikey.type != kTypeDeletion &&
+        tombstones_->Covers(ikey.user_key, ikey.sequence, sequence_)) {
+      deleted_key_.clear();
+      AppendInternalKey(&deleted_key_, ParsedInternalKey(
+          ikey.user_key, ikey.sequence, kTypeDeletion));
+      deleted_ = true;
+    }
+  }
+
+  Iterator* const iter_;
+  RangeTombstoneList* const tombstones_;
+  const SequenceNumber sequence_;
+  bool deleted_;
+  std::string deleted_key_;
+
+  // No copying allowed
+  RangeDeletingIterator(const RangeDeletingIterator&);
+  void operator=(const RangeDeletingIterator&);
+};
+}  // namespace
+
+Iterator* NewRangeDeletingIterator(Iterator* internal_iter,
+                                   RangeTombstoneList* tombstones,
+                                   SequenceNumber sequence) {
+  if (tombstones->empty()) {
+    delete tombstones;
+    return internal_iter;
+  }
+  return new RangeDeletingIterator(internal_iter, tombstones, sequence);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,94 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Range tombstones (see DB::DeleteRange) are kept apart from the other
+// entries: in a second skiplist of the memtable, and in a "rangedel" meta
+// block of every table file that holds any.  Both are read through
+// iterators whose keys are internal keys (begin, sequence,
+// kTypeRangeDeletion), in internal key order, and whose values are the
+// exclusive end keys.  A tombstone at sequence s deletes the entries with
+// a user key in [begin, end) and a sequence number below s.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+struct RangeTombstone {
+  std::string begin;
+  std::string end;              // Exclusive
+  SequenceNumber sequence;
+};
+
+// Return the largest sequence number, not above "snapshot", of the
+// tombstones of "iter" that cover "user_key", or 0 if none does.  Scans
+// every tombstone that begins at or before user_key, so it suits the
+// short lists of a single memtable or table file.
+extern SequenceNumber MaxCoveringTombstone(Iterator* iter,
+                                           const Comparator* ucmp,
+                                           const Slice& user_key,
+                                           SequenceNumber snapshot);
+
+// The tombstones of several memtables and files, with fast lookups of
+// the ones covering a key.  Not thread-safe.
+class RangeTombstoneList {
+ public:
+  explicit RangeTombstoneList(const Comparator* user_comparator);
+
+  void Add(const Slice& begin, const Slice& end, SequenceNumber sequence);
+
+  // Add the tombstones of "iter".  Returns the status of iter, or a
+  // Corruption error if one of its keys cannot be parsed.
+  Status AddAll(Iterator* iter);
+
+  bool empty() const { return tombstones_.empty(); }
+  const std::vector<RangeTombstone>& tombstones() const {
+    return tombstones_;
+  }
+
+  // Same as MaxCoveringTombstone() above, in logarithmic time once the
+  // tombstones have been cut into disjoint fragments by the first call.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+  // True iff the entry for "user_key" at "sequence" is deleted by a
+  // tombstone visible at "snapshot".
+  bool Covers(const Slice& user_key, SequenceNumber sequence,
+              SequenceNumber snapshot) const {
+    return MaxCoveringSequence(user_key, snapshot) > sequence;
+  }
+
+ private:
+  void Fragment() const;
+
+  const Comparator* const ucmp_;
+  std::vector<RangeTombstone> tombstones_;
+
+  // Fragment i spans [points_[i], points_[i+1]) and is covered by the
+  // tombstones with sequence numbers sequences_[i], largest first.
+  mutable bool fragmented_;
+  mutable std::vector<Slice> points_;
+  mutable std::vector<std::vector<SequenceNumber> > sequences_;
+
+  // No copying allowed
+  RangeTombstoneList(const RangeTombstoneList&);
+  void operator=(const RangeTombstoneList&);
+};
+
+// Return an iterator over the internal keys of "internal_iter" that
+// presents every entry deleted by a tombstone of *tombstones visible at
+// "sequence" as a deletion.  Takes ownership of both arguments, and
+// returns internal_iter itself if there are no tombstones.
+extern Iterator* NewRangeDeletingIterator(Iterator* internal_iter,
+                                          RangeTombstoneList* tombstones,
+                                          SequenceNumber sequence);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
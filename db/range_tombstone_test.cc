@@ -0,0 +1,212 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include "db/db_impl.h"
+#include "leveldb/comparator.h"
+#include "leveldb/db.h"
+#include "leveldb/write_batch.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class RangeTombstoneTest {
+ public:
+  std::string dbname_;
+  Options options_;
+  DB* db_;
+
+  RangeTombstoneTest() : db_(NULL) {
+    dbname_ = test::TmpDir() + "/range_tombstone_test";
+    DestroyDB(dbname_, options_);
+    options_.create_if_missing = true;
+  }
+
+  ~RangeTombstoneTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+  }
+
+  void Reopen() {
+    delete db_;
+    db_ = NULL;
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  }
+
+  DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+  std::string Get(const std::string& key, const Snapshot* snapshot = NULL) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::string value;
+    Status s = db_->Get(options, key, &value);
+    return s.IsNotFound() ? "NOT_FOUND" : s.ok() ? value : s.ToString();
+  }
+
+  // Return the keys of the database in both directions.
+  std::string Contents(const Snapshot* snapshot = NULL) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::string forward, reverse;
+    Iterator* iter = db_->NewIterator(options);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      forward += iter->key().ToString();
+    }
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      reverse = iter->key().ToString() + reverse;
+    }
+    Status s = iter->status();
+    delete iter;
+    if (!s.ok()) {
+      return s.ToString();
+    }
+    ASSERT_EQ(forward, reverse);
+    return forward;
+  }
+
+  // Return the number of point entries the files and memtables hold.
+  int CountInternalEntries() {
+    Iterator* iter = dbfull()->TEST_NewInternalIterator();
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    delete iter;
+    return count;
+  }
+
+  void PutAll(const char* keys) {
+    for (const char* p = keys; *p != '\0'; p++) {
+      ASSERT_OK(db_->Put(WriteOptions(), std::string(1, *p), "v"));
+    }
+  }
+};
+
+TEST(RangeTombstoneTest, Fragments) {
+  RangeTombstoneList list(BytewiseComparator());
+  ASSERT_TRUE(list.empty());
+  list.Add("b", "f", 5);
+  list.Add("d", "h", 9);
+  list.Add("a", "c", 3);
+  list.Add("x", "x", 20);     // Empty, ignored
+  ASSERT_EQ(3u, list.tombstones().size());
+
+  const char* keys[] = { "0", "a", "b", "c", "d", "e", "f", "g", "h", "z" };
+  const SequenceNumber latest[] = { 0, 3, 5, 5, 9, 9, 9, 9, 0, 0 };
+  const SequenceNumber at6[] = { 0, 3, 5, 5, 5, 5, 0, 0, 0, 0 };
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(latest[i], list.MaxCoveringSequence(keys[i], kMaxSequenceNumber));
+    ASSERT_EQ(at6[i], list.MaxCoveringSequence(keys[i], 6));
+  }
+  ASSERT_TRUE(list.Covers("d", 8, kMaxSequenceNumber));
+  ASSERT_TRUE(!list.Covers("d", 9, kMaxSequenceNumber));
+  ASSERT_TRUE(!list.Covers("d", 8, 8));
+
+  // Adding a tombstone after a lookup fragments the list again
+  list.Add("y", "z", 1);
+  ASSERT_EQ(1u, list.MaxCoveringSequence("y", kMaxSequenceNumber));
+  ASSERT_EQ(9u, list.MaxCoveringSequence("g", kMaxSequenceNumber));
+}
+
+TEST(RangeTombstoneTest, ReadAfterDeleteRange) {
+  ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  PutAll("abcdefgh");
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  const Snapshot* snapshot = db_->GetSnapshot();
+
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "c", "f"));
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "x", "a"));    // Empty range
+  ASSERT_OK(db_->Put(WriteOptions(), "d", "new"));
+
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_EQ("NOT_FOUND", Get("e"));
+  ASSERT_EQ("new", Get("d"));
+  ASSERT_EQ("v", Get("f"));
+  ASSERT_EQ("abdfgh", Contents());
+  ASSERT_EQ("v", Get("c", snapshot));
+  ASSERT_EQ("abcdefgh", Contents(snapshot));
+
+  // Same answers once the tombstone is in a table file, and after the
+  // tables are reopened from the MANIFEST
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_EQ("abdfgh", Contents());
+  ASSERT_EQ("abcdefgh", Contents(snapshot));
+  db_->ReleaseSnapshot(snapshot);
+  Reopen();
+  ASSERT_EQ("NOT_FOUND", Get("e"));
+  ASSERT_EQ("new", Get("d"));
+  ASSERT_EQ("abdfgh", Contents());
+
+  // And after the log holding a tombstone is replayed
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "a", "c"));
+  Reopen();
+  ASSERT_EQ("dfgh", Contents());
+}
+
+TEST(RangeTombstoneTest, CompactionDropsCoveredEntries) {
+  ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  PutAll("abcdefghij");
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  PutAll("bcd");
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(13, CountInternalEntries());
+
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "b", "i"));
+  ASSERT_OK(db_->Put(WriteOptions(), "e", "new"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("aeij", Contents());
+
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("aeij", Contents());
+  ASSERT_EQ("new", Get("e"));
+  ASSERT_EQ(4, CountInternalEntries());
+
+  // The tombstone is gone too, so older data cannot reappear and new
+  // data is not hidden
+  ASSERT_OK(db_->Put(WriteOptions(), "c", "v"));
+  ASSERT_EQ("aceij", Contents());
+  Reopen();
+  ASSERT_EQ("aceij", Contents());
+}
+
+TEST(RangeTombstoneTest, WriteBatch) {
+  ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  PutAll("abcd");
+  WriteBatch batch;
+  batch.DeleteRange("a", "c");
+  batch.Put("b", "v");
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_EQ("bcd", Contents());
+}
+
+TEST(RangeTombstoneTest, SecondaryLookup) {
+  options_.PrimaryAtt = "ID";
+  options_.secondaryAtt = "c";
+  ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  for (int i = 0; i < 6; i++) {
+    char doc[100];
+    snprintf(doc, sizeof(doc), "{\"ID\": %d, \"c\": \"x\"}", i);
+    ASSERT_OK(db_->Put(WriteOptions(), doc));
+    if (i == 2) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    }
+  }
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "1", "4"));
+
+  std::vector<SKeyReturnVal> hits;
+  ASSERT_OK(db_->Get(ReadOptions(), "x", &hits, 10));
+  std::string keys;
+  for (size_t i = 0; i < hits.size(); i++) {
+    keys += hits[i].key;
+  }
+  ASSERT_EQ("540", keys);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
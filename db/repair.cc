@@ -37,6 +37,7 @@
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/secondary_key_extractor.h"
 
 namespace leveldb {
 
@@ -52,6 +53,9 @@ class Repairer {
         options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
+        owns_secondary_key_extractor_(
+            options_.secondary_key_extractor !=
+            options.secondary_key_extractor),
         next_file_number_(1) {
     // TableCache can be small since we expect each table to be opened once.
     table_cache_ = new TableCache(dbname_, &options_, 10);
@@ -65,6 +69,9 @@ class Repairer {
     if (owns_cache_) {
       delete options_.block_cache;
     }
+    if (owns_secondary_key_extractor_) {
+      delete options_.secondary_key_extractor;
+    }
   }
 
   Status Run() {
@@ -104,6 +111,7 @@ class Repairer {
   Options const options_;
   bool owns_info_log_;
   bool owns_cache_;
+  bool owns_secondary_key_extractor_;
   TableCache* table_cache_;
   VersionEdit edit_;
 
@@ -198,7 +206,8 @@ class Repairer {
     Slice record;
     WriteBatch batch;
     //SECONDARY MEMTABLE
-    MemTable* mem = new MemTable(icmp_, this->options_.secondaryAtt);
+    MemTable* mem = new MemTable(icmp_,
+                                 this->options_.secondary_key_extractor);
     mem->Ref();
     int counter = 0;
     while (reader.ReadRecord(&record, &scratch)) {
@@ -225,7 +234,10 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_tombstones = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_tombstones, &meta);
+    delete range_tombstones;
     delete iter;
     mem->Unref();
     mem = NULL;
@@ -299,6 +311,32 @@ class Repairer {
         status = iter->status();
       }
       delete iter;
+
+      // The key range also covers the range tombstones, as for any table.
+      iter = table_cache_->NewRangeTombstoneIterator(t->meta.number,
+                                                     t->meta.file_size);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        Slice key = iter->key();
+        if (!ParseInternalKey(key, &parsed)) {
+          continue;
+        }
+        InternalKey end(iter->value(), kMaxSequenceNumber, kValueTypeForSeek);
+        if (empty || icmp_.Compare(key, t->meta.smallest.Encode()) < 0) {
+          t->meta.smallest.DecodeFrom(key);
+        }
+        if (empty || icmp_.Compare(end, t->meta.largest) > 0) {
+          t->meta.largest = end;
+        }
+        empty = false;
+        t->meta.has_range_deletions = true;
+        if (parsed.sequence > t->max_sequence) {
+          t->max_sequence = parsed.sequence;
+        }
+      }
+      if (status.ok() && !iter->status().ok()) {
+        status = iter->status();
+      }
+      delete iter;
     }
     // If there was trouble opening an .sst file this will report that the .ldb
     // file was not found, which is kind of lame but shouldn't happen often.
@@ -333,7 +371,8 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
+                    t.meta.smallest, t.meta.largest,
+                    0, kMaxSequenceNumber, t.meta.has_range_deletions);
     }
 
     //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
@@ -0,0 +1,199 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/secondary_aggregate.h"
+
+#include "db/db_impl.h"
+#include "db/document.h"
+#include "db/memtable.h"
+#include "db/range_tombstone.h"
+#include "db/secondary_key.h"
+#include "db/snapshot.h"
+#include "db/version_set.h"
+#include "leveldb/comparator.h"
+#include "table/filter_block.h"
+#include "rapidjson/document.h"
+
+namespace leveldb {
+
+namespace {
+
+ReadOptions ValidationOptions(const ReadOptions& options) {
+  // Records are checked by their raw stored value.
+  ReadOptions result = options;
+  result.json_documents = false;
+  result.secondary_key.clear();
+  return result;
+}
+
+// Return true iff "mem" holds an entry with a user key in
+// [smallest_user_key, largest_user_key].
+bool HasEntryIn(MemTable* mem, const Comparator* ucmp,
+                const Slice& smallest_user_key,
+                const Slice& largest_user_key) {
+  Iterator* iter = mem->NewIterator();
+  InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  iter->Seek(start.Encode());
+  const bool result = iter->Valid() &&
+      ucmp->Compare(ExtractUserKey(iter->key()), largest_user_key) <= 0;
+  delete iter;
+  return result;
+}
+
+}  // namespace
+
+SecondaryAggregator::SecondaryAggregator(DBImpl* db,
+                                         const Options& db_options,
+                                         const ReadOptions& options,
+                                         const Slice& skey,
+                                         MemTable* mem, MemTable* imm,
+                                         Version* version,
+                                         const RangeTombstoneList* tombstones)
+    : db_(db),
+      db_options_(db_options),
+      ucmp_(db->user_comparator()),
+      options_(ValidationOptions(options)),
+      composite_(!db_options.secondaryTrailingAtt.empty()),
+      merges_(db_options.merge_operator != NULL),
+      snapshot_(reinterpret_cast<const SnapshotImpl*>(
+          options.snapshot)->number_),
+      mem_(mem),
+      imm_(imm),
+      version_(version),
+      tombstones_(tombstones),
+      rank_attributes_(1, db_options.rankingAtt),
+      level_(-1),
+      file_(NULL),
+      blocks_read_(0),
+      blocks_summarized_(0) {
+  AppendIndexKey(db_options, skey, &index_key_);
+  // The secondary filters hold keys with an internal key tag appended.
+  AppendInternalKey(&filter_key_, ParsedInternalKey(
+      index_key_, kMaxSequenceNumber, kValueTypeForSeek));
+}
+
+void SecondaryAggregator::StartFile(int level, const FileMetaData* f) {
+  level_ = level;
+  file_ = f;
+}
+
+bool SecondaryAggregator::StatsUsable(const Slice* smallest_user_key,
+                                      const Slice& largest_user_key) const {
+  if (merges_ || file_ == NULL || file_->largest_seq > snapshot_) {
+    return false;
+  }
+  // Clamp the block's range, bounded by index separators, to the file.
+  Slice smallest = file_->smallest.user_key();
+  if (smallest_user_key != NULL &&
+      ucmp_->Compare(*smallest_user_key, smallest) > 0) {
+    smallest = *smallest_user_key;
+  }
+  Slice largest = file_->largest.user_key();
+  if (ucmp_->Compare(largest_user_key, largest) < 0) {
+    largest = largest_user_key;
+  }
+
+  if (HasEntryIn(mem_, ucmp_, smallest, largest) ||
+      (imm_ != NULL && HasEntryIn(imm_, ucmp_, smallest, largest)) ||
+      version_->OverlapInNewerFiles(level_, file_->number,
+                                    smallest, largest)) {
+    return false;
+  }
+  const std::vector<RangeTombstone>& list = tombstones_->tombstones();
+  for (size_t i = 0; i < list.size(); i++) {
+    if (ucmp_->Compare(list[i].begin, largest) <= 0 &&
+        ucmp_->Compare(list[i].end, smallest) > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SecondaryAggregator::BlockMayMatch(FilterBlockReader* filter,
+                                        uint64_t offset) const {
+  return filter == NULL || filter->KeyMayMatch(offset, filter_key_);
+}
+
+void SecondaryAggregator::AddStats(const SecondaryStats& stats) {
+  blocks_summarized_++;
+  stats_.Add(stats);
+}
+
+void SecondaryAggregator::Offer(const Slice& pkey, const Slice& value,
+                                SequenceNumber seq, ValueType type) {
+  if (!status_.ok() || seq > snapshot_ || type == kTypeDeletion ||
+      type == kTypeRangeDeletion) {
+    return;
+  }
+  if (merges_) {
+    // Any version, or operand, of pkey stands for the record: check its
+    // merged value once.
+    if (!checked_.insert(pkey.ToString()).second) {
+      return;
+    }
+    Status s = db_->GetLive(options_, pkey, &scratch_, NULL);
+    if (s.ok()) {
+      if (HasIndexKey(db_options_, scratch_, index_key_)) {
+        Count(scratch_);
+      }
+    } else if (!s.IsNotFound()) {
+      status_ = s;
+    }
+    return;
+  }
+
+  // An older version of pkey can still carry the key after the record
+  // was updated or deleted, so only the live version is counted.  Each
+  // version is offered at most once, from where it is stored.
+  if (type != kTypeValue || tombstones_->Covers(pkey, seq, snapshot_) ||
+      !HasIndexKey(db_options_, value, index_key_)) {
+    return;
+  }
+  SequenceNumber live;
+  Status s = db_->GetLive(options_, pkey, &scratch_, &live);
+  if (s.ok()) {
+    if (live == seq) {
+      Count(value);
+    }
+  } else if (!s.IsNotFound()) {
+    status_ = s;
+  }
+}
+
+void SecondaryAggregator::SaveTableEntry(const Slice& ikey,
+                                         const Slice& value) {
+  ParsedInternalKey parsed_key;
+  if (!ParseInternalKey(ikey, &parsed_key)) {
+    status_ = Status::Corruption("corrupted key in table");
+    return;
+  }
+  Offer(parsed_key.user_key, value, parsed_key.sequence, parsed_key.type);
+}
+
+void SecondaryAggregator::Count(const Slice& value) {
+  const std::string& attribute = db_options_.rankingAtt;
+  rapidjson::Document doc;
+  if (!attribute.empty() &&
+      ReadDocument(db_options_.document_schema, value, &rank_attributes_,
+                   &doc) &&
+      doc.HasMember(attribute.c_str()) &&
+      doc[attribute.c_str()].IsNumber()) {
+    const double rank = doc[attribute.c_str()].GetDouble();
+    stats_.Add(&rank);
+  } else {
+    stats_.Add(NULL);
+  }
+}
+
+void SecondaryAggregator::Finish(SecondaryAggregate* result) const {
+  result->count = stats_.count();
+  result->value_count = stats_.value_count();
+  result->sum = stats_.sum();
+  result->min = stats_.range().empty() ? 0 : stats_.range().min();
+  result->max = stats_.range().empty() ? 0 : stats_.range().max();
+  result->blocks_read = blocks_read_;
+  result->blocks_summarized = blocks_summarized_;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,135 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// State of a single DB::GetSecondaryAggregate().  The memtables and
+// every table file offer it the records that may carry the secondary
+// key; a record is counted once, through its live version.  Data blocks
+// whose SecondaryStats (see table/format.h) still describe live records
+// are counted from the statistics instead of being read.
+
+#ifndef STORAGE_LEVELDB_DB_SECONDARY_AGGREGATE_H_
+#define STORAGE_LEVELDB_DB_SECONDARY_AGGREGATE_H_
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/db.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+#include "table/format.h"
+
+namespace leveldb {
+
+class DBImpl;
+class FilterBlockReader;
+class MemTable;
+class RangeTombstoneList;
+class Version;
+struct FileMetaData;
+
+class SecondaryAggregator {
+ public:
+  // Aggregate over the records carrying "skey" that are live at
+  // options.snapshot, which must be set.  "mem", "imm" (which may be
+  // NULL) and "version" are the state being read, and must stay
+  // referenced for the lifetime of this object, as must "*tombstones",
+  // which holds their range tombstones.
+  SecondaryAggregator(DBImpl* db, const Options& db_options,
+                      const ReadOptions& options, const Slice& skey,
+                      MemTable* mem, MemTable* imm, Version* version,
+                      const RangeTombstoneList* tombstones);
+
+  // The key, built by AppendIndexKey(), under which the index holds the
+  // records to count.  For a composite index it is a prefix of the keys
+  // of the memtable postings.
+  const std::string& index_key() const { return index_key_; }
+  bool composite() const { return composite_; }
+
+  SequenceNumber snapshot() const { return snapshot_; }
+
+  // Called before the blocks of file "f" of "level" are offered.
+  void StartFile(int level, const FileMetaData* f);
+
+  // Return true iff the statistics of a data block of the current file
+  // whose user keys lie in [*smallest_user_key, largest_user_key]
+  // (smallest_user_key is NULL for the first block) describe records
+  // that are all live: the whole file is visible at the snapshot, and
+  // neither a newer memtable or file nor a range tombstone holds a key
+  // in that range.
+  bool StatsUsable(const Slice* smallest_user_key,
+                   const Slice& largest_user_key) const;
+
+  // Return false if the secondary filter of the data block at "offset"
+  // shows that the block holds no record carrying the key.  "filter" may
+  // be NULL.
+  bool BlockMayMatch(FilterBlockReader* filter, uint64_t offset) const;
+
+  // Count the records of a block from its statistics, or note that the
+  // block is read instead.
+  void AddStats(const SecondaryStats& stats);
+  void StartBlock() { blocks_read_++; }
+
+  // Offer the entry of "pkey" at "seq".  It is counted iff it carries
+  // the key and is the live version of pkey (or, with a merge operator,
+  // iff pkey is live and its merged value carries the key).
+  void Offer(const Slice& pkey, const Slice& value, SequenceNumber seq,
+             ValueType type);
+
+  // Table-side entry point: "ikey" is an internal key read from a data
+  // block.
+  void SaveTableEntry(const Slice& ikey, const Slice& value);
+
+  // The first error met while checking records against the DB.
+  const Status& status() const { return status_; }
+
+  void Finish(SecondaryAggregate* result) const;
+
+ private:
+  // Count the live value "value".
+  void Count(const Slice& value);
+
+  DBImpl* const db_;
+  const Options& db_options_;
+  const Comparator* const ucmp_;
+  ReadOptions options_;
+  std::string index_key_;
+  std::string filter_key_;      // index_key_ as the filters hold it
+  const bool composite_;
+
+  // True iff records may have been changed by merge operands, whose
+  // merged value no single entry shows.  Statistics are not used then,
+  // and every record is checked, once, by its merged value.
+  const bool merges_;
+
+  const SequenceNumber snapshot_;
+  MemTable* const mem_;
+  MemTable* const imm_;
+  Version* const version_;
+  const RangeTombstoneList* const tombstones_;
+  const std::vector<std::string> rank_attributes_;
+
+  // The file being read.
+  int level_;
+  const FileMetaData* file_;
+
+  // With merges_, the primary keys already checked.
+  std::unordered_set<std::string> checked_;
+
+  // Reused across validations so that a record does not allocate.
+  std::string scratch_;
+
+  SecondaryStats stats_;
+  uint64_t blocks_read_;
+  uint64_t blocks_summarized_;
+  Status status_;
+
+  // No copying allowed
+  SecondaryAggregator(const SecondaryAggregator&);
+  void operator=(const SecondaryAggregator&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_SECONDARY_AGGREGATE_H_
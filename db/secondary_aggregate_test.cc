@@ -0,0 +1,316 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/secondary_aggregate.h"
+
+#include "db/db_impl.h"
+#include "leveldb/db.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/secondary_query.h"
+#include "rapidjson/document.h"
+#include "util/logging.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class SecondaryAggregateTest {
+ public:
+  std::string dbname_;
+  const FilterPolicy* filter_policy_;
+  const MergeOperator* merge_operator_;
+  Options options_;
+  DB* db_;
+
+  SecondaryAggregateTest()
+      : filter_policy_(NewBloomFilterPolicy(10)),
+        merge_operator_(NewJsonMergeOperator()),
+        db_(NULL) {
+    dbname_ = test::TmpDir() + "/secondary_aggregate_test";
+    DestroyDB(dbname_, options_);
+    options_.create_if_missing = true;
+    options_.filter_policy = filter_policy_;
+    options_.block_size = 256;
+    options_.PrimaryAtt = "ID";
+    options_.secondaryAtt = "c";
+    options_.rankingAtt = "r";
+    options_.secondary_block_stats = true;
+  }
+
+  ~SecondaryAggregateTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+    delete merge_operator_;
+    delete filter_policy_;
+  }
+
+  DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+  void Open() {
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  }
+
+  void PutDoc(int id, const char* c, int r) {
+    char doc[100];
+    snprintf(doc, sizeof(doc), "{\"ID\": %d, \"c\": \"%s\", \"r\": %d}",
+             id, c, r);
+    ASSERT_OK(db_->Put(WriteOptions(), doc));
+  }
+
+  // Aggregate "skey" by reading every live document.
+  std::string BruteForce(const std::string& skey,
+                         const Snapshot* snapshot = NULL) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    SecondaryAggregate result = SecondaryAggregate();
+    Iterator* iter = db_->NewIterator(options);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      rapidjson::Document doc;
+      doc.Parse<0>(iter->value().ToString().c_str());
+      if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("c") ||
+          !doc["c"].IsString() || skey != doc["c"].GetString()) {
+        continue;
+      }
+      result.count++;
+      if (doc.HasMember("r") && doc["r"].IsNumber()) {
+        const double r = doc["r"].GetDouble();
+        if (result.value_count == 0 || r < result.min) result.min = r;
+        if (result.value_count == 0 || r > result.max) result.max = r;
+        result.value_count++;
+        result.sum += r;
+      }
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+    return ToString(result);
+  }
+
+  std::string Aggregate(const std::string& skey,
+                        const Snapshot* snapshot = NULL,
+                        SecondaryAggregate* out = NULL) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    SecondaryAggregate result;
+    Status s = db_->GetSecondaryAggregate(options, skey, &result);
+    if (!s.ok()) {
+      return s.ToString();
+    }
+    if (out != NULL) {
+      *out = result;
+    }
+    return ToString(result);
+  }
+
+  static std::string ToString(const SecondaryAggregate& result) {
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%llu/%llu sum=%g [%g,%g]",
+             static_cast<unsigned long long>(result.count),
+             static_cast<unsigned long long>(result.value_count),
+             result.sum, result.min, result.max);
+    return buf;
+  }
+
+  void CheckAll(const Snapshot* snapshot = NULL) {
+    const char* keys[] = { "x", "y", "z", "none" };
+    for (int i = 0; i < 4; i++) {
+      ASSERT_EQ(BruteForce(keys[i], snapshot), Aggregate(keys[i], snapshot));
+    }
+  }
+};
+
+TEST(SecondaryAggregateTest, MatchesScan) {
+  Open();
+  const char* keys[] = { "x", "y", "z" };
+  for (int i = 0; i < 300; i++) {
+    PutDoc(i, keys[i % 3], i);
+  }
+  CheckAll();
+  ASSERT_EQ("100/100 sum=14850 [0,297]", Aggregate("x"));
+
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  CheckAll();
+  const Snapshot* snapshot = db_->GetSnapshot();
+
+  // Updates, deletions and range deletions, first in the memtable, then
+  // in newer files over the old ones
+  for (int i = 0; i < 300; i += 7) {
+    PutDoc(i, "y", 1000 + i);
+  }
+  for (int i = 1; i < 300; i += 11) {
+    ASSERT_OK(db_->Delete(WriteOptions(), NumberToString(i)));
+  }
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "150", "170"));
+  CheckAll();
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  CheckAll();
+  CheckAll(snapshot);
+  ASSERT_EQ("100/100 sum=14850 [0,297]", Aggregate("x", snapshot));
+
+  db_->ReleaseSnapshot(snapshot);
+  db_->CompactRange(NULL, NULL);
+  CheckAll();
+}
+
+TEST(SecondaryAggregateTest, CompactedBlocksAreSummarized) {
+  Open();
+  const char* keys[] = { "x", "y", "z" };
+  for (int i = 0; i < 500; i++) {
+    PutDoc(i, keys[i % 3], i);
+  }
+  db_->CompactRange(NULL, NULL);
+
+  // Nothing newer overlaps the compacted data: no block is read
+  SecondaryAggregate result;
+  ASSERT_EQ(BruteForce("x"), Aggregate("x", NULL, &result));
+  ASSERT_EQ(0u, result.blocks_read);
+  ASSERT_GT(result.blocks_summarized, 1u);
+
+  // Only the blocks a newer write overlaps are read again
+  PutDoc(250, "x", 7);
+  ASSERT_EQ(BruteForce("x"), Aggregate("x", NULL, &result));
+  ASSERT_EQ(1u, result.blocks_read);
+  ASSERT_GT(result.blocks_summarized, 1u);
+  ASSERT_EQ(BruteForce("none"), Aggregate("none", NULL, &result));
+  ASSERT_EQ(0u, result.blocks_read + result.blocks_summarized);
+}
+
+TEST(SecondaryAggregateTest, Composite) {
+  options_.secondaryTrailingAtt = "r";
+  Open();
+  const char* keys[] = { "x", "y" };
+  for (int i = 0; i < 200; i++) {
+    PutDoc(i, keys[i % 2], i % 10);
+  }
+  CheckAll();
+  db_->CompactRange(NULL, NULL);
+  PutDoc(4, "y", 3);
+  CheckAll();
+}
+
+TEST(SecondaryAggregateTest, MergeOperands) {
+  options_.merge_operator = merge_operator_;
+  Open();
+  for (int i = 0; i < 100; i++) {
+    PutDoc(i, "x", i);
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 100; i += 3) {
+    ASSERT_OK(db_->Merge(WriteOptions(), NumberToString(i),
+                         "{\"c\": \"y\"}"));
+  }
+  for (int i = 1; i < 100; i += 3) {
+    ASSERT_OK(db_->Merge(WriteOptions(), NumberToString(i),
+                         "{\"r\": 1000}"));
+  }
+  CheckAll();
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  CheckAll();
+  db_->CompactRange(NULL, NULL);
+  CheckAll();
+}
+
+TEST(SecondaryAggregateTest, BitmapIndex) {
+  options_.filter_policy = NULL;
+  options_.secondary_block_stats = false;
+  options_.secondary_index_type = kSecondaryBitmapIndex;
+  Open();
+  const char* keys[] = { "x", "y", "z" };
+  for (int i = 0; i < 300; i++) {
+    PutDoc(i, keys[i % 3], i);
+  }
+  PutDoc(1000, "rare", 1);
+  db_->CompactRange(NULL, NULL);
+  PutDoc(3, "y", 5);
+  CheckAll();
+
+  // A key held by no block reads none; a rare one reads a single block
+  SecondaryAggregate result;
+  ASSERT_EQ(BruteForce("none"), Aggregate("none", NULL, &result));
+  ASSERT_EQ(0u, result.blocks_read);
+  ASSERT_EQ("1/1 sum=1 [1,1]", Aggregate("rare", NULL, &result));
+  ASSERT_EQ(1u, result.blocks_read);
+
+  // Lookups narrowed by the bitmaps find the same documents
+  std::vector<SKeyReturnVal> values;
+  ASSERT_OK(db_->Get(ReadOptions(), "rare", &values, 10));
+  ASSERT_EQ(1u, values.size());
+  ASSERT_EQ("1000", values[0].key);
+  values.clear();
+  ASSERT_TRUE(db_->Get(ReadOptions(), "none", &values, 10).IsNotFound());
+  ASSERT_EQ(0u, values.size());
+  values.clear();
+  SecondaryQuery query = SecondaryQuery::Or(SecondaryQuery::Equals("c", "rare"),
+                                            SecondaryQuery::Equals("c", "y"));
+  ASSERT_OK(db_->Get(ReadOptions(), query, &values, 1000));
+  ASSERT_EQ(102u, values.size());
+  values.clear();
+  query = SecondaryQuery::And(SecondaryQuery::Equals("c", "rare"),
+                              SecondaryQuery::Equals("c", "y"));
+  ASSERT_TRUE(db_->Get(ReadOptions(), query, &values, 1000).IsNotFound());
+  ASSERT_EQ(0u, values.size());
+}
+
+TEST(SecondaryAggregateTest, ApproximateCount) {
+  options_.secondary_count_sketch_width = 256;
+  Open();
+  const char* keys[] = { "x", "y", "z" };
+  for (int i = 0; i < 600; i++) {
+    PutDoc(i, keys[i % 3], i);
+  }
+  PutDoc(1000, "rare", 1);
+
+  // The memtable counts its postings exactly
+  uint64_t count;
+  ASSERT_OK(db_->GetApproximateSecondaryCount("x", &count));
+  ASSERT_EQ(200u, count);
+  ASSERT_OK(db_->GetApproximateSecondaryCount("rare", &count));
+  ASSERT_EQ(1u, count);
+
+  // Tables by their sketches, which never undercount
+  db_->CompactRange(NULL, NULL);
+  ASSERT_OK(db_->GetApproximateSecondaryCount("x", &count));
+  ASSERT_GE(count, 200u);
+  ASSERT_LE(count, 220u);
+  ASSERT_OK(db_->GetApproximateSecondaryCount("rare", &count));
+  ASSERT_GE(count, 1u);
+  ASSERT_LE(count, 20u);
+  ASSERT_OK(db_->GetApproximateSecondaryCount("none", &count));
+  ASSERT_LE(count, 20u);
+
+  // Newer writes add to the estimate until they are compacted
+  for (int i = 2000; i < 2100; i++) {
+    PutDoc(i, "rare", i);
+  }
+  ASSERT_OK(db_->GetApproximateSecondaryCount("rare", &count));
+  ASSERT_GE(count, 101u);
+  ASSERT_LE(count, 120u);
+}
+
+TEST(SecondaryAggregateTest, ApproximateCountWithoutSketch) {
+  Open();
+  for (int i = 0; i < 100; i++) {
+    PutDoc(i, "x", i);
+  }
+  db_->CompactRange(NULL, NULL);
+  PutDoc(100, "x", 100);
+  uint64_t count;
+  ASSERT_OK(db_->GetApproximateSecondaryCount("x", &count));
+  ASSERT_EQ(1u, count);
+}
+
+TEST(SecondaryAggregateTest, NoIndex) {
+  options_.secondaryAtt.clear();
+  Open();
+  ASSERT_EQ("Invalid argument: no secondary index to aggregate over",
+            Aggregate("x"));
+  uint64_t count;
+  ASSERT_EQ("Invalid argument: no secondary index to count",
+            db_->GetApproximateSecondaryCount("x", &count).ToString());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/secondary_file_directory.h"
+
+#include <algorithm>
+#include "util/mutexlock.h"
+#include "util/roaring_bitmap.h"
+
+namespace leveldb {
+
+SecondaryFileDirectory::SecondaryFileDirectory(size_t max_keys)
+    : max_keys_(max_keys),
+      full_(false) {
+}
+
+void SecondaryFileDirectory::AddFile(uint64_t number,
+                                     const RoaringBitmap& hashes) {
+  std::vector<uint32_t> values;
+  hashes.GetValues(&values);
+  MutexLock l(&mu_);
+  for (size_t i = 0; i < values.size(); i++) {
+    std::unordered_map<uint32_t, Entry>::iterator it =
+        entries_.find(values[i]);
+    if (it == entries_.end()) {
+      if (full_ || entries_.size() >= max_keys_) {
+        full_ = true;
+        continue;
+      }
+      it = entries_.insert(std::make_pair(values[i], Entry())).first;
+      it->second.overflowed = false;
+    }
+    Entry* e = &it->second;
+    if (e->overflowed) {
+      continue;
+    }
+    if (e->files.size() >= kMaxFilesPerKey) {
+      // Remembered as overflowed, so that it is not admitted again with
+      // some of its files missing.
+      e->overflowed = true;
+      std::vector<uint64_t>().swap(e->files);
+      continue;
+    }
+    e->files.push_back(number);
+  }
+}
+
+void SecondaryFileDirectory::RemoveFile(uint64_t number,
+                                        const RoaringBitmap& hashes) {
+  std::vector<uint32_t> values;
+  hashes.GetValues(&values);
+  MutexLock l(&mu_);
+  for (size_t i = 0; i < values.size(); i++) {
+    std::unordered_map<uint32_t, Entry>::iterator it =
+        entries_.find(values[i]);
+    if (it == entries_.end() || it->second.overflowed) {
+      continue;
+    }
+    std::vector<uint64_t>& files = it->second.files;
+    files.erase(std::remove(files.begin(), files.end(), number),
+                files.end());
+    if (files.empty()) {
+      // No file holds the key any more: it is complete when re-admitted.
+      entries_.erase(it);
+    }
+  }
+}
+
+bool SecondaryFileDirectory::Lookup(const std::vector<uint32_t>& hashes,
+                                    std::vector<uint64_t>* files) const {
+  files->clear();
+  {
+    MutexLock l(&mu_);
+    for (size_t i = 0; i < hashes.size(); i++) {
+      std::unordered_map<uint32_t, Entry>::const_iterator it =
+          entries_.find(hashes[i]);
+      if (it == entries_.end()) {
+        if (full_) {
+          return false;  // May be held by files added while full
+        }
+        continue;        // Held by no file
+      }
+      if (it->second.overflowed) {
+        return false;
+      }
+      files->insert(files->end(), it->second.files.begin(),
+                    it->second.files.end());
+    }
+  }
+  std::sort(files->begin(), files->end());
+  files->erase(std::unique(files->begin(), files->end()), files->end());
+  return true;
+}
+
+size_t SecondaryFileDirectory::size() const {
+  MutexLock l(&mu_);
+  return entries_.size();
+}
+
+}  // namespace leveldb
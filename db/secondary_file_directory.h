@@ -0,0 +1,70 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An in-memory directory from the hashes of secondary keys (see
+// SecondaryKeyHash()) to the numbers of the table files holding them,
+// kept by the VersionSet as files are added and dropped (see
+// Options::secondary_file_directory_keys).
+//
+// A key the directory tracks is listed with every file, in any live
+// version, that may hold it, so that a lookup need only visit those.  A
+// key is not tracked once it is held by more than kMaxFilesPerKey files,
+// nor, once the directory is full, if it was not tracked before; lookups
+// then fall back to probing the filters of every file.  Since a key that
+// is not admitted may be held by files already added, the directory
+// admits no new key after it first fills up, until it is rebuilt.
+
+#ifndef STORAGE_LEVELDB_DB_SECONDARY_FILE_DIRECTORY_H_
+#define STORAGE_LEVELDB_DB_SECONDARY_FILE_DIRECTORY_H_
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "port/port.h"
+
+namespace leveldb {
+
+class RoaringBitmap;
+
+class SecondaryFileDirectory {
+ public:
+  // A directory of at most "max_keys" keys.
+  explicit SecondaryFileDirectory(size_t max_keys);
+
+  // Record that file "number" holds the keys whose hashes are "hashes".
+  void AddFile(uint64_t number, const RoaringBitmap& hashes);
+
+  // Forget file "number", added with "hashes", once no version holds it.
+  void RemoveFile(uint64_t number, const RoaringBitmap& hashes);
+
+  // If every hash of "hashes" is tracked, store in *files, sorted, the
+  // numbers of the files that may hold any of them and return true.
+  // Otherwise return false.
+  bool Lookup(const std::vector<uint32_t>& hashes,
+              std::vector<uint64_t>* files) const;
+
+  // Number of keys tracked.
+  size_t size() const;
+
+  enum { kMaxFilesPerKey = 8 };
+
+ private:
+  struct Entry {
+    bool overflowed;               // Held by too many files: not tracked
+    std::vector<uint64_t> files;   // Unless overflowed
+  };
+
+  const size_t max_keys_;
+  mutable port::Mutex mu_;
+  std::unordered_map<uint32_t, Entry> entries_;
+  bool full_;                      // Admits no new key
+
+  // No copying allowed
+  SecondaryFileDirectory(const SecondaryFileDirectory&);
+  void operator=(const SecondaryFileDirectory&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_SECONDARY_FILE_DIRECTORY_H_
@@ -0,0 +1,101 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/secondary_file_directory.h"
+
+#include "util/roaring_bitmap.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class SecondaryFileDirectoryTest {
+ public:
+  static RoaringBitmap Hashes(uint32_t first, uint32_t n) {
+    RoaringBitmap result;
+    for (uint32_t i = 0; i < n; i++) {
+      result.Add(first + i);
+    }
+    return result;
+  }
+
+  static std::string Lookup(const SecondaryFileDirectory& directory,
+                            uint32_t hash) {
+    std::vector<uint64_t> files;
+    if (!directory.Lookup(std::vector<uint32_t>(1, hash), &files)) {
+      return "untracked";
+    }
+    std::string result;
+    for (size_t i = 0; i < files.size(); i++) {
+      if (!result.empty()) result.push_back(',');
+      char buf[30];
+      snprintf(buf, sizeof(buf), "%llu",
+               static_cast<unsigned long long>(files[i]));
+      result.append(buf);
+    }
+    return result;
+  }
+};
+
+TEST(SecondaryFileDirectoryTest, AddRemove) {
+  SecondaryFileDirectory directory(100);
+  directory.AddFile(7, Hashes(10, 5));     // 10..14
+  directory.AddFile(3, Hashes(12, 5));     // 12..16
+  ASSERT_EQ(7u, directory.size());
+  ASSERT_EQ("7", Lookup(directory, 10));
+  ASSERT_EQ("3,7", Lookup(directory, 13));
+  ASSERT_EQ("3", Lookup(directory, 16));
+  ASSERT_EQ("", Lookup(directory, 99));
+
+  std::vector<uint32_t> hashes;
+  hashes.push_back(10);
+  hashes.push_back(16);
+  std::vector<uint64_t> files;
+  ASSERT_TRUE(directory.Lookup(hashes, &files));
+  ASSERT_EQ(2u, files.size());
+
+  directory.RemoveFile(7, Hashes(10, 5));
+  ASSERT_EQ("", Lookup(directory, 10));
+  ASSERT_EQ("3", Lookup(directory, 13));
+  ASSERT_EQ(5u, directory.size());
+}
+
+TEST(SecondaryFileDirectoryTest, Overflow) {
+  SecondaryFileDirectory directory(100);
+  for (uint64_t f = 1; f <= SecondaryFileDirectory::kMaxFilesPerKey; f++) {
+    directory.AddFile(f, Hashes(1, 1));
+  }
+  ASSERT_EQ("1,2,3,4,5,6,7,8", Lookup(directory, 1));
+  directory.AddFile(9, Hashes(1, 1));
+  ASSERT_EQ("untracked", Lookup(directory, 1));
+
+  // Stays untracked, since files may still hold it
+  for (uint64_t f = 1; f <= 5; f++) {
+    directory.RemoveFile(f, Hashes(1, 1));
+  }
+  ASSERT_EQ("untracked", Lookup(directory, 1));
+}
+
+TEST(SecondaryFileDirectoryTest, Full) {
+  SecondaryFileDirectory directory(10);
+  directory.AddFile(1, Hashes(0, 8));
+  ASSERT_EQ("", Lookup(directory, 50));
+  directory.AddFile(2, Hashes(5, 8));      // 8..12 do not all fit
+  ASSERT_EQ(10u, directory.size());
+  ASSERT_EQ("1,2", Lookup(directory, 6));
+  ASSERT_EQ("2", Lookup(directory, 9));
+  ASSERT_EQ("untracked", Lookup(directory, 12));
+  ASSERT_EQ("untracked", Lookup(directory, 50));
+
+  // No new key is admitted once full, even after room is made
+  directory.RemoveFile(1, Hashes(0, 8));
+  directory.AddFile(3, Hashes(100, 1));
+  ASSERT_EQ("untracked", Lookup(directory, 100));
+  ASSERT_EQ("2", Lookup(directory, 6));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
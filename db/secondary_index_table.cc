@@ -0,0 +1,282 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/secondary_index_table.h"
+
+#include <algorithm>
+#include <set>
+#include "db/secondary_key.h"
+#include "db/secondary_lookup.h"
+#include "db/write_batch_internal.h"
+#include "leveldb/iterator.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/write_batch.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+namespace {
+
+// Sorts after any key a document is likely to have.
+const char kPrefix[] = "\xff\xff\xffsecondary-index";
+const size_t kPrefixSize = sizeof(kPrefix) - 1;
+
+const char kCompositeTag = 'k';
+const char kPostingTag = 'p';
+
+void PutBigEndian64(std::string* dst, uint64_t value) {
+  char buf[8];
+  for (int i = 7; i >= 0; i--) {
+    buf[i] = static_cast<char>(value & 0xff);
+    value >>= 8;
+  }
+  dst->append(buf, sizeof(buf));
+}
+
+uint64_t DecodeBigEndian64(const char* p) {
+  uint64_t result = 0;
+  for (int i = 0; i < 8; i++) {
+    result = (result << 8) | static_cast<unsigned char>(p[i]);
+  }
+  return result;
+}
+
+// Append to *dst the start of the index table keys of "index_key".
+void AppendIndexTableKey(SecondaryIndexTableType type, const Slice& index_key,
+                         std::string* dst) {
+  dst->append(kPrefix, kPrefixSize);
+  if (type == kSecondaryCompositeIndexTable) {
+    dst->push_back(kCompositeTag);
+    PutLengthPrefixedSlice(dst, index_key);
+  } else {
+    dst->push_back(kPostingTag);
+    dst->append(index_key.data(), index_key.size());
+  }
+}
+
+// Collects the index table entries of the records of a batch, from the
+// secondary keys that WriteBatch::PutDocument() extracted where it did.
+class EntryCollector : public KeyedBatchHandler {
+ public:
+  EntryCollector(const Options& options, SequenceNumber sequence)
+      : options_(options),
+        composite_(!options.secondaryTrailingAtt.empty()),
+        sequence_(sequence) { }
+
+  virtual void Put(const Slice& key, const Slice& value,
+                   const std::vector<std::string>* secondary_keys) {
+    const SequenceNumber sequence = sequence_++;
+    if (IsIndexTableKey(key)) {
+      return;
+    }
+    std::vector<std::string> extracted;
+    if (secondary_keys == NULL) {
+      ExtractSecondaryKeys(options_, value, &extracted);
+      secondary_keys = &extracted;
+    }
+    const std::vector<std::string>& keys = *secondary_keys;
+    // Both the index keys and, for a composite index, the composite keys
+    // that fix both attributes are looked up.
+    std::vector<std::string> index_keys;
+    GetIndexKeys(options_, keys, &index_keys);
+    if (composite_) {
+      for (size_t i = 0; i < keys.size(); i++) {
+        if (std::find(index_keys.begin(), index_keys.end(), keys[i]) ==
+            index_keys.end()) {
+          index_keys.push_back(keys[i]);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < index_keys.size(); i++) {
+      Entry entry;
+      AppendIndexTableKey(options_.secondary_index_table, index_keys[i],
+                          &entry.key);
+      if (options_.secondary_index_table == kSecondaryCompositeIndexTable) {
+        PutBigEndian64(&entry.key, ~sequence);
+        entry.key.append(key.data(), key.size());
+      } else {
+        PutLengthPrefixedSlice(&entry.value, key);
+        PutFixed64(&entry.value, sequence);
+      }
+      entries_.push_back(entry);
+    }
+  }
+  virtual void Delete(const Slice& key) {
+    sequence_++;
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    sequence_++;
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    sequence_++;
+  }
+
+  void AddTo(WriteBatch* batch) const {
+    for (size_t i = 0; i < entries_.size(); i++) {
+      if (options_.secondary_index_table == kSecondaryCompositeIndexTable) {
+        batch->Put(entries_[i].key, Slice());
+      } else {
+        batch->Merge(entries_[i].key, entries_[i].value);
+      }
+    }
+  }
+
+ private:
+  struct Entry {
+    std::string key;
+    std::string value;
+  };
+
+  const Options& options_;
+  const bool composite_;
+  SequenceNumber sequence_;
+  std::vector<Entry> entries_;
+};
+
+// Append to *dst the postings of "list" whose primary keys are not in
+// *seen, and add those keys to it.  Returns false if "list" is not a
+// posting list.
+bool AppendUnseenPostings(Slice list, std::set<std::string>* seen,
+                          std::string* dst) {
+  while (!list.empty()) {
+    const char* start = list.data();
+    Slice pkey;
+    if (!GetLengthPrefixedSlice(&list, &pkey) || list.size() < 8) {
+      return false;
+    }
+    list.remove_prefix(8);
+    if (seen->insert(pkey.ToString()).second) {
+      dst->append(start, list.data() - start);
+    }
+  }
+  return true;
+}
+
+class PostingListMergeOperator : public MergeOperator {
+ public:
+  virtual const char* Name() const {
+    return "leveldb.SecondaryPostingList";
+  }
+
+  // Newer postings go first.  Only the newest posting of a record can
+  // be live, so the older ones are dropped.
+  virtual bool Merge(const Slice& key, const Slice* existing_value,
+                     const Slice& operand, std::string* new_value) const {
+    if (!IsIndexTableKey(key)) {
+      return false;
+    }
+    new_value->clear();
+    std::set<std::string> seen;
+    return AppendUnseenPostings(operand, &seen, new_value) &&
+        (existing_value == NULL ||
+         AppendUnseenPostings(*existing_value, &seen, new_value));
+  }
+};
+
+class HidingIterator : public Iterator {
+ public:
+  explicit HidingIterator(Iterator* iter) : iter_(iter) { }
+  virtual ~HidingIterator() {
+    delete iter_;
+  }
+
+  virtual bool Valid() const {
+    return iter_->Valid() && !IsIndexTableKey(iter_->key());
+  }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); }
+  virtual void SeekToLast() {
+    iter_->Seek(IndexTableStart());
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else if (iter_->status().ok()) {
+      iter_->SeekToLast();
+    }
+  }
+  virtual void Seek(const Slice& target) { iter_->Seek(target); }
+  virtual void Next() { iter_->Next(); }
+  virtual void Prev() { iter_->Prev(); }
+  virtual Slice key() const { return iter_->key(); }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const { return iter_->status(); }
+
+ private:
+  Iterator* iter_;
+};
+
+}  // namespace
+
+bool IsIndexTableKey(const Slice& user_key) {
+  return user_key.starts_with(Slice(kPrefix, kPrefixSize));
+}
+
+Slice IndexTableStart() {
+  return Slice(kPrefix, kPrefixSize);
+}
+
+void AppendIndexTableEntries(const Options& options, WriteBatch* batch) {
+  if (options.secondary_index_table == kNoSecondaryIndexTable ||
+      options.secondary_key_extractor == NULL) {
+    return;
+  }
+  EntryCollector collector(options, WriteBatchInternal::Sequence(batch));
+  WriteBatchInternal::Iterate(batch, &collector);
+  collector.AddTo(batch);
+}
+
+Status ReadIndexTable(const Options& options, Iterator* iter,
+                      const std::vector<std::string>& keys,
+                      SecondaryLookup* lookup) {
+  const SecondaryIndexTableType type = options.secondary_index_table;
+  std::string start;
+  for (size_t i = 0; i < keys.size() && iter->status().ok(); i++) {
+    start.clear();
+    AppendIndexTableKey(type, keys[i], &start);
+    iter->Seek(start);
+    if (type == kSecondaryCompositeIndexTable) {
+      for (; iter->Valid() && iter->key().starts_with(start); iter->Next()) {
+        Slice rest = iter->key();
+        rest.remove_prefix(start.size());
+        if (rest.size() < 8) {
+          return Status::Corruption("bad secondary index table key");
+        }
+        const SequenceNumber sequence = ~DecodeBigEndian64(rest.data());
+        if (lookup->OlderThanResults(sequence)) {
+          break;  // So are the entries that follow
+        }
+        rest.remove_prefix(8);
+        if (lookup->InWindow(sequence)) {
+          lookup->OfferLive(rest, sequence);
+        }
+      }
+    } else if (iter->Valid() && iter->key() == Slice(start)) {
+      Slice input = iter->value();
+      while (!input.empty()) {
+        Slice pkey;
+        if (!GetLengthPrefixedSlice(&input, &pkey) || input.size() < 8) {
+          return Status::Corruption("bad secondary posting list");
+        }
+        const SequenceNumber sequence = DecodeFixed64(input.data());
+        input.remove_prefix(8);
+        if (lookup->OlderThanResults(sequence)) {
+          break;
+        }
+        if (lookup->InWindow(sequence)) {
+          lookup->OfferLive(pkey, sequence);
+        }
+      }
+    }
+  }
+  return iter->status();
+}
+
+const MergeOperator* NewIndexTableMergeOperator() {
+  return new PostingListMergeOperator;
+}
+
+Iterator* NewIndexTableHidingIterator(Iterator* iter) {
+  return new HidingIterator(iter);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The stand-alone secondary index table (see Options::secondary_index_table)
+// is kept in the DB itself, in a range of reserved user keys that sorts
+// after every other one.  Its entries are added to the WriteBatch of the
+// records they index, so they share their log record and sequence
+// numbers, and are flushed and compacted along with them.  Iterators do
+// not show them.
+//
+// kSecondaryCompositeIndexTable keys every record by each of its index
+// keys (see AppendIndexKey()):
+//
+//    key   := prefix 'k' index_key:varstring ~sequence:fixed64-big-endian pkey
+//    value := empty
+//
+// so that the records of an index key are contiguous, newest first.
+//
+// kSecondaryPostingIndexTable keeps one posting list per index key.  A
+// write adds its postings as merge operands, which reads and compactions
+// merge into a single list, newest first:
+//
+//    key     := prefix 'p' index_key
+//    value   := posting*
+//    posting := pkey:varstring sequence:fixed64
+//
+// Entries are never deleted: a record updated or deleted since leaves
+// stale ones, which lookups recognize because the sequence number of
+// the live record differs.  A posting list keeps only the newest
+// posting of each record, though, dropping the others as its operands
+// are merged, so it grows with the records ever indexed under its key
+// rather than with their updates.
+
+#ifndef STORAGE_LEVELDB_DB_SECONDARY_INDEX_TABLE_H_
+#define STORAGE_LEVELDB_DB_SECONDARY_INDEX_TABLE_H_
+
+#include <string>
+#include <vector>
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Iterator;
+class MergeOperator;
+class SecondaryLookup;
+class WriteBatch;
+
+// Return true iff "user_key" belongs to the index table.
+extern bool IsIndexTableKey(const Slice& user_key);
+
+// Return the smallest key of the index table.
+extern Slice IndexTableStart();
+
+// Append to "batch", whose sequence number is set, the index table
+// entries of its Put records under "options".
+extern void AppendIndexTableEntries(const Options& options,
+                                    WriteBatch* batch);
+
+// Offer to *lookup the records that the index table read by "iter", an
+// iterator over the user keys of the DB at the snapshot of the lookup,
+// lists under the index keys "keys", newest first until no older one can
+// enter its result.
+extern Status ReadIndexTable(const Options& options, Iterator* iter,
+                             const std::vector<std::string>& keys,
+                             SecondaryLookup* lookup);
+
+// Return the operator that merges the posting lists of the index table.
+// It rejects operands of other keys.  The caller must delete it.
+extern const MergeOperator* NewIndexTableMergeOperator();
+
+// Return an iterator over the entries of the DB iterator "iter" outside
+// the index table.  Takes ownership of "iter".
+extern Iterator* NewIndexTableHidingIterator(Iterator* iter);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_SECONDARY_INDEX_TABLE_H_
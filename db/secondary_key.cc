@@ -0,0 +1,382 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/secondary_key.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+#include "db/document.h"
+#include "leveldb/filter_policy.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+// Read-only rapidjson stream over a Slice.
+struct SliceStream {
+  typedef char Ch;
+
+  explicit SliceStream(const Slice& s)
+      : head_(s.data()), src_(s.data()), end_(s.data() + s.size()) { }
+
+  Ch Peek() const { return src_ < end_ ? *src_ : '\0'; }
+  Ch Take() { return src_ < end_ ? *src_++ : '\0'; }
+  size_t Tell() const { return src_ - head_; }
+
+  Ch* PutBegin() { assert(false); return 0; }
+  void Put(Ch) { assert(false); }
+  size_t PutEnd(Ch*) { assert(false); return 0; }
+
+  const Ch* head_;
+  const Ch* src_;
+  const Ch* end_;
+};
+
+typedef std::vector<const rapidjson::Value*> ValueList;
+
+// Append to *out the values found under "path" in "v".
+void FindValues(const rapidjson::Value& v, Slice path, ValueList* out) {
+  if (v.IsArray()) {
+    for (rapidjson::SizeType i = 0; i < v.Size(); i++) {
+      FindValues(v[i], path, out);
+    }
+    return;
+  }
+  if (path.empty()) {
+    out->push_back(&v);
+    return;
+  }
+  if (!v.IsObject()) {
+    return;
+  }
+
+  const char* dot = static_cast<const char*>(
+      memchr(path.data(), '.', path.size()));
+  Slice name(path.data(), dot == NULL ? path.size() : dot - path.data());
+  Slice rest;
+  if (dot != NULL) {
+    rest = Slice(dot + 1, path.data() + path.size() - (dot + 1));
+  }
+  for (rapidjson::Value::ConstMemberIterator m = v.MemberBegin();
+       m != v.MemberEnd(); ++m) {
+    if (Slice(m->name.GetString(), m->name.GetStringLength()) == name) {
+      FindValues(m->value, rest, out);
+      return;
+    }
+  }
+}
+
+// Store in *key the secondary key for the scalar "v".  Returns false if
+// "v" carries no key.
+bool FormatKey(const rapidjson::Value& v, std::string* key) {
+  if (v.IsString()) {
+    key->assign(v.GetString(), v.GetStringLength());
+    return true;
+  }
+  std::ostringstream s;
+  if (v.IsNumber()) {
+    if (v.IsUint64()) {
+      s << v.GetUint64();
+    } else if (v.IsInt64()) {
+      s << v.GetInt64();
+    } else if (v.IsDouble()) {
+      s << v.GetDouble();
+    } else if (v.IsUint()) {
+      s << v.GetUint();
+    } else if (v.IsInt()) {
+      s << v.GetInt();
+    }
+  } else if (v.IsBool()) {
+    s << v.GetBool();
+  } else {
+    return false;
+  }
+  *key = s.str();
+  return true;
+}
+
+void AddUnique(const std::string& key, std::vector<std::string>* v) {
+  if (std::find(v->begin(), v->end(), key) == v->end()) {
+    v->push_back(key);
+  }
+}
+
+}  // namespace
+
+bool ParseDocument(const Slice& value, rapidjson::Document* doc) {
+  SliceStream stream(value);
+  doc->ParseStream<0>(stream);
+  return !doc->HasParseError() && doc->IsObject();
+}
+
+void GetSecondaryKeys(const rapidjson::Value& doc, const Slice& path,
+                      std::vector<std::string>* keys) {
+  ValueList values;
+  FindValues(doc, path, &values);
+  std::string key;
+  for (size_t i = 0; i < values.size(); i++) {
+    if (FormatKey(*values[i], &key)) {
+      AddUnique(key, keys);
+    }
+  }
+}
+
+bool HasSecondaryKey(const rapidjson::Value& doc, const Slice& path,
+                     const Slice& skey) {
+  ValueList values;
+  FindValues(doc, path, &values);
+  std::string key;
+  for (size_t i = 0; i < values.size(); i++) {
+    const rapidjson::Value& v = *values[i];
+    if (v.IsString()) {
+      // The common case: compare in place without formatting.
+      if (Slice(v.GetString(), v.GetStringLength()) == skey) {
+        return true;
+      }
+    } else if (FormatKey(v, &key) && Slice(key) == skey) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void AppendKeyComponent(std::string* dst, const Slice& value) {
+  // A NUL in the value becomes "\0\xff" and the component ends with
+  // "\0\x01", which sorts below any escaped byte.
+  for (size_t i = 0; i < value.size(); i++) {
+    dst->push_back(value[i]);
+    if (value[i] == '\0') {
+      dst->push_back('\xff');
+    }
+  }
+  dst->push_back('\0');
+  dst->push_back('\x01');
+}
+
+void GetCompositeSecondaryKeys(const rapidjson::Value& doc,
+                               const Slice& leading, const Slice& trailing,
+                               std::vector<std::string>* keys) {
+  std::vector<std::string> leading_keys;
+  GetSecondaryKeys(doc, leading, &leading_keys);
+  if (leading_keys.empty()) {
+    return;
+  }
+  std::vector<std::string> trailing_keys;
+  GetSecondaryKeys(doc, trailing, &trailing_keys);
+
+  std::string prefix, key;
+  for (size_t i = 0; i < leading_keys.size(); i++) {
+    prefix.clear();
+    AppendKeyComponent(&prefix, leading_keys[i]);
+    if (trailing_keys.empty()) {
+      AddUnique(prefix, keys);
+    }
+    for (size_t j = 0; j < trailing_keys.size(); j++) {
+      key = prefix;
+      AppendKeyComponent(&key, trailing_keys[j]);
+      AddUnique(key, keys);
+    }
+  }
+}
+
+Slice LeadingKeyComponent(const Slice& key) {
+  for (size_t i = 0; i + 1 < key.size(); i++) {
+    if (key[i] == '\0') {
+      if (key[i + 1] == '\x01') {
+        return Slice(key.data(), i + 2);
+      }
+      i++;  // Skip the escaped NUL
+    }
+  }
+  return key;
+}
+
+SecondaryKeyExtractor::~SecondaryKeyExtractor() { }
+
+namespace {
+
+const char kJsonExtractorName[] = "leveldb.JsonSecondaryKeyExtractor";
+
+class JsonSecondaryKeyExtractor : public SecondaryKeyExtractor {
+ public:
+  JsonSecondaryKeyExtractor(const std::string& leading,
+                            const std::string& trailing,
+                            const std::vector<std::string>& schema)
+      : leading_(leading), trailing_(trailing), schema_(schema) {
+    // Only these attributes of a binary document need decoding.
+    attributes_.push_back(TopLevelAttribute(leading).ToString());
+    if (!trailing.empty()) {
+      AddUnique(TopLevelAttribute(trailing).ToString(), &attributes_);
+    }
+  }
+
+  virtual const char* Name() const {
+    return kJsonExtractorName;
+  }
+
+  virtual void Extract(const Slice& value,
+                       std::vector<std::string>* keys) const {
+    rapidjson::Document doc;
+    if (!ReadDocument(schema_, value, &attributes_, &doc)) {
+      return;
+    }
+    if (trailing_.empty()) {
+      GetSecondaryKeys(doc, leading_, keys);
+    } else {
+      GetCompositeSecondaryKeys(doc, leading_, trailing_, keys);
+    }
+  }
+
+ private:
+  const std::string leading_;
+  const std::string trailing_;
+  const std::vector<std::string> schema_;
+  std::vector<std::string> attributes_;
+};
+
+}  // namespace
+
+const SecondaryKeyExtractor* NewJsonSecondaryKeyExtractor(
+    const std::string& attribute) {
+  return new JsonSecondaryKeyExtractor(attribute, "",
+                                       std::vector<std::string>());
+}
+
+const SecondaryKeyExtractor* NewJsonSecondaryKeyExtractor(
+    const std::string& leading, const std::string& trailing,
+    const std::vector<std::string>& schema) {
+  return new JsonSecondaryKeyExtractor(leading, trailing, schema);
+}
+
+void ExtractSecondaryKeys(const Options& options, const Slice& value,
+                          std::vector<std::string>* keys) {
+  if (options.secondary_key_extractor != NULL) {
+    options.secondary_key_extractor->Extract(value, keys);
+  } else if (!options.secondaryAtt.empty()) {
+    JsonSecondaryKeyExtractor extractor(options.secondaryAtt,
+                                        options.secondaryTrailingAtt,
+                                        options.document_schema);
+    extractor.Extract(value, keys);
+  }
+}
+
+void AppendIndexKey(const Options& options, const Slice& skey,
+                    std::string* dst) {
+  if (options.secondaryTrailingAtt.empty()) {
+    dst->append(skey.data(), skey.size());
+  } else {
+    AppendKeyComponent(dst, skey);
+  }
+}
+
+void GetIndexKeys(const Options& options,
+                  const std::vector<std::string>& keys,
+                  std::vector<std::string>* index_keys) {
+  const bool composite = !options.secondaryTrailingAtt.empty();
+  for (size_t i = 0; i < keys.size(); i++) {
+    const Slice key = composite ? LeadingKeyComponent(keys[i])
+                                : Slice(keys[i]);
+    if (std::find(index_keys->begin(), index_keys->end(), key) ==
+        index_keys->end()) {
+      index_keys->push_back(key.ToString());
+    }
+  }
+}
+
+bool HasIndexKey(const Options& options, const Slice& value,
+                 const Slice& index_key) {
+  const bool composite = !options.secondaryTrailingAtt.empty();
+  std::vector<std::string> keys;
+  ExtractSecondaryKeys(options, value, &keys);
+  for (size_t i = 0; i < keys.size(); i++) {
+    if ((composite ? LeadingKeyComponent(keys[i]) : Slice(keys[i])) ==
+        index_key) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IsJsonSecondaryKeyExtractor(const SecondaryKeyExtractor* extractor) {
+  return strcmp(extractor->Name(), kJsonExtractorName) == 0;
+}
+
+std::string SecondaryFilterBlockName(const Options& options) {
+  std::string name = "secondaryfilter.";
+  const SecondaryKeyExtractor* extractor = options.secondary_key_extractor;
+  if (extractor != NULL && !IsJsonSecondaryKeyExtractor(extractor)) {
+    name.append(extractor->Name());
+    name.push_back('.');
+  } else if (!options.secondaryTrailingAtt.empty()) {
+    name.append(options.secondaryAtt);
+    name.push_back('+');
+    name.append(options.secondaryTrailingAtt);
+    name.push_back('.');
+  }
+  name.append(options.filter_policy->Name());
+  return name;
+}
+
+// Append to *name the definition of the secondary index of "options".
+static void AppendIndexName(const Options& options, std::string* name) {
+  const SecondaryKeyExtractor* extractor = options.secondary_key_extractor;
+  if (extractor != NULL && !IsJsonSecondaryKeyExtractor(extractor)) {
+    name->append(extractor->Name());
+  } else {
+    name->append(options.secondaryAtt);
+    if (!options.secondaryTrailingAtt.empty()) {
+      name->push_back('+');
+      name->append(options.secondaryTrailingAtt);
+    }
+  }
+}
+
+std::string SecondaryStatsBlockName(const Options& options) {
+  // Named like the filter after the index, and after the attribute the
+  // statistics summarize.
+  std::string name = "secondarystats.";
+  AppendIndexName(options, &name);
+  name.push_back('.');
+  name.append(options.rankingAtt);
+  return name;
+}
+
+std::string SecondaryBitmapBlockName(const Options& options) {
+  std::string name = "secondarybitmap.";
+  AppendIndexName(options, &name);
+  return name;
+}
+
+std::string SecondaryPostingBlockName(const Options& options) {
+  std::string name = "secondaryposting.";
+  AppendIndexName(options, &name);
+  return name;
+}
+
+std::string SecondaryHashesBlockName(const Options& options) {
+  std::string name = "secondaryhashes.";
+  AppendIndexName(options, &name);
+  return name;
+}
+
+uint32_t SecondaryKeyHash(const Slice& index_key) {
+  return Hash(index_key.data(), index_key.size(), 0x5e3c4d2b);
+}
+
+bool RecordsKeyHashes(const Options& options) {
+  return options.secondary_key_extractor != NULL &&
+      (options.secondary_level_summaries ||
+       options.secondary_file_directory_keys > 0);
+}
+
+std::string SecondarySketchBlockName(const Options& options) {
+  std::string name = "secondarysketch.";
+  AppendIndexName(options, &name);
+  return name;
+}
+
+}  // namespace leveldb
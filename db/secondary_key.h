@@ -0,0 +1,132 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Extraction of secondary keys from JSON documents.  The secondary
+// attribute is a dot-separated path such as "user.country".  Arrays met
+// along the path or at its end are expanded element by element, so that
+// {"tags": ["a", "b"]} carries both "a" and "b" for the path "tags".
+// Scalars are formatted as by operator<< (booleans as "1" and "0");
+// nulls and objects carry no key.
+//
+// A composite index over a leading and a trailing attribute keys each
+// document by the encoded leading key followed by the encoded trailing
+// key.  Components are escaped and terminated so that the keys of one
+// leading value are contiguous in key order and share its encoding as a
+// prefix.
+
+#ifndef STORAGE_LEVELDB_DB_SECONDARY_KEY_H_
+#define STORAGE_LEVELDB_DB_SECONDARY_KEY_H_
+
+#include <string>
+#include <vector>
+#include "leveldb/options.h"
+#include "leveldb/secondary_key_extractor.h"
+#include "leveldb/slice.h"
+#include "rapidjson/document.h"
+
+namespace leveldb {
+
+// Parse the JSON document "value" into *doc without copying it into a
+// NUL-terminated string first.  Returns true iff it holds an object.
+extern bool ParseDocument(const Slice& value, rapidjson::Document* doc);
+
+// Append to *keys every secondary key "doc" carries for "path" that is
+// not in *keys already.
+extern void GetSecondaryKeys(const rapidjson::Value& doc, const Slice& path,
+                             std::vector<std::string>* keys);
+
+// Return true iff "doc" carries the secondary key "skey" for "path".
+extern bool HasSecondaryKey(const rapidjson::Value& doc, const Slice& path,
+                            const Slice& skey);
+
+// Append to *dst the composite key component for "value".
+extern void AppendKeyComponent(std::string* dst, const Slice& value);
+
+// Append to *keys every composite key "doc" carries for the index over
+// "leading" and "trailing" that is not in *keys already.  A document
+// with a leading key but no trailing key is keyed by the leading
+// component alone.
+extern void GetCompositeSecondaryKeys(const rapidjson::Value& doc,
+                                      const Slice& leading,
+                                      const Slice& trailing,
+                                      std::vector<std::string>* keys);
+
+// Return the leading component of the composite key "key".
+extern Slice LeadingKeyComponent(const Slice& key);
+
+// Return an extractor of the composite keys over "leading" and
+// "trailing", or of the keys of "leading" alone if "trailing" is empty,
+// from JSON text or from binary documents written under "schema".
+extern const SecondaryKeyExtractor* NewJsonSecondaryKeyExtractor(
+    const std::string& leading, const std::string& trailing,
+    const std::vector<std::string>& schema);
+
+// Append to *keys the secondary keys of the stored value "value" under
+// "options": those options.secondary_key_extractor takes, or else those
+// of options.secondaryAtt (and secondaryTrailingAtt), if set.
+extern void ExtractSecondaryKeys(const Options& options, const Slice& value,
+                                 std::vector<std::string>* keys);
+
+// Append to *dst the key under which the index of "options" holds the
+// documents whose secondary attribute (the leading one, for a composite
+// index) carries "skey".  For a composite index that key is the common
+// prefix of their composite keys.
+extern void AppendIndexKey(const Options& options, const Slice& skey,
+                           std::string* dst);
+
+// Append to *index_keys, without repeating one, the keys built by
+// AppendIndexKey() under which the index of "options" holds a value
+// whose secondary keys are "keys".
+extern void GetIndexKeys(const Options& options,
+                         const std::vector<std::string>& keys,
+                         std::vector<std::string>* index_keys);
+
+// Return true iff the stored value "value" is held by the index of
+// "options" under "index_key", as built by AppendIndexKey().
+extern bool HasIndexKey(const Options& options, const Slice& value,
+                        const Slice& index_key);
+
+// Return true iff "extractor" reads its keys from a JSON attribute, so
+// that the keys of a document can be checked on the parsed document.
+extern bool IsJsonSecondaryKeyExtractor(
+    const SecondaryKeyExtractor* extractor);
+
+// Return the name of the meta block holding the secondary filter of
+// tables built with "options", so that a table written for a different
+// index is not read with the wrong keys.
+extern std::string SecondaryFilterBlockName(const Options& options);
+
+// Return the name of the meta block holding the SecondaryStats (see
+// table/format.h) of tables built with "options".
+extern std::string SecondaryStatsBlockName(const Options& options);
+
+// Return the name of the meta block mapping each secondary key of tables
+// built with "options" to the bitmap of the data blocks holding it.
+extern std::string SecondaryBitmapBlockName(const Options& options);
+
+// Return the name of the meta block mapping the heavy-hitter secondary
+// keys of tables built with "options" to their posting lists.
+extern std::string SecondaryPostingBlockName(const Options& options);
+
+// Return the name of the meta block holding the count-min sketch of the
+// secondary keys of tables built with "options".
+extern std::string SecondarySketchBlockName(const Options& options);
+
+// Return the name of the meta block holding the set of hashes of the
+// secondary keys of tables built with "options".
+extern std::string SecondaryHashesBlockName(const Options& options);
+
+// The hash under which "index_key", as built by AppendIndexKey() or
+// entered in the secondary filters, is recorded in the key hash sets of
+// tables and levels (see Options::secondary_level_summaries).
+extern uint32_t SecondaryKeyHash(const Slice& index_key);
+
+// Return true iff tables built with "options" record the hashes of their
+// secondary keys, for Options::secondary_level_summaries or
+// Options::secondary_file_directory_keys.
+extern bool RecordsKeyHashes(const Options& options);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_SECONDARY_KEY_H_
@@ -0,0 +1,166 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/secondary_key.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static std::string Keys(const std::string& json, const std::string& path) {
+  rapidjson::Document doc;
+  if (!ParseDocument(json, &doc)) {
+    return "(not an object)";
+  }
+  std::vector<std::string> keys;
+  GetSecondaryKeys(doc, path, &keys);
+  std::string result;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i > 0) result.append(",");
+    result.append(keys[i]);
+  }
+  return result;
+}
+
+static bool Has(const std::string& json, const std::string& path,
+                const std::string& skey) {
+  rapidjson::Document doc;
+  return ParseDocument(json, &doc) && HasSecondaryKey(doc, path, skey);
+}
+
+class SecondaryKeyTest { };
+
+TEST(SecondaryKeyTest, Scalars) {
+  ASSERT_EQ("u1", Keys("{\"a\": \"u1\"}", "a"));
+  ASSERT_EQ("42", Keys("{\"a\": 42}", "a"));
+  ASSERT_EQ("-7", Keys("{\"a\": -7}", "a"));
+  ASSERT_EQ("1.5", Keys("{\"a\": 1.5}", "a"));
+  ASSERT_EQ("1", Keys("{\"a\": true}", "a"));
+  ASSERT_EQ("", Keys("{\"a\": null}", "a"));
+  ASSERT_EQ("", Keys("{\"a\": {\"b\": 1}}", "a"));
+  ASSERT_EQ("", Keys("{\"b\": 1}", "a"));
+  ASSERT_EQ("(not an object)", Keys("[1, 2]", "a"));
+  ASSERT_EQ("(not an object)", Keys("{\"a\": ", "a"));
+}
+
+TEST(SecondaryKeyTest, Arrays) {
+  ASSERT_EQ("a,b", Keys("{\"tags\": [\"a\", \"b\", \"a\"]}", "tags"));
+  ASSERT_EQ("1,x,2", Keys("{\"tags\": [1, [\"x\", 2], null, {}]}", "tags"));
+  ASSERT_EQ("", Keys("{\"tags\": []}", "tags"));
+}
+
+TEST(SecondaryKeyTest, Paths) {
+  ASSERT_EQ("nz", Keys("{\"user\": {\"country\": \"nz\"}}", "user.country"));
+  ASSERT_EQ("", Keys("{\"user\": \"nz\"}", "user.country"));
+  ASSERT_EQ("", Keys("{\"user.country\": \"nz\"}", "user.country"));
+  ASSERT_EQ("s1,s2",
+            Keys("{\"items\": [{\"sku\": \"s1\"}, {\"sku\": \"s2\"}, 3]}",
+                 "items.sku"));
+  ASSERT_EQ("x,y", Keys("{\"a\": {\"b\": {\"c\": [\"x\", \"y\"]}}}", "a.b.c"));
+}
+
+TEST(SecondaryKeyTest, HasSecondaryKey) {
+  const std::string doc =
+      "{\"tags\": [\"red\", 5], \"user\": {\"country\": \"nz\"}}";
+  ASSERT_TRUE(Has(doc, "tags", "red"));
+  ASSERT_TRUE(Has(doc, "tags", "5"));
+  ASSERT_TRUE(!Has(doc, "tags", "blue"));
+  ASSERT_TRUE(Has(doc, "user.country", "nz"));
+  ASSERT_TRUE(!Has(doc, "user", "nz"));
+}
+
+static std::string Component(const std::string& value) {
+  std::string result;
+  AppendKeyComponent(&result, value);
+  return result;
+}
+
+TEST(SecondaryKeyTest, CompositeComponents) {
+  ASSERT_EQ(std::string("ab\0\x01", 4), Component("ab"));
+  ASSERT_EQ(std::string("a\0\xff\0\x01", 5), Component(std::string("a\0", 2)));
+
+  // Keys of one leading value are contiguous and ordered by the trailing
+  // value, even when one leading value is a prefix of another.
+  const std::string a_x = Component("a") + Component("x");
+  const std::string a_y = Component("a") + Component("y");
+  const std::string ab = Component("ab") + Component("");
+  const std::string a_nul = Component(std::string("a\0", 2));
+  ASSERT_LT(a_x, a_y);
+  ASSERT_LT(a_y, a_nul);
+  ASSERT_LT(a_nul, ab);
+  ASSERT_TRUE(Slice(a_x).starts_with(Component("a")));
+  ASSERT_TRUE(!Slice(ab).starts_with(Component("a")));
+  ASSERT_EQ(a_nul, LeadingKeyComponent(a_nul + Component("x")).ToString());
+}
+
+TEST(SecondaryKeyTest, CompositeKeys) {
+  rapidjson::Document doc;
+  ASSERT_TRUE(ParseDocument(
+      "{\"t\": [\"a\", \"b\"], \"s\": [1, 2], \"u\": \"x\"}", &doc));
+  std::vector<std::string> keys;
+  GetCompositeSecondaryKeys(doc, "t", "s", &keys);
+  ASSERT_EQ(4, keys.size());
+  ASSERT_EQ(Component("a") + Component("1"), keys[0]);
+  ASSERT_EQ(Component("b") + Component("2"), keys[3]);
+  ASSERT_EQ(Component("b"), LeadingKeyComponent(keys[3]).ToString());
+
+  // Without a trailing key a document is keyed by its leading component.
+  keys.clear();
+  GetCompositeSecondaryKeys(doc, "u", "missing", &keys);
+  ASSERT_EQ(1, keys.size());
+  ASSERT_EQ(Component("x"), keys[0]);
+
+  keys.clear();
+  GetCompositeSecondaryKeys(doc, "missing", "s", &keys);
+  ASSERT_TRUE(keys.empty());
+}
+
+TEST(SecondaryKeyTest, JsonExtractor) {
+  const SecondaryKeyExtractor* plain = NewJsonSecondaryKeyExtractor("t");
+  const SecondaryKeyExtractor* composite =
+      NewJsonSecondaryKeyExtractor("t", "s", std::vector<std::string>());
+  ASSERT_TRUE(IsJsonSecondaryKeyExtractor(plain));
+
+  std::vector<std::string> keys;
+  plain->Extract("{\"t\": [\"a\", \"b\"], \"s\": 1}", &keys);
+  ASSERT_EQ(2, keys.size());
+  ASSERT_EQ("b", keys[1]);
+
+  keys.clear();
+  composite->Extract("{\"t\": \"a\", \"s\": 1}", &keys);
+  ASSERT_EQ(1, keys.size());
+  ASSERT_EQ(Component("a") + Component("1"), keys[0]);
+
+  keys.clear();
+  plain->Extract("not json", &keys);
+  ASSERT_TRUE(keys.empty());
+
+  delete composite;
+  delete plain;
+}
+
+TEST(SecondaryKeyTest, IndexKeys) {
+  Options options;
+  options.secondaryAtt = "t";
+  std::string key;
+  AppendIndexKey(options, "a", &key);
+  ASSERT_EQ("a", key);
+  ASSERT_TRUE(HasIndexKey(options, "{\"t\": [\"b\", \"a\"]}", key));
+  ASSERT_TRUE(!HasIndexKey(options, "{\"t\": \"ab\"}", key));
+  ASSERT_TRUE(!HasIndexKey(options, "", key));
+
+  // A composite index matches on the leading component.
+  options.secondaryTrailingAtt = "s";
+  key.clear();
+  AppendIndexKey(options, "a", &key);
+  ASSERT_EQ(Component("a"), key);
+  ASSERT_TRUE(HasIndexKey(options, "{\"t\": \"a\", \"s\": 1}", key));
+  ASSERT_TRUE(HasIndexKey(options, "{\"t\": \"a\"}", key));
+  ASSERT_TRUE(!HasIndexKey(options, "{\"t\": \"b\", \"s\": \"a\"}", key));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
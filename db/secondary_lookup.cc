@@ -0,0 +1,609 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/secondary_lookup.h"
+
+#include <string.h>
+#include <algorithm>
+#include "db/db_impl.h"
+#include "db/document.h"
+#include "db/range_tombstone.h"
+#include "db/secondary_key.h"
+#include "table/filter_block.h"
+#include "leveldb/env.h"
+#include "util/coding.h"
+#include "util/roaring_bitmap.h"
+
+namespace leveldb {
+
+SecondaryResultSet::SecondaryResultSet() : cleanup_(NULL) { }
+
+SecondaryResultSet::~SecondaryResultSet() {
+  RunCleanups();
+}
+
+void SecondaryResultSet::Clear() {
+  results_.clear();
+  resume_cursor_.clear();
+  RunCleanups();
+}
+
+void SecondaryResultSet::RegisterCleanup(CleanupFunction func,
+                                         void* arg1, void* arg2) {
+  assert(func != NULL);
+  Cleanup* c = new Cleanup;
+  c->function = func;
+  c->arg1 = arg1;
+  c->arg2 = arg2;
+  c->next = cleanup_;
+  cleanup_ = c;
+}
+
+void SecondaryResultSet::RunCleanups() {
+  while (cleanup_ != NULL) {
+    Cleanup* c = cleanup_;
+    cleanup_ = c->next;
+    (*c->function)(c->arg1, c->arg2);
+    delete c;
+  }
+}
+
+namespace {
+
+// Mark "node" as answerable from the index under "key".
+void SetIndexKey(const std::string& key, SecondaryQueryNode* node) {
+  node->indexed = true;
+  node->index_key = key;
+  // The secondary filters hold keys with an internal key tag appended.
+  AppendInternalKey(&node->filter_key,
+                    ParsedInternalKey(key, kMaxSequenceNumber,
+                                      kValueTypeForSeek));
+}
+
+void Prepare(const SecondaryQuery& query, const std::string& leading,
+             const std::string& trailing, SecondaryQueryNode* node) {
+  node->op = query.op();
+  node->indexed = false;
+  if (query.op() == SecondaryQuery::kEquals) {
+    node->attribute = query.attribute();
+    node->value = query.value();
+    if (!leading.empty() && query.attribute() == leading) {
+      if (trailing.empty()) {
+        SetIndexKey(node->value, node);
+      } else {
+        std::string prefix;
+        AppendKeyComponent(&prefix, node->value);
+        SetIndexKey(prefix, node);
+      }
+    }
+    return;
+  }
+  const std::vector<SecondaryQuery>& children = query.children();
+  node->children.resize(children.size());
+  const SecondaryQueryNode* lead = NULL;
+  const SecondaryQueryNode* trail = NULL;
+  for (size_t i = 0; i < children.size(); i++) {
+    SecondaryQueryNode* child = &node->children[i];
+    Prepare(children[i], leading, trailing, child);
+    if (child->op == SecondaryQuery::kEquals && !trailing.empty()) {
+      if (lead == NULL && child->attribute == leading) lead = child;
+      if (trail == NULL && child->attribute == trailing) trail = child;
+    }
+  }
+  if (node->op == SecondaryQuery::kAnd && lead != NULL && trail != NULL) {
+    // Both attributes of the composite index are fixed: the conjunction
+    // has an exact composite key.
+    std::string key;
+    AppendKeyComponent(&key, lead->value);
+    AppendKeyComponent(&key, trail->value);
+    SetIndexKey(key, node);
+  }
+}
+
+// A stored value under evaluation, parsed or split into keys only when
+// a term needs it.
+class Candidate {
+ public:
+  Candidate(const Slice& value, const SecondaryKeyExtractor* extractor,
+            const std::vector<std::string>* schema)
+      : value_(value), extractor_(extractor), schema_(schema),
+        parsed_(false), is_document_(false), extracted_(false) { }
+
+  // Return the value as a JSON document, or NULL if it is not one.
+  const rapidjson::Document* document() {
+    if (!parsed_) {
+      is_document_ = ReadDocument(*schema_, value_, NULL, &doc_);
+      parsed_ = true;
+    }
+    return is_document_ ? &doc_ : NULL;
+  }
+
+  // Return true iff the value carries the index key "key".
+  bool HasKey(const std::string& key) {
+    if (!extracted_) {
+      extractor_->Extract(value_, &keys_);
+      extracted_ = true;
+    }
+    return std::find(keys_.begin(), keys_.end(), key) != keys_.end();
+  }
+
+ private:
+  const Slice value_;
+  const SecondaryKeyExtractor* const extractor_;
+  const std::vector<std::string>* const schema_;
+  bool parsed_;
+  bool is_document_;
+  bool extracted_;
+  rapidjson::Document doc_;
+  std::vector<std::string> keys_;
+};
+
+bool Evaluate(const SecondaryQueryNode& node,
+              const SecondaryKeyExtractor* extractor, Candidate* value) {
+  switch (node.op) {
+    case SecondaryQuery::kEquals: {
+      if (node.indexed && extractor != NULL) {
+        return value->HasKey(node.index_key);
+      }
+      const rapidjson::Document* doc = value->document();
+      return doc != NULL && HasSecondaryKey(*doc, node.attribute, node.value);
+    }
+    case SecondaryQuery::kAnd:
+      for (size_t i = 0; i < node.children.size(); i++) {
+        if (!Evaluate(node.children[i], extractor, value)) return false;
+      }
+      return true;
+    case SecondaryQuery::kOr:
+      for (size_t i = 0; i < node.children.size(); i++) {
+        if (Evaluate(node.children[i], extractor, value)) return true;
+      }
+      return false;
+  }
+  return false;
+}
+
+bool Cover(const SecondaryQueryNode& node, std::vector<std::string>* keys) {
+  switch (node.op) {
+    case SecondaryQuery::kEquals:
+      if (!node.indexed) return false;
+      keys->push_back(node.index_key);
+      return true;
+    case SecondaryQuery::kAnd:
+      if (node.indexed) {
+        keys->push_back(node.index_key);
+        return true;
+      }
+      // Any conjunct that is covered covers the whole conjunction.
+      for (size_t i = 0; i < node.children.size(); i++) {
+        std::vector<std::string> child_keys;
+        if (Cover(node.children[i], &child_keys)) {
+          keys->insert(keys->end(), child_keys.begin(), child_keys.end());
+          return true;
+        }
+      }
+      return false;
+    case SecondaryQuery::kOr:
+      for (size_t i = 0; i < node.children.size(); i++) {
+        if (!Cover(node.children[i], keys)) return false;
+      }
+      return true;
+  }
+  return false;
+}
+
+bool MayMatch(const SecondaryQueryNode& node, FilterBlockReader* filter,
+              uint64_t offset) {
+  switch (node.op) {
+    case SecondaryQuery::kEquals:
+      return !node.indexed || filter->KeyMayMatch(offset, node.filter_key);
+    case SecondaryQuery::kAnd:
+      if (node.indexed && !filter->KeyMayMatch(offset, node.filter_key)) {
+        return false;
+      }
+      for (size_t i = 0; i < node.children.size(); i++) {
+        if (!MayMatch(node.children[i], filter, offset)) return false;
+      }
+      return true;
+    case SecondaryQuery::kOr:
+      for (size_t i = 0; i < node.children.size(); i++) {
+        if (MayMatch(node.children[i], filter, offset)) return true;
+      }
+      return false;
+  }
+  return true;
+}
+
+// Store in *blocks the bitmap of "key" in the bitmap block read by
+// "bitmaps", or an empty one if the block lacks the key.  Returns false
+// if the bitmap cannot be decoded.
+bool GetBlockBitmap(Iterator* bitmaps, const Slice& key,
+                    RoaringBitmap* blocks) {
+  blocks->Clear();
+  bitmaps->Seek(key);
+  if (!bitmaps->Valid() || bitmaps->key() != key) {
+    return bitmaps->status().ok();
+  }
+  Slice input = bitmaps->value();
+  return blocks->DecodeFrom(&input);
+}
+
+// Return whether a document satisfying "node" may be found among
+// entries whose secondary keys hash into "hashes".  Leaves that are not
+// indexed may match anything.
+bool HashesMayMatch(const SecondaryQueryNode& node,
+                    const RoaringBitmap& hashes) {
+  switch (node.op) {
+    case SecondaryQuery::kEquals:
+      return !node.indexed ||
+          hashes.Contains(SecondaryKeyHash(node.index_key));
+    case SecondaryQuery::kAnd:
+      if (node.indexed && !hashes.Contains(SecondaryKeyHash(node.index_key))) {
+        return false;
+      }
+      for (size_t i = 0; i < node.children.size(); i++) {
+        if (!HashesMayMatch(node.children[i], hashes)) return false;
+      }
+      return true;
+    case SecondaryQuery::kOr:
+      for (size_t i = 0; i < node.children.size(); i++) {
+        if (HashesMayMatch(node.children[i], hashes)) return true;
+      }
+      return false;
+  }
+  return true;
+}
+
+bool BlocksMatching(const SecondaryQueryNode& node, Iterator* bitmaps,
+                    RoaringBitmap* blocks) {
+  switch (node.op) {
+    case SecondaryQuery::kEquals:
+      return node.indexed && GetBlockBitmap(bitmaps, node.index_key, blocks);
+    case SecondaryQuery::kAnd: {
+      bool narrowed = node.indexed &&
+          GetBlockBitmap(bitmaps, node.index_key, blocks);
+      RoaringBitmap child;
+      for (size_t i = 0; i < node.children.size(); i++) {
+        if (!BlocksMatching(node.children[i], bitmaps, &child)) {
+          continue;
+        }
+        if (narrowed) {
+          blocks->IntersectWith(child);
+        } else {
+          blocks->Swap(&child);
+          narrowed = true;
+        }
+      }
+      return narrowed;
+    }
+    case SecondaryQuery::kOr: {
+      blocks->Clear();
+      RoaringBitmap child;
+      for (size_t i = 0; i < node.children.size(); i++) {
+        if (!BlocksMatching(node.children[i], bitmaps, &child)) {
+          return false;
+        }
+        blocks->UnionWith(child);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+// Validation compares the stored bytes of a record, so its reads must
+// not convert documents.
+ReadOptions ValidationOptions(const ReadOptions& options) {
+  ReadOptions result = options;
+  result.json_documents = false;
+  return result;
+}
+
+}  // namespace
+
+SecondaryLookup::SecondaryLookup(DBImpl* db, Env* env,
+                                 const Options& db_options,
+                                 const ReadOptions& options,
+                                 const SecondaryQuery& query,
+                                 SequenceNumber snapshot, int k,
+                                 SecondaryResultSet* result)
+    : db_(db),
+      options_(ValidationOptions(options)),
+      composite_(!db_options.secondaryTrailingAtt.empty()),
+      merges_(db_options.merge_operator != NULL),
+      extractor_(db_options.secondary_key_extractor != NULL &&
+                 !IsJsonSecondaryKeyExtractor(
+                     db_options.secondary_key_extractor)
+                 ? db_options.secondary_key_extractor : NULL),
+      schema_(&db_options.document_schema),
+      range_tombstones_(NULL),
+      snapshot_(snapshot),
+      min_sequence_(options.min_sequence),
+      max_sequence_(std::min<SequenceNumber>(options.max_sequence, snapshot)),
+      ranking_attribute_(options.ranking_attribute),
+      better_(!options.ranking_attribute.empty(), options.ranking_ascending),
+      k_(k),
+      result_(result),
+      heap_(result->mutable_results()),
+      key_arena_(NULL),
+      env_(env),
+      max_blocks_(options.max_blocks_read),
+      max_files_(options.max_files_probed),
+      deadline_(options.max_micros > 0
+                ? env->NowMicros() + options.max_micros : 0),
+      blocks_read_(0),
+      files_probed_(0),
+      incomplete_(false),
+      block_unmatched_(false),
+      level_(-1),
+      file_(0),
+      stop_offset_(0),
+      resume_level_(-1),
+      resume_file_(0),
+      resume_offset_(0),
+      bad_cursor_(false) {
+  assert(heap_->empty());
+  heap_->reserve(k > 0 ? k : 0);
+  Prepare(query, db_options.secondaryAtt, db_options.secondaryTrailingAtt,
+          &query_);
+
+  if (!options.resume_cursor.empty()) {
+    Slice input(options.resume_cursor);
+    uint32_t level;
+    if (GetVarint32(&input, &level) &&
+        GetVarint64(&input, &resume_file_) &&
+        GetVarint64(&input, &resume_offset_) &&
+        input.empty() &&
+        level < static_cast<uint32_t>(config::kNumLevels)) {
+      resume_level_ = level;
+    } else {
+      bad_cursor_ = true;
+    }
+  }
+}
+
+bool SecondaryLookup::SkipFile(int level, uint64_t number) const {
+  // Files of a level are probed newest (highest numbered) first.
+  return level < resume_level_ ||
+      (level == resume_level_ && number > resume_file_);
+}
+
+bool SecondaryLookup::SkipBlock(uint64_t offset) const {
+  return level_ == resume_level_ && file_ == resume_file_ &&
+      offset < resume_offset_;
+}
+
+bool SecondaryLookup::AnyBlockOrder() const {
+  return max_blocks_ <= 0 && deadline_ == 0 &&
+      !(level_ == resume_level_ && file_ == resume_file_);
+}
+
+bool SecondaryLookup::StartFile(int level, uint64_t number) {
+  assert(!incomplete_);
+  level_ = level;
+  file_ = number;
+  if ((max_files_ > 0 && files_probed_ >= max_files_) ||
+      (deadline_ > 0 && env_->NowMicros() >= deadline_)) {
+    incomplete_ = true;
+    stop_offset_ = 0;
+    return false;
+  }
+  files_probed_++;
+  return true;
+}
+
+bool SecondaryLookup::StartBlock(uint64_t offset) {
+  assert(!incomplete_);
+  if ((max_blocks_ > 0 && blocks_read_ >= max_blocks_) ||
+      (deadline_ > 0 && env_->NowMicros() >= deadline_)) {
+    incomplete_ = true;
+    stop_offset_ = offset;
+    return false;
+  }
+  blocks_read_++;
+  block_unmatched_ = true;
+  return true;
+}
+
+bool SecondaryLookup::Matches(const Slice& value, double* rank) const {
+  Candidate candidate(value, extractor_, schema_);
+  if (!Evaluate(query_, extractor_, &candidate)) {
+    return false;
+  }
+
+  *rank = 0;
+  if (ranked()) {
+    const rapidjson::Document* doc = candidate.document();
+    const char* rankAtt = ranking_attribute_.c_str();
+    if (doc == NULL || !doc->HasMember(rankAtt) ||
+        !(*doc)[rankAtt].IsNumber()) {
+      return false;
+    }
+    *rank = (*doc)[rankAtt].GetDouble();
+  }
+  return true;
+}
+
+bool SecondaryLookup::CoveringKeys(std::vector<std::string>* keys) const {
+  keys->clear();
+  if (!Cover(query_, keys)) {
+    return false;
+  }
+  std::sort(keys->begin(), keys->end());
+  keys->erase(std::unique(keys->begin(), keys->end()), keys->end());
+  return true;
+}
+
+bool SecondaryLookup::BlockMayMatch(FilterBlockReader* filter,
+                                    uint64_t offset) const {
+  return filter == NULL || MayMatch(query_, filter, offset);
+}
+
+bool SecondaryLookup::MatchingBlocks(Iterator* bitmaps,
+                                     RoaringBitmap* blocks) const {
+  return BlocksMatching(query_, bitmaps, blocks);
+}
+
+bool SecondaryLookup::MayMatchKeyHashes(const RoaringBitmap& hashes) const {
+  return HashesMayMatch(query_, hashes);
+}
+
+bool SecondaryLookup::MayMatchFile(SequenceNumber smallest_seq,
+                                   SequenceNumber largest_seq) const {
+  if (largest_seq < min_sequence_ || smallest_seq > max_sequence_) {
+    return false;
+  }
+  // Everything in the file may be older than the oldest hit.
+  return !OlderThanResults(largest_seq);
+}
+
+bool SecondaryLookup::MayImproveRank(double min, double max) const {
+  if (min > max) {
+    return false;
+  }
+  if (!Full()) {
+    return true;
+  }
+  // Ties on the ranking value are broken by recency, so a document equal
+  // to the worst hit can still displace it.
+  const double worst = heap_->front().rank_value;
+  return better_.ascending ? min <= worst : max >= worst;
+}
+
+static void DeleteArena(void* arg1, void* arg2) {
+  delete reinterpret_cast<Arena*>(arg1);
+}
+
+bool SecondaryLookup::Offer(const Slice& pkey, const Slice& value,
+                            SequenceNumber seq, double rank, bool validate,
+                            bool copy_key) {
+  if (k_ <= 0 || keys_found_.find(pkey) != keys_found_.end()) {
+    return false;
+  }
+  if (range_tombstones_ != NULL &&
+      range_tombstones_->Covers(pkey, seq, snapshot_)) {
+    return false;
+  }
+  SKeyPinnedVal hit;
+  hit.value = value;
+  hit.sequence_number = seq;
+  hit.rank_value = rank;
+  if (Full() && !better_(hit, heap_->front())) {
+    return false;
+  }
+  if (validate) {
+    // Only the live version of a record may be returned: an older
+    // version of pkey can still carry the secondary key after the record
+    // itself was updated, even to the same bytes, or deleted.
+    SequenceNumber live;
+    Status st = db_->GetLive(options_, pkey, &scratch_, &live);
+    if (!st.ok()) {
+      return false;
+    }
+    if (live != seq || Slice(scratch_) != value) {
+      // Merge operands written since leave the record live, though
+      // changed: its merged form is returned if it still matches.
+      if (!merges_ || !Matches(scratch_, &hit.rank_value) ||
+          (Full() && !better_(hit, heap_->front()))) {
+        return false;
+      }
+      hit.value = Copy(scratch_);
+    }
+  }
+
+  if (Full()) {
+    std::pop_heap(heap_->begin(), heap_->end(), better_);
+    keys_found_.erase(heap_->back().key);
+    heap_->pop_back();
+  }
+  if (copy_key) {
+    hit.key = Copy(pkey);
+  } else {
+    hit.key = pkey;
+  }
+  heap_->push_back(hit);
+  std::push_heap(heap_->begin(), heap_->end(), better_);
+  keys_found_.insert(hit.key);
+  return true;
+}
+
+Slice SecondaryLookup::Copy(const Slice& s) {
+  if (key_arena_ == NULL) {
+    key_arena_ = new Arena;
+    result_->RegisterCleanup(&DeleteArena, key_arena_, NULL);
+  }
+  char* buf = key_arena_->Allocate(s.size() > 0 ? s.size() : 1);
+  memcpy(buf, s.data(), s.size());
+  return Slice(buf, s.size());
+}
+
+void SecondaryLookup::OfferMerged(const Slice& pkey, SequenceNumber seq) {
+  if (k_ <= 0 || keys_found_.find(pkey) != keys_found_.end() ||
+      !db_->Get(options_, pkey, &scratch_).ok()) {
+    return;
+  }
+  SKeyPinnedVal hit;
+  hit.sequence_number = seq;
+  if (!Matches(scratch_, &hit.rank_value) ||
+      (Full() && !better_(hit, heap_->front()))) {
+    return;
+  }
+  Offer(pkey, Copy(scratch_), seq, hit.rank_value, false, true);
+}
+
+void SecondaryLookup::OfferLive(const Slice& pkey, SequenceNumber seq) {
+  SequenceNumber live;
+  if (k_ <= 0 || keys_found_.find(pkey) != keys_found_.end() ||
+      !db_->GetLive(options_, pkey, &scratch_, &live).ok() || live != seq) {
+    return;
+  }
+  SKeyPinnedVal hit;
+  hit.sequence_number = seq;
+  if (!Matches(scratch_, &hit.rank_value) ||
+      (Full() && !better_(hit, heap_->front()))) {
+    return;
+  }
+  Offer(pkey, Copy(scratch_), seq, hit.rank_value, false, true);
+}
+
+bool SecondaryLookup::SaveTableEntry(const Slice& ikey, const Slice& value) {
+  ParsedInternalKey parsed_key;
+  if (!ParseInternalKey(ikey, &parsed_key)) {
+    block_unmatched_ = false;
+    return false;
+  }
+  if (parsed_key.type == kTypeDeletion) {
+    return false;
+  }
+  if (!InWindow(parsed_key.sequence) ||
+      OlderThanResults(parsed_key.sequence)) {
+    // Cannot enter the heap; skip the JSON parse.
+    block_unmatched_ = false;
+    return false;
+  }
+  if (parsed_key.type == kTypeMerge) {
+    block_unmatched_ = false;
+    OfferMerged(parsed_key.user_key, parsed_key.sequence);
+    return false;  // Nothing points into the block
+  }
+  double rank;
+  if (!Matches(value, &rank)) {
+    return false;
+  }
+  block_unmatched_ = false;
+  return Offer(parsed_key.user_key, value, parsed_key.sequence, rank,
+               true, true);
+}
+
+void SecondaryLookup::Finish() {
+  std::sort_heap(heap_->begin(), heap_->end(), better_);
+  if (incomplete_) {
+    std::string cursor;
+    PutVarint32(&cursor, level_);
+    PutVarint64(&cursor, file_);
+    PutVarint64(&cursor, stop_offset_);
+    result_->set_resume_cursor(cursor);
+  }
+}
+
+}  // namespace leveldb
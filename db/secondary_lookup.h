@@ -0,0 +1,280 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// State of a single top-K secondary lookup.  The same SecondaryLookup is
+// handed to the memtables, Version::Get and Table::InternalGet so that
+// every phase feeds one heap.  Hits are kept as Slices into memory pinned
+// by the caller's SecondaryResultSet.
+
+#ifndef STORAGE_LEVELDB_DB_SECONDARY_LOOKUP_H_
+#define STORAGE_LEVELDB_DB_SECONDARY_LOOKUP_H_
+
+#include <string>
+#include <unordered_set>
+#include "db/dbformat.h"
+#include "leveldb/db.h"
+#include "leveldb/options.h"
+#include "leveldb/secondary_query.h"
+#include "util/arena.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+class DBImpl;
+class Env;
+class FilterBlockReader;
+class RangeTombstoneList;
+class RoaringBitmap;
+
+struct SliceHash {
+  size_t operator()(const Slice& s) const {
+    return Hash(s.data(), s.size(), 0);
+  }
+};
+
+// A SecondaryQuery prepared for evaluation.
+struct SecondaryQueryNode {
+  SecondaryQuery::Op op;
+  std::string attribute;                    // kEquals only
+  std::string value;                        // kEquals only
+  bool indexed;                             // answerable from the index
+  std::string index_key;                    // key (or prefix) in the index
+  std::string filter_key;                   // index_key as an internal key
+  std::vector<SecondaryQueryNode> children;
+};
+
+class SecondaryLookup {
+ public:
+  // Look up the documents satisfying "query", of which terms on
+  // db_options.secondaryAtt can be answered from the secondary filters
+  // and memtable postings.  If db_options.secondaryTrailingAtt is set the
+  // index is a composite one over both attributes: terms on secondaryAtt
+  // become prefix lookups, and conjunctions that fix both attributes are
+  // answered by the composite key.  "result" must be empty and must
+  // outlive this object.  Entries newer than "snapshot" or outside the
+  // sequence window of "options" are ignored.
+  SecondaryLookup(DBImpl* db, Env* env, const Options& db_options,
+                  const ReadOptions& options, const SecondaryQuery& query,
+                  SequenceNumber snapshot, int k,
+                  SecondaryResultSet* result);
+
+  // True iff options.resume_cursor could not be parsed.
+  bool bad_cursor() const { return bad_cursor_; }
+
+  // True iff this lookup continues an earlier one, in which case the
+  // memtables have already been read.
+  bool resuming() const { return resume_level_ >= 0; }
+
+  // Return true iff the earlier lookup being resumed already probed
+  // file "number" of "level", or the block at "offset" of the current
+  // file.
+  bool SkipFile(int level, uint64_t number) const;
+  bool SkipBlock(uint64_t offset) const;
+
+  // Charge the probe of a file, or the read of one of its data blocks,
+  // against the budget of ReadOptions.  Return false, and mark the lookup
+  // incomplete, if the budget is spent and the file or block must not be
+  // read.
+  bool StartFile(int level, uint64_t number);
+  bool StartBlock(uint64_t offset);
+
+  // True iff the data blocks of the current file may be read in any
+  // order rather than by increasing offset: no budget can stop the
+  // lookup among them, and it does not resume inside the file.
+  bool AnyBlockOrder() const;
+
+  // True iff the budget ran out before the lookup finished.
+  bool incomplete() const { return incomplete_; }
+
+  // True iff every entry offered from the data block last started was
+  // checked against the query, and none satisfied it.
+  bool BlockUnmatched() const { return block_unmatched_; }
+
+  SequenceNumber snapshot() const { return snapshot_; }
+  SequenceNumber min_sequence() const { return min_sequence_; }
+  SecondaryResultSet* result() const { return result_; }
+
+  // True once K hits have been collected.
+  bool Full() const { return heap_->size() >= static_cast<size_t>(k_); }
+
+  // True iff hits are ranked by a document attribute rather than by
+  // recency.
+  bool ranked() const { return !ranking_attribute_.empty(); }
+  const std::string& ranking_attribute() const { return ranking_attribute_; }
+
+  // True once entries older than all those offered so far cannot
+  // improve the result (as when the memtables are done with).
+  bool Done() const { return Full() && !ranked(); }
+
+  // True iff nothing written at or before "seq" can enter the result.
+  bool OlderThanResults(SequenceNumber seq) const {
+    return !ranked() && Full() && seq <= heap_->front().sequence_number;
+  }
+
+  // Return false if no document whose ranking attribute lies in
+  // [min, max] can enter the result.  An empty range (min > max) never
+  // can.
+  bool MayImproveRank(double min, double max) const;
+
+  // True iff a hit at sequence "seq" falls in the requested window.
+  bool InWindow(SequenceNumber seq) const {
+    return seq >= min_sequence_ && seq <= max_sequence_;
+  }
+
+  // Return false if no entry with sequence numbers in
+  // [smallest_seq, largest_seq] can enter the result, so that a table
+  // file with that range need not be read.
+  bool MayMatchFile(SequenceNumber smallest_seq,
+                    SequenceNumber largest_seq) const;
+
+  // Return true iff "value" satisfies the query (and, if ranked(), is a
+  // JSON document with a numeric ranking attribute, which is stored in
+  // *rank).  Terms on the indexed attribute are checked against the keys
+  // of the secondary key extractor; other terms need a JSON document.
+  bool Matches(const Slice& value, double* rank) const;
+
+  // If every match carries one of a set of indexed secondary keys, store
+  // them in *keys and return true.  Otherwise return false: the query
+  // can only be answered by examining every document.  For a composite
+  // index the keys are prefixes of the index keys (see composite()).
+  bool CoveringKeys(std::vector<std::string>* keys) const;
+
+  // True iff the index is a composite one, whose keys are encoded by
+  // GetCompositeSecondaryKeys().
+  bool composite() const { return composite_; }
+
+  // Return false if the secondary filter of the data block at "offset"
+  // shows that no entry of the block can satisfy the query.  "filter"
+  // may be NULL.
+  bool BlockMayMatch(FilterBlockReader* filter, uint64_t offset) const;
+
+  // Store in *blocks the ordinals of the data blocks of a table that may
+  // hold a document satisfying the query, from the table's secondary
+  // bitmaps read by "bitmaps" (see kSecondaryBitmapIndex).  Returns false
+  // if some term cannot be answered by them, so that every block may.
+  bool MatchingBlocks(Iterator* bitmaps, RoaringBitmap* blocks) const;
+
+  // Return false if "hashes", the hashes of the secondary keys of some
+  // table files (see SecondaryKeyHash()), show that none of them holds
+  // an entry satisfying the query.
+  bool MayMatchKeyHashes(const RoaringBitmap& hashes) const;
+
+  // Hits deleted by one of "*tombstones" are rejected.  The list must
+  // outlive the lookup.
+  void set_range_tombstones(const RangeTombstoneList* tombstones) {
+    range_tombstones_ = tombstones;
+  }
+
+  // Offer the document "value" stored under primary key "pkey" at
+  // sequence "seq" with ranking value "rank".  If "validate" is set the
+  // hit is only taken when it is still the live version of pkey.  Returns
+  // true iff the hit was retained, in which case the memory behind value
+  // (and behind pkey, unless "copy_key" asks for the key to be copied
+  // into the result set) must stay pinned for the lifetime of result().
+  bool Offer(const Slice& pkey, const Slice& value, SequenceNumber seq,
+             double rank, bool validate, bool copy_key);
+
+  // Offer the live document of "pkey", whose newest entry, at sequence
+  // "seq", is a merge operand.  The merged document and the key are
+  // copied into the result set, so nothing needs to stay pinned.
+  void OfferMerged(const Slice& pkey, SequenceNumber seq);
+
+  // Offer the live document of "pkey" if its newest entry is at
+  // sequence "seq", as listed by the secondary index table.  The document
+  // and the key are copied into the result set.
+  void OfferLive(const Slice& pkey, SequenceNumber seq);
+
+  // Table-side entry point: "ikey" is an internal key read from a data
+  // block.  Same return value as Offer().
+  bool SaveTableEntry(const Slice& ikey, const Slice& value);
+
+  // Turn the heap into the final best-first ordering and, if the lookup
+  // is incomplete, record where it stopped in result().
+  void Finish();
+
+ private:
+  // Heap order: a ranks before b.  The heap front is the worst hit.
+  struct Better {
+    Better(bool r, bool a) : by_rank(r), ascending(a) { }
+    bool by_rank;
+    bool ascending;
+    bool operator()(const SKeyPinnedVal& a, const SKeyPinnedVal& b) const {
+      if (by_rank && a.rank_value != b.rank_value) {
+        return ascending ? a.rank_value < b.rank_value
+                         : a.rank_value > b.rank_value;
+      }
+      return a.sequence_number > b.sequence_number;
+    }
+  };
+
+  // Copy "s" into key_arena_.
+  Slice Copy(const Slice& s);
+
+  DBImpl* const db_;
+  const ReadOptions options_;
+  SecondaryQueryNode query_;
+  const bool composite_;
+
+  // True iff stored documents may have been changed by merge operands
+  // written since, so that a version that is no longer live may still
+  // match in its merged form.
+  const bool merges_;
+
+  // The extractor of the index keys, unless they can be read from the
+  // parsed JSON document.
+  const SecondaryKeyExtractor* extractor_;
+
+  // Attribute names interned by binary documents.
+  const std::vector<std::string>* schema_;
+  const RangeTombstoneList* range_tombstones_;
+  const SequenceNumber snapshot_;
+  const SequenceNumber min_sequence_;
+  const SequenceNumber max_sequence_;
+  const std::string ranking_attribute_;
+  const Better better_;
+  const int k_;
+  SecondaryResultSet* const result_;
+  std::vector<SKeyPinnedVal>* const heap_;
+
+  // Primary keys currently in the heap.
+  std::unordered_set<Slice, SliceHash> keys_found_;
+
+  // Reused across validations so that a hit does not allocate.
+  std::string scratch_;
+
+  // Holds the primary keys of table hits: block keys are prefix-compressed
+  // and only materialized in the block iterator.  Also holds merged
+  // documents.  Owned by result_.
+  Arena* key_arena_;
+
+  // Budget.  A limit of zero means none.
+  Env* const env_;
+  const int max_blocks_;
+  const int max_files_;
+  const uint64_t deadline_;
+  int blocks_read_;
+  int files_probed_;
+  bool incomplete_;
+  bool block_unmatched_;
+
+  // Position of the file being probed and, once incomplete, of the file
+  // and block at which the lookup stopped.
+  int level_;
+  uint64_t file_;
+  uint64_t stop_offset_;
+
+  // Position at which an earlier lookup stopped, or -1 if not resuming.
+  int resume_level_;
+  uint64_t resume_file_;
+  uint64_t resume_offset_;
+  bool bad_cursor_;
+
+  // No copying allowed
+  SecondaryLookup(const SecondaryLookup&);
+  void operator=(const SecondaryLookup&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_SECONDARY_LOOKUP_H_
@@ -0,0 +1,1424 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/secondary_lookup.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include "db/db_impl.h"
+#include "db/secondary_index_table.h"
+#include "db/secondary_key.h"
+#include "leveldb/cache.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/secondary_key_extractor.h"
+#include "leveldb/secondary_query.h"
+#include "leveldb/write_batch.h"
+#include "port/port.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+// Counts the opens and reads of table files while enabled.  While its
+// clock ticks, NowMicros() advances by one on each call instead.
+class CountingEnv : public EnvWrapper {
+ public:
+  explicit CountingEnv(Env* base)
+      : EnvWrapper(base), counting_(false), opens_(0), reads_(0),
+        ticking_(false), now_(0), hook_(NULL), hook_arg_(NULL) { }
+
+  void StartCounting() {
+    MutexLock l(&mu_);
+    counting_ = true;
+    opens_ = 0;
+    reads_ = 0;
+  }
+
+  int opens() {
+    MutexLock l(&mu_);
+    return opens_;
+  }
+
+  int reads() {
+    MutexLock l(&mu_);
+    return reads_;
+  }
+
+  void set_ticking(bool ticking) {
+    MutexLock l(&mu_);
+    ticking_ = ticking;
+  }
+
+  uint64_t NowMicros() {
+    MutexLock l(&mu_);
+    return ticking_ ? ++now_ : target()->NowMicros();
+  }
+
+  // Call (*hook)(arg) once, on the next read of a table file.
+  void RunOnNextRead(void (*hook)(void* arg), void* arg) {
+    MutexLock l(&mu_);
+    hook_ = hook;
+    hook_arg_ = arg;
+  }
+
+  Status NewRandomAccessFile(const std::string& f, RandomAccessFile** r) {
+    class CountingFile : public RandomAccessFile {
+     public:
+      CountingFile(CountingEnv* env, RandomAccessFile* base)
+          : env_(env), base_(base) { }
+      ~CountingFile() { delete base_; }
+      Status Read(uint64_t offset, size_t n, Slice* result,
+                  char* scratch) const {
+        env_->CountRead();
+        // Copied into scratch, as by a file read without mmap, so that
+        // the blocks read can be cached
+        Status s = base_->Read(offset, n, result, scratch);
+        if (s.ok() && result->data() != scratch) {
+          memcpy(scratch, result->data(), result->size());
+          *result = Slice(scratch, result->size());
+        }
+        return s;
+      }
+     private:
+      CountingEnv* env_;
+      RandomAccessFile* base_;
+    };
+    Status s = target()->NewRandomAccessFile(f, r);
+    if (s.ok()) {
+      CountOpen();
+      *r = new CountingFile(this, *r);
+    }
+    return s;
+  }
+
+ private:
+  void CountOpen() {
+    MutexLock l(&mu_);
+    if (counting_) {
+      opens_++;
+    }
+  }
+
+  void CountRead() {
+    void (*hook)(void* arg);
+    void* arg;
+    {
+      MutexLock l(&mu_);
+      if (counting_) {
+        reads_++;
+      }
+      hook = hook_;
+      arg = hook_arg_;
+      hook_ = NULL;
+    }
+    if (hook != NULL) {
+      (*hook)(arg);
+    }
+  }
+
+  port::Mutex mu_;
+  bool counting_;
+  int opens_;
+  int reads_;
+  bool ticking_;
+  uint64_t now_;
+  void (*hook_)(void* arg);
+  void* hook_arg_;
+};
+
+// An LRU cache that counts the handles not yet released.
+class PinCountingCache : public Cache {
+ public:
+  explicit PinCountingCache(size_t capacity)
+      : base_(NewLRUCache(capacity)), pinned_(0) { }
+  ~PinCountingCache() { delete base_; }
+
+  int pinned() {
+    MutexLock l(&mu_);
+    return pinned_;
+  }
+
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value)) {
+    return Count(base_->Insert(key, value, charge, deleter));
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         CachePriority priority) {
+    return Count(base_->Insert(key, value, charge, deleter, priority));
+  }
+  virtual Handle* Lookup(const Slice& key) {
+    return Count(base_->Lookup(key));
+  }
+  virtual Handle* Lookup(const Slice& key, CachePriority priority) {
+    return Count(base_->Lookup(key, priority));
+  }
+  virtual void Release(Handle* handle) {
+    {
+      MutexLock l(&mu_);
+      pinned_--;
+    }
+    base_->Release(handle);
+  }
+  virtual void* Value(Handle* handle) { return base_->Value(handle); }
+  virtual void Erase(const Slice& key) { base_->Erase(key); }
+  virtual uint64_t NewId() { return base_->NewId(); }
+
+ private:
+  Handle* Count(Handle* handle) {
+    if (handle != NULL) {
+      MutexLock l(&mu_);
+      pinned_++;
+    }
+    return handle;
+  }
+
+  Cache* const base_;
+  port::Mutex mu_;
+  int pinned_;
+};
+
+// Extracts attribute "t" of JSON documents, counting its calls.
+class CountingExtractor : public SecondaryKeyExtractor {
+ public:
+  CountingExtractor()
+      : base_(NewJsonSecondaryKeyExtractor("t", "",
+                                           std::vector<std::string>())),
+        calls_(0) { }
+  ~CountingExtractor() { delete base_; }
+
+  int calls() {
+    MutexLock l(&mu_);
+    return calls_;
+  }
+
+  virtual const char* Name() const { return "t"; }
+  virtual void Extract(const Slice& value,
+                       std::vector<std::string>* keys) const {
+    {
+      MutexLock l(&mu_);
+      calls_++;
+    }
+    base_->Extract(value, keys);
+  }
+
+ private:
+  const SecondaryKeyExtractor* const base_;
+  mutable port::Mutex mu_;
+  mutable int calls_;
+};
+
+class SecondaryLookupTest {
+ public:
+  std::string dbname_;
+  CountingEnv* env_;
+  const FilterPolicy* filter_policy_;
+  Options options_;
+  DB* db_;
+
+  // The live documents, by ID: their tenant and the order of their write.
+  std::map<int, std::pair<std::string, int> > model_;
+  int writes_;
+
+  SecondaryLookupTest()
+      : env_(new CountingEnv(Env::Default())),
+        filter_policy_(NewBloomFilterPolicy(10)),
+        db_(NULL),
+        writes_(0) {
+    dbname_ = test::TmpDir() + "/secondary_lookup_test";
+    DestroyDB(dbname_, options_);
+    options_.env = env_;
+    options_.create_if_missing = true;
+    options_.filter_policy = filter_policy_;
+    options_.block_size = 256;
+    options_.PrimaryAtt = "ID";
+    options_.secondaryAtt = "t";
+    options_.secondary_heavy_hitter_fraction = 0.25;
+  }
+
+  ~SecondaryLookupTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+    delete filter_policy_;
+    delete env_;
+  }
+
+  DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+  void Open() {
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  }
+
+  int NumTableFilesAtLevel(int level) {
+    std::string property;
+    ASSERT_TRUE(
+        db_->GetProperty("leveldb.num-files-at-level" + NumberToString(level),
+                         &property));
+    return atoi(property.c_str());
+  }
+
+  std::string FilesPerLevel() {
+    std::string result;
+    int last_non_zero_offset = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      int f = NumTableFilesAtLevel(level);
+      char buf[100];
+      snprintf(buf, sizeof(buf), "%s%d", (level ? "," : ""), f);
+      result += buf;
+      if (f > 0) {
+        last_non_zero_offset = result.size();
+      }
+    }
+    result.resize(last_non_zero_offset);
+    return result;
+  }
+
+  // Open an empty DB in place of the current one.
+  void DestroyAndReopen() {
+    delete db_;
+    db_ = NULL;
+    DestroyDB(dbname_, Options());
+    model_.clear();
+    Open();
+  }
+
+  void PutDoc(int id, const std::string& tenant) {
+    char doc[100];
+    snprintf(doc, sizeof(doc), "{\"ID\": %d, \"t\": \"%s\"}", id,
+             tenant.c_str());
+    ASSERT_OK(db_->Put(WriteOptions(), doc));
+    model_[id] = std::make_pair(tenant, writes_++);
+  }
+
+  // Like PutDoc(), with the raw JSON "rank" as attribute "r" unless it
+  // is empty.
+  void PutRankedDoc(int id, const std::string& tenant,
+                    const std::string& rank) {
+    std::string doc = "{\"ID\": " + NumberToString(id) + ", \"t\": \"" +
+        tenant + "\"";
+    if (!rank.empty()) {
+      doc += ", \"r\": " + rank;
+    }
+    doc += "}";
+    ASSERT_OK(db_->Put(WriteOptions(), doc));
+    model_[id] = std::make_pair(tenant, writes_++);
+  }
+
+  // Like PutDoc(), with the unindexed attribute "c" set to "color"
+  // unless it is empty.
+  void PutColoredDoc(int id, const std::string& tenant,
+                     const std::string& color) {
+    std::string doc = "{\"ID\": " + NumberToString(id) + ", \"t\": \"" +
+        tenant + "\"";
+    if (!color.empty()) {
+      doc += ", \"c\": \"" + color + "\"";
+    }
+    doc += "}";
+    ASSERT_OK(db_->Put(WriteOptions(), doc));
+    model_[id] = std::make_pair(tenant, writes_++);
+  }
+
+  void DeleteDoc(int id) {
+    ASSERT_OK(db_->Delete(WriteOptions(), NumberToString(id)));
+    model_.erase(id);
+  }
+
+  // The IDs of the K most recently written live documents of "tenants".
+  std::string Expected(const std::set<std::string>& tenants, int k) {
+    std::map<int, int> newest;   // Write order -> ID
+    for (std::map<int, std::pair<std::string, int> >::const_iterator it =
+             model_.begin(); it != model_.end(); ++it) {
+      if (tenants.count(it->second.first) > 0) {
+        newest[-it->second.second] = it->first;
+      }
+    }
+    std::string result;
+    for (std::map<int, int>::const_iterator it = newest.begin();
+         it != newest.end() && k > 0; ++it, k--) {
+      if (!result.empty()) result.push_back(',');
+      result.append(NumberToString(it->second));
+    }
+    return result;
+  }
+
+  // The IDs of the K most recently written live documents satisfying
+  // "query", found by reading every document.
+  std::string ExpectedByScan(const SecondaryQuery& query, int k) {
+    std::map<int, int> newest;   // Write order -> ID
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      rapidjson::Document doc;
+      if (ParseDocument(iter->value(), &doc) && Satisfies(query, doc)) {
+        const int id = atoi(iter->key().ToString().c_str());
+        newest[-model_[id].second] = id;
+      }
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+    std::string result;
+    for (std::map<int, int>::const_iterator it = newest.begin();
+         it != newest.end() && k > 0; ++it, k--) {
+      if (!result.empty()) result.push_back(',');
+      result.append(NumberToString(it->second));
+    }
+    return result;
+  }
+
+  static bool Satisfies(const SecondaryQuery& query,
+                        const rapidjson::Document& doc) {
+    const std::vector<SecondaryQuery>& children = query.children();
+    switch (query.op()) {
+      case SecondaryQuery::kEquals:
+        return HasSecondaryKey(doc, query.attribute(), query.value());
+      case SecondaryQuery::kAnd:
+        for (size_t i = 0; i < children.size(); i++) {
+          if (!Satisfies(children[i], doc)) return false;
+        }
+        return true;
+      case SecondaryQuery::kOr:
+        for (size_t i = 0; i < children.size(); i++) {
+          if (Satisfies(children[i], doc)) return true;
+        }
+        return false;
+    }
+    return false;
+  }
+
+  std::string Lookup(const SecondaryQuery& query, int k,
+                     const ReadOptions& options = ReadOptions()) {
+    std::vector<SKeyReturnVal> values;
+    Status s = db_->Get(options, query, &values, k);
+    if (!s.ok() && !s.IsNotFound()) {
+      return s.ToString();
+    }
+    std::string result;
+    for (size_t i = 0; i < values.size(); i++) {
+      if (!result.empty()) result.push_back(',');
+      result.append(values[i].key);
+    }
+    return result;
+  }
+
+  // Like Lookup(), for DB::Get by the secondary key "skey".
+  std::string LookupKey(const std::string& skey, int k,
+                        const ReadOptions& options = ReadOptions()) {
+    std::vector<SKeyReturnVal> values;
+    Status s = db_->Get(options, skey, &values, k);
+    if (!s.ok() && !s.IsNotFound()) {
+      return s.ToString();
+    }
+    std::string result;
+    for (size_t i = 0; i < values.size(); i++) {
+      if (!result.empty()) result.push_back(',');
+      result.append(values[i].key);
+    }
+    return result;
+  }
+
+  void CheckAll() {
+    std::set<std::string> hot, cold, both;
+    hot.insert("default");
+    cold.insert("t1");
+    both.insert("default");
+    both.insert("t1");
+    SecondaryQuery is_default = SecondaryQuery::Equals("t", "default");
+    SecondaryQuery is_t1 = SecondaryQuery::Equals("t", "t1");
+    ASSERT_EQ(Expected(hot, 10), Lookup(is_default, 10));
+    ASSERT_EQ(Expected(hot, 1000), Lookup(is_default, 1000));
+    ASSERT_EQ(Expected(cold, 5), Lookup(is_t1, 5));
+    ASSERT_EQ(Expected(both, 20),
+              Lookup(SecondaryQuery::Or(is_default, is_t1), 20));
+  }
+
+  // The keys of the live documents of "tenant" from "start" on, in key
+  // order.
+  std::string ExpectedScan(const std::string& tenant,
+                           const std::string& start = "") {
+    std::set<std::string> keys;
+    for (std::map<int, std::pair<std::string, int> >::const_iterator it =
+             model_.begin(); it != model_.end(); ++it) {
+      if (it->second.first == tenant && NumberToString(it->first) >= start) {
+        keys.insert(NumberToString(it->first));
+      }
+    }
+    std::string result;
+    for (std::set<std::string>::const_iterator it = keys.begin();
+         it != keys.end(); ++it) {
+      if (!result.empty()) result.push_back(',');
+      result.append(*it);
+    }
+    return result;
+  }
+
+  // The keys yielded by a scan of the documents of "tenant", forward
+  // from "start" (the first key if empty) or else backward from the
+  // last key.
+  std::string Scan(const std::string& tenant, bool forward,
+                                const std::string& start = "",
+                                ReadOptions options = ReadOptions()) {
+    options.secondary_key = tenant;
+    std::vector<std::string> keys;
+    Iterator* iter = db_->NewIterator(options);
+    if (!forward) {
+      for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+        keys.push_back(iter->key().ToString());
+      }
+      std::reverse(keys.begin(), keys.end());
+    } else {
+      if (start.empty()) {
+        iter->SeekToFirst();
+      } else {
+        iter->Seek(start);
+      }
+      for (; iter->Valid(); iter->Next()) {
+        rapidjson::Document doc;
+        ASSERT_TRUE(ParseDocument(iter->value(), &doc));
+        ASSERT_TRUE(HasSecondaryKey(doc, "t", tenant));
+        keys.push_back(iter->key().ToString());
+      }
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+    std::string result;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (!result.empty()) result.push_back(',');
+      result.append(keys[i]);
+    }
+    return result;
+  }
+
+  void Load(int n) {
+    for (int i = 0; i < n; i++) {
+      PutDoc(i, i % 3 != 0 ? "default" : "t" + NumberToString(i % 40));
+    }
+  }
+};
+
+// Run "query" in pages under the budget of "options", each resuming the
+// last, until one is complete, and return the union of their hits,
+// which must not repeat.
+static std::set<std::string> LookupInPages(DB* db, const SecondaryQuery& query,
+                                           ReadOptions options, int* pages) {
+  std::set<std::string> keys;
+  bool partial = false;
+  *pages = 0;
+  Status s;
+  do {
+    SecondaryResultSet result;
+    s = db->Get(options, query, &result, 1000);
+    for (size_t i = 0; i < result.size(); i++) {
+      ASSERT_TRUE(keys.insert(result[i].key.ToString()).second);
+    }
+    if (s.IsIncomplete()) {
+      ASSERT_TRUE(!result.resume_cursor().empty());
+      partial = partial || !result.empty();
+      options.resume_cursor = result.resume_cursor();
+    }
+    ASSERT_LT(++*pages, 10000);
+  } while (s.IsIncomplete());
+  ASSERT_TRUE(s.ok() || s.IsNotFound());
+  // Some page returned the hits it had before the budget ran out
+  ASSERT_TRUE(partial || *pages == 1);
+  return keys;
+}
+
+TEST(SecondaryLookupTest, PostingListsMatchModel) {
+  Open();
+  Load(600);
+  db_->CompactRange(NULL, NULL);
+  CheckAll();
+
+  // Older versions stay in the same tables as their updates while a
+  // snapshot is held: only the live one may be returned.
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < 600; i += 7) {
+    PutDoc(i, i % 2 == 0 ? "t1" : "default");
+  }
+  for (int i = 5; i < 600; i += 11) {
+    DeleteDoc(i);
+  }
+  CheckAll();
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  CheckAll();
+  db_->CompactRange(NULL, NULL);
+  CheckAll();
+  db_->ReleaseSnapshot(snapshot);
+  db_->CompactRange(NULL, NULL);
+  CheckAll();
+}
+
+TEST(SecondaryLookupTest, PostingListsReadFewBlocks) {
+  Open();
+  Load(600);
+  db_->CompactRange(NULL, NULL);
+
+  ReadOptions options;
+  options.fill_cache = false;
+  SecondaryQuery is_default = SecondaryQuery::Equals("t", "default");
+  std::set<std::string> hot;
+  hot.insert("default");
+  ASSERT_EQ(Expected(hot, 5), Lookup(is_default, 5, options));
+
+  // Tables are open: only the data blocks of the five hits are read,
+  // once for the hit and once to check that it is live
+  env_->StartCounting();
+  ASSERT_EQ(Expected(hot, 5), Lookup(is_default, 5, options));
+  ASSERT_LE(env_->reads(), 10);
+
+  // A lookup with a block budget reads blocks in order, every block
+  // holding the value
+  options.max_blocks_read = 1000;
+  env_->StartCounting();
+  ASSERT_EQ(Expected(hot, 5), Lookup(is_default, 5, options));
+  ASSERT_GT(env_->reads(), 20);
+}
+
+TEST(SecondaryLookupTest, Budgets) {
+  Open();
+  // Three files of disjoint key ranges, so that the point reads that
+  // validate hits never trigger a compaction between two pages, and
+  // newer versions in the memtable
+  for (int f = 1; f <= 3; f++) {
+    for (int i = 0; i < 150; i++) {
+      PutDoc(f * 100000 + i, i % 3 != 0 ? "default"
+                                          : "t" + NumberToString(i % 40));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  for (int i = 0; i < 150; i += 7) {
+    PutDoc(100000 + i, "t1");
+    PutDoc(300000 + i, "default");
+  }
+  for (int i = 1; i < 150; i += 11) {
+    DeleteDoc(200000 + i);
+  }
+  CheckAll();
+
+  SecondaryQuery is_default = SecondaryQuery::Equals("t", "default");
+  SecondaryQuery either = SecondaryQuery::Or(
+      is_default, SecondaryQuery::Equals("t", "t1"));
+  for (int q = 0; q < 2; q++) {
+    const SecondaryQuery& query = (q == 0 ? is_default : either);
+    int pages;
+    const std::set<std::string> all =
+        LookupInPages(db_, query, ReadOptions(), &pages);
+    ASSERT_EQ(1, pages);
+
+    ReadOptions options;
+    options.max_files_probed = 1;
+    ASSERT_TRUE(all == LookupInPages(db_, query, options, &pages));
+    ASSERT_EQ(3, pages);
+
+    options = ReadOptions();
+    options.max_blocks_read = 5;
+    ASSERT_TRUE(all == LookupInPages(db_, query, options, &pages));
+    ASSERT_GT(pages, 1);
+
+    options = ReadOptions();
+    options.max_micros = 5;
+    env_->set_ticking(true);
+    ASSERT_TRUE(all == LookupInPages(db_, query, options, &pages));
+    env_->set_ticking(false);
+    ASSERT_GT(pages, 1);
+  }
+
+  // A cursor from elsewhere is rejected
+  ReadOptions options;
+  options.resume_cursor = "garbage";
+  ASSERT_EQ("Invalid argument: bad secondary lookup resume cursor",
+            Lookup(is_default, 10, options));
+}
+
+TEST(SecondaryLookupTest, Queries) {
+  typedef SecondaryQuery Q;
+  std::vector<std::string> few;
+  few.push_back("t1");
+  few.push_back("t2");
+  few.push_back("t5");
+  const Q is_default = Q::Equals("t", "default");
+  const Q is_t1 = Q::Equals("t", "t1");
+  const Q is_red = Q::Equals("c", "red");     // Not indexed
+  const Q in_few = Q::In("t", few);
+  std::vector<Q> queries;
+  queries.push_back(in_few);
+  queries.push_back(Q::And(is_default, is_red));
+  queries.push_back(Q::And(is_red, is_t1));
+  queries.push_back(Q::And(is_default, is_t1));
+  queries.push_back(Q::Or(is_t1, is_red));
+  queries.push_back(Q::Or(in_few, is_t1));
+  queries.push_back(Q::And(in_few, Q::Or(is_red, Q::Equals("c", "blue"))));
+  queries.push_back(Q::Or(Q::And(is_t1, is_red),
+                          Q::And(is_default, Q::Equals("c", "green"))));
+  queries.push_back(Q::Or(Q::And(is_red, Q::Equals("c", "blue")),
+                          Q::Equals("t", "none")));
+
+  // Pruned by the secondary filters and memtable postings, by the
+  // bitmaps of kSecondaryBitmapIndex, and by the level summaries
+  for (int config = 0; config < 3; config++) {
+    delete db_;
+    db_ = NULL;
+    DestroyDB(dbname_, Options());
+    model_.clear();
+    options_.filter_policy = (config == 1 ? NULL : filter_policy_);
+    options_.secondary_index_type =
+        (config == 1 ? kSecondaryBitmapIndex : kSecondaryFilterIndex);
+    options_.secondary_level_summaries = (config == 2);
+    Open();
+
+    const char* colors[] = { "red", "green", "blue", "" };
+    for (int i = 0; i < 300; i++) {
+      PutColoredDoc(i, i % 3 != 0 ? "default" : "t" + NumberToString(i % 40),
+                    colors[(i / 3) % 4]);
+    }
+    for (int phase = 0; phase < 3; phase++) {
+      if (phase == 1) {
+        ASSERT_OK(dbfull()->TEST_CompactMemTable());
+        // Newer versions in the memtable, over the table
+        for (int i = 0; i < 300; i += 7) {
+          PutColoredDoc(i, i % 2 == 0 ? "t1" : "default", colors[i % 4]);
+        }
+        for (int i = 5; i < 300; i += 11) {
+          DeleteDoc(i);
+        }
+      } else if (phase == 2) {
+        db_->CompactRange(NULL, NULL);
+      }
+      for (size_t q = 0; q < queries.size(); q++) {
+        ASSERT_EQ(ExpectedByScan(queries[q], 1000), Lookup(queries[q], 1000));
+        ASSERT_EQ(ExpectedByScan(queries[q], 7), Lookup(queries[q], 7));
+      }
+    }
+  }
+}
+
+TEST(SecondaryLookupTest, DocumentBatches) {
+  Open();
+  // Tenant "a" is written by batches of PutDocument() mixed with plain
+  // records, and tenant "b" the same documents by DB::Put
+  for (int i = 0; i < 200; i += 10) {
+    WriteBatch batch;
+    for (int j = i; j < i + 10; j++) {
+      const std::string tenant = (j % 3 != 0 ? "a" : "t1");
+      if (j % 5 == 4) {
+        batch.Put(NumberToString(j), "{\"t\": \"" + tenant + "\"}");
+      } else {
+        ASSERT_OK(batch.PutDocument(options_, "{\"ID\": " +
+                                    NumberToString(j) + ", \"t\": \"" +
+                                    tenant + "\"}"));
+      }
+      model_[j] = std::make_pair(tenant, writes_++);
+    }
+    batch.Delete(NumberToString(i + 2));
+    model_.erase(i + 2);
+    ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  }
+  for (int j = 0; j < 200; j++) {
+    PutDoc(1000 + j, j % 3 != 0 ? "b" : "t1");
+    if (j % 10 == 2) {
+      DeleteDoc(1000 + j);
+    }
+  }
+
+  // The same postings before and after the log is replayed, and once
+  // flushed
+  std::set<std::string> a, b, t1;
+  a.insert("a");
+  b.insert("b");
+  t1.insert("t1");
+  for (int pass = 0; pass < 3; pass++) {
+    if (pass == 1) {
+      delete db_;
+      db_ = NULL;
+      Open();
+    } else if (pass == 2) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    }
+    const std::string found_a = LookupKey("a", 1000);
+    const std::string found_b = LookupKey("b", 1000);
+    ASSERT_EQ(Expected(a, 1000), found_a);
+    ASSERT_EQ(Expected(b, 1000), found_b);
+    ASSERT_EQ(std::count(found_a.begin(), found_a.end(), ','),
+              std::count(found_b.begin(), found_b.end(), ','));
+    ASSERT_EQ(Expected(t1, 1000), LookupKey("t1", 1000));
+  }
+}
+
+TEST(SecondaryLookupTest, NoPostingLists) {
+  options_.secondary_heavy_hitter_fraction = 0;
+  Open();
+  Load(600);
+  db_->CompactRange(NULL, NULL);
+  CheckAll();
+}
+
+TEST(SecondaryLookupTest, LevelSummaries) {
+  options_.secondary_heavy_hitter_fraction = 0;
+  options_.secondary_level_summaries = true;
+  Open();
+  Load(600);
+  db_->CompactRange(NULL, NULL);
+  CheckAll();
+  for (int i = 0; i < 600; i += 7) {
+    PutDoc(i, "t1");
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  CheckAll();
+
+  // Reopened from the sidecar, a key held by no file opens no table
+  delete db_;
+  db_ = NULL;
+  ASSERT_TRUE(env_->FileExists(dbname_ + "/SECONDARY-SUMMARY"));
+  Open();
+  env_->StartCounting();
+  ASSERT_EQ("", Lookup(SecondaryQuery::Equals("t", "none"), 10));
+  SecondaryAggregate aggregate;
+  ASSERT_TRUE(db_->GetSecondaryAggregate(ReadOptions(), "none",
+                                         &aggregate).ok());
+  ASSERT_EQ(0u, aggregate.count);
+  ASSERT_EQ(0, env_->reads());
+  CheckAll();
+
+  // Levels are summarized again as files come and go
+  PutDoc(5000, "t99");
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(NULL, NULL);
+  CheckAll();
+  std::set<std::string> rare;
+  rare.insert("t99");
+  ASSERT_EQ(Expected(rare, 10), Lookup(SecondaryQuery::Equals("t", "t99"), 10));
+}
+
+TEST(SecondaryLookupTest, NoLevelSummaries) {
+  options_.secondary_heavy_hitter_fraction = 0;
+  Open();
+  Load(600);
+  db_->CompactRange(NULL, NULL);
+  delete db_;
+  db_ = NULL;
+  Open();
+  env_->StartCounting();
+  ASSERT_EQ("", Lookup(SecondaryQuery::Equals("t", "none"), 10));
+  ASSERT_GT(env_->reads(), 0);
+}
+
+TEST(SecondaryLookupTest, FileDirectory) {
+  options_.secondary_heavy_hitter_fraction = 0;
+  options_.secondary_file_directory_keys = 1000;
+  Open();
+  // Six files, each holding the documents of its own tenant
+  for (int f = 0; f < 6; f++) {
+    for (int i = 0; i < 50; i++) {
+      PutDoc((f + 1) * 100000 + i, "f" + NumberToString(f));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  std::set<std::string> tenant;
+  tenant.insert("f3");
+  const SecondaryQuery is_f3 = SecondaryQuery::Equals("t", "f3");
+
+  // Only the file holding the tenant is opened
+  delete db_;
+  db_ = NULL;
+  Open();
+  env_->StartCounting();
+  ASSERT_EQ(Expected(tenant, 10), Lookup(is_f3, 10));
+  ASSERT_EQ(1, env_->opens());
+  SecondaryAggregate aggregate;
+  ASSERT_OK(db_->GetSecondaryAggregate(ReadOptions(), "f4", &aggregate));
+  ASSERT_EQ(50u, aggregate.count);
+
+  // Without the directory, the filters of the other files are probed too
+  delete db_;
+  db_ = NULL;
+  options_.secondary_file_directory_keys = 0;
+  Open();
+  env_->StartCounting();
+  ASSERT_EQ(Expected(tenant, 10), Lookup(is_f3, 10));
+  ASSERT_GT(env_->opens(), 1);
+
+  // Files come and go
+  delete db_;
+  db_ = NULL;
+  options_.secondary_file_directory_keys = 1000;
+  Open();
+  db_->CompactRange(NULL, NULL);
+  PutDoc(700000, "f3");
+  DeleteDoc(400000);
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(Expected(tenant, 100), Lookup(is_f3, 100));
+  CheckAll();
+}
+
+static const SecondaryIndexTableType kIndexTables[] = {
+  kSecondaryCompositeIndexTable,
+  kSecondaryPostingIndexTable
+};
+
+TEST(SecondaryLookupTest, IndexTableLookupsMatchModel) {
+  options_.secondary_heavy_hitter_fraction = 0;
+  for (int t = 0; t < 2; t++) {
+    options_.secondary_index_table = kIndexTables[t];
+    DestroyAndReopen();
+    Load(300);
+    CheckAll();
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    CheckAll();
+
+    for (int i = 0; i < 300; i += 7) {
+      PutDoc(i, i % 2 == 0 ? "t1" : "default");
+    }
+    for (int i = 5; i < 300; i += 11) {
+      DeleteDoc(i);
+    }
+    CheckAll();
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    CheckAll();
+    db_->CompactRange(NULL, NULL);
+    CheckAll();
+  }
+}
+
+TEST(SecondaryLookupTest, IndexTableSurvivesRecovery) {
+  options_.secondary_heavy_hitter_fraction = 0;
+  for (int t = 0; t < 2; t++) {
+    options_.secondary_index_table = kIndexTables[t];
+    DestroyAndReopen();
+    Load(300);
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    // Entries only in the log
+    PutDoc(1000, "t1");
+    PutDoc(3, "default");
+    DeleteDoc(6);
+    delete db_;
+    db_ = NULL;
+    Open();
+    CheckAll();
+  }
+}
+
+TEST(SecondaryLookupTest, IndexTableHiddenFromIterators) {
+  options_.secondary_heavy_hitter_fraction = 0;
+  for (int t = 0; t < 2; t++) {
+    options_.secondary_index_table = kIndexTables[t];
+    DestroyAndReopen();
+    Load(300);
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    for (int i = 0; i < 300; i += 7) {
+      PutDoc(i, i % 2 == 0 ? "t1" : "default");
+    }
+
+    int n = 0;
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      n++;
+    }
+    ASSERT_EQ(static_cast<int>(model_.size()), n);
+    iter->SeekToLast();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("99", iter->key().ToString());
+    delete iter;
+  }
+}
+
+TEST(SecondaryLookupTest, ResultCache) {
+  Cache* cache = NewLRUCache(1 << 20);
+  options_.secondary_result_cache = cache;
+  Open();
+  Load(300);
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  // Without the block cache, only a cached result reads nothing
+  ReadOptions options;
+  options.fill_cache = false;
+  std::set<std::string> t1, none;
+  t1.insert("t1");
+  none.insert("none");
+  ASSERT_EQ(Expected(t1, 5), LookupKey("t1", 5, options));
+  ASSERT_EQ(Expected(t1, 10), LookupKey("t1", 10, options));
+  ASSERT_EQ("", LookupKey("none", 5, options));
+  env_->StartCounting();
+  ASSERT_EQ(Expected(t1, 5), LookupKey("t1", 5, options));
+  ASSERT_EQ(Expected(t1, 10), LookupKey("t1", 10, options));
+  ASSERT_EQ("", LookupKey("none", 5, options));
+  ASSERT_EQ(0, env_->reads());
+
+  // Nor after writes of other keys
+  PutDoc(1000, "default");
+  PutDoc(1001, "t2");
+  ASSERT_EQ(Expected(t1, 5), LookupKey("t1", 5, options));
+  ASSERT_EQ(0, env_->reads());
+
+  // Records gaining the key, losing it or deleted expire the results
+  PutDoc(1002, "t1");
+  ASSERT_EQ(Expected(t1, 5), LookupKey("t1", 5, options));
+  DeleteDoc(1002);
+  ASSERT_EQ(Expected(t1, 5), LookupKey("t1", 5, options));
+  PutDoc(280, "default");
+  ASSERT_EQ(Expected(t1, 5), LookupKey("t1", 5, options));
+  PutDoc(1003, "none");
+  ASSERT_EQ(Expected(none, 5), LookupKey("none", 5, options));
+
+  // So do range deletions
+  PutDoc(2000, "t1");
+  ASSERT_EQ(Expected(t1, 10), LookupKey("t1", 10, options));
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "2000", "2001"));
+  model_.erase(2000);
+  ASSERT_EQ(Expected(t1, 10), LookupKey("t1", 10, options));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(Expected(t1, 10), LookupKey("t1", 10, options));
+  CheckAll();
+
+  delete db_;
+  db_ = NULL;
+  delete cache;
+}
+
+TEST(SecondaryLookupTest, NegativeBlockCache) {
+  // A filter this weak lets most blocks through for any key
+  const FilterPolicy* weak_filter = NewBloomFilterPolicy(1);
+  options_.filter_policy = weak_filter;
+  options_.secondary_negative_block_cache = true;
+  Open();
+  Load(600);
+  db_->CompactRange(NULL, NULL);
+
+  ReadOptions options;
+  options.fill_cache = false;
+  std::set<std::string> t7;
+  t7.insert("t7");
+  SecondaryQuery query = SecondaryQuery::Equals("t", "t7");
+  env_->StartCounting();
+  ASSERT_EQ(Expected(t7, 100), Lookup(query, 100, options));
+  const int first = env_->reads();
+  env_->StartCounting();
+  ASSERT_EQ(Expected(t7, 100), Lookup(query, 100, options));
+  ASSERT_LT(env_->reads(), first);
+
+  // Other keys, and newer writes, are still found
+  PutDoc(27, "t8");
+  PutDoc(1000, "t7");
+  ASSERT_EQ(Expected(t7, 100), Lookup(query, 100, options));
+  CheckAll();
+
+  delete db_;
+  db_ = NULL;
+  delete weak_filter;
+}
+
+TEST(SecondaryLookupTest, SequenceWindow) {
+  options_.secondary_heavy_hitter_fraction = 0;
+  Open();
+  for (int f = 1; f <= 3; f++) {
+    for (int i = 0; i < 5; i++) {
+      PutDoc(f * 100 + i, "w");
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  std::map<std::string, uint64_t> sequence;
+  std::vector<SKeyReturnVal> values;
+  ASSERT_OK(db_->Get(ReadOptions(), "w", &values, 100));
+  ASSERT_EQ(15u, values.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    sequence[values[i].key] = values[i].sequence_number;
+  }
+
+  // A newer version of 201, unchanged, in the memtable
+  delete db_;
+  db_ = NULL;
+  Open();
+  PutDoc(201, "w");
+
+  // Only the hits whose live version was written in the window come
+  // back, and only the file of the middle batch is opened
+  ReadOptions options;
+  options.min_sequence = sequence["200"];
+  options.max_sequence = sequence["204"];
+  env_->StartCounting();
+  ASSERT_EQ("204,203,202,200", LookupKey("w", 100, options));
+  ASSERT_EQ(1, env_->opens());
+
+  // Bounds are inclusive
+  options.min_sequence = sequence["104"];
+  options.max_sequence = sequence["200"];
+  ASSERT_EQ("200,104", LookupKey("w", 100, options));
+  options.min_sequence = sequence["304"] + 1;
+  options.max_sequence = ~static_cast<uint64_t>(0);
+  ASSERT_EQ("201", LookupKey("w", 100, options));
+  options.min_sequence = sequence["304"];
+  options.max_sequence = sequence["304"];
+  ASSERT_EQ("304", LookupKey("w", 100, options));
+}
+
+// The IDs of the k documents of "ranks" (ID -> rank) with the highest,
+// or lowest, rank.
+static std::string ExpectedRanked(const std::map<int, double>& ranks,
+                                  bool ascending, int k) {
+  std::vector<std::pair<double, int> > order;
+  for (std::map<int, double>::const_iterator it = ranks.begin();
+       it != ranks.end(); ++it) {
+    order.push_back(std::make_pair(ascending ? it->second : -it->second,
+                                   it->first));
+  }
+  std::sort(order.begin(), order.end());
+  std::string result;
+  for (size_t i = 0; i < order.size() && static_cast<int>(i) < k; i++) {
+    if (!result.empty()) result.push_back(',');
+    result.append(NumberToString(order[i].second));
+  }
+  return result;
+}
+
+TEST(SecondaryLookupTest, RankedResults) {
+  Open();
+  // Documents of "r" with distinct numeric ranks, but for some without
+  // the attribute or with a string in it, in a table and in the memtable
+  std::map<int, double> ranks;
+  for (int i = 0; i < 60; i++) {
+    const int rank = (i * 37) % 101;
+    if (i % 10 == 7) {
+      PutRankedDoc(i, "r", "");
+    } else if (i % 10 == 8) {
+      PutRankedDoc(i, "r", "\"high\"");
+    } else {
+      PutRankedDoc(i, "r", NumberToString(rank));
+      ranks[i] = rank;
+    }
+    PutRankedDoc(1000 + i, "other", NumberToString(1000 + i));
+    if (i == 30) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    }
+  }
+  // Older versions of the best ranked keep their old rank only on disk
+  PutRankedDoc(2, "r", "-1");
+  ranks[2] = -1;
+  PutRankedDoc(3, "r", "");
+  ranks.erase(3);
+
+  ReadOptions options;
+  options.ranking_attribute = "r";
+  SecondaryQuery is_r = SecondaryQuery::Equals("t", "r");
+  for (int pass = 0; pass < 2; pass++) {
+    options.ranking_ascending = false;
+    ASSERT_EQ(ExpectedRanked(ranks, false, 5), Lookup(is_r, 5, options));
+    ASSERT_EQ(ExpectedRanked(ranks, false, 5), LookupKey("r", 5, options));
+    ASSERT_EQ(ExpectedRanked(ranks, false, 100), Lookup(is_r, 100, options));
+    options.ranking_ascending = true;
+    ASSERT_EQ(ExpectedRanked(ranks, true, 5), Lookup(is_r, 5, options));
+    ASSERT_EQ(ExpectedRanked(ranks, true, 100), Lookup(is_r, 100, options));
+
+    // The rank values come back with the hits
+    std::vector<SKeyReturnVal> values;
+    ASSERT_OK(db_->Get(options, is_r, &values, 1));
+    ASSERT_EQ(1u, values.size());
+    ASSERT_EQ("2", values[0].key);
+    ASSERT_EQ(-1.0, values[0].rank_value);
+
+    db_->CompactRange(NULL, NULL);
+  }
+
+  // Ranked by an attribute no document holds, nothing is returned
+  options.ranking_attribute = "none";
+  ASSERT_EQ("", Lookup(is_r, 5, options));
+}
+
+TEST(SecondaryLookupTest, PinnedResultsOutliveCompaction) {
+  PinCountingCache cache(1 << 20);
+  options_.block_cache = &cache;
+  Open();
+  Load(300);
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 1000; i < 1005; i++) {
+    PutDoc(i, "t1");
+  }
+
+  // Hits come from the memtable and from table blocks
+  std::vector<SKeyReturnVal> copied;
+  ASSERT_OK(db_->Get(ReadOptions(), "t1", &copied, 10));
+  SecondaryResultSet pinned;
+  ASSERT_OK(db_->Get(ReadOptions(), "t1", &pinned, 10));
+  ASSERT_GT(copied.size(), 5u);
+  ASSERT_EQ(copied.size(), pinned.size());
+  ASSERT_GT(cache.pinned(), 0);
+
+  // The memtable is flushed and every table compacted away, updating
+  // the hits, while the result set still points into them
+  for (int i = 0; i < 300; i++) {
+    PutDoc(i, "t2");
+  }
+  PutDoc(1000, "t2");
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(NULL, NULL);
+  for (size_t i = 0; i < pinned.size(); i++) {
+    ASSERT_EQ(copied[i].key, pinned[i].key.ToString());
+    ASSERT_EQ(copied[i].value, pinned[i].value.ToString());
+    ASSERT_EQ(copied[i].sequence_number, pinned[i].sequence_number);
+  }
+
+  // Clearing or destroying the result set releases its blocks
+  pinned.Clear();
+  ASSERT_TRUE(pinned.empty());
+  ASSERT_EQ(0, cache.pinned());
+  {
+    SecondaryResultSet scoped;
+    ASSERT_OK(db_->Get(ReadOptions(), "t2", &scoped, 10));
+    ASSERT_GT(cache.pinned(), 0);
+  }
+  ASSERT_EQ(0, cache.pinned());
+  delete db_;
+  db_ = NULL;
+}
+
+TEST(SecondaryLookupTest, LookupsKeepPrimaryBlocksCached) {
+  Cache* cache = NewLRUCache(64 << 10);
+  options_.block_cache = cache;
+  options_.secondary_heavy_hitter_fraction = 0;
+  Open();
+  Load(3000);
+  db_->CompactRange(NULL, NULL);
+  std::set<std::string> hot;
+  hot.insert("default");
+  const SecondaryQuery is_default = SecondaryQuery::Equals("t", "default");
+
+  // A lookup reading more blocks than the cache holds, at the default
+  // priority, leaves the blocks of primary Gets cached
+  std::string value;
+  for (int i = 100; i < 110; i++) {
+    ASSERT_OK(db_->Get(ReadOptions(), NumberToString(i), &value));
+  }
+  ASSERT_EQ(Expected(hot, 1000), Lookup(is_default, 1000));
+  env_->StartCounting();
+  for (int i = 100; i < 110; i++) {
+    ASSERT_OK(db_->Get(ReadOptions(), NumberToString(i), &value));
+  }
+  ASSERT_EQ(0, env_->reads());
+
+  // At the priority of primary Gets, it evicts them
+  ReadOptions high;
+  high.secondary_cache_priority = kHighCachePriority;
+  ASSERT_EQ(Expected(hot, 1000), Lookup(is_default, 1000, high));
+  env_->StartCounting();
+  for (int i = 100; i < 110; i++) {
+    ASSERT_OK(db_->Get(ReadOptions(), NumberToString(i), &value));
+  }
+  ASSERT_GT(env_->reads(), 0);
+
+  delete db_;
+  db_ = NULL;
+  delete cache;
+}
+
+// Moves document 1 to tenant "moved".
+static void MoveFirstDoc(void* arg) {
+  reinterpret_cast<SecondaryLookupTest*>(arg)->PutDoc(1, "moved");
+}
+
+TEST(SecondaryLookupTest, DeleteBySecondaryKey) {
+  options_.secondary_heavy_hitter_fraction = 0;
+  Open();
+  // More than one page of "gone" documents, across two levels of tables
+  // and the memtable
+  const int kDocs = 13000;
+  for (int i = 0; i < kDocs; i++) {
+    PutDoc(i, i % 6 != 0 ? "gone" : "kept");
+    if (i == 5999) {
+      db_->CompactRange(NULL, NULL);
+    } else if (i == 9999) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    }
+  }
+  std::set<std::string> gone, kept;
+  gone.insert("gone");
+  kept.insert("kept");
+  const std::string expected_kept = Expected(kept, kDocs);
+
+  // Document 1 is moved away once the lookups are under way, after the
+  // snapshot they read was taken
+  env_->RunOnNextRead(&MoveFirstDoc, this);
+  uint64_t deleted;
+  ASSERT_OK(db_->DeleteBySecondaryKey(WriteOptions(), "gone", &deleted));
+  ASSERT_EQ("moved", model_[1].first);
+
+  int n_gone = 0;
+  std::string value;
+  for (int i = 0; i < kDocs; i++) {
+    Status s = db_->Get(ReadOptions(), NumberToString(i), &value);
+    if (model_[i].first == "gone") {
+      ASSERT_TRUE(s.IsNotFound()) << i;
+      n_gone++;
+    } else {
+      ASSERT_OK(s);
+    }
+  }
+  ASSERT_GT(n_gone, 10000);
+  ASSERT_EQ(n_gone, static_cast<int>(deleted));
+  ASSERT_EQ("", LookupKey("gone", kDocs));
+  ASSERT_EQ(expected_kept, LookupKey("kept", kDocs));
+  ASSERT_EQ("1", LookupKey("moved", kDocs));
+
+  ASSERT_OK(db_->DeleteBySecondaryKey(WriteOptions(), "gone", &deleted));
+  ASSERT_EQ(0, static_cast<int>(deleted));
+}
+
+TEST(SecondaryLookupTest, NewerMatchesInDeeperLevel) {
+  options_.secondary_heavy_hitter_fraction = 0;
+  Open();
+  // A file in level 2, under which the older documents are flushed to
+  // level 1; the newer ones, overlapping neither, go to level 2
+  PutDoc(105000, "kept");
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 100000; i <= 111000; i++) {
+    if (i != 105000) PutDoc(i, "gone");
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 900000; i < 900100; i++) {
+    PutDoc(i, "gone");
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,2", FilesPerLevel());
+
+  std::set<std::string> gone;
+  gone.insert("gone");
+  ASSERT_EQ(Expected(gone, 10), LookupKey("gone", 10));
+  ASSERT_EQ(Expected(gone, 10000), LookupKey("gone", 10000));
+
+  uint64_t deleted;
+  ASSERT_OK(db_->DeleteBySecondaryKey(WriteOptions(), "gone", &deleted));
+  ASSERT_EQ(11100, static_cast<int>(deleted));
+  std::string value;
+  ASSERT_TRUE(db_->Get(ReadOptions(), "900050", &value).IsNotFound());
+  ASSERT_TRUE(db_->Get(ReadOptions(), "100050", &value).IsNotFound());
+  ASSERT_OK(db_->Get(ReadOptions(), "105000", &value));
+  ASSERT_EQ("", LookupKey("gone", 100));
+}
+
+TEST(SecondaryLookupTest, PostingListsStayBounded) {
+  options_.secondary_index_table = kSecondaryPostingIndexTable;
+  Open();
+  // The raw posting list of "t1"; see db/secondary_index_table.h
+  const std::string list_key = IndexTableStart().ToString() + "p" + "t1";
+  std::set<std::string> t1;
+  t1.insert("t1");
+  std::string list;
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < 500; i++) {
+      PutDoc(i % 5, "t1");
+    }
+    // One posting, of 2 + 8 bytes, for each of the five documents
+    ASSERT_OK(db_->Get(ReadOptions(), list_key, &list));
+    ASSERT_EQ(50, static_cast<int>(list.size()));
+    ASSERT_EQ(Expected(t1, 10), LookupKey("t1", 10));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  db_->CompactRange(NULL, NULL);
+  ASSERT_OK(db_->Get(ReadOptions(), list_key, &list));
+  ASSERT_EQ(50, static_cast<int>(list.size()));
+  ASSERT_EQ(Expected(t1, 10), LookupKey("t1", 10));
+}
+
+TEST(SecondaryLookupTest, IndexTableUsesDocumentKeys) {
+  CountingExtractor extractor;
+  options_.secondary_key_extractor = &extractor;
+  for (int t = 0; t < 2; t++) {
+    options_.secondary_index_table = kIndexTables[t];
+    DestroyAndReopen();
+    WriteBatch batch;
+    for (int i = 0; i < 10; i++) {
+      ASSERT_OK(batch.PutDocument(options_, "{\"ID\": " + NumberToString(i) +
+                                  ", \"t\": \"t1\"}"));
+      model_[i] = std::make_pair("t1", writes_++);
+    }
+    // The keys PutDocument() extracted make the index table entries
+    const int calls = extractor.calls();
+    ASSERT_OK(db_->Write(WriteOptions(), &batch));
+    ASSERT_EQ(calls, extractor.calls());
+    CheckAll();
+  }
+  delete db_;
+  db_ = NULL;
+}
+
+TEST(SecondaryLookupTest, ScanBySecondaryKey) {
+  Open();
+  Load(600);
+  db_->CompactRange(NULL, NULL);
+  for (int i = 0; i < 600; i += 7) {
+    PutDoc(i, i % 2 == 0 ? "t1" : "default");
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 5; i < 600; i += 11) {
+    DeleteDoc(i);
+  }
+  PutDoc(1000, "t1");
+
+  const char* tenants[] = { "t1", "t2", "default", "none" };
+  for (int t = 0; t < 4; t++) {
+    ASSERT_EQ(ExpectedScan(tenants[t]), Scan(tenants[t], true));
+    ASSERT_EQ(ExpectedScan(tenants[t]), Scan(tenants[t], false));
+    // From the middle of the range
+    ASSERT_EQ(ExpectedScan(tenants[t], "3"), Scan(tenants[t], true, "3"));
+  }
+}
+
+TEST(SecondaryLookupTest, ScanBySecondaryKeyHidesStaleVersions) {
+  Open();
+  for (int i = 0; i < 300; i++) {
+    PutDoc(i, i % 10 == 0 ? "t1" : "default");
+  }
+  db_->CompactRange(NULL, NULL);
+  // The newer versions, in blocks whose secondary filters rule "t1" out
+  // and which the scan therefore skips
+  for (int i = 0; i < 300; i += 20) {
+    PutDoc(i, "default");
+    DeleteDoc(i + 10);
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("", ExpectedScan("t1"));
+  ASSERT_EQ("", Scan("t1", true));
+  ASSERT_EQ("", Scan("t1", false));
+}
+
+TEST(SecondaryLookupTest, ScanBySecondaryKeySkipsBlocks) {
+  Open();
+  for (int i = 0; i < 3000; i++) {
+    PutDoc(i, i % 600 == 0 ? "rare" : "default");
+  }
+  db_->CompactRange(NULL, NULL);
+  ReadOptions options;
+  options.fill_cache = false;
+
+  env_->StartCounting();
+  Iterator* iter = db_->NewIterator(options);
+  int n = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    n++;
+  }
+  delete iter;
+  ASSERT_EQ(3000, n);
+  const int full_reads = env_->reads();
+
+  // The blocks holding the five documents, and the point reads of their
+  // live versions, are a small part of those of a full scan
+  env_->StartCounting();
+  ASSERT_EQ("0,1200,1800,2400,600", ExpectedScan("rare"));
+  ASSERT_EQ(ExpectedScan("rare"), Scan("rare", true, "", options));
+  ASSERT_LT(env_->reads() * 4, full_reads);
+}
+
+TEST(SecondaryLookupTest, IndexTableNeedsNoMergeOperator) {
+  options_.secondary_index_table = kSecondaryPostingIndexTable;
+  options_.merge_operator = NewJsonMergeOperator();
+  ASSERT_TRUE(!DB::Open(options_, dbname_, &db_).ok());
+  delete options_.merge_operator;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,42 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/secondary_query.h"
+
+namespace leveldb {
+
+SecondaryQuery SecondaryQuery::Equals(const Slice& attribute,
+                                      const Slice& value) {
+  SecondaryQuery q(kEquals);
+  q.attribute_ = attribute.ToString();
+  q.value_ = value.ToString();
+  return q;
+}
+
+SecondaryQuery SecondaryQuery::In(const Slice& attribute,
+                                  const std::vector<std::string>& values) {
+  SecondaryQuery q(kOr);
+  for (size_t i = 0; i < values.size(); i++) {
+    q.children_.push_back(Equals(attribute, values[i]));
+  }
+  return q;
+}
+
+SecondaryQuery SecondaryQuery::And(const SecondaryQuery& a,
+                                   const SecondaryQuery& b) {
+  SecondaryQuery q(kAnd);
+  q.children_.push_back(a);
+  q.children_.push_back(b);
+  return q;
+}
+
+SecondaryQuery SecondaryQuery::Or(const SecondaryQuery& a,
+                                  const SecondaryQuery& b) {
+  SecondaryQuery q(kOr);
+  q.children_.push_back(a);
+  q.children_.push_back(b);
+  return q;
+}
+
+}  // namespace leveldb
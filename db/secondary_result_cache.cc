@@ -0,0 +1,163 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/secondary_result_cache.h"
+
+#include "db/secondary_index_table.h"
+#include "db/secondary_key.h"
+#include "db/write_batch_internal.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+struct SecondaryResultCache::Entry {
+  SequenceNumber sequence;              // Computed at, or after, this one
+  uint32_t key_bucket;
+  std::vector<uint32_t> record_buckets;
+  std::vector<SKeyReturnVal> values;
+};
+
+// Collects the buckets of the keys the records of a batch write.
+class SecondaryResultCache::WriteCollector : public KeyedBatchHandler {
+ public:
+  WriteCollector(const Options& options, Writes* writes)
+      : options_(options), writes_(writes) { }
+
+  virtual void Put(const Slice& key, const Slice& value,
+                   const std::vector<std::string>* secondary_keys) {
+    if (IsIndexTableKey(key)) {
+      return;
+    }
+    writes_->buckets.push_back(RecordBucket(key));
+    std::vector<std::string> extracted;
+    if (secondary_keys == NULL) {
+      ExtractSecondaryKeys(options_, value, &extracted);
+      secondary_keys = &extracted;
+    }
+    index_keys_.clear();
+    GetIndexKeys(options_, *secondary_keys, &index_keys_);
+    for (size_t i = 0; i < index_keys_.size(); i++) {
+      writes_->buckets.push_back(KeyBucket(index_keys_[i]));
+    }
+  }
+  virtual void Delete(const Slice& key) {
+    writes_->buckets.push_back(RecordBucket(key));
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    if (!IsIndexTableKey(key)) {
+      writes_->unknown = true;
+    }
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    writes_->unknown = true;
+  }
+
+ private:
+  const Options& options_;
+  Writes* const writes_;
+  std::vector<std::string> index_keys_;
+};
+
+SecondaryResultCache::SecondaryResultCache(const Options& options)
+    : options_(options),
+      cache_(options.secondary_result_cache),
+      cache_id_(cache_->NewId()),
+      written_(kBuckets, 0),
+      any_written_(0) {
+}
+
+void SecondaryResultCache::DeleteEntry(const Slice& key, void* value) {
+  delete reinterpret_cast<Entry*>(value);
+}
+
+uint32_t SecondaryResultCache::KeyBucket(const Slice& index_key) {
+  return SecondaryKeyHash(index_key) & (kBuckets - 1);
+}
+
+uint32_t SecondaryResultCache::RecordBucket(const Slice& pkey) {
+  return Hash(pkey.data(), pkey.size(), 0x7d2a91c3) & (kBuckets - 1);
+}
+
+void SecondaryResultCache::CollectWrites(const WriteBatch* batch,
+                                         Writes* writes) const {
+  WriteCollector collector(options_, writes);
+  WriteBatchInternal::Iterate(batch, &collector);
+}
+
+void SecondaryResultCache::Note(const Writes& writes,
+                                SequenceNumber sequence) {
+  if (writes.unknown) {
+    any_written_ = sequence;
+  }
+  for (size_t i = 0; i < writes.buckets.size(); i++) {
+    written_[writes.buckets[i]] = sequence;
+  }
+}
+
+bool SecondaryResultCache::Cacheable(const ReadOptions& options) {
+  return options.snapshot == NULL && options.min_sequence == 0 &&
+      options.max_sequence == ~static_cast<uint64_t>(0) &&
+      options.resume_cursor.empty();
+}
+
+void SecondaryResultCache::MakeKey(const ReadOptions& options,
+                                   const Slice& skey, int k,
+                                   std::string* key) const {
+  key->clear();
+  PutFixed64(key, cache_id_);
+  PutVarint32(key, static_cast<uint32_t>(k));
+  key->push_back(options.json_documents ? 1 : 0);
+  key->push_back(options.ranking_ascending ? 1 : 0);
+  PutLengthPrefixedSlice(key, options.ranking_attribute);
+  key->append(skey.data(), skey.size());
+}
+
+Cache::Handle* SecondaryResultCache::Lookup(const Slice& key) {
+  Cache::Handle* handle = cache_->Lookup(key);
+  if (handle == NULL) {
+    return NULL;
+  }
+  const Entry* entry = reinterpret_cast<Entry*>(cache_->Value(handle));
+  bool current = any_written_ <= entry->sequence &&
+      written_[entry->key_bucket] <= entry->sequence;
+  for (size_t i = 0; current && i < entry->record_buckets.size(); i++) {
+    current = written_[entry->record_buckets[i]] <= entry->sequence;
+  }
+  if (!current) {
+    cache_->Release(handle);
+    cache_->Erase(key);
+    return NULL;
+  }
+  return handle;
+}
+
+bool SecondaryResultCache::Read(Cache::Handle* handle,
+                                std::vector<SKeyReturnVal>* values) {
+  const Entry* entry = reinterpret_cast<Entry*>(cache_->Value(handle));
+  values->insert(values->end(), entry->values.begin(), entry->values.end());
+  const bool found = !entry->values.empty();
+  cache_->Release(handle);
+  return found;
+}
+
+void SecondaryResultCache::Insert(const Slice& key, const Slice& skey,
+                                  SequenceNumber sequence,
+                                  const SKeyReturnVal* values, size_t n) {
+  Entry* entry = new Entry;
+  entry->sequence = sequence;
+  std::string index_key;
+  AppendIndexKey(options_, skey, &index_key);
+  entry->key_bucket = KeyBucket(index_key);
+  entry->values.assign(values, values + n);
+  size_t charge = sizeof(Entry) + key.size();
+  for (size_t i = 0; i < n; i++) {
+    entry->record_buckets.push_back(RecordBucket(values[i].key));
+    charge += sizeof(SKeyReturnVal) + sizeof(uint32_t) +
+        values[i].key.size() + values[i].value.size();
+  }
+  cache_->Release(cache_->Insert(key, entry, charge, &DeleteEntry));
+}
+
+}  // namespace leveldb
@@ -0,0 +1,109 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The results of secondary lookups by a single key, kept in
+// Options::secondary_result_cache.  Each entry records the sequence
+// number at which it was computed.  The write path notes, in a fixed
+// table of buckets, the newest sequence number that wrote each secondary
+// key and each primary key; an entry is used only while neither its
+// secondary key nor any of the primary keys it returns was written since
+// it was computed.  A record gaining the key writes the key, and one
+// leaving it (or deleted) writes its primary key, which is only seen by
+// the entries listing it: those not listing it did not need it.  Merge
+// operands and range deletions, whose effect on the keys is not known
+// until they are read, invalidate every entry.  Buckets are shared by
+// the keys that hash alike, which only makes entries expire early.
+
+#ifndef STORAGE_LEVELDB_DB_SECONDARY_RESULT_CACHE_H_
+#define STORAGE_LEVELDB_DB_SECONDARY_RESULT_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/cache.h"
+#include "leveldb/db.h"
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+class WriteBatch;
+
+class SecondaryResultCache {
+ public:
+  // The results are kept in options.secondary_result_cache, which must
+  // be non-NULL and outlive this object.
+  explicit SecondaryResultCache(const Options& options);
+
+  // The keys written by a batch, as collected by CollectWrites().
+  struct Writes {
+    std::vector<uint32_t> buckets;
+    bool unknown;     // True iff the batch may change any result
+
+    Writes() : unknown(false) { }
+  };
+
+  // Store in *writes the buckets written by the records of "batch".
+  // Parses the documents that WriteBatch::PutDocument() did not, so is
+  // best called without holding the DB mutex.
+  void CollectWrites(const WriteBatch* batch, Writes* writes) const;
+
+  // Note that "writes" were made at sequence numbers up to "sequence".
+  // Must be called before the writes become visible to a lookup through
+  // VersionSet::LastSequence().
+  // REQUIRES: the DB mutex is held.
+  void Note(const Writes& writes, SequenceNumber sequence);
+
+  // Return true iff a lookup with "options" may be answered from, and
+  // stored in, the cache.  Lookups at an explicit snapshot, within a
+  // window of sequence numbers or resuming an earlier one are not.
+  static bool Cacheable(const ReadOptions& options);
+
+  // Store in *key the cache key of the lookup of "skey" for at most
+  // "k" results with "options".
+  void MakeKey(const ReadOptions& options, const Slice& skey, int k,
+               std::string* key) const;
+
+  // Return the entry cached under "key" if no write noted since it was
+  // computed can have changed it, and else NULL.  The caller must pass a
+  // non-NULL result to Read().
+  // REQUIRES: the DB mutex is held.
+  Cache::Handle* Lookup(const Slice& key);
+
+  // Append the results held by "handle" to *values and release it.
+  // Returns false iff the lookup found nothing.
+  bool Read(Cache::Handle* handle, std::vector<SKeyReturnVal>* values);
+
+  // Cache under "key" the n "values" found by the lookup of "skey" that
+  // started once "sequence" was the last sequence number of the DB.
+  void Insert(const Slice& key, const Slice& skey, SequenceNumber sequence,
+              const SKeyReturnVal* values, size_t n);
+
+ private:
+  struct Entry;
+  class WriteCollector;
+
+  enum { kBuckets = 1 << 14 };
+
+  static uint32_t KeyBucket(const Slice& index_key);
+  static uint32_t RecordBucket(const Slice& pkey);
+  static void DeleteEntry(const Slice& key, void* value);
+
+  const Options& options_;
+  Cache* const cache_;
+  const uint64_t cache_id_;     // Tells apart the DBs sharing cache_
+
+  // The newest sequence number noted for the keys of each bucket, and
+  // for any key.  Guarded by the DB mutex.
+  std::vector<SequenceNumber> written_;
+  SequenceNumber any_written_;
+
+  // No copying allowed
+  SecondaryResultCache(const SecondaryResultCache&);
+  void operator=(const SecondaryResultCache&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_SECONDARY_RESULT_CACHE_H_
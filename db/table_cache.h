@@ -18,6 +18,8 @@
 namespace leveldb {
 
 class Env;
+class SecondaryAggregator;
+class SecondaryLookup;
 
 class TableCache {
  public:
@@ -36,6 +38,11 @@ class TableCache {
                         uint64_t file_size,
                         Table** tableptr = NULL);
 
+  // Return an iterator over the range tombstones of the specified file
+  // (see db/range_tombstone.h).
+  Iterator* NewRangeTombstoneIterator(uint64_t file_number,
+                                      uint64_t file_size);
+
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
   Status Get(const ReadOptions& options,
@@ -44,14 +51,22 @@ class TableCache {
              const Slice& k,
              void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
- 
-Status Get(const ReadOptions& options,
-                       uint64_t file_number,
-                       uint64_t file_size,
-                      const Slice& k,
-                       void* arg,
-                       bool (*saver)(void*, const Slice&, const Slice&,std::string secKey,int topKOutput,DBImpl* db),
-                       string secKey,int topKOutput,DBImpl* db) ;
+
+  // Feed the entries of the specified file that may satisfy the query of
+  // *lookup into *lookup.  If a retained hit points into the file, the
+  // table stays open until lookup->result() is released.
+  Status Get(const ReadOptions& options,
+             uint64_t file_number,
+             uint64_t file_size,
+             SecondaryLookup* lookup);
+
+  // Offer the records of the specified file that may carry the key of
+  // *aggregator to it.
+  Status Get(const ReadOptions& options,
+             uint64_t file_number,
+             uint64_t file_size,
+             SecondaryAggregator* aggregator);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
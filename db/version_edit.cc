@@ -20,7 +20,10 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   // 8 was used for large value refs
-  kPrevLogNumber        = 9
+  kPrevLogNumber        = 9,
+  kNewFileSeqRange      = 10,  // kNewFile followed by the sequence range
+  kNewFileRangeDeletions = 11  // kNewFileSeqRange of a file holding range
+                               // tombstones
 };
 
 void VersionEdit::Clear() {
@@ -76,12 +79,19 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    const bool has_seq_range = f.has_range_deletions ||
+        f.smallest_seq != 0 || f.largest_seq != kMaxSequenceNumber;
+    PutVarint32(dst, f.has_range_deletions ? kNewFileRangeDeletions
+                : has_seq_range ? kNewFileSeqRange : kNewFile);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (has_seq_range) {
+      PutVarint64(dst, f.smallest_seq);
+      PutVarint64(dst, f.largest_seq);
+    }
   }
 }
 
@@ -186,6 +196,25 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.smallest_seq = 0;
+          f.largest_seq = kMaxSequenceNumber;
+          f.has_range_deletions = false;
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-file entry";
+        }
+        break;
+
+      case kNewFileSeqRange:
+      case kNewFileRangeDeletions:
+        if (GetLevel(&input, &level) &&
+            GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.smallest_seq) &&
+            GetVarint64(&input, &f.largest_seq)) {
+          f.has_range_deletions = (tag == kNewFileRangeDeletions);
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
@@ -258,6 +287,15 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.smallest_seq != 0 || f.largest_seq != kMaxSequenceNumber) {
+      r.append(" seq ");
+      AppendNumberTo(&r, f.smallest_seq);
+      r.append(" .. ");
+      AppendNumberTo(&r, f.largest_seq);
+    }
+    if (f.has_range_deletions) {
+      r.append(" rangedel");
+    }
   }
   r.append("\n}\n");
   return r;
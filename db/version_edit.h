@@ -12,6 +12,7 @@
 
 namespace leveldb {
 
+class RoaringBitmap;
 class VersionSet;
 
 struct FileMetaData {
@@ -21,8 +22,19 @@ struct FileMetaData {
   uint64_t file_size;         // File size in bytes
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
-
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+  SequenceNumber smallest_seq;  // Oldest entry in table (0 if unknown)
+  SequenceNumber largest_seq;   // Newest entry (kMaxSequenceNumber if unknown)
+  bool has_range_deletions;     // Holds range tombstones (DB::DeleteRange)
+
+  // The hashes of the secondary keys of the table, owned by the
+  // FileMetaData of a version, or NULL if not recorded (see
+  // Options::secondary_level_summaries).
+  const RoaringBitmap* key_hashes;
+
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0),
+        smallest_seq(0), largest_seq(kMaxSequenceNumber),
+        has_range_deletions(false), key_hashes(NULL) { }
 };
 
 class VersionEdit {
@@ -63,11 +75,30 @@ class VersionEdit {
                uint64_t file_size,
                const InternalKey& smallest,
                const InternalKey& largest) {
+    AddFile(level, file, file_size, smallest, largest,
+            0, kMaxSequenceNumber);
+  }
+
+  // Same as above, but also record that every entry in the file has a
+  // sequence number in [smallest_seq, largest_seq], and whether the file
+  // holds range tombstones.  The key range of such a file covers its
+  // tombstones, the largest key being the smallest internal key of the
+  // user key at which the last one ends.
+  void AddFile(int level, uint64_t file,
+               uint64_t file_size,
+               const InternalKey& smallest,
+               const InternalKey& largest,
+               SequenceNumber smallest_seq,
+               SequenceNumber largest_seq,
+               bool has_range_deletions = false) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.smallest_seq = smallest_seq;
+    f.largest_seq = largest_seq;
+    f.has_range_deletions = has_range_deletions;
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -39,6 +39,20 @@ TEST(VersionEditTest, EncodeDecode) {
   TestEncodeDecode(edit);
 }
 
+TEST(VersionEditTest, EncodeDecodeSequenceRange) {
+  static const uint64_t kBig = 1ull << 50;
+
+  VersionEdit edit;
+  edit.AddFile(0, 300, 400,
+               InternalKey("foo", kBig + 10, kTypeValue),
+               InternalKey("zoo", kBig + 5, kTypeValue),
+               kBig + 1, kBig + 10);
+  edit.AddFile(1, 301, 401,
+               InternalKey("bar", 7, kTypeValue),
+               InternalKey("baz", 8, kTypeValue));
+  TestEncodeDecode(edit);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -13,14 +13,19 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
+#include "db/secondary_aggregate.h"
+#include "db/secondary_file_directory.h"
+#include "db/secondary_key.h"
+#include "db/secondary_lookup.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/crc32c.h"
 #include "util/logging.h"
-#include "rapidjson/document.h"
 
 namespace leveldb {
 
@@ -86,9 +91,18 @@ Version::~Version() {
       assert(f->refs > 0);
       f->refs--;
       if (f->refs <= 0) {
+        if (f->key_hashes != NULL) {
+          if (vset_->file_directory_ != NULL) {
+            vset_->file_directory_->RemoveFile(f->number, *f->key_hashes);
+          }
+          delete f->key_hashes;
+        }
         delete f;
       }
     }
+    if (key_hashes_[level] != NULL && --key_hashes_[level]->refs == 0) {
+      delete key_hashes_[level];
+    }
   }
 }
 
@@ -259,6 +273,22 @@ void Version::AddIterators(const ReadOptions& options,
   }
 }
 
+Status Version::AddRangeTombstones(RangeTombstoneList* tombstones) {
+  Status s;
+  for (int level = 0; s.ok() && level < config::kNumLevels; level++) {
+    for (size_t i = 0; s.ok() && i < files_[level].size(); i++) {
+      const FileMetaData* f = files_[level][i];
+      if (f->has_range_deletions) {
+        Iterator* iter = vset_->table_cache_->NewRangeTombstoneIterator(
+            f->number, f->file_size);
+        s = tombstones->AddAll(iter);
+        delete iter;
+      }
+    }
+  }
+  return s;
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -266,19 +296,14 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerge,
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
-};
-struct SecSaver {
-  SaverState state;
-  const Comparator* ucmp;
-  Slice user_key;
-  std::vector<SKeyReturnVal>* value;
-  std::unordered_set<std::string>* resultSetofKeysFound;
+  SequenceNumber sequence;  // Of the entry found
 };
 }
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -288,173 +313,31 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+      s->sequence = parsed_key.sequence;
+      switch (parsed_key.type) {
+        case kTypeValue:
+          s->state = kFound;
+          break;
+        case kTypeDeletion:
+          s->state = kDeleted;
+          break;
+        case kTypeMerge:
+          s->state = kMerge;
+          break;
+        case kTypeRangeDeletion:
+          s->state = kCorrupt;  // Never stored with the other entries
+          break;
       }
-    }
-  }
-}
-
-static bool SecSaveValue(void* arg, const Slice& ikey, const Slice& v, string secKey, int topKOutput, DBImpl* db) {
-    
- // ofstream outputFile;
-  //outputFile.open("/home/mohiuddin/Desktop/TestDB/debug.txt" ,std::ofstream::out | std::ofstream::app);
-      
-    
-  SecSaver* s = reinterpret_cast<SecSaver*>(arg);
-             
-  ParsedInternalKey parsed_key;
-  if (!ParseInternalKey(ikey, &parsed_key)) {
-    s->state = kCorrupt;
-  } else {
-      
-        std:string val;
-        val.assign(v.data(), v.size());
-                
-            //parse the Json Object
-
-
-
-        rapidjson::Document docToParse; 
-
-        docToParse.Parse<0>(val.c_str());   
-
-        ///
-        const char* sKeyAtt = secKey.c_str();
-
-        if(!docToParse.IsObject()||!docToParse.HasMember(sKeyAtt)||docToParse[sKeyAtt].IsNull())
-            return false;
-
-        std::ostringstream key;
-        if(docToParse[sKeyAtt].IsNumber())
-        {
-              if(docToParse[sKeyAtt].IsUint64())
-              {
-                  unsigned long long int tid = docToParse[sKeyAtt].GetUint64();
-                  key<<tid;
-
-              }
-              else if (docToParse[sKeyAtt].IsInt64())
-              {
-                  long long int tid = docToParse[sKeyAtt].GetInt64();
-                  key<<tid;
-              }
-              else if (docToParse[sKeyAtt].IsDouble())
-              {
-                  double tid = docToParse[sKeyAtt].GetDouble();
-                  key<<tid;
-              }
-
-              else if (docToParse[sKeyAtt].IsUint())
-              {
-                  unsigned int tid = docToParse[sKeyAtt].GetUint();
-                  key<<tid;
-              }
-              else if (docToParse[sKeyAtt].IsInt())
-              {
-                  int tid = docToParse[sKeyAtt].GetInt();
-                  key<<tid;             
-              }
-        }
-        else if (docToParse[sKeyAtt].IsString())
-        {
-              const char* tid = docToParse[sKeyAtt].GetString();
-              key<<tid;
-        }
-        else if(docToParse[sKeyAtt].IsBool())
-        {
-              bool tid = docToParse[sKeyAtt].GetBool();
-              key<<tid;
-        }
-
-        Slice Key = key.str();
-
-      
-    if (s->ucmp->Compare(Key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
       if (s->state == kFound) {
-        
-        struct SKeyReturnVal newVal;
-        Slice ukey = ExtractUserKey(ikey);
-        
-        //outputFile<<ikey.ToString()<<ukey.ToString()<<endl<<val<<endl;
-        if(s->resultSetofKeysFound->find(ukey.ToString())==s->resultSetofKeysFound->end())
-        {
-         
-            //const char* p = ukey.data();
-
-            //char *d;
-            /*
-            if(ikey.size()-7>0)
-            {
-                d = new char[ikey.size()-6];
-                memcpy( d, p, ikey.size()-7 );
-                d[ikey.size()-7] = '\0';
-                //std::strcpy(d,p);
-
-                newVal.key = Slice(d);
-            }*/
-
-            //d = new char[ukey.size()+1];
-            //memcpy( d, p, ukey.size() );
-            //d[ukey.size()] = '\0';
-                //std::strcpy(d,p);
-            newVal.key = ukey.ToString();//Slice(d);
-            //char *d2;
-            //d2 = new char[val.size()+1];
-            //const char *t = val.c_str();
-            //memcpy( d2, t, val.size());
-            //d2[val.size()] = '\0';
-            //std::strcpy(d2,val.c_str());
-
-            //Slice(block_iter->key().data(),block_iter->key().size());//entry;
-            newVal.value = val;//Slice(d2); 
-            //const char* entry = ikey.data();
-            
-            //newVal.value = Slice(d2);
-            
-            
-            
-            newVal.sequence_number = parsed_key.sequence;
-            std::string temp;
-            //s->value->push_back(newVal); 
-            if(s->value->size()<topKOutput)
-            {
-                Status st = db->Get(leveldb::ReadOptions(),newVal.key, &temp);
-                if(st.ok()&&!st.IsNotFound()&&temp==newVal.value)
-                {
-                        newVal.Push(s->value, newVal);
-                        s->resultSetofKeysFound->insert(ukey.ToString());
-                }
-            }
-            else if(newVal.sequence_number>s->value->front().sequence_number)
-            {
-                Status st = db->Get(leveldb::ReadOptions(),newVal.key, &temp);
-                if(st.ok()&&!st.IsNotFound()&&temp==newVal.value)
-                {
-                    newVal.Pop(s->value);
-                    newVal.Push(s->value,newVal);
-                    s->resultSetofKeysFound->insert(ukey.ToString());
-                    s->resultSetofKeysFound->erase(s->resultSetofKeysFound->find(s->value->front().key));
-                }
-            }
-            
-            return true;
-        }
+        s->value->assign(v.data(), v.size());
       }
     }
   }
-  
-  return false;
 }
 
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
   return a->number > b->number;
 }
-static bool NewestFirstSequenceNumber(SKeyReturnVal a, SKeyReturnVal b) {
-  return a.sequence_number > b.sequence_number;
-}
 
 void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
                                  void* arg,
@@ -504,7 +387,8 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
                     std::string* value,
-                    GetStats* stats) {
+                    GetStats* stats,
+                    SequenceNumber* sequence) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
   const Comparator* ucmp = vset_->icmp_.user_comparator();
@@ -515,6 +399,13 @@ Status Version::Get(const ReadOptions& options,
   FileMetaData* last_file_read = NULL;
   int last_file_read_level = -1;
 
+  // The newest range tombstone covering the key in the files searched so
+  // far.  Entries in later files are older than it, as are the entries of
+  // its own file that it covers, so it deletes them.
+  SequenceNumber tombstone = 0;
+  const SequenceNumber snapshot = DecodeFixed64(
+      ikey.data() + ikey.size() - 8) >> 8;
+
   // We can search level-by-level since entries never hop across
   // levels.  Therefore we are guaranteed that if we find data
   // in an smaller level, later levels are irrelevant.
@@ -572,16 +463,35 @@ Status Version::Get(const ReadOptions& options,
       last_file_read = f;
       last_file_read_level = level;
 
+      if (f->has_range_deletions) {
+        Iterator* tombstones = vset_->table_cache_->NewRangeTombstoneIterator(
+            f->number, f->file_size);
+        tombstone = std::max(tombstone, MaxCoveringTombstone(
+            tombstones, ucmp, user_key, snapshot));
+        s = tombstones->status();
+        delete tombstones;
+        if (!s.ok()) {
+          return s;
+        }
+      }
+
       Saver saver;
       saver.state = kNotFound;
       saver.ucmp = ucmp;
       saver.user_key = user_key;
       saver.value = value;
+      saver.sequence = 0;
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
                                    ikey, &saver, SaveValue);
       if (!s.ok()) {
         return s;
       }
+      if (saver.state != kCorrupt && saver.sequence < tombstone) {
+        return Status::NotFound(Slice());  // Covered, or none left to find
+      }
+      if (sequence != NULL) {
+        *sequence = saver.sequence;
+      }
       switch (saver.state) {
         case kNotFound:
           break;      // Keep searching in other files
@@ -593,6 +503,9 @@ Status Version::Get(const ReadOptions& options,
         case kCorrupt:
           s = Status::Corruption("corrupted key for ", user_key);
           return s;
+        case kMerge:
+          s = Status::Incomplete(Slice());  // The caller merges
+          return s;
       }
     }
   }
@@ -603,133 +516,111 @@ Status Version::Get(const ReadOptions& options,
 
 
 
+bool Version::ListFiles(SecondaryLookup* lookup,
+                        std::vector<uint64_t>* files) const {
+  std::vector<std::string> keys;
+  if (vset_->file_directory_ == NULL || !all_key_hashes_ ||
+      !lookup->CoveringKeys(&keys)) {
+    return false;
+  }
+  std::vector<uint32_t> hashes;
+  for (size_t i = 0; i < keys.size(); i++) {
+    hashes.push_back(SecondaryKeyHash(keys[i]));
+  }
+  return vset_->file_directory_->Lookup(hashes, files);
+}
+
 Status Version::Get(const ReadOptions& options,
-                    const LookupKey& k,
-                    std::vector<SKeyReturnVal>* value,
-                    GetStats* stats, string secKey, int kNoOfOutputs,std::unordered_set<std::string>* resultSetofKeysFound, DBImpl* db) {
-    
-    //ofstream outputFile;
-    //outputFile.open("/home/mohiuddin/Desktop/TestDB/debug.txt" ,std::ofstream::out | std::ofstream::app);
-    
-    //outputFile<<"in\n";
-    
-    
-  Slice ikey = k.internal_key();
-  Slice user_key = k.user_key();
-  const Comparator* ucmp = vset_->icmp_.user_comparator();
+                    SecondaryLookup* lookup,
+                    GetStats* stats) {
   Status s;
 
   stats->seek_file = NULL;
   stats->seek_file_level = -1;
-  FileMetaData* last_file_read = NULL;
-  int last_file_read_level = -1;
 
-  // We can search level-by-level since entries never hop across
-  // levels.  Therefore we are guaranteed that if we find data
-  // in an smaller level, later levels are irrelevant.
+  // Files are not partitioned by secondary key, so every file of a level
+  // is probed (its secondary filter rules out most blocks).  Levels are
+  // visited in order, newest file first.  A deeper level may still hold
+  // newer entries than a shallower one (a memtable can be flushed
+  // straight past an older level), so once the heap is full the files
+  // are pruned by their sequence numbers rather than by level.
+  std::vector<uint64_t> listed;
+  const bool use_directory = ListFiles(lookup, &listed);
   std::vector<FileMetaData*> tmp;
-  FileMetaData* tmp2;
-  int valueSize = 0;
   for (int level = 0; level < config::kNumLevels; level++) {
     size_t num_files = files_[level].size();
     if (num_files == 0) continue;
+    if (key_hashes_[level] != NULL &&
+        !lookup->MayMatchKeyHashes(key_hashes_[level]->hashes)) {
+      continue;  // No file of the level holds the keys
+    }
 
-    // Get the list of files to search in this level
-    FileMetaData* const* files = &files_[level][0];
-    //if (level == 0) {
-      // Level-0 files may overlap each other.  Find all files that
-      // overlap user_key and process them in order from newest to oldest.
-      tmp.reserve(num_files);
-      for (uint32_t i = 0; i < num_files; i++) {
-        FileMetaData* f = files[i];
-        //if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
-        //    ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
-          tmp.push_back(f);
-        //}
-      }
-      if (tmp.empty()) continue;
+    tmp.assign(files_[level].begin(), files_[level].end());
+    std::sort(tmp.begin(), tmp.end(), NewestFirst);
 
-      std::sort(tmp.begin(), tmp.end(), NewestFirst);
-      files = &tmp[0];
-      num_files = tmp.size();
-    //} 
-    /*else {
-      // Binary search to find earliest index whose largest key >= ikey.
-      uint32_t index = FindFile(vset_->icmp_, files_[level], ikey);
-      if (index >= num_files) {
-        files = NULL;
-        num_files = 0;
-      } else {
-        tmp2 = files[index];
-        if (ucmp->Compare(user_key, tmp2->smallest.user_key()) < 0) {
-          // All of "tmp2" is past any data for user_key
-          files = NULL;
-          num_files = 0;
-        } else {
-          files = &tmp2;
-          num_files = 1;
-        }
+    for (uint32_t i = 0; i < tmp.size(); ++i) {
+      FileMetaData* f = tmp[i];
+      if ((use_directory &&
+           !std::binary_search(listed.begin(), listed.end(), f->number)) ||
+          lookup->SkipFile(level, f->number) ||
+          !lookup->MayMatchFile(f->smallest_seq, f->largest_seq)) {
+        continue;
       }
-    }
-     * 
-        */
-      //outputFile<<num_files<<endl;
-    for (uint32_t i = 0; i < num_files; ++i) {
-      if (last_file_read != NULL && stats->seek_file == NULL) {
-        // We have had more than one seek for this read.  Charge the 1st file.
-        stats->seek_file = last_file_read;
-        stats->seek_file_level = last_file_read_level;
+      if (!lookup->StartFile(level, f->number)) {
+        return s;  // Out of budget
       }
-
-      FileMetaData* f = files[i];
-      last_file_read = f;
-      last_file_read_level = level;
-
-      //outputFile<<f->number<<" in\n"; 
-      //s = vset_->table_cache_->Get(options, f->number, f->file_size,
-      //                             k, value, secKey, kNoOfOutputs,internal_comparator_);
-      SecSaver saver;
-      saver.state = kNotFound;
-      saver.ucmp = ucmp;
-      saver.user_key = user_key;
-      saver.value = value;
-      saver.resultSetofKeysFound = resultSetofKeysFound;
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
-                                   ikey, &saver, &SecSaveValue, secKey,kNoOfOutputs,db);
-
-      //for(std::vector<SKeyReturnVal>::iterator it = value->begin(); it != value->end(); ++it) {
-      //      outputFile<<it->key.ToString()<<endl<<it->value.ToString()<<endl;
- 
-      //}
-      //for(int i=0;i<value->size();i++)
-        //  outputFile<<value[i]->key.ToString()<<endl<<value[i]->ToString()<<endl;
-
-      //       outputFile<<"in\n";
-      
-    }
-      
-      if(value->size()>=kNoOfOutputs){
-        //std::sort(value->begin(), value->end(), NewestFirstSequenceNumber);
-        //value->erase(value->begin()+kNoOfOutputs,value->end());
-      
+                                   lookup);
+      if (!s.ok() || lookup->incomplete()) {
         return s;
       }
-      
-      //valueSize = value->size();
-      
-  }
- 
-   
-  //std::sort(value->begin(), value->end(), NewestFirstSequenceNumber); 
-  if(value->size()==0)
-        return Status::NotFound(Slice());  // Use an empty error message for speed
+    }
+  }
+
+  if (lookup->result()->empty())
+    return Status::NotFound(Slice());  // Use an empty error message for speed
   else
-      return s;
+    return s;
 }
 
 
 
 
+Status Version::Get(const ReadOptions& options,
+                    SecondaryAggregator* aggregator) {
+  // Every record carrying the key is counted, so every file is read,
+  // newest first.
+  Status s;
+  std::vector<FileMetaData*> tmp;
+  const uint32_t hash = SecondaryKeyHash(aggregator->index_key());
+  std::vector<uint64_t> listed;
+  const bool use_directory =
+      vset_->file_directory_ != NULL && all_key_hashes_ &&
+      vset_->file_directory_->Lookup(std::vector<uint32_t>(1, hash), &listed);
+  for (int level = 0; s.ok() && level < config::kNumLevels; level++) {
+    if (key_hashes_[level] != NULL &&
+        !key_hashes_[level]->hashes.Contains(hash)) {
+      continue;
+    }
+    tmp.assign(files_[level].begin(), files_[level].end());
+    std::sort(tmp.begin(), tmp.end(), NewestFirst);
+    for (size_t i = 0; s.ok() && i < tmp.size(); i++) {
+      FileMetaData* f = tmp[i];
+      if (use_directory &&
+          !std::binary_search(listed.begin(), listed.end(), f->number)) {
+        continue;
+      }
+      aggregator->StartFile(level, f);
+      s = vset_->table_cache_->Get(options, f->number, f->file_size,
+                                   aggregator);
+      if (s.ok()) {
+        s = aggregator->status();
+      }
+    }
+  }
+  return s;
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != NULL) {
@@ -801,6 +692,26 @@ bool Version::OverlapInLevel(int level,
                                smallest_user_key, largest_user_key);
 }
 
+bool Version::OverlapInNewerFiles(int level, uint64_t number,
+                                  const Slice& smallest_user_key,
+                                  const Slice& largest_user_key) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  for (size_t i = 0; i < files_[0].size(); i++) {
+    const FileMetaData* f = files_[0][i];
+    if ((level > 0 || f->number > number) &&
+        !AfterFile(ucmp, &smallest_user_key, f) &&
+        !BeforeFile(ucmp, &largest_user_key, f)) {
+      return true;
+    }
+  }
+  for (int l = 1; l < level; l++) {
+    if (OverlapInLevel(l, &smallest_user_key, &largest_user_key)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 int Version::PickLevelForMemTableOutput(
     const Slice& smallest_user_key,
     const Slice& largest_user_key) {
@@ -1091,13 +1002,19 @@ VersionSet::VersionSet(const std::string& dbname,
       descriptor_file_(NULL),
       descriptor_log_(NULL),
       dummy_versions_(this),
-      current_(NULL) {
+      current_(NULL),
+      file_directory_(
+          RecordsKeyHashes(*options) &&
+          options->secondary_file_directory_keys > 0
+          ? new SecondaryFileDirectory(options->secondary_file_directory_keys)
+          : NULL) {
   AppendVersion(new Version(this));
 }
 
 VersionSet::~VersionSet() {
   current_->Unref();
   assert(dummy_versions_.next_ == &dummy_versions_);  // List must be empty
+  delete file_directory_;
   delete descriptor_log_;
   delete descriptor_file_;
 }
@@ -1141,6 +1058,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     builder.SaveTo(v);
   }
   Finalize(v);
+  SummarizeKeyHashes(v, current_);
 
   // Initialize new descriptor log file if necessary by creating
   // a temporary file that contains a snapshot of the current version.
@@ -1316,6 +1234,9 @@ Status VersionSet::Recover() {
     builder.SaveTo(v);
     // Install recovered version
     Finalize(v);
+    ReadSavedKeyHashes();
+    SummarizeKeyHashes(v, current_);
+    saved_key_hashes_.clear();
     AppendVersion(v);
     manifest_file_number_ = next_file;
     next_file_number_ = next_file + 1;
@@ -1327,6 +1248,136 @@ Status VersionSet::Recover() {
   return s;
 }
 
+void VersionSet::SummarizeKeyHashes(Version* v, Version* base) {
+  if (!RecordsKeyHashes(*options_)) {
+    return;
+  }
+  v->all_key_hashes_ = true;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = v->files_[level];
+    const std::vector<FileMetaData*>& base_files = base->files_[level];
+    // Files kept from base are shared with it.
+    std::unordered_set<FileMetaData*> old(base_files.begin(),
+                                          base_files.end());
+    std::vector<FileMetaData*> added;
+    bool complete = !files.empty();
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[i];
+      if (old.count(f) == 0) {
+        LoadKeyHashes(f);
+        if (f->key_hashes != NULL && file_directory_ != NULL) {
+          file_directory_->AddFile(f->number, *f->key_hashes);
+        }
+        added.push_back(f);
+      }
+      complete = complete && f->key_hashes != NULL;
+      v->all_key_hashes_ = v->all_key_hashes_ && f->key_hashes != NULL;
+    }
+    if (!complete || !options_->secondary_level_summaries) {
+      continue;
+    }
+    LevelKeyHashes* base_hashes = base->key_hashes_[level];
+    const bool grown = base_hashes != NULL &&
+        files.size() == base_files.size() + added.size();
+    LevelKeyHashes* summary;
+    if (grown && added.empty()) {
+      summary = base_hashes;
+    } else {
+      summary = new LevelKeyHashes;
+      const std::vector<FileMetaData*>& sources = grown ? added : files;
+      if (grown) {
+        summary->hashes = base_hashes->hashes;
+      }
+      for (size_t i = 0; i < sources.size(); i++) {
+        summary->hashes.UnionWith(*sources[i]->key_hashes);
+      }
+    }
+    summary->refs++;
+    v->key_hashes_[level] = summary;
+  }
+}
+
+void VersionSet::LoadKeyHashes(FileMetaData* f) {
+  RoaringBitmap* hashes = new RoaringBitmap;
+  std::map<uint64_t, std::string>::const_iterator saved =
+      saved_key_hashes_.find(f->number);
+  bool ok;
+  if (saved != saved_key_hashes_.end()) {
+    Slice input = saved->second;
+    ok = hashes->DecodeFrom(&input);
+  } else {
+    // Newly written tables are already in the table cache.
+    Table* tableptr;
+    Iterator* iter = table_cache_->NewIterator(
+        ReadOptions(), f->number, f->file_size, &tableptr);
+    ok = tableptr != NULL && tableptr->ReadSecondaryKeyHashes(hashes);
+    delete iter;
+  }
+  if (ok) {
+    f->key_hashes = hashes;
+  } else {
+    delete hashes;
+  }
+}
+
+// The sidecar holds, for each table file, its number and its encoded key
+// hashes, followed by the masked crc32c of all of it:
+//
+//    sidecar := (number:varint64 hashes:varstring)* crc:fixed32
+void VersionSet::ReadSavedKeyHashes() {
+  saved_key_hashes_.clear();
+  if (!RecordsKeyHashes(*options_)) {
+    return;
+  }
+  std::string contents;
+  if (!ReadFileToString(env_, SecondarySummaryFileName(dbname_),
+                        &contents).ok() ||
+      contents.size() < 4) {
+    return;
+  }
+  const size_t n = contents.size() - 4;
+  if (crc32c::Unmask(DecodeFixed32(contents.data() + n)) !=
+      crc32c::Value(contents.data(), n)) {
+    Log(options_->info_log, "Ignoring corrupted %s\n",
+        SecondarySummaryFileName(dbname_).c_str());
+    return;
+  }
+  Slice input(contents.data(), n);
+  uint64_t number;
+  Slice hashes;
+  while (GetVarint64(&input, &number) &&
+         GetLengthPrefixedSlice(&input, &hashes)) {
+    saved_key_hashes_[number] = hashes.ToString();
+  }
+}
+
+Status VersionSet::SaveKeyHashes() {
+  std::string contents;
+  std::string encoding;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    for (size_t i = 0; i < files.size(); i++) {
+      if (files[i]->key_hashes != NULL) {
+        encoding.clear();
+        files[i]->key_hashes->EncodeTo(&encoding);
+        PutVarint64(&contents, files[i]->number);
+        PutLengthPrefixedSlice(&contents, encoding);
+      }
+    }
+  }
+  PutFixed32(&contents,
+             crc32c::Mask(crc32c::Value(contents.data(), contents.size())));
+  const std::string tmp = TempFileName(dbname_, NewFileNumber());
+  Status s = WriteStringToFile(env_, contents, tmp);
+  if (s.ok()) {
+    s = env_->RenameFile(tmp, SecondarySummaryFileName(dbname_));
+  }
+  if (!s.ok()) {
+    env_->DeleteFile(tmp);
+  }
+  return s;
+}
+
 void VersionSet::MarkFileNumberUsed(uint64_t number) {
   if (next_file_number_ <= number) {
     next_file_number_ = number + 1;
@@ -1391,7 +1442,8 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->smallest_seq, f->largest_seq, f->has_range_deletions);
     }
   }
 
@@ -1478,6 +1530,26 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
   return result;
 }
 
+uint64_t VersionSet::ApproximateSecondaryCount(Version* v,
+                                               const Slice& index_key) {
+  uint64_t result = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = v->files_[level];
+    for (size_t i = 0; i < files.size(); i++) {
+      Table* tableptr;
+      Iterator* iter = table_cache_->NewIterator(
+          ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+      uint64_t count;
+      if (tableptr != NULL &&
+          tableptr->ApproximateSecondaryCount(index_key, &count)) {
+        result += count;
+      }
+      delete iter;
+    }
+  }
+  return result;
+}
+
 void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
   for (Version* v = dummy_versions_.next_;
        v != &dummy_versions_;
@@ -1796,6 +1868,32 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+bool Compaction::IsBaseLevelForRange(const Slice& begin, const Slice& end) {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Status Compaction::AddInputRangeTombstones(RangeTombstoneList* tombstones) {
+  Status s;
+  for (int which = 0; s.ok() && which < 2; which++) {
+    for (size_t i = 0; s.ok() && i < inputs_[which].size(); i++) {
+      const FileMetaData* f = inputs_[which][i];
+      if (f->has_range_deletions) {
+        Iterator* iter =
+            input_version_->vset_->table_cache_->NewRangeTombstoneIterator(
+                f->number, f->file_size);
+        s = tombstones->AddAll(iter);
+        delete iter;
+      }
+    }
+  }
+  return s;
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
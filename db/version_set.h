@@ -23,6 +23,7 @@
 #include "db/version_edit.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/roaring_bitmap.h"
 #include "db_impl.h"
 
 namespace leveldb {
@@ -32,6 +33,9 @@ namespace log { class Writer; }
 class Compaction;
 class Iterator;
 class MemTable;
+class RangeTombstoneList;
+class SecondaryAggregator;
+class SecondaryLookup;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -58,6 +62,17 @@ extern bool SomeFileOverlapsRange(
     const Slice* smallest_user_key,
     const Slice* largest_user_key);
 
+// The union of the key hashes of the files of a level, shared by the
+// versions in which the level holds the same files.
+struct LevelKeyHashes {
+  int refs;
+  RoaringBitmap hashes;
+
+  LevelKeyHashes() : refs(0) { }
+};
+
+class SecondaryFileDirectory;
+
 class Version {
  public:
   // Append to *iters a sequence of iterators that will
@@ -65,19 +80,31 @@ class Version {
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Add the range tombstones of the files of this Version to *tombstones.
+  // REQUIRES: lock is not held
+  Status AddRangeTombstones(RangeTombstoneList* tombstones);
+
   // Lookup the value for key.  If found, store it in *val and
-  // return OK.  Else return a non-OK status.  Fills *stats.
+  // return OK.  Else return a non-OK status, Incomplete() if the newest
+  // entry found is a merge operand.  Entries deleted by a range tombstone
+  // count as not found.  Fills *stats, and *sequence (if non-NULL) with
+  // the sequence number of the value or merge operand found.
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, SequenceNumber* sequence = NULL);
+  // Feed the records that may satisfy the query of *lookup into it,
+  // level by level, until the lookup has collected its K results.
   Status Get(const ReadOptions& options,
-                    const LookupKey& k,
-                    std::vector<SKeyReturnVal>* value,
-                    GetStats* stats,string secKey, int kNoOfOutputs,std::unordered_set<std::string>* resultSetofKeysFound, DBImpl *db);
+             SecondaryLookup* lookup,
+             GetStats* stats);
+  // Offer the records of every file that may carry the key of
+  // *aggregator to it.
+  // REQUIRES: lock is not held
+  Status Get(const ReadOptions& options, SecondaryAggregator* aggregator);
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -108,6 +135,13 @@ class Version {
                       const Slice* smallest_user_key,
                       const Slice* largest_user_key);
 
+  // Returns true iff a file newer than file "number" of "level" (a later
+  // level-0 file, or a file of a lower level) overlaps some part of
+  // [smallest_user_key,largest_user_key].
+  bool OverlapInNewerFiles(int level, uint64_t number,
+                           const Slice& smallest_user_key,
+                           const Slice& largest_user_key);
+
   // Return the level at which we should place a new memtable compaction
   // result that covers the range [smallest_user_key,largest_user_key].
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
@@ -125,6 +159,12 @@ class Version {
   class LevelFileNumIterator;
   Iterator* NewConcatenatingIterator(const ReadOptions&, int level) const;
 
+  // If the secondary file directory tracks the keys covering the query
+  // of *lookup, store in *files, sorted, the numbers of the files that
+  // may hold them and return true.  Otherwise return false.
+  bool ListFiles(SecondaryLookup* lookup,
+                 std::vector<uint64_t>* files) const;
+
   // Call func(arg, level, f) for every file that overlaps user_key in
   // order from newest to oldest.  If an invocation of func returns
   // false, makes no more calls.
@@ -152,12 +192,25 @@ class Version {
   double compaction_score_;
   int compaction_level_;
 
+  // Per level, the union of the key hashes of its files, or NULL unless
+  // every file of the level has them.  Set by
+  // VersionSet::SummarizeKeyHashes().
+  LevelKeyHashes* key_hashes_[config::kNumLevels];
+
+  // True iff every file has its key hashes, and is therefore listed by
+  // the secondary file directory under each of its keys.
+  bool all_key_hashes_;
+
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {
+        compaction_level_(-1),
+        all_key_hashes_(false) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      key_hashes_[level] = NULL;
+    }
   }
 
   ~Version();
@@ -266,6 +319,11 @@ class VersionSet {
   // "key" as of version "v".
   uint64_t ApproximateOffsetOf(Version* v, const InternalKey& key);
 
+  // Return the sum of the estimates, by the count sketches of the files
+  // of "v", of their records carrying the secondary index key
+  // "index_key".  Files written without a sketch count for nothing.
+  uint64_t ApproximateSecondaryCount(Version* v, const Slice& index_key);
+
   // Return a human-readable short (single-line) summary of the number
   // of files per level.  Uses *scratch as backing store.
   struct LevelSummaryStorage {
@@ -273,6 +331,13 @@ class VersionSet {
   };
   const char* LevelSummary(LevelSummaryStorage* scratch) const;
 
+  // Save the key hashes of the files of the current version to the
+  // sidecar file read back by Recover(), so that the level summaries and
+  // the secondary file directory are rebuilt without reading every
+  // table.
+  // REQUIRES: mutex is held
+  Status SaveKeyHashes();
+
  private:
   class Builder;
 
@@ -281,6 +346,16 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // If tables record their key hashes, load those of the files that "v"
+  // adds to "base" and enter them in the secondary file directory.  With
+  // Options::secondary_level_summaries, also set the level summaries of
+  // "v", sharing those of base for the levels whose files are unchanged.
+  void SummarizeKeyHashes(Version* v, Version* base);
+  void LoadKeyHashes(FileMetaData* f);
+
+  // Read the sidecar written by SaveKeyHashes() into saved_key_hashes_.
+  void ReadSavedKeyHashes();
+
   void GetRange(const std::vector<FileMetaData*>& inputs,
                 InternalKey* smallest,
                 InternalKey* largest);
@@ -320,6 +395,13 @@ class VersionSet {
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
 
+  // While recovering, the encoded key hashes of the table files saved by
+  // SaveKeyHashes(), by file number.
+  std::map<uint64_t, std::string> saved_key_hashes_;
+
+  // NULL unless Options::secondary_file_directory_keys is set.
+  SecondaryFileDirectory* file_directory_;
+
   // No copying allowed
   VersionSet(const VersionSet&);
   void operator=(const VersionSet&);
@@ -359,6 +441,12 @@ class Compaction {
   // in levels greater than "level+1".
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Same as above, for all user keys in [begin, end).
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end);
+
+  // Add the range tombstones of the input files to *tombstones.
+  Status AddInputRangeTombstones(RangeTombstoneList* tombstones);
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
@@ -8,17 +8,38 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeMerge varstring varstring         |
+//    kTypeRangeDeletion varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
+//
+// WriteBatch::secondary_keys_ holds the secondary keys of the records
+// added by PutDocument(), so that the memtable need not extract them:
+//    secondary_keys_ := keys*
+//    keys :=
+//       index: varint32           (of the record in rep_, ascending)
+//       count: varint32
+//       key: varstring[count]
+// It is not logged; records replayed from the log have their keys
+// extracted again.
 
 #include "leveldb/write_batch.h"
 
+#include <string.h>
+#include <sstream>
+#include <vector>
 #include "leveldb/db.h"
+#include "leveldb/secondary_key_extractor.h"
 #include "db/dbformat.h"
+#include "db/document.h"
 #include "db/memtable.h"
+#include "db/secondary_key.h"
 #include "db/write_batch_internal.h"
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -34,9 +55,16 @@ WriteBatch::~WriteBatch() { }
 
 WriteBatch::Handler::~Handler() { }
 
+void WriteBatch::Handler::Merge(const Slice& key, const Slice& value) {
+}
+
+void WriteBatch::Handler::DeleteRange(const Slice& begin, const Slice& end) {
+}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
+  secondary_keys_.clear();
 }
 
 Status WriteBatch::Iterate(Handler* handler) const {
@@ -68,6 +96,22 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeMerge:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->Merge(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->DeleteRange(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
@@ -102,43 +146,255 @@ void WriteBatch::Put(const Slice& key, const Slice& value) {
   PutLengthPrefixedSlice(&rep_, value);
 }
 
+void WriteBatchInternal::PutSpliced(WriteBatch* b, const Slice& key,
+                                    const Slice& value, const Slice& cut) {
+  assert(cut.data() >= value.data() &&
+         cut.data() + cut.size() <= value.data() + value.size());
+  const size_t before = cut.data() - value.data();
+  const size_t after = value.size() - before - cut.size();
+  WriteBatchInternal::SetCount(b, WriteBatchInternal::Count(b) + 1);
+  b->rep_.push_back(static_cast<char>(kTypeValue));
+  PutLengthPrefixedSlice(&b->rep_, key);
+  PutVarint32(&b->rep_, before + after);
+  b->rep_.append(value.data(), before);
+  b->rep_.append(cut.data() + cut.size(), after);
+}
+
+namespace {
+
+// Store in *key the primary key text of the JSON value "value" without
+// parsing it, if the DOM path below would produce the same bytes: a
+// string without escapes, a boolean, or an integer that surely fits in
+// 64 bits.  Returns false otherwise.
+bool PrimaryKeyText(const Slice& value, Slice* key) {
+  if (value.size() >= 2 && value[0] == '"') {
+    *key = Slice(value.data() + 1, value.size() - 2);
+    return memchr(key->data(), '\\', key->size()) == NULL;
+  } else if (value == Slice("true")) {
+    *key = "1";
+    return true;
+  } else if (value == Slice("false")) {
+    *key = "0";
+    return true;
+  }
+  Slice digits = value;
+  if (digits.starts_with("-")) {
+    digits.remove_prefix(1);
+    if (digits == Slice("0")) return false;    // Printed as "0"
+  }
+  if (digits.empty() || digits.size() > 18) return false;
+  for (size_t i = 0; i < digits.size(); i++) {
+    if (digits[i] < '0' || digits[i] > '9') return false;
+  }
+  *key = value;
+  return true;
+}
+
+// Format the primary key value "v" as operator<< does.
+std::string PrimaryKeyString(const rapidjson::Value& v) {
+  std::ostringstream key;
+  if (v.IsUint64()) {
+    key << v.GetUint64();
+  } else if (v.IsInt64()) {
+    key << v.GetInt64();
+  } else if (v.IsNumber()) {
+    key << v.GetDouble();
+  } else if (v.IsString()) {
+    key << v.GetString();
+  } else if (v.IsBool()) {
+    key << v.GetBool();
+  }
+  return key.str();
+}
+
+}  // namespace
+
+Status WriteBatch::PutDocument(const Options& options, const Slice& document) {
+  if (options.PrimaryAtt.empty()) {
+    return Status::InvalidArgument("Primary Attribute Not Set");
+  }
+
+  // Text documents with a plain primary key are split in place: the key
+  // is read off the scanned text and the rest of the document is copied
+  // straight into the batch, with no DOM built or written back out.
+  const size_t start = rep_.size();
+  AttributeSpan span;
+  Slice key;
+  if (!options.binary_documents &&
+      FindTopLevelAttribute(document, options.PrimaryAtt, &span) &&
+      PrimaryKeyText(span.value, &key)) {
+    WriteBatchInternal::PutSpliced(this, key, document, span.member);
+  } else {
+    rapidjson::Document doc;
+    const char* name = options.PrimaryAtt.c_str();
+    if (!ParseDocument(document, &doc) || !doc.HasMember(name) ||
+        doc[name].IsNull()) {
+      return Status::InvalidArgument("Primary Attribute does not found");
+    }
+    const std::string primary_key = PrimaryKeyString(doc[name]);
+    if (options.binary_documents) {
+      std::string encoded;
+      EncodeDocument(options.document_schema, doc, options.PrimaryAtt,
+                     &encoded);
+      Put(primary_key, encoded);
+    } else {
+      doc.RemoveMember(name);
+      rapidjson::StringBuffer buffer;
+      rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+      doc.Accept(writer);
+      Put(primary_key, buffer.GetString());
+    }
+  }
+
+  // Extract the secondary keys from the value as stored.
+  std::vector<std::string> keys;
+  Slice record(rep_.data() + start, rep_.size() - start);
+  Slice value;
+  record.remove_prefix(1);
+  if (GetLengthPrefixedSlice(&record, &value) &&
+      GetLengthPrefixedSlice(&record, &value)) {
+    ExtractSecondaryKeys(options, value, &keys);
+  }
+  PutVarint32(&secondary_keys_, WriteBatchInternal::Count(this) - 1);
+  PutVarint32(&secondary_keys_, keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    PutLengthPrefixedSlice(&secondary_keys_, keys[i]);
+  }
+  return Status::OK();
+}
+
 void WriteBatch::Delete(const Slice& key) {
   WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
   rep_.push_back(static_cast<char>(kTypeDeletion));
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::Merge(const Slice& key, const Slice& value) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeMerge));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::DeleteRange(const Slice& begin, const Slice& end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
 namespace {
-class MemTableInserter : public WriteBatch::Handler {
+// Parse the head of secondary_keys_ "input", storing the index of its
+// record in *index and leaving "input" at the keys.
+bool NextSecondaryKeys(Slice* input, uint32_t* index, uint32_t* count) {
+  return GetVarint32(input, index) && GetVarint32(input, count);
+}
+
+// Hands the records of a batch to a KeyedBatchHandler along with the
+// secondary keys of its secondary_keys_.
+class KeyFeeder : public WriteBatch::Handler {
+ public:
+  KeyedBatchHandler* handler_;
+  uint32_t index_;              // Of the record being handled
+  Slice secondary_keys_;        // Of the records not yet handled
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    Slice input = secondary_keys_;
+    uint32_t index, count;
+    if (NextSecondaryKeys(&input, &index, &count) && index == index_) {
+      std::vector<std::string> keys(count);
+      Slice k;
+      for (uint32_t i = 0; i < count; i++) {
+        GetLengthPrefixedSlice(&input, &k);
+        keys[i] = k.ToString();
+      }
+      secondary_keys_ = input;
+      handler_->Put(key, value, &keys);
+    } else {
+      handler_->Put(key, value, NULL);
+    }
+    index_++;
+  }
+  virtual void Delete(const Slice& key) {
+    handler_->Delete(key);
+    index_++;
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    handler_->Merge(key, value);
+    index_++;
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    handler_->DeleteRange(begin, end);
+    index_++;
+  }
+};
+
+class MemTableInserter : public KeyedBatchHandler {
  public:
   SequenceNumber sequence_;
   MemTable* mem_;
 
-  virtual void Put(const Slice& key, const Slice& value) {
-    mem_->Add(sequence_, kTypeValue, key, value);
+  virtual void Put(const Slice& key, const Slice& value,
+                   const std::vector<std::string>* secondary_keys) {
+    mem_->Add(sequence_, kTypeValue, key, value, secondary_keys);
     sequence_++;
   }
   virtual void Delete(const Slice& key) {
     mem_->Add(sequence_, kTypeDeletion, key, Slice());
     sequence_++;
   }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    mem_->Add(sequence_, kTypeMerge, key, value);
+    sequence_++;
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    mem_->Add(sequence_, kTypeRangeDeletion, begin, end);
+    sequence_++;
+  }
 };
 }  // namespace
 
+KeyedBatchHandler::~KeyedBatchHandler() { }
+
+Status WriteBatchInternal::Iterate(const WriteBatch* b,
+                                   KeyedBatchHandler* handler) {
+  KeyFeeder feeder;
+  feeder.handler_ = handler;
+  feeder.index_ = 0;
+  feeder.secondary_keys_ = b->secondary_keys_;
+  return b->Iterate(&feeder);
+}
+
 Status WriteBatchInternal::InsertInto(const WriteBatch* b,
                                       MemTable* memtable) {
   MemTableInserter inserter;
   inserter.sequence_ = WriteBatchInternal::Sequence(b);
   inserter.mem_ = memtable;
-  return b->Iterate(&inserter);
+  return Iterate(b, &inserter);
 }
 
 void WriteBatchInternal::SetContents(WriteBatch* b, const Slice& contents) {
   assert(contents.size() >= kHeader);
   b->rep_.assign(contents.data(), contents.size());
+  b->secondary_keys_.clear();
 }
 
 void WriteBatchInternal::Append(WriteBatch* dst, const WriteBatch* src) {
+  // The keys of src follow those of dst, with their records renumbered.
+  const uint32_t base = Count(dst);
+  Slice input = src->secondary_keys_;
+  uint32_t index, count;
+  while (NextSecondaryKeys(&input, &index, &count)) {
+    PutVarint32(&dst->secondary_keys_, base + index);
+    PutVarint32(&dst->secondary_keys_, count);
+    const char* keys = input.data();
+    Slice k;
+    for (uint32_t i = 0; i < count; i++) {
+      GetLengthPrefixedSlice(&input, &k);
+    }
+    dst->secondary_keys_.append(keys, input.data() - keys);
+  }
+
   SetCount(dst, Count(dst) + Count(src));
   assert(src->rep_.size() >= kHeader);
   dst->rep_.append(src->rep_.data() + kHeader, src->rep_.size() - kHeader);
@@ -5,12 +5,27 @@
 #ifndef STORAGE_LEVELDB_DB_WRITE_BATCH_INTERNAL_H_
 #define STORAGE_LEVELDB_DB_WRITE_BATCH_INTERNAL_H_
 
+#include <string>
+#include <vector>
 #include "leveldb/write_batch.h"
 
 namespace leveldb {
 
 class MemTable;
 
+// Like WriteBatch::Handler, except that Put() is also passed the
+// secondary keys WriteBatch::PutDocument() extracted from the record,
+// or NULL for a record added otherwise.
+class KeyedBatchHandler {
+ public:
+  virtual ~KeyedBatchHandler();
+  virtual void Put(const Slice& key, const Slice& value,
+                   const std::vector<std::string>* secondary_keys) = 0;
+  virtual void Delete(const Slice& key) = 0;
+  virtual void Merge(const Slice& key, const Slice& value) = 0;
+  virtual void DeleteRange(const Slice& begin, const Slice& end) = 0;
+};
+
 // WriteBatchInternal provides static methods for manipulating a
 // WriteBatch that we don't want in the public WriteBatch interface.
 class WriteBatchInternal {
@@ -38,8 +53,15 @@ class WriteBatchInternal {
 
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
+  // Add a Put of "value" with the bytes of "cut", which must lie within
+  // "value", left out.  The rest of value is copied into the batch once.
+  static void PutSpliced(WriteBatch* batch, const Slice& key,
+                         const Slice& value, const Slice& cut);
+
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  static Status Iterate(const WriteBatch* batch, KeyedBatchHandler* handler);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
@@ -14,7 +14,7 @@ namespace leveldb {
 
 static std::string PrintContents(WriteBatch* b) {
   InternalKeyComparator cmp(BytewiseComparator());
-  MemTable* mem = new MemTable(cmp);
+  MemTable* mem = new MemTable(cmp, NULL);
   mem->Ref();
   std::string state;
   Status s = WriteBatchInternal::InsertInto(b, mem);
@@ -52,6 +52,51 @@ static std::string PrintContents(WriteBatch* b) {
   return state;
 }
 
+// Prints the records of a batch with the secondary keys extracted by
+// PutDocument(), if any.
+class KeyPrinter : public KeyedBatchHandler {
+ public:
+  std::string state_;
+
+  virtual void Put(const Slice& key, const Slice& value,
+                   const std::vector<std::string>* secondary_keys) {
+    state_.append("Put(" + key.ToString() + ")");
+    if (secondary_keys != NULL) {
+      state_.append("[");
+      for (size_t i = 0; i < secondary_keys->size(); i++) {
+        if (i > 0) state_.append(",");
+        state_.append((*secondary_keys)[i]);
+      }
+      state_.append("]");
+    }
+  }
+  virtual void Delete(const Slice& key) {
+    state_.append("Delete(" + key.ToString() + ")");
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    state_.append("Merge(" + key.ToString() + ")");
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    state_.append("DeleteRange(" + begin.ToString() + ")");
+  }
+};
+
+static std::string PrintKeys(const WriteBatch* b) {
+  KeyPrinter printer;
+  Status s = WriteBatchInternal::Iterate(b, &printer);
+  if (!s.ok()) {
+    printer.state_.append("ParseError()");
+  }
+  return printer.state_;
+}
+
+static Options DocumentOptions() {
+  Options options;
+  options.PrimaryAtt = "id";
+  options.secondaryAtt = "tags";
+  return options;
+}
+
 class WriteBatchTest { };
 
 TEST(WriteBatchTest, Empty) {
@@ -113,6 +158,64 @@ TEST(WriteBatchTest, Append) {
             PrintContents(&b1));
 }
 
+TEST(WriteBatchTest, PutDocument) {
+  const Options options = DocumentOptions();
+  WriteBatch batch;
+  batch.Put("a", "{\"tags\": \"x\"}");
+  ASSERT_OK(batch.PutDocument(options,
+                              "{\"id\": \"b\", \"tags\": [\"y\", \"z\"]}"));
+  batch.Delete("c");
+  ASSERT_OK(batch.PutDocument(options, "{\"id\": 4, \"other\": 1}"));
+  batch.Merge("e", "{}");
+  ASSERT_OK(batch.PutDocument(options, "{\"tags\": \"w\", \"id\": \"f\"}"));
+  batch.Put("g", "{\"tags\": \"v\"}");
+  ASSERT_TRUE(!batch.PutDocument(options, "{\"tags\": \"u\"}").ok());
+  // Plain records are left for the memtable to extract
+  ASSERT_EQ("Put(a)Put(b)[y,z]Delete(c)Put(4)[]Merge(e)Put(f)[w]Put(g)",
+            PrintKeys(&batch));
+  ASSERT_EQ(7, WriteBatchInternal::Count(&batch));
+
+  // Keys do not survive a Clear() or a copy of the contents
+  WriteBatch copy;
+  WriteBatchInternal::SetContents(&copy, WriteBatchInternal::Contents(&batch));
+  ASSERT_EQ("Put(a)Put(b)Delete(c)Put(4)Merge(e)Put(f)Put(g)",
+            PrintKeys(&copy));
+  batch.Clear();
+  ASSERT_OK(batch.PutDocument(options, "{\"id\": \"h\", \"tags\": \"t\"}"));
+  ASSERT_EQ("Put(h)[t]", PrintKeys(&batch));
+}
+
+TEST(WriteBatchTest, AppendDocuments) {
+  const Options options = DocumentOptions();
+  WriteBatch b1, b2, b3;
+  ASSERT_OK(b1.PutDocument(options, "{\"id\": \"a\", \"tags\": \"x\"}"));
+  b1.Put("b", "{\"tags\": \"y\"}");
+  b2.Delete("c");
+  ASSERT_OK(b2.PutDocument(options, "{\"id\": \"d\", \"tags\": \"z\"}"));
+  b2.Put("e", "{\"tags\": \"w\"}");
+  ASSERT_OK(b2.PutDocument(options, "{\"id\": \"f\", \"tags\": [1, 2]}"));
+
+  // The keys of the appended batch follow those of the first, at the
+  // index of their records in the combined batch
+  WriteBatchInternal::Append(&b1, &b2);
+  ASSERT_EQ("Put(a)[x]Put(b)Delete(c)Put(d)[z]Put(e)Put(f)[1,2]",
+            PrintKeys(&b1));
+  WriteBatchInternal::Append(&b1, &b2);
+  ASSERT_EQ("Put(a)[x]Put(b)Delete(c)Put(d)[z]Put(e)Put(f)[1,2]"
+            "Delete(c)Put(d)[z]Put(e)Put(f)[1,2]",
+            PrintKeys(&b1));
+
+  // Into a batch without keys, or from one
+  b3.Put("g", "{}");
+  WriteBatchInternal::Append(&b3, &b2);
+  b2.Clear();
+  b2.Put("h", "{}");
+  WriteBatchInternal::Append(&b3, &b2);
+  ASSERT_EQ("Put(g)Delete(c)Put(d)[z]Put(e)Put(f)[1,2]Put(h)",
+            PrintKeys(&b3));
+  ASSERT_EQ(6, WriteBatchInternal::Count(&b3));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
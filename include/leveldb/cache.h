@@ -25,8 +25,20 @@ namespace leveldb {
 
 class Cache;
 
+// The priority of a cache insertion or lookup.  Entries inserted at low
+// priority are the first to be evicted until a high-priority lookup
+// shows they are reused, so that a scan reading many entries once does
+// not evict the working set of other readers.
+enum CachePriority {
+  kHighCachePriority,
+  kLowCachePriority
+};
+
 // Create a new cache with a fixed size capacity.  This implementation
-// of Cache uses a least-recently-used eviction policy.
+// of Cache uses a least-recently-used eviction policy, segmented by
+// priority: entries inserted at kLowCachePriority wait in a
+// probationary segment, evicted before any other entry, until a lookup
+// at kHighCachePriority promotes them.
 extern Cache* NewLRUCache(size_t capacity);
 
 class Cache {
@@ -52,6 +64,12 @@ class Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Same as above, at the given priority.  The default implementation
+  // ignores the priority.
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         CachePriority priority);
+
   // If the cache has no mapping for "key", returns NULL.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -59,6 +77,10 @@ class Cache {
   // longer needed.
   virtual Handle* Lookup(const Slice& key) = 0;
 
+  // Same as above, at the given priority.  The default implementation
+  // ignores the priority.
+  virtual Handle* Lookup(const Slice& key, CachePriority priority);
+
   // Release a mapping returned by a previous Lookup().
   // REQUIRES: handle must not have been released yet.
   // REQUIRES: handle must have been returned by a method on *this.
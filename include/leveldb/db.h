@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <algorithm>
+#include <utility>
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 
@@ -20,6 +21,7 @@ static const int kMinorVersion = 14;
 struct Options;
 struct ReadOptions;
 struct WriteOptions;
+class SecondaryQuery;
 class WriteBatch;
 
 // Abstract handle to particular state of a DB.
@@ -44,25 +46,101 @@ struct SKeyReturnVal {
   std::string key;           
   std::string value;
   uint64_t sequence_number;
+  double rank_value;         // See ReadOptions::ranking_attribute
     static bool comp(const leveldb::SKeyReturnVal& a,const leveldb::SKeyReturnVal& b)
     {
-       return a.sequence_number<b.sequence_number?false:true;
+       return a.sequence_number > b.sequence_number;
     }
     void Push(vector<leveldb::SKeyReturnVal>* heap,leveldb::SKeyReturnVal val) {
-        heap->push_back(val);
+        heap->push_back(std::move(val));
         push_heap(heap->begin(), heap->end(), comp);
     }
     leveldb::SKeyReturnVal Pop(vector<leveldb::SKeyReturnVal>* heap) {
-        leveldb::SKeyReturnVal val = heap->front();
-
         //This operation will move the smallest element to the end of the vector
         pop_heap(heap->begin(), heap->end(), comp);
 
         //Remove the last element from vector, which is the smallest element
+        leveldb::SKeyReturnVal val = std::move(heap->back());
         heap->pop_back(); 
         return val;
     }
 };
+
+// A secondary lookup hit whose key and value point into memory pinned by
+// the SecondaryResultSet that holds it (a block-cache entry, a table
+// block or a memtable arena).  Valid only while that result set is live.
+struct SKeyPinnedVal {
+  Slice key;
+  Slice value;
+  uint64_t sequence_number;
+  double rank_value;         // See ReadOptions::ranking_attribute
+};
+
+// Summary of the live documents carrying a secondary key, as returned by
+// DB::GetSecondaryAggregate().  sum, min and max are over the value_count
+// documents whose Options::rankingAtt is a number (min and max are 0 if
+// there are none).
+struct SecondaryAggregate {
+  uint64_t count;
+  uint64_t value_count;
+  double sum;
+  double min;
+  double max;
+
+  // Data blocks read, and data blocks counted from their statistics
+  // alone (see Options::secondary_block_stats).
+  uint64_t blocks_read;
+  uint64_t blocks_summarized;
+};
+
+// Result of a zero-copy secondary lookup.  Holds the hits best first
+// (newest first unless ReadOptions::ranking_attribute is set) together
+// with references on the blocks and memtables their slices point into;
+// the references are dropped when the result set is cleared or
+// destroyed.  Not safe for concurrent use.
+class SecondaryResultSet {
+ public:
+  SecondaryResultSet();
+  ~SecondaryResultSet();
+
+  size_t size() const { return results_.size(); }
+  bool empty() const { return results_.empty(); }
+  const SKeyPinnedVal& operator[](size_t i) const { return results_[i]; }
+
+  // Drop every hit and release everything pinned on their behalf.
+  void Clear();
+
+  // Where an incomplete lookup stopped; pass it as
+  // ReadOptions::resume_cursor to continue.  Empty if it was complete.
+  const std::string& resume_cursor() const { return resume_cursor_; }
+  void set_resume_cursor(const std::string& c) { resume_cursor_ = c; }
+
+  // Clients are allowed to register function/arg1/arg2 triples that
+  // will be invoked when this result set is cleared or destroyed.
+  typedef void (*CleanupFunction)(void* arg1, void* arg2);
+  void RegisterCleanup(CleanupFunction function, void* arg1, void* arg2);
+
+  // Used by the lookup to maintain its top-K heap in place.
+  std::vector<SKeyPinnedVal>* mutable_results() { return &results_; }
+
+ private:
+  struct Cleanup {
+    CleanupFunction function;
+    void* arg1;
+    void* arg2;
+    Cleanup* next;
+  };
+  Cleanup* cleanup_;
+  std::vector<SKeyPinnedVal> results_;
+  std::string resume_cursor_;
+
+  void RunCleanups();
+
+  // No copying allowed
+  SecondaryResultSet(const SecondaryResultSet&);
+  void operator=(const SecondaryResultSet&);
+};
+
 // A DB is a persistent ordered map from keys to values.
 // A DB is safe for concurrent access from multiple threads without
 // any external synchronization.
@@ -94,6 +172,35 @@ class DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Apply the merge operand "value" to the database entry for "key" with
+  // Options::merge_operator.  The entry is not read: the operand is
+  // applied when the entry is next read or compacted.  Returns
+  // NotSupported if the database has no merge operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options, const Slice& key,
+                       const Slice& value) = 0;
+
+  // Remove the database entries (if any) for all keys in ["begin",
+  // "end").  A single range tombstone is written, so the cost does not
+  // depend on how many entries the range holds; they are dropped in bulk
+  // by later compactions.  It is not an error if the range is empty.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin, const Slice& end) = 0;
+
+  // Remove every record whose value carries the secondary key "skey"
+  // (see Options::secondaryAtt), as found by a secondary lookup on a
+  // snapshot taken at the start of the call, and store their number in
+  // *deleted.  A record rewritten or deleted since the snapshot is left
+  // alone.  That check is not atomic with the deletion, however: a
+  // record rewritten after its check and before its batch is written is
+  // deleted, even if its new value lacks "skey".  The records are
+  // deleted in batches, so on error some of them may already be gone;
+  // *deleted counts those.
+  virtual Status DeleteBySecondaryKey(const WriteOptions& options,
+                                      const Slice& skey,
+                                      uint64_t* deleted) = 0;
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -114,6 +221,36 @@ class DB {
                    const Slice& skey,
                    std::vector<SKeyReturnVal>* value, int kNoOfOutputs) = 0;
 
+  // Same lookup as above, but the returned keys and values are not
+  // copied: they point into block-cache entries and memtables that stay
+  // pinned until *result is cleared or destroyed.  Any previous contents
+  // of *result are released first.  *result must be cleared or
+  // destroyed before the DB is deleted.  Prefer this form for large K.
+  //
+  // If a budget set in "options" runs out, the hits found so far are
+  // returned with a status for which IsIncomplete() is true, and
+  // result->resume_cursor() can be used to continue the lookup.
+  virtual Status Get(const ReadOptions& options,
+                   const Slice& skey,
+                   SecondaryResultSet* result, int kNoOfOutputs) = 0;
+
+  // Same as the two lookups above, but for the K most recent (or best
+  // ranked) documents satisfying "query"; see leveldb/secondary_query.h.
+  virtual Status Get(const ReadOptions& options,
+                     const SecondaryQuery& query,
+                     std::vector<SKeyReturnVal>* value, int kNoOfOutputs) = 0;
+  virtual Status Get(const ReadOptions& options,
+                     const SecondaryQuery& query,
+                     SecondaryResultSet* result, int kNoOfOutputs) = 0;
+
+  // Store in *result the number of live documents whose secondary key is
+  // "skey", and the count, sum and range of their numeric
+  // Options::rankingAtt.  Unlike the lookups above, no document is
+  // returned, and blocks of tables written with
+  // Options::secondary_block_stats may be counted without being read.
+  virtual Status GetSecondaryAggregate(const ReadOptions& options,
+                                       const Slice& skey,
+                                       SecondaryAggregate* result) = 0;
   
 
   // Return a heap-allocated iterator over the contents of the database.
@@ -161,6 +298,16 @@ class DB {
   virtual void GetApproximateSizes(const Range* range, int n,
                                    uint64_t* sizes) = 0;
 
+  // Store in "*count" an estimate of the number of documents whose
+  // secondary key is "skey", to choose between an index lookup and a
+  // scan without reading any document.  Tables are counted by the
+  // sketches of Options::secondary_count_sketch_width, which tend to
+  // overestimate; a record rewritten since it was last compacted may be
+  // counted more than once, and tables written without a sketch are not
+  // counted at all.
+  virtual Status GetApproximateSecondaryCount(const Slice& skey,
+                                              uint64_t* count) = 0;
+
   // Compact the underlying storage for the key range [*begin,*end].
   // In particular, deleted and overwritten versions are discarded,
   // and the data is rearranged to reduce the cost of operations
@@ -0,0 +1,28 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Access to documents stored in the binary encoding selected by
+// Options::binary_documents.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_DOCUMENT_H_
+#define STORAGE_LEVELDB_INCLUDE_DOCUMENT_H_
+
+#include <string>
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+struct Options;
+
+// Store in *json the JSON text of the document "value", as read from a
+// database opened with "options" (for example through an iterator or a
+// SecondaryResultSet).  A value that is JSON text already is copied
+// unchanged.
+extern Status DocumentToJson(const Options& options, const Slice& value,
+                             std::string* json);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_DOCUMENT_H_
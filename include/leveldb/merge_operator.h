@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom MergeOperator object.  It
+// gives DB::Merge() its meaning: a merge operand written for a key is
+// stored as is, without reading the key's current value, and is applied
+// to that value when the key is read or compacted.
+//
+// For example, an operand that sets a single field of a document updates
+// the document without a read-modify-write cycle.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+
+namespace leveldb {
+
+class Slice;
+
+class MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Return the name of this operator.
+  virtual const char* Name() const = 0;
+
+  // Store in *new_value the result of applying "operand" to the value
+  // "*existing_value" of "key", or to no value if existing_value is
+  // NULL.  Return false if the operand cannot be applied; the read or
+  // compaction meeting it then fails with a Corruption status.
+  //
+  // Operands are applied one at a time, oldest first.
+  virtual bool Merge(const Slice& key, const Slice* existing_value,
+                     const Slice& operand, std::string* new_value) const = 0;
+};
+
+// Return a merge operator that treats each operand as a JSON merge patch
+// (RFC 7396) of a JSON document: attributes of the patch replace those
+// of the document, patches for object attributes apply recursively, and
+// attributes set to null are removed.  A document absent or not an
+// object is patched as an empty object, and an operand that is not an
+// object replaces the document.  Documents must be stored as JSON text:
+// DB::Open rejects this operator if Options::binary_documents is set.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const MergeOperator* NewJsonMergeOperator();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -6,17 +6,20 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
 #include <iostream>
 #include <vector>
+#include "leveldb/cache.h"
 using namespace std;
 
 namespace leveldb {
 
-class Cache;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class SecondaryKeyExtractor;
+class MergeOperator;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -30,6 +33,35 @@ enum CompressionType {
   kSnappyCompression = 0x1
 };
 
+// How newly written tables index the secondary keys of their data blocks
+// (see Options::secondary_index_type).
+enum SecondaryIndexType {
+  // A filter of the secondary keys of every data block, built by the
+  // filter policy.
+  kSecondaryFilterIndex = 0x0,
+
+  // In addition, for every distinct secondary key of a table, a
+  // compressed bitmap of the data blocks that hold it.  Exact where
+  // filters are not, and small for attributes with few distinct values,
+  // whose keys occur in almost every block and so defeat the filters.
+  kSecondaryBitmapIndex = 0x1
+};
+
+// Whether the DB also keeps a stand-alone secondary index table (see
+// Options::secondary_index_table).
+enum SecondaryIndexTableType {
+  kNoSecondaryIndexTable = 0x0,
+
+  // One key per record and secondary key, made of the secondary key,
+  // the record's sequence number and its primary key, so that the
+  // records of a secondary key are contiguous and newest first.
+  kSecondaryCompositeIndexTable = 0x1,
+
+  // One posting list per secondary key.  Writes append their postings
+  // lazily, as merge operands, and compactions merge them.
+  kSecondaryPostingIndexTable = 0x2
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct Options {
   // -------------------
@@ -138,12 +170,177 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
-  // Create an Options object with default values for all fields.
+  // Document attribute to build the secondary index on.  A dot-separated
+  // path ("user.country") reaches into nested objects, and every element
+  // of an array met along the path is indexed, so a document can be found
+  // under several secondary keys.
   string secondaryAtt;
+
+  // If set, the secondary index is a composite index over secondaryAtt
+  // followed by this attribute.  Queries that constrain both attributes
+  // to single values are then filtered per block on the pair, and
+  // lookups on secondaryAtt alone become prefix lookups.  Tables written
+  // under a different index definition are read without their secondary
+  // filters.
+  //
+  // Default: empty (index secondaryAtt alone)
+  string secondaryTrailingAtt;
   string PrimaryAtt;
+
+  // The structure that indexes the secondary keys in newly written
+  // tables.  Choose kSecondaryBitmapIndex for an attribute with a
+  // handful of distinct values (a status, a type, a region): secondary
+  // lookups then read only the blocks that hold a match, and
+  // conjunctions intersect the bitmaps of their terms.  Tables written
+  // under either type can be read under the other.
+  //
+  // Default: kSecondaryFilterIndex
+  SecondaryIndexType secondary_index_type;
+
+  // If positive, newly written tables also keep, for every secondary key
+  // carried by at least this fraction of their entries (a default tenant,
+  // a common status), an explicit list of those entries newest first.
+  // Such keys are detected with a sketch of bounded size while the table
+  // is built.  Secondary lookups covered by the lists of a table read
+  // just the listed entries instead of every block whose filter matches,
+  // and stop as soon as the remaining entries are too old to enter the
+  // result.
+  //
+  // Default: 0 (no posting lists)
+  double secondary_heavy_hitter_fraction;
+
+  // If positive, newly written tables also keep a count-min sketch of
+  // this many counters per row (and 4 rows) of the secondary keys of
+  // their records, from which DB::GetApproximateSecondaryCount()
+  // estimates how many records carry a key without reading any data
+  // block.  An estimate for a table overshoots by more than 2/width of
+  // its records only with small probability.  The sketch takes 16 bytes
+  // per unit of width in every table.
+  //
+  // Default: 0 (no sketch)
+  int secondary_count_sketch_width;
+
+  // If true, newly written tables also record the set of hashes of their
+  // secondary keys, and every version of the DB keeps, per level, the
+  // union of the sets of its files.  A secondary lookup or aggregate then
+  // skips, with a single probe, each level none of whose files carries
+  // its keys, instead of probing the filter of every file.  A level is
+  // only summarized once all of its files were written with this option.
+  // The sets of the table files are saved to a sidecar file when the DB
+  // is closed, so that reopening it does not read every table.
+  //
+  // Default: false
+  bool secondary_level_summaries;
+
+  // If positive, the DB also keeps in memory a directory from up to this
+  // many secondary keys to the table files holding them, maintained as
+  // tables are flushed and compacted and rebuilt when the DB is opened.
+  // A secondary lookup or aggregate on tracked keys then visits just the
+  // listed files instead of probing the filter of every file.  Keys held
+  // by many files, or first written once the directory is full, are not
+  // tracked, and fall back to the filters.  Each tracked key takes about
+  // 100 bytes.  Like secondary_level_summaries, needs tables written
+  // with the hashes of their keys; the two share them.
+  //
+  // Default: 0 (no directory)
+  size_t secondary_file_directory_keys;
+
+  // If non-NULL, the results of DB::Get by a secondary key are kept in
+  // this cache (e.g. one made by NewLRUCache()), keyed by the key, the
+  // number of results asked for and the ReadOptions that shape them.  A
+  // repeated lookup is answered from it, unless a write since could have
+  // changed its result: one carrying the key, one to a record it
+  // returned, a merge operand or a range deletion.  Lookups at a
+  // snapshot, in a window of sequence numbers or resuming an earlier one
+  // bypass it.  The cache may be shared by several DBs.
+  //
+  // Default: NULL
+  Cache* secondary_result_cache;
+
+  // If true, a data block that a secondary lookup read because the
+  // secondary filter let its keys through, but that holds none of them,
+  // is remembered as such in the block cache, which charges a few dozen
+  // bytes per (key, block) pair against its capacity.  Later lookups of
+  // those keys skip the block instead of paying for the same filter
+  // false positive again.
+  //
+  // Default: false
+  bool secondary_negative_block_cache;
+
+  // If not kNoSecondaryIndexTable, the DB also keeps a secondary index
+  // table keyed by secondary key, maintained in the same WriteBatch and
+  // log record as the records it indexes.  Secondary lookups that the
+  // index keys cover then cost a few seeks in that table, plus a read of
+  // each hit, instead of probing the secondary filters of every table
+  // file.  The index table is stored under reserved user keys beginning
+  // with "\xff\xff\xff", which DeleteRange() must not cover.
+  //
+  // REQUIRES: comparator is the bytewise comparator and there is no
+  // merge_operator; DB::Open() fails otherwise.
+  //
+  // Default: kNoSecondaryIndexTable
+  SecondaryIndexTableType secondary_index_table;
+
+  // If non-NULL, use the specified extractor to compute the secondary
+  // keys of stored values instead of reading the JSON attribute
+  // secondaryAtt.  Secondary lookups, and SecondaryQuery terms on
+  // secondaryAtt, are then answered with the extractor's keys, and
+  // secondaryTrailingAtt is ignored.  If secondaryAtt is empty it
+  // defaults to the extractor's name.
+  //
+  // Default: NULL
+  const SecondaryKeyExtractor* secondary_key_extractor;
+
+  // If non-NULL, use the specified operator to apply the operands
+  // written by DB::Merge().  Merge() is not supported without one.  The
+  // same operator must be used every time the database is opened once
+  // operands have been written.  See leveldb/merge_operator.h.
+  //
+  // Default: NULL
+  const MergeOperator* merge_operator;
+
+  // Numeric document attribute whose per-block and per-table range is
+  // recorded in newly written tables.  Secondary lookups ranked by this
+  // attribute (see ReadOptions::ranking_attribute) use the ranges to skip
+  // blocks and tables that cannot improve their result.
+  //
+  // Default: empty (no ranges recorded)
+  string rankingAtt;
+
+  // If true, newly written tables also record, for every secondary key of
+  // every data block, how many records carry it along with the count,
+  // range and sum of their numeric rankingAtt values.
+  // DB::GetSecondaryAggregate() then answers from these statistics for
+  // the blocks that no newer data overlaps, without reading them.  The
+  // statistics take about as much space as the secondary keys of each
+  // block.
+  //
+  // Default: false
+  bool secondary_block_stats;
+
+  // If true, Put(value) stores documents in a binary encoding instead of
+  // JSON text: top-level attributes named in document_schema are stored
+  // without their names at a fixed position, and no stored document has
+  // to be parsed as text again.  Secondary keys, query terms and ranking
+  // values are read from either form, so the option may be turned on for
+  // an existing database.  See ReadOptions::json_documents and
+  // DocumentToJson() for reading binary documents back as JSON.  The
+  // operator of NewJsonMergeOperator() cannot patch binary documents, so
+  // DB::Open rejects it with this option.
+  //
+  // Default: false
+  bool binary_documents;
+
+  // Top-level attribute names interned by the binary encoding.  Names may
+  // be appended, but never removed or reordered, once documents have
+  // been stored with them.
+  //
+  // Default: empty
+  std::vector<string> document_schema;
   //////////////////Secondary Filter////////////
   
   
+  // Create an Options object with default values for all fields.
   Options();
 };
 
@@ -166,10 +363,83 @@ struct ReadOptions {
   // Default: NULL
   const Snapshot* snapshot;
 
+  // Secondary lookups only: return just the records whose visible
+  // version was written at a sequence number in
+  // [min_sequence, max_sequence].  Pass the sequence_number of the last
+  // hit seen plus one as min_sequence to fetch only newer writes; table
+  // files entirely outside the window are not read.
+  // Default: every sequence number
+  uint64_t min_sequence;
+  uint64_t max_sequence;
+
+  // Secondary lookups only: if non-empty, return the K records with the
+  // highest (or, if ranking_ascending, the lowest) numeric value of this
+  // document attribute instead of the K most recent ones.  Records
+  // without a numeric value for it are not returned.
+  // Default: empty (rank by recency)
+  std::string ranking_attribute;
+  bool ranking_ascending;
+
+  // Secondary lookups only: stop once this many data blocks have been
+  // read, this many table files probed, or this many microseconds spent.
+  // The hits found so far are then returned with a status for which
+  // IsIncomplete() is true.  Zero means no limit.
+  // Default: 0
+  int max_blocks_read;
+  int max_files_probed;
+  uint64_t max_micros;
+
+  // Secondary lookups only: if non-empty, the resume_cursor() of the
+  // result of an earlier incomplete lookup.  The lookup then skips the
+  // memtables and the files and blocks that one already read.  Best
+  // effort if the DB was compacted in between.
+  // Default: empty
+  std::string resume_cursor;
+
+  // If true, documents stored in the binary encoding (see
+  // Options::binary_documents) are converted back to JSON text by
+  // DB::Get and by the forms of the secondary Get that copy their
+  // results.  Other reads return the stored bytes.
+  // Default: false
+  bool json_documents;
+
+  // NewIterator only: if non-empty, the iterator yields just the records
+  // whose document carries this key of the secondary attribute
+  // (Options::secondaryAtt, or its leading attribute for a composite
+  // index).  Data blocks whose secondary filter rules the key out are
+  // not read.  A skipped block may hold a newer version or the deletion
+  // of a record found in another, so when Options::filter_policy is set
+  // each record found is checked against its live version, with a point
+  // lookup, before it is returned.  A scan thus costs about two reads
+  // per record returned: far less than a plain scan of a range where
+  // the key is rare, but more where most records carry it.  Without a
+  // filter policy no block is skipped and no record is checked.
+  // Default: empty (every record)
+  std::string secondary_key;
+
+  // The priority (see CachePriority) at which data blocks are looked up
+  // in and inserted into the block cache: by point reads and iterators,
+  // and by secondary lookups, aggregates and iterators over a secondary
+  // key, which stream many blocks that are seldom read again.  By
+  // default the blocks of the latter enter the cache on probation, to be
+  // evicted before those of other reads unless one of those reads them.
+  // Default: kHighCachePriority and kLowCachePriority
+  CachePriority cache_priority;
+  CachePriority secondary_cache_priority;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(NULL) {
+        snapshot(NULL),
+        min_sequence(0),
+        max_sequence(~static_cast<uint64_t>(0)),
+        ranking_ascending(false),
+        max_blocks_read(0),
+        max_files_probed(0),
+        max_micros(0),
+        json_documents(false),
+        cache_priority(kHighCachePriority),
+        secondary_cache_priority(kLowCachePriority) {
   }
 };
 
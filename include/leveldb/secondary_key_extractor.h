@@ -0,0 +1,56 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom SecondaryKeyExtractor
+// object.  This object is responsible for computing the secondary keys
+// of a stored value.  The keys are entered in the memtable postings and
+// the secondary filters, and are what secondary lookups match against.
+//
+// By default the keys are taken from a JSON attribute of the value (see
+// Options::secondaryAtt and NewJsonSecondaryKeyExtractor() below).  An
+// application storing values in its own format can instead supply an
+// extractor that reads the keys directly, without any parsing.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SECONDARY_KEY_EXTRACTOR_H_
+#define STORAGE_LEVELDB_INCLUDE_SECONDARY_KEY_EXTRACTOR_H_
+
+#include <string>
+#include <vector>
+
+namespace leveldb {
+
+class Slice;
+
+class SecondaryKeyExtractor {
+ public:
+  virtual ~SecondaryKeyExtractor();
+
+  // Return the name of this extractor.  The name is recorded with the
+  // secondary filters of every table, so it must change whenever the
+  // keys extracted from a value change.  Otherwise filters built with
+  // the old keys may wrongly rule out blocks.
+  virtual const char* Name() const = 0;
+
+  // Append the secondary keys of "value" to *keys.  A value may carry no
+  // key, one key, or several keys.  It is found by a lookup on any of
+  // them.  Duplicates should be left out.
+  //
+  // Warning: do not change the initial contents of *keys.
+  virtual void Extract(const Slice& value,
+                       std::vector<std::string>* keys) const = 0;
+};
+
+// Return an extractor that takes the secondary keys of a JSON document
+// from "attribute", as described for Options::secondaryAtt.  The
+// extractor used when Options::secondary_key_extractor is NULL is of
+// this kind, and also knows Options::document_schema.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const SecondaryKeyExtractor* NewJsonSecondaryKeyExtractor(
+    const std::string& attribute);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SECONDARY_KEY_EXTRACTOR_H_
@@ -0,0 +1,69 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SecondaryQuery is a boolean predicate over document attributes, for
+// use with the query form of DB::Get.  For example
+//
+//    SecondaryQuery::And(SecondaryQuery::Equals("status", "open"),
+//                        SecondaryQuery::Equals("region", "eu"))
+//
+// Attributes are paths as described for Options::secondaryAtt.  Terms on
+// the indexed attribute (Options::secondaryAtt) are evaluated against the
+// secondary filters and memtable postings before any document is read;
+// terms on other attributes are checked on the documents that the
+// indexed terms let through.  With a composite index (see
+// Options::secondaryTrailingAtt), a conjunction fixing both of its
+// attributes is looked up by the pair.  A query that cannot be narrowed
+// by indexed terms, such as an OR with an unindexed branch, reads every
+// document.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SECONDARY_QUERY_H_
+#define STORAGE_LEVELDB_INCLUDE_SECONDARY_QUERY_H_
+
+#include <string>
+#include <vector>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class SecondaryQuery {
+ public:
+  enum Op {
+    kEquals,
+    kAnd,
+    kOr
+  };
+
+  // Match documents whose "attribute" carries the key "value".
+  static SecondaryQuery Equals(const Slice& attribute, const Slice& value);
+
+  // Match documents whose "attribute" carries any of "values".
+  static SecondaryQuery In(const Slice& attribute,
+                           const std::vector<std::string>& values);
+
+  // Match documents matched by both, or by either, of the queries.
+  static SecondaryQuery And(const SecondaryQuery& a, const SecondaryQuery& b);
+  static SecondaryQuery Or(const SecondaryQuery& a, const SecondaryQuery& b);
+
+  Op op() const { return op_; }
+
+  // REQUIRES: op() == kEquals
+  const std::string& attribute() const { return attribute_; }
+  const std::string& value() const { return value_; }
+
+  // REQUIRES: op() != kEquals
+  const std::vector<SecondaryQuery>& children() const { return children_; }
+
+ private:
+  explicit SecondaryQuery(Op op) : op_(op) { }
+
+  Op op_;
+  std::string attribute_;
+  std::string value_;
+  std::vector<SecondaryQuery> children_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SECONDARY_QUERY_H_
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <unordered_set>
+#include "leveldb/cache.h"
 #include "leveldb/iterator.h"
 #include "db/dbformat.h"
 #include <vector>
@@ -19,7 +20,10 @@ class BlockHandle;
 class Footer;
 struct Options;
 class RandomAccessFile;
+class RoaringBitmap;
 struct ReadOptions;
+class SecondaryAggregator;
+class SecondaryLookup;
 class TableCache;
 
 // A Table is a sorted map from strings to strings.  Tables are
@@ -51,6 +55,11 @@ class Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the range tombstones of the table, in the
+  // form described in db/range_tombstone.h, or an iterator carrying the
+  // error if they could not be read.
+  Iterator* NewRangeTombstoneIterator() const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -59,12 +68,29 @@ class Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // If the table was built with options.secondary_count_sketch_width,
+  // store in *count an estimate, never below the true value, of the
+  // number of records of the table whose newest entry carries the
+  // secondary index key "index_key", and return true.  Otherwise return
+  // false.
+  bool ApproximateSecondaryCount(const Slice& index_key,
+                                 uint64_t* count) const;
+
+  // If the table was built with options.secondary_level_summaries, read
+  // the hashes of its secondary keys into *hashes and return true.
+  // Otherwise, or if they cannot be read, return false.
+  bool ReadSecondaryKeyHashes(RoaringBitmap* hashes) const;
+
  private:
   struct Rep;
   Rep* rep_;
 
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  // Same as BlockReader, but a block whose secondary filter rules out
+  // options.secondary_key is not read and yields no entries.
+  static Iterator* SecondaryKeyBlockReader(void*, const ReadOptions&,
+                                           const Slice&);
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
@@ -74,13 +100,53 @@ class Table {
       const ReadOptions&, const Slice& key,
       void* arg,
       void (*handle_result)(void* arg, const Slice& k, const Slice& v));
-  Status InternalGet(const ReadOptions& options, const Slice& k,
-                          void* arg,
-                          bool (*saver)(void*, const Slice&, const Slice&,std::string secKey,int topKOutput, DBImpl* db),string secKey,int topKOutput,DBImpl* db) ;
+  // Feeds every entry of the data blocks whose secondary filter may
+  // satisfy the query of *lookup into *lookup.  Blocks holding retained
+  // hits are pinned in lookup->result(); *pinned is set iff any were, in
+  // which case the caller must also keep this table open for as long as
+  // the result.
+  Status InternalGet(const ReadOptions& options,
+                     SecondaryLookup* lookup, bool* pinned);
+  // Feeds the entries named by "entries", internal keys listed by the
+  // posting lists of the table newest first, into *lookup until older
+  // ones cannot enter its result.  Same pinning as above.
+  Status ReadPostings(const ReadOptions& options,
+                      const std::vector<std::string>& entries,
+                      SecondaryLookup* lookup, bool* pinned);
+  // Feeds the entries of the data blocks that may hold a record carrying
+  // the key of *aggregator into it, or, where the secondary statistics
+  // of a block still describe live records, the statistics alone.
+  Status InternalGet(const ReadOptions& options,
+                     SecondaryAggregator* aggregator);
+
+  // Load the data block named by the encoded BlockHandle "index_value",
+  // through the block cache when there is one.  On success *cache_handle
+  // is the cache reference to release, or NULL if the caller owns *block.
+  Status ReadDataBlock(const ReadOptions& options, const Slice& index_value,
+                       Block** block, Cache::Handle** cache_handle) const;
+
+  // Return true iff the block cache records that the data block at
+  // "offset" holds none of the secondary index keys "keys".  Like the
+  // blocks a lookup reads, these records are cached at
+  // options.cache_priority.
+  bool BlockLacksKeys(const ReadOptions& options, uint64_t offset,
+                      const std::vector<std::string>& keys) const;
+  // Record in the block cache which of "keys" the data block "block",
+  // at "offset", does not hold.  Records nothing if the block holds
+  // merge operands, whose keys are only known once merged.
+  void NoteMissingKeys(const ReadOptions& options, uint64_t offset,
+                       Block* block,
+                       const std::vector<std::string>& keys) const;
 
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
   void ReadSecondaryFilter(const Slice& filter_handle_value);
+  void ReadRangeTombstones(const Slice& handle_value);
+  // Read the statistics, bitmap or posting block named by
+  // "handle_value", with its checksum verified.  Returns NULL if it
+  // cannot be read.
+  Block* ReadSecondaryIndexBlock(const Slice& handle_value);
+  void ReadSecondarySketch(const Slice& handle_value);
 
   // No copying allowed
   Table(const Table&);
@@ -46,6 +46,15 @@ class TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add a range tombstone deleting the keys in ["begin_key", "end") to
+  // the table, in a meta block of its own (see db/range_tombstone.h).
+  // "begin_key" is compared like the keys passed to Add(), but is
+  // independent of them.
+  // REQUIRES: begin_key is after any previously added begin_key according
+  // to comparator.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeTombstone(const Slice& begin_key, const Slice& end);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -78,6 +87,9 @@ class TableBuilder {
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  // Count the entry "key" towards the heavy hitters, listing it under
+  // the secondary key "skey" if that is tracked.
+  void AddPosting(const Slice& skey, const Slice& key);
 
   struct Rep;
   Rep* rep_;
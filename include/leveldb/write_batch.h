@@ -27,6 +27,7 @@
 namespace leveldb {
 
 class Slice;
+struct Options;
 
 class WriteBatch {
  public:
@@ -36,9 +37,33 @@ class WriteBatch {
   // Store the mapping "key->value" in the database.
   void Put(const Slice& key, const Slice& value);
 
+  // Store the JSON document "document" under the value of its primary
+  // attribute, as DB::Put(options, document) does.  The document is
+  // parsed, and its secondary keys extracted, by the calling thread now
+  // rather than when the batch is written, so that threads filling
+  // batches for one database do this work in parallel.
+  //
+  // REQUIRES: "options" are the options the database the batch is
+  // written to was opened with.  The database does not check them: a
+  // batch prepared with a different PrimaryAtt, secondaryAtt,
+  // secondaryTrailingAtt, secondary_key_extractor, binary_documents or
+  // document_schema stores the record, or indexes it in the memtable,
+  // under the wrong keys without any error.
+  Status PutDocument(const Options& options, const Slice& document);
+
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Apply the merge operand "value" to the mapping for "key"; see
+  // Options::merge_operator.
+  void Merge(const Slice& key, const Slice& value);
+
+  // Erase the mappings for all keys in ["begin", "end"), as ordered by
+  // the database's comparator.  A single range tombstone is recorded
+  // however many keys it covers.  It is recorded even if "begin" is not
+  // before "end", but then deletes nothing.
+  void DeleteRange(const Slice& begin, const Slice& end);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -48,6 +73,10 @@ class WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // The default implementation ignores merge operands.
+    virtual void Merge(const Slice& key, const Slice& value);
+    // The default implementation ignores range deletions.
+    virtual void DeleteRange(const Slice& begin, const Slice& end);
   };
   Status Iterate(Handler* handler) const;
 
@@ -55,6 +84,7 @@ class WriteBatch {
   friend class WriteBatchInternal;
 
   std::string rep_;  // See comment in write_batch.cc for the format of rep_
+  std::string secondary_keys_;  // Keys extracted by PutDocument(), ditto
 
   // Intentionally copyable
 };
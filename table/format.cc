@@ -4,6 +4,8 @@
 
 #include "table/format.h"
 #include <fstream>
+#include <limits>
+#include <string.h>
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "table/block.h"
@@ -34,6 +36,104 @@ Status BlockHandle::DecodeFrom(Slice* input) {
   }
 }
 
+RankRange::RankRange()
+    : min_(std::numeric_limits<double>::infinity()),
+      max_(-std::numeric_limits<double>::infinity()) {
+}
+
+void RankRange::Add(double value) {
+  if (value < min_) min_ = value;
+  if (value > max_) max_ = value;
+}
+
+void RankRange::Add(const RankRange& other) {
+  if (other.min_ < min_) min_ = other.min_;
+  if (other.max_ > max_) max_ = other.max_;
+}
+
+static void PutDouble(std::string* dst, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  PutFixed64(dst, bits);
+}
+
+static double DecodeDouble(const char* ptr) {
+  uint64_t bits = DecodeFixed64(ptr);
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void RankRange::EncodeTo(std::string* dst) const {
+  PutDouble(dst, min_);
+  PutDouble(dst, max_);
+}
+
+bool RankRange::DecodeFrom(Slice* input) {
+  if (input->size() < kEncodedLength) {
+    return false;
+  }
+  min_ = DecodeDouble(input->data());
+  max_ = DecodeDouble(input->data() + 8);
+  input->remove_prefix(kEncodedLength);
+  return true;
+}
+
+SecondaryStats::SecondaryStats()
+    : count_(0),
+      value_count_(0),
+      sum_(0) {
+}
+
+void SecondaryStats::Add(const double* value) {
+  count_++;
+  if (value != NULL) {
+    value_count_++;
+    sum_ += *value;
+    range_.Add(*value);
+  }
+}
+
+void SecondaryStats::Add(const SecondaryStats& other) {
+  count_ += other.count_;
+  value_count_ += other.value_count_;
+  sum_ += other.sum_;
+  range_.Add(other.range_);
+}
+
+void SecondaryStats::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, count_);
+  PutVarint64(dst, value_count_);
+  if (value_count_ > 0) {
+    PutDouble(dst, sum_);
+    range_.EncodeTo(dst);
+  }
+}
+
+bool SecondaryStats::DecodeFrom(Slice* input) {
+  *this = SecondaryStats();
+  if (!GetVarint64(input, &count_) || !GetVarint64(input, &value_count_)) {
+    return false;
+  }
+  if (value_count_ > 0) {
+    if (input->size() < 8) {
+      return false;
+    }
+    sum_ = DecodeDouble(input->data());
+    input->remove_prefix(8);
+    return range_.DecodeFrom(input);
+  }
+  return true;
+}
+
+void AppendSecondaryStatsKey(std::string* dst, const Slice& index_key,
+                             uint64_t offset) {
+  PutLengthPrefixedSlice(dst, index_key);
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    dst->push_back(static_cast<char>((offset >> shift) & 0xff));
+  }
+}
+
 void Footer::EncodeTo(std::string* dst) const {
 #ifndef NDEBUG
   const size_t original_size = dst->size();
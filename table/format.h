@@ -42,6 +42,68 @@ class BlockHandle {
   uint64_t size_;
 };
 
+// RankRange is the range of values taken by Options::rankingAtt over
+// the entries of a data block or of a whole table.  It is appended to
+// the block handle of each index entry, and stored for the whole table
+// in the metaindex under "rankstats.<attribute>".
+class RankRange {
+ public:
+  // Create an empty range.
+  RankRange();
+
+  bool empty() const { return min_ > max_; }
+  double min() const { return min_; }
+  double max() const { return max_; }
+
+  void Add(double value);
+  void Add(const RankRange& other);
+
+  void EncodeTo(std::string* dst) const;
+  bool DecodeFrom(Slice* input);
+
+  enum { kEncodedLength = 16 };
+
+ private:
+  double min_;
+  double max_;
+};
+
+// SecondaryStats summarizes, for one secondary key and one data block,
+// the records whose newest entry in the table is a value carrying the
+// key: how many there are and, over those with a numeric
+// Options::rankingAtt, the count, range and sum of that attribute.
+// Tables built with Options::secondary_block_stats keep one for every
+// key of every block in a meta block, under the varint32-length-prefixed
+// index key followed by the big-endian block offset.
+class SecondaryStats {
+ public:
+  SecondaryStats();
+
+  uint64_t count() const { return count_; }
+  uint64_t value_count() const { return value_count_; }
+  double sum() const { return sum_; }
+  const RankRange& range() const { return range_; }
+
+  // Count a record, with its value of the attribute if "value" is
+  // non-NULL.
+  void Add(const double* value);
+  void Add(const SecondaryStats& other);
+
+  void EncodeTo(std::string* dst) const;
+  bool DecodeFrom(Slice* input);
+
+ private:
+  uint64_t count_;
+  uint64_t value_count_;
+  double sum_;
+  RankRange range_;
+};
+
+// Append to *dst the key of the SecondaryStats of "index_key" for the
+// data block at "offset".
+extern void AppendSecondaryStatsKey(std::string* dst, const Slice& index_key,
+                                    uint64_t offset);
+
 // Footer encapsulates the fixed information stored at the tail
 // end of every table file.
 class Footer {
@@ -13,7 +13,13 @@
 #include "table/filter_block.h"
 #include "table/format.h"
 #include "table/two_level_iterator.h"
+#include "db/secondary_aggregate.h"
+#include "db/secondary_lookup.h"
+#include "db/secondary_key.h"
 #include "util/coding.h"
+#include "util/count_min_sketch.h"
+#include "util/roaring_bitmap.h"
+#include <algorithm>
 #include <sstream>
 #include <fstream>
 #include <unordered_set>
@@ -32,6 +38,13 @@ struct Table::Rep {
   ~Rep() {
     delete filter;
     delete [] filter_data;
+    delete secondary_filter;
+    delete [] secondary_filter_data;
+    delete range_del_block;
+    delete secondary_stats_block;
+    delete secondary_bitmap_block;
+    delete secondary_posting_block;
+    delete secondary_sketch;
     delete index_block;
   }
 
@@ -45,8 +58,23 @@ struct Table::Rep {
   FilterBlockReader* secondary_filter;
   const char* secondary_filter_data;
 
+  // Set if the table was built with options.rankingAtt, in which case
+  // every index entry also carries the range for its data block.
+  bool has_rank_stats;
+  RankRange rank_range;
+
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  Block* range_del_block;        // NULL if the table has no range tombstones
+  Block* secondary_stats_block;  // NULL if absent or unreadable
+  Block* secondary_bitmap_block; // NULL if absent or unreadable
+  Block* secondary_posting_block;  // NULL if absent or unreadable
+  CountMinSketch* secondary_sketch;  // NULL if absent or unreadable
+
+  // Set if the table records the hashes of its secondary keys, which are
+  // only read on demand.
+  bool has_secondary_hashes;
+  BlockHandle secondary_hashes_handle;
 };
 
 Status Table::Open(const Options& options,
@@ -93,6 +121,13 @@ Status Table::Open(const Options& options,
     rep->filter = NULL;
     rep->secondary_filter_data = NULL;
     rep->secondary_filter = NULL;
+    rep->has_rank_stats = false;
+    rep->range_del_block = NULL;
+    rep->secondary_stats_block = NULL;
+    rep->secondary_bitmap_block = NULL;
+    rep->secondary_posting_block = NULL;
+    rep->secondary_sketch = NULL;
+    rep->has_secondary_hashes = false;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   } else {
@@ -107,10 +142,8 @@ void Table::ReadMeta(const Footer& footer) {
     //ofstream outputFile;
     //outputFile.open("/Users/nakshikatha/Desktop/test codes/debug.txt",std::ofstream::out | std::ofstream::app);
     //outputFile<<"read meta\n";
-  if (rep_->options.filter_policy == NULL) {
-    return;  // Do not need any metadata
-  }
-
+  // The metaindex is read even without a filter policy or ranking
+  // attribute: any table may hold range tombstones.
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
   ReadOptions opt;
@@ -122,22 +155,72 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-      //outputFile<<"valid P\n";
-    ReadFilter(iter->value());
-  }
+  if (rep_->options.filter_policy != NULL) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+        //outputFile<<"valid P\n";
+      ReadFilter(iter->value());
+    }
   
-  std::string skey = "secondaryfilter.";
-  skey.append(rep_->options.filter_policy->Name());
-  iter->Seek(skey);
-  //outputFile<<(iter->Valid())<<endl;
-  if (iter->Valid() && iter->key() == Slice(skey)) {
-      //outputFile<<"valid S\n";
-    ReadSecondaryFilter(iter->value());
-    //outputFile<<(rep_->secondary_filter==NULL)<<endl;
+    std::string skey = SecondaryFilterBlockName(rep_->options);
+    iter->Seek(skey);
+    //outputFile<<(iter->Valid())<<endl;
+    if (iter->Valid() && iter->key() == Slice(skey)) {
+        //outputFile<<"valid S\n";
+      ReadSecondaryFilter(iter->value());
+      //outputFile<<(rep_->secondary_filter==NULL)<<endl;
+    }
+  }
+
+  iter->Seek("rangedel");
+  if (iter->Valid() && iter->key() == Slice("rangedel")) {
+    ReadRangeTombstones(iter->value());
+  }
+
+  if (rep_->options.secondary_block_stats) {
+    std::string skey = SecondaryStatsBlockName(rep_->options);
+    iter->Seek(skey);
+    if (iter->Valid() && iter->key() == Slice(skey)) {
+      rep_->secondary_stats_block = ReadSecondaryIndexBlock(iter->value());
+    }
+  }
+
+  if (rep_->options.secondary_key_extractor != NULL) {
+    // Read whatever the index type tables are now written with.
+    std::string bkey = SecondaryBitmapBlockName(rep_->options);
+    iter->Seek(bkey);
+    if (iter->Valid() && iter->key() == Slice(bkey)) {
+      rep_->secondary_bitmap_block = ReadSecondaryIndexBlock(iter->value());
+    }
+    std::string pkey = SecondaryPostingBlockName(rep_->options);
+    iter->Seek(pkey);
+    if (iter->Valid() && iter->key() == Slice(pkey)) {
+      rep_->secondary_posting_block = ReadSecondaryIndexBlock(iter->value());
+    }
+    std::string hkey = SecondaryHashesBlockName(rep_->options);
+    iter->Seek(hkey);
+    if (iter->Valid() && iter->key() == Slice(hkey)) {
+      Slice v = iter->value();
+      rep_->has_secondary_hashes =
+          rep_->secondary_hashes_handle.DecodeFrom(&v).ok();
+    }
+    std::string ckey = SecondarySketchBlockName(rep_->options);
+    iter->Seek(ckey);
+    if (iter->Valid() && iter->key() == Slice(ckey)) {
+      ReadSecondarySketch(iter->value());
+    }
+  }
+
+  if (!rep_->options.rankingAtt.empty()) {
+    std::string rkey = "rankstats.";
+    rkey.append(rep_->options.rankingAtt);
+    iter->Seek(rkey);
+    if (iter->Valid() && iter->key() == Slice(rkey)) {
+      Slice v = iter->value();
+      rep_->has_rank_stats = rep_->rank_range.DecodeFrom(&v);
+    }
   }
   
   delete iter;
@@ -185,6 +268,96 @@ void Table::ReadSecondaryFilter(const Slice& filter_handle_value) {
 }
 
 
+void Table::ReadRangeTombstones(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+  // Unlike the filters, range tombstones are needed for correct reads,
+  // so their checksum is verified.
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents contents;
+  Status s = ReadBlock(rep_->file, opt, handle, &contents);
+  if (s.ok()) {
+    rep_->range_del_block = new Block(contents);
+  } else if (rep_->status.ok()) {
+    rep_->status = s;
+  }
+}
+
+void Table::ReadSecondarySketch(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+  // Only ever used for estimates: read like the filters.
+  ReadOptions opt;
+  BlockContents contents;
+  if (!ReadBlock(rep_->file, opt, handle, &contents).ok()) {
+    return;
+  }
+  Slice input = contents.data;
+  CountMinSketch* sketch = new CountMinSketch(1, 1);
+  if (sketch->DecodeFrom(&input)) {
+    rep_->secondary_sketch = sketch;
+  } else {
+    delete sketch;
+  }
+  if (contents.heap_allocated) {
+    delete[] contents.data.data();
+  }
+}
+
+bool Table::ReadSecondaryKeyHashes(RoaringBitmap* hashes) const {
+  if (!rep_->has_secondary_hashes) {
+    return false;
+  }
+  // Whole levels are skipped on their word: checksummed.
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents contents;
+  if (!ReadBlock(rep_->file, opt, rep_->secondary_hashes_handle,
+                 &contents).ok()) {
+    return false;
+  }
+  Slice input = contents.data;
+  const bool ok = hashes->DecodeFrom(&input);
+  if (contents.heap_allocated) {
+    delete[] contents.data.data();
+  }
+  return ok;
+}
+
+bool Table::ApproximateSecondaryCount(const Slice& index_key,
+                                      uint64_t* count) const {
+  if (rep_->secondary_sketch == NULL) {
+    return false;
+  }
+  *count = rep_->secondary_sketch->Estimate(index_key);
+  return true;
+}
+
+Block* Table::ReadSecondaryIndexBlock(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&v).ok()) {
+    return NULL;
+  }
+  // Unlike the filters, statistics, bitmaps and posting lists are exact
+  // and blocks are skipped on their word alone, so they are checksummed;
+  // without them the data blocks are read instead.
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents contents;
+  if (!ReadBlock(rep_->file, opt, handle, &contents).ok()) {
+    return NULL;
+  }
+  return new Block(contents);
+}
+
 Table::~Table() {
   delete rep_;
 }
@@ -198,21 +371,97 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
+static void DeleteNothing(const Slice& key, void* value) {
+}
+
+// Store in *dst the block cache key recording that the data block at
+// "offset" of the table "cache_id" lacks the secondary index key
+// "index_key".  The tag keeps it apart from the 16-byte block keys.
+static void MissingKeyCacheKey(uint64_t cache_id, uint64_t offset,
+                               const Slice& index_key, std::string* dst) {
+  dst->clear();
+  PutFixed64(dst, cache_id);
+  PutFixed64(dst, offset);
+  dst->push_back('m');
+  dst->append(index_key.data(), index_key.size());
+}
+
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
   cache->Release(handle);
 }
 
-// Convert an index iterator value (i.e., an encoded BlockHandle)
-// into an iterator over the contents of the corresponding block.
-Iterator* Table::BlockReader(void* arg,
-                             const ReadOptions& options,
-                             const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
-  Block* block = NULL;
-  Cache::Handle* cache_handle = NULL;
+// Hand a data block read for "lookup" to its result set if it holds a
+// retained hit, or else release it.
+static void KeepOrReleaseBlock(SecondaryLookup* lookup, Cache* block_cache,
+                               Block* block, Cache::Handle* cache_handle,
+                               bool retained, bool* pinned) {
+  if (retained) {
+    *pinned = true;
+    if (cache_handle != NULL) {
+      lookup->result()->RegisterCleanup(&ReleaseBlock, block_cache,
+                                        cache_handle);
+    } else {
+      lookup->result()->RegisterCleanup(&DeleteBlock, block, NULL);
+    }
+  } else if (cache_handle != NULL) {
+    block_cache->Release(cache_handle);
+  } else {
+    delete block;
+  }
+}
+
+static SequenceNumber EntrySequence(const Slice& internal_key) {
+  return DecodeFixed64(internal_key.data() + internal_key.size() - 8) >> 8;
+}
+
+static bool NewerEntry(const std::string& a, const std::string& b) {
+  const SequenceNumber sa = EntrySequence(a);
+  const SequenceNumber sb = EntrySequence(b);
+  return sa != sb ? sa > sb : a < b;
+}
+
+// If every key of "keys" has a posting list in "block", store in
+// *entries the internal keys the lists name, newest first and each
+// once, and return true.
+static bool GetPostings(Block* block, const std::vector<std::string>& keys,
+                        std::vector<std::string>* entries) {
+  bool result = true;
+  Iterator* iter = block->NewIterator(BytewiseComparator());
+  for (size_t i = 0; result && i < keys.size(); i++) {
+    iter->Seek(keys[i]);
+    if (!iter->Valid() || iter->key() != Slice(keys[i])) {
+      result = false;
+      break;
+    }
+    Slice input = iter->value();
+    uint32_t n;
+    result = GetVarint32(&input, &n);
+    for (uint32_t j = 0; result && j < n; j++) {
+      Slice entry;
+      result = GetLengthPrefixedSlice(&input, &entry) && entry.size() >= 8;
+      if (result) {
+        entries->push_back(entry.ToString());
+      }
+    }
+  }
+  delete iter;
+  if (result && keys.size() > 1) {
+    std::sort(entries->begin(), entries->end(), NewerEntry);
+    entries->erase(std::unique(entries->begin(), entries->end()),
+                   entries->end());
+  }
+  return result;
+}
+
+Status Table::ReadDataBlock(const ReadOptions& options,
+                            const Slice& index_value,
+                            Block** block,
+                            Cache::Handle** cache_handle) const {
+  Cache* block_cache = rep_->options.block_cache;
+  *block = NULL;
+  *cache_handle = NULL;
 
   BlockHandle handle;
   Slice input = index_value;
@@ -224,29 +473,96 @@ Iterator* Table::BlockReader(void* arg,
     BlockContents contents;
     if (block_cache != NULL) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
+      EncodeFixed64(cache_key_buffer, rep_->cache_id);
       EncodeFixed64(cache_key_buffer+8, handle.offset());
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
-      if (cache_handle != NULL) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+      *cache_handle = block_cache->Lookup(key, options.cache_priority);
+      if (*cache_handle != NULL) {
+        *block = reinterpret_cast<Block*>(block_cache->Value(*cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(rep_->file, options, handle, &contents);
         if (s.ok()) {
-          block = new Block(contents);
+          *block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(
-                key, block, block->size(), &DeleteCachedBlock);
+            *cache_handle = block_cache->Insert(
+                key, *block, (*block)->size(), &DeleteCachedBlock,
+                options.cache_priority);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(rep_->file, options, handle, &contents);
       if (s.ok()) {
-        block = new Block(contents);
+        *block = new Block(contents);
       }
     }
   }
+  return s;
+}
+
+bool Table::BlockLacksKeys(const ReadOptions& options, uint64_t offset,
+                           const std::vector<std::string>& keys) const {
+  Cache* block_cache = rep_->options.block_cache;
+  std::string key;
+  for (size_t i = 0; i < keys.size(); i++) {
+    MissingKeyCacheKey(rep_->cache_id, offset, keys[i], &key);
+    Cache::Handle* handle = block_cache->Lookup(key, options.cache_priority);
+    if (handle == NULL) {
+      return false;
+    }
+    block_cache->Release(handle);
+  }
+  return true;
+}
+
+void Table::NoteMissingKeys(const ReadOptions& options, uint64_t offset,
+                            Block* block,
+                            const std::vector<std::string>& keys) const {
+  // The index keys of the records, and for a composite index their full
+  // keys too, which the conjunctions fixing both attributes look up.
+  std::vector<std::string> held, extracted;
+  Iterator* iter = block->NewIterator(rep_->options.comparator);
+  bool complete = true;
+  for (iter->SeekToFirst(); complete && iter->Valid(); iter->Next()) {
+    ParsedInternalKey parsed_key;
+    if (!ParseInternalKey(iter->key(), &parsed_key) ||
+        parsed_key.type == kTypeMerge) {
+      complete = false;
+    } else if (parsed_key.type == kTypeValue) {
+      extracted.clear();
+      ExtractSecondaryKeys(rep_->options, iter->value(), &extracted);
+      GetIndexKeys(rep_->options, extracted, &held);
+      held.insert(held.end(), extracted.begin(), extracted.end());
+    }
+  }
+  complete = complete && iter->status().ok();
+  delete iter;
+  if (!complete) {
+    return;
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  std::string key;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (std::find(held.begin(), held.end(), keys[i]) == held.end()) {
+      MissingKeyCacheKey(rep_->cache_id, offset, keys[i], &key);
+      block_cache->Release(block_cache->Insert(key, NULL, key.size(),
+                                               &DeleteNothing,
+                                               options.cache_priority));
+    }
+  }
+}
+
+// Convert an index iterator value (i.e., an encoded BlockHandle)
+// into an iterator over the contents of the corresponding block.
+Iterator* Table::BlockReader(void* arg,
+                             const ReadOptions& options,
+                             const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  Cache* block_cache = table->rep_->options.block_cache;
+  Block* block = NULL;
+  Cache::Handle* cache_handle = NULL;
+  Status s = table->ReadDataBlock(options, index_value, &block, &cache_handle);
 
   Iterator* iter;
   if (block != NULL) {
@@ -262,10 +578,43 @@ Iterator* Table::BlockReader(void* arg,
   return iter;
 }
 
+Iterator* Table::SecondaryKeyBlockReader(void* arg,
+                                         const ReadOptions& options,
+                                         const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  Slice input = index_value;
+  BlockHandle handle;
+  if (handle.DecodeFrom(&input).ok()) {
+    // The secondary filters hold keys with an internal key tag appended.
+    std::string index_key, filter_key;
+    AppendIndexKey(table->rep_->options, options.secondary_key, &index_key);
+    AppendInternalKey(&filter_key, ParsedInternalKey(
+        index_key, kMaxSequenceNumber, kValueTypeForSeek));
+    if (!table->rep_->secondary_filter->KeyMayMatch(handle.offset(),
+                                                    filter_key)) {
+      return NewEmptyIterator();
+    }
+  }
+  return BlockReader(arg, options, index_value);
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
+  const bool skip_blocks = !options.secondary_key.empty() &&
+      rep_->secondary_filter != NULL;
   return NewTwoLevelIterator(
       rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+      skip_blocks ? &Table::SecondaryKeyBlockReader : &Table::BlockReader,
+      const_cast<Table*>(this), options);
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (!rep_->status.ok()) {
+    return NewErrorIterator(rep_->status);
+  }
+  if (rep_->range_del_block == NULL) {
+    return NewEmptyIterator();
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
@@ -299,81 +648,278 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
   return s;
 }
 
-Status Table::InternalGet(const ReadOptions& options, const Slice& k,
-                          void* arg,
-                          bool (*saver)(void*, const Slice&, const Slice&,std::string secKey,int topKOutput, DBImpl* db),string secKey,int topKOutput,DBImpl* db)  {
-    //ofstream outputFile;
-    //outputFile.open("/Users/nakshikatha/Desktop/test codes/debug.txt");
-    //outputFile<<k.ToString()<<"\n\nStart:\n\n";
+Status Table::InternalGet(const ReadOptions& options,
+                          SecondaryLookup* lookup, bool* pinned) {
   Status s;
+  *pinned = false;
+  Cache* block_cache = rep_->options.block_cache;
+  FilterBlockReader* filter = rep_->secondary_filter;
+
+  // Blocks (or the whole table) whose range of the ranking attribute
+  // cannot beat the current K-th hit are skipped.
+  const bool use_ranks = rep_->has_rank_stats && lookup->ranked() &&
+      lookup->ranking_attribute() == rep_->options.rankingAtt;
+  if (use_ranks && !lookup->MayImproveRank(rep_->rank_range.min(),
+                                           rep_->rank_range.max())) {
+    return s;
+  }
+
+  // A query covered by posting lists of the table reads just the
+  // entries they list.
+  if (rep_->secondary_posting_block != NULL && lookup->AnyBlockOrder()) {
+    std::vector<std::string> keys, entries;
+    if (lookup->CoveringKeys(&keys) &&
+        GetPostings(rep_->secondary_posting_block, keys, &entries)) {
+      return ReadPostings(options, entries, lookup, pinned);
+    }
+  }
+
+  // The secondary bitmaps, if any, name the blocks that can match.
+  RoaringBitmap blocks;
+  bool use_bitmaps = false;
+  if (rep_->secondary_bitmap_block != NULL) {
+    Iterator* bitmaps =
+        rep_->secondary_bitmap_block->NewIterator(BytewiseComparator());
+    use_bitmaps = lookup->MatchingBlocks(bitmaps, &blocks);
+    delete bitmaps;
+    if (use_bitmaps && blocks.empty()) {
+      return s;
+    }
+  }
+
+  // Blocks that an earlier lookup read for the covering keys of the
+  // query, only to find none of them, are skipped.
+  std::vector<std::string> covering;
+  const bool use_missing = rep_->options.secondary_negative_block_cache &&
+      block_cache != NULL && lookup->CoveringKeys(&covering);
+
   Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
-  iiter->SeekToFirst();
- 
-  //outputFile<<"in2\n";
-  int p =1;
-  while (iiter->Valid()) {
+  uint32_t block_number = 0;
+  for (iiter->SeekToFirst(); s.ok() && iiter->Valid(); iiter->Next()) {
+    const uint32_t ordinal = block_number++;
     Slice handle_value = iiter->value();
-      FilterBlockReader* filter = rep_->secondary_filter;
-      BlockHandle handle;
-      //outputFile<<(filter != NULL)<<endl;//(!filter->KeyMayMatch(handle.offset(), k));//(handle.DecodeFrom(&handle_value).ok());
-      if (filter != NULL &&
-          handle.DecodeFrom(&handle_value).ok() &&
-          !filter->KeyMayMatch(handle.offset(), k)) {
-          //outputFile<<(!filter->KeyMayMatch(handle.offset(), k))<<"\n";
-          //outputFile<<"false\n";
-        // Not found
-      } else {
-           
-        //outputFile<<"true\n";
-  
-        Iterator* block_iter = BlockReader(this, options, iiter->value());
-        block_iter->SeekToFirst();
-        while(block_iter->Valid()) {
-         
-        bool f = (*saver)(arg, block_iter->key(), block_iter->value(),secKey, topKOutput,db);
-        //if(f)
-            //outputFile<<"saved\n";
-                //outputFile<<newVal.key.ToString()<<endl<<newVal.value.ToString()<<endl;
-                
-             /*  if(f)
-                    kNoOfOutputs--;
-                
-                
-                
-                if(kNoOfOutputs<=0)
-                {
-                    if (s.ok()) {
-                        s = iiter->status();
-                      }
-                    
-                    //delete block_iter;
-                    //delete iiter;
-                    //outputFile.close();
-                    return s;
-                }
-               
-                      
-           */
-          
-         
-        block_iter->Next();
+    BlockHandle handle;
+    if (!handle.DecodeFrom(&handle_value).ok()) {
+      s = Status::Corruption("bad block handle");
+      break;
+    }
+    if (lookup->SkipBlock(handle.offset())) {
+      continue;  // Read by the lookup being resumed
+    }
+    if (use_bitmaps && !blocks.Contains(ordinal)) {
+      continue;  // No match
+    }
+    if (!lookup->BlockMayMatch(filter, handle.offset())) {
+      continue;  // Not found
+    }
+    if (use_missing && BlockLacksKeys(options, handle.offset(), covering)) {
+      continue;  // Found not to hold them before
+    }
+    RankRange block_rank;
+    if (use_ranks && block_rank.DecodeFrom(&handle_value) &&
+        !lookup->MayImproveRank(block_rank.min(), block_rank.max())) {
+      continue;
+    }
+    if (!lookup->StartBlock(handle.offset())) {
+      break;  // Out of budget
+    }
+
+    Block* block;
+    Cache::Handle* cache_handle;
+    s = ReadDataBlock(options, iiter->value(), &block, &cache_handle);
+    if (!s.ok()) {
+      break;
+    }
+
+    // Hits keep pointing into the block, so instead of copying them out
+    // the block itself is handed to the result set when one was kept.
+    bool retained = false;
+    Iterator* block_iter = block->NewIterator(rep_->options.comparator);
+    for (block_iter->SeekToFirst(); block_iter->Valid(); block_iter->Next()) {
+      if (lookup->SaveTableEntry(block_iter->key(), block_iter->value())) {
+        retained = true;
+      }
+    }
+    s = block_iter->status();
+    delete block_iter;
+    if (s.ok() && use_missing && lookup->BlockUnmatched()) {
+      NoteMissingKeys(options, handle.offset(), block, covering);
+    }
+
+    KeepOrReleaseBlock(lookup, block_cache, block, cache_handle, retained,
+                       pinned);
+  }
+
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  return s;
+}
+
+Status Table::ReadPostings(const ReadOptions& options,
+                           const std::vector<std::string>& entries,
+                           SecondaryLookup* lookup, bool* pinned) {
+  Status s;
+  Cache* block_cache = rep_->options.block_cache;
+  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  for (size_t i = 0; s.ok() && i < entries.size(); i++) {
+    const Slice entry(entries[i]);
+    if (lookup->OlderThanResults(EntrySequence(entry))) {
+      break;  // So are the entries that follow
+    }
+    iiter->Seek(entry);
+    if (!iiter->Valid()) {
+      s = iiter->status();
+      if (s.ok()) {
+        s = Status::Corruption("posting past the last data block");
+      }
+      break;
+    }
+
+    Block* block;
+    Cache::Handle* cache_handle;
+    s = ReadDataBlock(options, iiter->value(), &block, &cache_handle);
+    if (!s.ok()) {
+      break;
+    }
+    bool retained = false;
+    Iterator* block_iter = block->NewIterator(rep_->options.comparator);
+    block_iter->Seek(entry);
+    if (block_iter->Valid() && block_iter->key() == entry) {
+      retained = lookup->SaveTableEntry(block_iter->key(),
+                                        block_iter->value());
+    }
+    s = block_iter->status();
+    delete block_iter;
+    KeepOrReleaseBlock(lookup, block_cache, block, cache_handle, retained,
+                       pinned);
+  }
+
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  return s;
+}
+
+Status Table::InternalGet(const ReadOptions& options,
+                          SecondaryAggregator* aggregator) {
+  Status s;
+  Cache* block_cache = rep_->options.block_cache;
+
+  // The statistics list, in block order, every block holding the newest
+  // entry of a record that carries the key; no other block can hold a
+  // live one.
+  std::string prefix;
+  PutLengthPrefixedSlice(&prefix, aggregator->index_key());
+  Iterator* stats_iter = NULL;
+  if (rep_->secondary_stats_block != NULL) {
+    stats_iter = rep_->secondary_stats_block->NewIterator(
+        BytewiseComparator());
+    stats_iter->Seek(prefix);
+  }
+
+  // Without statistics, the secondary bitmap of the key, if any, names
+  // the blocks that can hold it.
+  RoaringBitmap blocks;
+  bool use_bitmap = false;
+  if (stats_iter == NULL && rep_->secondary_bitmap_block != NULL) {
+    Iterator* bitmaps =
+        rep_->secondary_bitmap_block->NewIterator(BytewiseComparator());
+    bitmaps->Seek(aggregator->index_key());
+    if (bitmaps->Valid() && bitmaps->key() == Slice(aggregator->index_key())) {
+      Slice input = bitmaps->value();
+      use_bitmap = blocks.DecodeFrom(&input);
+    } else {
+      use_bitmap = bitmaps->status().ok();    // No block holds the key
+    }
+    delete bitmaps;
+    if (use_bitmap && blocks.empty()) {
+      return s;
+    }
+  }
+
+  std::string prev_key, stats_key;
+  bool has_prev = false;
+  uint32_t block_number = 0;
+  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  for (iiter->SeekToFirst(); s.ok() && iiter->Valid(); iiter->Next()) {
+    const uint32_t ordinal = block_number++;
+    if (stats_iter != NULL &&
+        (!stats_iter->Valid() || !stats_iter->key().starts_with(prefix))) {
+      break;  // No block left to read
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    if (!handle.DecodeFrom(&handle_value).ok()) {
+      s = Status::Corruption("bad block handle");
+      break;
+    }
+
+    // The block's user keys lie between the previous separator and its
+    // own.
+    const Slice largest = ExtractUserKey(iiter->key());
+    bool read;
+    if (stats_iter != NULL) {
+      stats_key.clear();
+      AppendSecondaryStatsKey(&stats_key, aggregator->index_key(),
+                              handle.offset());
+      read = stats_iter->key() == Slice(stats_key);
+      if (read) {
+        SecondaryStats stats;
+        Slice v = stats_iter->value();
+        const Slice smallest(prev_key);
+        if (aggregator->StatsUsable(has_prev ? &smallest : NULL, largest) &&
+            stats.DecodeFrom(&v)) {
+          aggregator->AddStats(stats);
+          read = false;
         }
-        s = block_iter->status();
-        delete block_iter;
-        
-        
+        stats_iter->Next();
       }
-      
-      iiter->Next();
+    } else if (use_bitmap) {
+      read = blocks.Contains(ordinal);
+    } else {
+      read = aggregator->BlockMayMatch(rep_->secondary_filter,
+                                       handle.offset());
+    }
+    prev_key.assign(largest.data(), largest.size());
+    has_prev = true;
+    if (!read) {
+      continue;
+    }
+
+    aggregator->StartBlock();
+    Block* block;
+    Cache::Handle* cache_handle;
+    s = ReadDataBlock(options, iiter->value(), &block, &cache_handle);
+    if (!s.ok()) {
+      break;
+    }
+    Iterator* block_iter = block->NewIterator(rep_->options.comparator);
+    for (block_iter->SeekToFirst(); block_iter->Valid(); block_iter->Next()) {
+      aggregator->SaveTableEntry(block_iter->key(), block_iter->value());
+    }
+    s = block_iter->status();
+    delete block_iter;
+    if (cache_handle != NULL) {
+      block_cache->Release(cache_handle);
+    } else {
+      delete block;
+    }
+    if (s.ok()) {
+      s = aggregator->status();
+    }
   }
-  
-   
-   
+
   if (s.ok()) {
     s = iiter->status();
   }
+  if (s.ok() && stats_iter != NULL) {
+    s = stats_iter->status();
+  }
   delete iiter;
-  //outputFile.close();
+  delete stats_iter;
   return s;
 }
 
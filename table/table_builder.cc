@@ -6,19 +6,49 @@
 #include <sstream>
 #include <fstream>
 #include <assert.h>
+#include <algorithm>
+#include <map>
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/secondary_key_extractor.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
 #include "util/coding.h"
+#include "util/count_min_sketch.h"
 #include "util/crc32c.h"
+#include "util/hash.h"
+#include "util/heavy_hitters.h"
+#include "util/roaring_bitmap.h"
+#include "db/dbformat.h"
+#include "db/document.h"
+#include "db/secondary_index_table.h"
+#include "db/secondary_key.h"
 #include "rapidjson/document.h"
 
 namespace leveldb {
 
+// Every key carried by at least "fraction" of the entries of a table
+// stays tracked by a sketch of twice the minimum size.
+static size_t HeavyHitterCapacity(double fraction) {
+  if (fraction <= 0) {
+    return 1;
+  }
+  return static_cast<size_t>(2 / std::max(fraction, 1e-6)) + 1;
+}
+
+// Rows of the secondary count sketch: an estimate is far off only if
+// all of them are.
+static const uint32_t kCountSketchDepth = 4;
+
+// Order internal keys by decreasing sequence number.
+static bool NewerEntry(const std::string& a, const std::string& b) {
+  return DecodeFixed64(a.data() + a.size() - 8) >
+      DecodeFixed64(b.data() + b.size() - 8);
+}
+
 struct TableBuilder::Rep {
   Options options;
   Options index_block_options;
@@ -27,6 +57,7 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
   std::string last_key;
   int64_t num_entries;
   bool closed;          // Either Finish() or Abandon() has been called.
@@ -44,6 +75,59 @@ struct TableBuilder::Rep {
   bool pending_index_entry;
   BlockHandle pending_handle;  // Handle to add to index block
 
+  // Ranges of options.rankingAtt, if set, over the current data block,
+  // over the block awaiting its index entry, and over the whole table.
+  RankRange block_rank;
+  RankRange pending_rank;
+  RankRange table_rank;
+
+  // The attributes of a binary document that ranking decodes.
+  std::vector<std::string> rank_attributes;
+
+  // With options.secondary_block_stats, the statistics of each secondary
+  // key over the current data block, and the encoded statistics of the
+  // blocks written so far by key (see SecondaryStats).  They are only
+  // written if the table holds no merge operand, whose merged record
+  // they could not describe.
+  bool secondary_stats;
+  bool has_merge_operands;
+  std::map<std::string, SecondaryStats> block_stats;
+  std::map<std::string, std::string> table_stats;
+
+  // With options.secondary_index_type == kSecondaryBitmapIndex, the
+  // ordinals of the data blocks holding each indexed key.
+  bool secondary_bitmaps;
+  uint32_t num_data_blocks;
+  std::map<std::string, RoaringBitmap> block_bitmaps;
+
+  // With options.secondary_heavy_hitter_fraction, a sketch of the indexed
+  // keys and, for each key it tracks, the internal keys of the entries
+  // carrying it.  A key evicted from the sketch loses its postings, and
+  // is marked (by hash) in evicted_keys so that it is not listed with
+  // entries missing if it is tracked again.  Like the statistics, lists
+  // are only written if the table holds no merge operand.
+  struct PostingList {
+    bool complete;
+    std::vector<std::string> entries;
+  };
+  bool secondary_postings;
+  HeavyHitters heavy_hitters;
+  std::map<std::string, PostingList> postings;
+  std::vector<bool> evicted_keys;
+
+  // With options.secondary_count_sketch_width, the frequencies of the
+  // index keys over the newest entry of each record.
+  CountMinSketch* count_sketch;
+
+  // With options.secondary_level_summaries or a secondary file
+  // directory, the hashes of the indexed keys of the table (see
+  // SecondaryKeyHash()).
+  bool secondary_hashes;
+  RoaringBitmap key_hashes;
+
+  // For the meta blocks keyed by secondary key.
+  Options meta_block_options;
+
   std::string compressed_output;
 
   Rep(const Options& opt, WritableFile* f)
@@ -53,6 +137,7 @@ struct TableBuilder::Rep {
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
+        range_del_block(&options),
         num_entries(0),
         closed(false),
         filter_block(opt.filter_policy == NULL ? NULL
@@ -60,8 +145,31 @@ struct TableBuilder::Rep {
         secondary_filter_block(opt.filter_policy == NULL ? NULL
                      : new FilterBlockBuilder(opt.filter_policy)),
              
-        pending_index_entry(false) {
+        pending_index_entry(false),
+        rank_attributes(1, opt.rankingAtt),
+        secondary_stats(opt.secondary_block_stats &&
+                        opt.secondary_key_extractor != NULL),
+        has_merge_operands(false),
+        secondary_bitmaps(
+            opt.secondary_index_type == kSecondaryBitmapIndex &&
+            opt.secondary_key_extractor != NULL),
+        num_data_blocks(0),
+        secondary_postings(opt.secondary_heavy_hitter_fraction > 0 &&
+                           opt.secondary_key_extractor != NULL),
+        heavy_hitters(
+            HeavyHitterCapacity(opt.secondary_heavy_hitter_fraction)),
+        count_sketch(opt.secondary_count_sketch_width > 0 &&
+                     opt.secondary_key_extractor != NULL
+                     ? new CountMinSketch(opt.secondary_count_sketch_width,
+                                          kCountSketchDepth)
+                     : NULL),
+        secondary_hashes(RecordsKeyHashes(opt)),
+        meta_block_options(opt) {
     index_block_options.block_restart_interval = 1;
+    meta_block_options.comparator = BytewiseComparator();
+    if (secondary_postings) {
+      evicted_keys.resize(1 << 16);
+    }
   }
 };
 
@@ -79,6 +187,7 @@ TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
   delete rep_->secondary_filter_block;
+  delete rep_->count_sketch;
   delete rep_;
 }
 
@@ -108,12 +217,31 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->num_entries > 0) {
     assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
   }
+  // Only the newest entry of a key in the table counts towards the
+  // secondary statistics.  Checked before last_key becomes a separator.
+  // The entries of a secondary index table are not documents.
+  const bool index_table_entry = IsIndexTableKey(ExtractUserKey(key));
+  bool newest_value = false;
+  if ((r->secondary_stats || r->secondary_postings ||
+       r->count_sketch != NULL) && !index_table_entry) {
+    const ValueType type = static_cast<ValueType>(
+        DecodeFixed64(key.data() + key.size() - 8) & 0xff);
+    if (type == kTypeMerge) {
+      r->has_merge_operands = true;
+    }
+    newest_value = type == kTypeValue &&
+        (r->num_entries == 0 ||
+         ExtractUserKey(key) != ExtractUserKey(r->last_key));
+  }
 
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
     std::string handle_encoding;
     r->pending_handle.EncodeTo(&handle_encoding);
+    if (!r->options.rankingAtt.empty()) {
+      r->pending_rank.EncodeTo(&handle_encoding);
+    }
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
   }
@@ -122,75 +250,81 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
       //outputFile<<key.ToString()<<std::endl;
     r->filter_block->AddKey(key);
   }
-if (r->secondary_filter_block != NULL&&!r->options.secondaryAtt.empty()) {
-    
-  rapidjson::Document docToParse; 
-  
-  docToParse.Parse<0>(value.ToString().c_str());   
-  
-  ///
-  const char* sKeyAtt = r->options.secondaryAtt.c_str();
-  
-  if(!docToParse.IsObject()||!docToParse.HasMember(sKeyAtt)||docToParse[sKeyAtt].IsNull())
-  {
-      r->last_key.assign(key.data(), key.size());
-        r->num_entries++;
-        r->data_block.Add(key, value);
-
-        const size_t estimated_block_size = r->data_block.CurrentSizeEstimate();
-        if (estimated_block_size >= r->options.block_size) {
-          Flush();
+  const SecondaryKeyExtractor* extractor = r->options.secondary_key_extractor;
+  if (extractor != NULL && !index_table_entry &&
+      (r->secondary_filter_block != NULL || !r->options.rankingAtt.empty() ||
+       r->secondary_stats || r->secondary_bitmaps ||
+       r->secondary_postings || r->count_sketch != NULL ||
+       r->secondary_hashes)) {
+    std::vector<std::string> secKeys;
+    extractor->Extract(value, &secKeys);
+    if (!secKeys.empty()) {
+      bool has_rank = false;
+      double rank = 0;
+      if (!r->options.rankingAtt.empty()) {
+        rapidjson::Document docToParse;
+        const char* rankAtt = r->options.rankingAtt.c_str();
+        if (ReadDocument(r->options.document_schema, value,
+                         &r->rank_attributes, &docToParse) &&
+            docToParse.HasMember(rankAtt) && docToParse[rankAtt].IsNumber()) {
+          rank = docToParse[rankAtt].GetDouble();
+          has_rank = true;
+          r->block_rank.Add(rank);
         }
-      return;
-  }
-  std::ostringstream sKey;
-  if(docToParse[sKeyAtt].IsNumber())
-  {
-        if(docToParse[sKeyAtt].IsUint64())
-        {
-            unsigned long long int tid = docToParse[sKeyAtt].GetUint64();
-            sKey<<tid;
-
-        }
-        else if (docToParse[sKeyAtt].IsInt64())
-        {
-            long long int tid = docToParse[sKeyAtt].GetInt64();
-            sKey<<tid;
-        }
-        else if (docToParse[sKeyAtt].IsDouble())
-        {
-            double tid = docToParse[sKeyAtt].GetDouble();
-            sKey<<tid;
+      }
+      if (newest_value) {
+        std::vector<std::string> index_keys;
+        GetIndexKeys(r->options, secKeys, &index_keys);
+        for (size_t i = 0; i < index_keys.size(); i++) {
+          if (r->secondary_stats) {
+            r->block_stats[index_keys[i]].Add(has_rank ? &rank : NULL);
+          }
+          if (r->count_sketch != NULL) {
+            r->count_sketch->Add(index_keys[i]);
+          }
         }
-        
-        else if (docToParse[sKeyAtt].IsUint())
-        {
-            unsigned int tid = docToParse[sKeyAtt].GetUint();
-            sKey<<tid;
+      }
+      if (r->secondary_filter_block != NULL || r->secondary_bitmaps ||
+          r->secondary_postings || r->secondary_hashes) {
+        // Every secondary key is indexed.  A composite index also enters
+        // the leading components, for prefix lookups.
+        const bool composite = !r->options.secondaryTrailingAtt.empty();
+        std::vector<Slice> indexed;
+        Slice lastLeading;
+        for (size_t i = 0; i < secKeys.size(); i++) {
+          indexed.push_back(secKeys[i]);
+          if (composite) {
+            Slice leading = LeadingKeyComponent(secKeys[i]);
+            if (leading.size() < secKeys[i].size() && leading != lastLeading) {
+              indexed.push_back(leading);
+            }
+            lastLeading = leading;
+          }
         }
-        else if (docToParse[sKeyAtt].IsInt())
-        {
-            int tid = docToParse[sKeyAtt].GetInt();
-            sKey<<tid;             
+        // Keys go into the filter with the entry's tag appended, as
+        // InternalFilterPolicy expects.
+        Slice tag(key.data() + key.size() - 8, 8);
+        std::string filterKey;
+        for (size_t i = 0; i < indexed.size(); i++) {
+          if (r->secondary_filter_block != NULL) {
+            filterKey.assign(indexed[i].data(), indexed[i].size());
+            filterKey.append(tag.data(), tag.size());
+            r->secondary_filter_block->AddKey(filterKey);
+          }
+          if (r->secondary_bitmaps) {
+            r->block_bitmaps[indexed[i].ToString()].Add(r->num_data_blocks);
+          }
+          if (r->secondary_postings) {
+            AddPosting(indexed[i], key);
+          }
+          if (r->secondary_hashes) {
+            r->key_hashes.Add(SecondaryKeyHash(indexed[i]));
+          }
         }
+      }
+    }
   }
-  else if (docToParse[sKeyAtt].IsString())
-  {
-        const char* tid = docToParse[sKeyAtt].GetString();
-        sKey<<tid;
-  }
-  else if(docToParse[sKeyAtt].IsBool())
-  {
-        bool tid = docToParse[sKeyAtt].GetBool();
-        sKey<<tid;
-  }
-  std::string tag = key.ToString().substr(key.size()-8);
-  Slice Key = sKey.str()+tag;
-  //outputFile<<"Sec: "<<Key.ToString()<<std::endl;
-  
-  
-  r->secondary_filter_block->AddKey(Key);
-}
+
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
   r->data_block.Add(key, value);
@@ -201,6 +335,38 @@ if (r->secondary_filter_block != NULL&&!r->options.secondaryAtt.empty()) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& begin_key,
+                                     const Slice& end) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_del_block.Add(begin_key, end);
+}
+
+void TableBuilder::AddPosting(const Slice& skey, const Slice& key) {
+  Rep* r = rep_;
+  const std::string k = skey.ToString();
+  std::map<std::string, Rep::PostingList>::iterator it = r->postings.find(k);
+  if (it != r->postings.end() && !it->second.entries.empty() &&
+      it->second.entries.back() == key) {
+    return;  // The entry carries the key twice
+  }
+  std::string evicted;
+  if (r->heavy_hitters.Add(k, &evicted)) {
+    r->postings.erase(evicted);
+    r->evicted_keys[Hash(evicted.data(), evicted.size(), 0) %
+                    r->evicted_keys.size()] = true;
+  }
+  if (it == r->postings.end()) {
+    it = r->postings.insert(std::make_pair(k, Rep::PostingList())).first;
+    const uint32_t h = Hash(k.data(), k.size(), 0);
+    it->second.complete = !r->evicted_keys[h % r->evicted_keys.size()];
+  }
+  if (it->second.complete) {
+    it->second.entries.push_back(key.ToString());
+  }
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -208,6 +374,17 @@ void TableBuilder::Flush() {
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
   WriteBlock(&r->data_block, &r->pending_handle);
+  for (std::map<std::string, SecondaryStats>::const_iterator it =
+           r->block_stats.begin(); it != r->block_stats.end(); ++it) {
+    std::string key;
+    AppendSecondaryStatsKey(&key, it->first, r->pending_handle.offset());
+    it->second.EncodeTo(&r->table_stats[key]);
+  }
+  r->block_stats.clear();
+  r->num_data_blocks++;
+  r->pending_rank = r->block_rank;
+  r->table_rank.Add(r->block_rank);
+  r->block_rank = RankRange();
   if (ok()) {
     r->pending_index_entry = true;
     r->status = r->file->Flush();
@@ -288,6 +465,9 @@ Status TableBuilder::Finish() {
   r->closed = true;
 
   BlockHandle filter_block_handle, secondary_filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle range_del_block_handle, stats_block_handle;
+  BlockHandle bitmap_block_handle, posting_block_handle, sketch_block_handle;
+  BlockHandle hashes_block_handle;
 
   // Write filter block
   if (ok() && r->filter_block != NULL) {
@@ -299,8 +479,75 @@ Status TableBuilder::Finish() {
     WriteRawBlock(r->secondary_filter_block->Finish(), kNoCompression,
                   &secondary_filter_block_handle);
   }
-  
-  
+  // Write range tombstone block
+  const bool has_range_deletions = !r->range_del_block.empty();
+  if (ok() && has_range_deletions) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+  // Write secondary statistics block
+  const bool has_stats = r->secondary_stats && !r->has_merge_operands;
+  if (ok() && has_stats) {
+    BlockBuilder stats_block(&r->meta_block_options);
+    for (std::map<std::string, std::string>::const_iterator it =
+             r->table_stats.begin(); it != r->table_stats.end(); ++it) {
+      stats_block.Add(it->first, it->second);
+    }
+    WriteBlock(&stats_block, &stats_block_handle);
+  }
+  // Write secondary bitmap block
+  if (ok() && r->secondary_bitmaps) {
+    BlockBuilder bitmap_block(&r->meta_block_options);
+    std::string encoding;
+    for (std::map<std::string, RoaringBitmap>::const_iterator it =
+             r->block_bitmaps.begin(); it != r->block_bitmaps.end(); ++it) {
+      encoding.clear();
+      it->second.EncodeTo(&encoding);
+      bitmap_block.Add(it->first, encoding);
+    }
+    WriteBlock(&bitmap_block, &bitmap_block_handle);
+  }
+  // Write secondary posting block, holding the complete lists of the
+  // keys carried by enough of the entries, each newest first
+  bool has_postings = false;
+  if (ok() && r->secondary_postings && !r->has_merge_operands) {
+    const double min_entries =
+        r->options.secondary_heavy_hitter_fraction * r->num_entries;
+    BlockBuilder posting_block(&r->meta_block_options);
+    std::string encoding;
+    for (std::map<std::string, Rep::PostingList>::iterator it =
+             r->postings.begin(); it != r->postings.end(); ++it) {
+      std::vector<std::string>& entries = it->second.entries;
+      if (!it->second.complete || entries.empty() ||
+          entries.size() < min_entries) {
+        continue;
+      }
+      std::stable_sort(entries.begin(), entries.end(), NewerEntry);
+      encoding.clear();
+      PutVarint32(&encoding, entries.size());
+      for (size_t i = 0; i < entries.size(); i++) {
+        PutLengthPrefixedSlice(&encoding, entries[i]);
+      }
+      posting_block.Add(it->first, encoding);
+    }
+    if (!posting_block.empty()) {
+      WriteBlock(&posting_block, &posting_block_handle);
+      has_postings = true;
+    }
+  }
+  // Write secondary count sketch
+  if (ok() && r->count_sketch != NULL) {
+    std::string encoding;
+    r->count_sketch->EncodeTo(&encoding);
+    WriteRawBlock(encoding, kNoCompression, &sketch_block_handle);
+  }
+
+  // Write secondary key hashes
+  if (ok() && r->secondary_hashes) {
+    std::string encoding;
+    r->key_hashes.EncodeTo(&encoding);
+    WriteRawBlock(encoding, kNoCompression, &hashes_block_handle);
+  }
+
   // Write metaindex block
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
@@ -312,14 +559,62 @@ Status TableBuilder::Finish() {
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (has_range_deletions) {
+      // Add mapping from "rangedel" to location of the range tombstones
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("rangedel", handle_encoding);
+    }
+    if (!r->options.rankingAtt.empty()) {
+      // Add mapping from "rankstats.Attribute" to the range over the table
+      std::string key = "rankstats.";
+      key.append(r->options.rankingAtt);
+      std::string range_encoding;
+      r->table_rank.EncodeTo(&range_encoding);
+      meta_index_block.Add(key, range_encoding);
+    }
+    if (r->secondary_bitmaps) {
+      // Add mapping from "secondarybitmap.Name" to the bitmap block
+      std::string key = SecondaryBitmapBlockName(r->options);
+      std::string handle_encoding;
+      bitmap_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
     if (r->secondary_filter_block != NULL) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "secondaryfilter.";
-      key.append(r->options.filter_policy->Name());
+      // Add mapping from "secondaryfilter.Name" to location of filter data
+      std::string key = SecondaryFilterBlockName(r->options);
       std::string handle_encoding;
       secondary_filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->secondary_hashes) {
+      // Add mapping from "secondaryhashes.Name" to the key hashes
+      std::string key = SecondaryHashesBlockName(r->options);
+      std::string handle_encoding;
+      hashes_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (has_postings) {
+      // Add mapping from "secondaryposting.Name" to the posting lists
+      std::string key = SecondaryPostingBlockName(r->options);
+      std::string handle_encoding;
+      posting_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (r->count_sketch != NULL) {
+      // Add mapping from "secondarysketch.Name" to the count sketch
+      std::string key = SecondarySketchBlockName(r->options);
+      std::string handle_encoding;
+      sketch_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (has_stats) {
+      // Add mapping from "secondarystats.Name" to the statistics block
+      std::string key = SecondaryStatsBlockName(r->options);
+      std::string handle_encoding;
+      stats_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
@@ -330,6 +625,9 @@ Status TableBuilder::Finish() {
       r->options.comparator->FindShortSuccessor(&r->last_key);
       std::string handle_encoding;
       r->pending_handle.EncodeTo(&handle_encoding);
+      if (!r->options.rankingAtt.empty()) {
+        r->pending_rank.EncodeTo(&handle_encoding);
+      }
       r->index_block.Add(r->last_key, Slice(handle_encoding));
       r->pending_index_entry = false;
     }
@@ -16,12 +16,23 @@ namespace leveldb {
 Cache::~Cache() {
 }
 
+Cache::Handle* Cache::Insert(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             CachePriority priority) {
+  return Insert(key, value, charge, deleter);
+}
+
+Cache::Handle* Cache::Lookup(const Slice& key, CachePriority priority) {
+  return Lookup(key);
+}
+
 namespace {
 
 // LRU cache implementation
 
 // An entry is a variable length heap-allocated structure.  Entries
-// are kept in a circular doubly linked list ordered by access time.
+// are kept in one of two circular doubly linked lists ordered by access
+// time: the probationary one, for low-priority entries, or the main one.
 struct LRUHandle {
   void* value;
   void (*deleter)(const Slice&, void* value);
@@ -32,6 +43,7 @@ struct LRUHandle {
   size_t key_length;
   uint32_t refs;
   uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+  bool probationary;  // Inserted at low priority and not promoted since
   char key_data[1];   // Beginning of key
 
   Slice key() const {
@@ -143,8 +155,10 @@ class LRUCache {
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash,
                         void* value, size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
-  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+                        void (*deleter)(const Slice& key, void* value),
+                        CachePriority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash,
+                        CachePriority priority);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
 
@@ -160,26 +174,32 @@ class LRUCache {
   port::Mutex mutex_;
   size_t usage_;
 
-  // Dummy head of LRU list.
+  // Dummy heads of the LRU lists of the main and probationary entries.
   // lru.prev is newest entry, lru.next is oldest entry.
   LRUHandle lru_;
+  LRUHandle probation_;
 
   HandleTable table_;
 };
 
 LRUCache::LRUCache()
     : usage_(0) {
-  // Make empty circular linked list
+  // Make empty circular linked lists
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  probation_.next = &probation_;
+  probation_.prev = &probation_;
 }
 
 LRUCache::~LRUCache() {
-  for (LRUHandle* e = lru_.next; e != &lru_; ) {
-    LRUHandle* next = e->next;
-    assert(e->refs == 1);  // Error if caller has an unreleased handle
-    Unref(e);
-    e = next;
+  LRUHandle* lists[] = { &lru_, &probation_ };
+  for (int i = 0; i < 2; i++) {
+    for (LRUHandle* e = lists[i]->next; e != lists[i]; ) {
+      LRUHandle* next = e->next;
+      assert(e->refs == 1);  // Error if caller has an unreleased handle
+      Unref(e);
+      e = next;
+    }
   }
 }
 
@@ -199,19 +219,24 @@ void LRUCache::LRU_Remove(LRUHandle* e) {
 }
 
 void LRUCache::LRU_Append(LRUHandle* e) {
-  // Make "e" newest entry by inserting just before lru_
-  e->next = &lru_;
-  e->prev = lru_.prev;
+  // Make "e" newest entry of its list by inserting just before its head
+  LRUHandle* list = e->probationary ? &probation_ : &lru_;
+  e->next = list;
+  e->prev = list->prev;
   e->prev->next = e;
   e->next->prev = e;
 }
 
-Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
+Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash,
+                                CachePriority priority) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != NULL) {
     e->refs++;
     LRU_Remove(e);
+    if (priority == kHighCachePriority) {
+      e->probationary = false;
+    }
     LRU_Append(e);
   }
   return reinterpret_cast<Cache::Handle*>(e);
@@ -224,7 +249,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 
 Cache::Handle* LRUCache::Insert(
     const Slice& key, uint32_t hash, void* value, size_t charge,
-    void (*deleter)(const Slice& key, void* value)) {
+    void (*deleter)(const Slice& key, void* value),
+    CachePriority priority) {
   MutexLock l(&mutex_);
 
   LRUHandle* e = reinterpret_cast<LRUHandle*>(
@@ -235,6 +261,7 @@ Cache::Handle* LRUCache::Insert(
   e->key_length = key.size();
   e->hash = hash;
   e->refs = 2;  // One from LRUCache, one for the returned handle
+  e->probationary = (priority == kLowCachePriority);
   memcpy(e->key_data, key.data(), key.size());
   LRU_Append(e);
   usage_ += charge;
@@ -245,8 +272,17 @@ Cache::Handle* LRUCache::Insert(
     Unref(old);
   }
 
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  // Probationary entries go first, oldest first, then the main ones,
+  // which a low-priority entry is never admitted at the expense of.
+  while (usage_ > capacity_) {
+    LRUHandle* old;
+    if (probation_.next != &probation_) {
+      old = probation_.next;
+    } else if (priority == kHighCachePriority && lru_.next != &lru_) {
+      old = lru_.next;
+    } else {
+      break;
+    }
     LRU_Remove(old);
     table_.Remove(old->key(), old->hash);
     Unref(old);
@@ -292,12 +328,21 @@ class ShardedLRUCache : public Cache {
   virtual ~ShardedLRUCache() { }
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) {
+    return Insert(key, value, charge, deleter, kHighCachePriority);
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         CachePriority priority) {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   virtual Handle* Lookup(const Slice& key) {
+    return Lookup(key, kHighCachePriority);
+  }
+  virtual Handle* Lookup(const Slice& key, CachePriority priority) {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Lookup(key, hash);
+    return shard_[Shard(hash)].Lookup(key, hash, priority);
   }
   virtual void Release(Handle* handle) {
     LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
@@ -45,8 +45,8 @@ class CacheTest {
     delete cache_;
   }
 
-  int Lookup(int key) {
-    Cache::Handle* handle = cache_->Lookup(EncodeKey(key));
+  int Lookup(int key, CachePriority priority = kHighCachePriority) {
+    Cache::Handle* handle = cache_->Lookup(EncodeKey(key), priority);
     const int r = (handle == NULL) ? -1 : DecodeValue(cache_->Value(handle));
     if (handle != NULL) {
       cache_->Release(handle);
@@ -54,9 +54,10 @@ class CacheTest {
     return r;
   }
 
-  void Insert(int key, int value, int charge = 1) {
+  void Insert(int key, int value, int charge = 1,
+              CachePriority priority = kHighCachePriority) {
     cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
-                                   &CacheTest::Deleter));
+                                   &CacheTest::Deleter, priority));
   }
 
   void Erase(int key) {
@@ -146,6 +147,37 @@ TEST(CacheTest, EvictionPolicy) {
   ASSERT_EQ(-1, Lookup(200));
 }
 
+TEST(CacheTest, LowPriorityEntriesAreEvictedFirst) {
+  for (int i = 0; i < kCacheSize / 2; i++) {
+    Insert(i, 1000+i);
+  }
+
+  // A scan at low priority many times the size of the cache leaves the
+  // entries inserted at high priority, even when it reads them too
+  for (int i = 0; i < 10 * kCacheSize; i++) {
+    Insert(100000+i, 1000+i, 1, kLowCachePriority);
+    ASSERT_EQ(1000 + (i % 100), Lookup(i % 100, kLowCachePriority));
+  }
+  for (int i = 0; i < kCacheSize / 2; i++) {
+    ASSERT_EQ(1000+i, Lookup(i));
+  }
+  ASSERT_EQ(-1, Lookup(100000));
+}
+
+TEST(CacheTest, HighPriorityLookupPromotes) {
+  Insert(100, 101, 1, kLowCachePriority);
+  Insert(200, 201, 1, kLowCachePriority);
+  ASSERT_EQ(101, Lookup(100, kLowCachePriority));
+  ASSERT_EQ(201, Lookup(200));
+
+  // Only the promoted entry outlives a scan
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000+i, 2000+i, 1, kLowCachePriority);
+  }
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+}
+
 TEST(CacheTest, HeavyEntries) {
   // Add a bunch of light and heavy entries and then count the combined
   // size of items still in the cache, which must be approximately the
@@ -0,0 +1,84 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/count_min_sketch.h"
+
+#include <assert.h>
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+CountMinSketch::CountMinSketch(uint32_t width, uint32_t depth)
+    : width_(width),
+      depth_(depth),
+      total_(0),
+      counters_(static_cast<size_t>(width) * depth, 0) {
+  assert(width > 0 && depth > 0);
+}
+
+void CountMinSketch::Columns(const Slice& item, uint32_t* h,
+                             uint32_t* delta) const {
+  // Rows index by double hashing, as the bloom filter probes (see
+  // util/bloom.cc): one hash and its rotation stand in for one
+  // independent hash per row.
+  *h = Hash(item.data(), item.size(), 0xbc9f1d34);
+  *delta = (*h >> 17) | (*h << 15);
+}
+
+void CountMinSketch::Add(const Slice& item, uint32_t n) {
+  total_ += n;
+  uint32_t h, delta;
+  Columns(item, &h, &delta);
+  for (uint32_t row = 0; row < depth_; row++, h += delta) {
+    uint32_t& counter = counters_[static_cast<size_t>(row) * width_ +
+                                  h % width_];
+    // Saturate rather than wrap, so that estimates stay upper bounds.
+    counter = (counter > 0xffffffffu - n) ? 0xffffffffu : counter + n;
+  }
+}
+
+uint64_t CountMinSketch::Estimate(const Slice& item) const {
+  uint64_t result = total_;
+  uint32_t h, delta;
+  Columns(item, &h, &delta);
+  for (uint32_t row = 0; row < depth_; row++, h += delta) {
+    const uint32_t counter = counters_[static_cast<size_t>(row) * width_ +
+                                       h % width_];
+    if (counter < result) {
+      result = counter;
+    }
+  }
+  return result;
+}
+
+void CountMinSketch::EncodeTo(std::string* dst) const {
+  PutVarint32(dst, width_);
+  PutVarint32(dst, depth_);
+  PutVarint64(dst, total_);
+  for (size_t i = 0; i < counters_.size(); i++) {
+    PutFixed32(dst, counters_[i]);
+  }
+}
+
+bool CountMinSketch::DecodeFrom(Slice* input) {
+  uint32_t width, depth;
+  uint64_t total;
+  if (!GetVarint32(input, &width) || !GetVarint32(input, &depth) ||
+      !GetVarint64(input, &total) || width == 0 || depth == 0 ||
+      input->size() / 4 / width < depth) {
+    return false;
+  }
+  width_ = width;
+  depth_ = depth;
+  total_ = total;
+  counters_.resize(static_cast<size_t>(width) * depth);
+  for (size_t i = 0; i < counters_.size(); i++) {
+    counters_[i] = DecodeFixed32(input->data() + 4 * i);
+  }
+  input->remove_prefix(4 * counters_.size());
+  return true;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,62 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A count-min sketch of the frequencies of the items of a stream.  It
+// holds "depth" rows of "width" counters; an item adds to one counter of
+// each row, chosen by double hashing, and its estimate is the
+// smallest of them.  An estimate never falls below the true count, and
+// exceeds it by more than 2/width of the stream only with probability
+// about 2^-depth.
+//
+// The encoding is:
+//
+//    sketch      := width:varint32 depth:varint32 total:varint64
+//                   counter:fixed32[width * depth]
+
+#ifndef STORAGE_LEVELDB_UTIL_COUNT_MIN_SKETCH_H_
+#define STORAGE_LEVELDB_UTIL_COUNT_MIN_SKETCH_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class CountMinSketch {
+ public:
+  // REQUIRES: width > 0 && depth > 0
+  CountMinSketch(uint32_t width, uint32_t depth);
+
+  // Count "n" more occurrences of "item".
+  void Add(const Slice& item, uint32_t n = 1);
+
+  // The estimated number of occurrences of "item".
+  uint64_t Estimate(const Slice& item) const;
+
+  // Number of occurrences added.
+  uint64_t total() const { return total_; }
+
+  uint32_t width() const { return width_; }
+  uint32_t depth() const { return depth_; }
+
+  void EncodeTo(std::string* dst) const;
+
+  // Replace the contents by the decoding of *input.  Returns false, and
+  // leaves the sketch unspecified, if it is malformed.
+  bool DecodeFrom(Slice* input);
+
+ private:
+  // The column of "item" in row r is (h + r * delta) % width_.
+  void Columns(const Slice& item, uint32_t* h, uint32_t* delta) const;
+
+  uint32_t width_;
+  uint32_t depth_;
+  uint64_t total_;
+  std::vector<uint32_t> counters_;   // Row after row
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_COUNT_MIN_SKETCH_H_
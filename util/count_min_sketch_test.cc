@@ -0,0 +1,95 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/count_min_sketch.h"
+
+#include <map>
+#include "util/logging.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class CountMinSketchTest { };
+
+TEST(CountMinSketchTest, Empty) {
+  CountMinSketch sketch(64, 4);
+  ASSERT_EQ(0u, sketch.total());
+  ASSERT_EQ(0u, sketch.Estimate("a"));
+  ASSERT_EQ(0u, sketch.Estimate(""));
+}
+
+TEST(CountMinSketchTest, Bounds) {
+  // A few hot values over many rare ones: every estimate is an upper
+  // bound, and the error stays within a small fraction of the stream.
+  Random rnd(301);
+  CountMinSketch sketch(512, 4);
+  std::map<std::string, uint64_t> counts;
+  for (int i = 0; i < 20000; i++) {
+    std::string item;
+    const uint32_t r = rnd.Uniform(10);
+    if (r < 3) {
+      item = "hot" + NumberToString(r);
+    } else {
+      item = "rare" + NumberToString(rnd.Uniform(5000));
+    }
+    sketch.Add(item);
+    counts[item]++;
+  }
+  ASSERT_EQ(20000u, sketch.total());
+  int far_off = 0;
+  for (std::map<std::string, uint64_t>::const_iterator it = counts.begin();
+       it != counts.end(); ++it) {
+    const uint64_t estimate = sketch.Estimate(it->first);
+    ASSERT_GE(estimate, it->second);
+    if (estimate - it->second > 2 * 20000 / 512) {
+      far_off++;
+    }
+  }
+  ASSERT_LE(far_off, static_cast<int>(counts.size() / 10));
+  ASSERT_LE(sketch.Estimate("hot0"), counts["hot0"] + 200);
+}
+
+TEST(CountMinSketchTest, AddMany) {
+  CountMinSketch sketch(16, 2);
+  sketch.Add("a", 1000);
+  sketch.Add("a");
+  ASSERT_EQ(1001u, sketch.Estimate("a"));
+  sketch.Add("b", 0xffffffffu);
+  ASSERT_EQ(0xffffffffu, sketch.Estimate("b"));
+}
+
+TEST(CountMinSketchTest, Encoding) {
+  CountMinSketch sketch(100, 3);
+  for (int i = 0; i < 1000; i++) {
+    sketch.Add(NumberToString(i % 37));
+  }
+  std::string encoding;
+  sketch.EncodeTo(&encoding);
+  encoding.append("tail");
+
+  CountMinSketch decoded(1, 1);
+  Slice input(encoding);
+  ASSERT_TRUE(decoded.DecodeFrom(&input));
+  ASSERT_EQ("tail", input.ToString());
+  ASSERT_EQ(100u, decoded.width());
+  ASSERT_EQ(3u, decoded.depth());
+  ASSERT_EQ(sketch.total(), decoded.total());
+  for (int i = 0; i < 40; i++) {
+    ASSERT_EQ(sketch.Estimate(NumberToString(i)),
+              decoded.Estimate(NumberToString(i)));
+  }
+
+  // Truncated encodings are rejected
+  input = Slice(encoding.data(), encoding.size() - 10);
+  ASSERT_TRUE(!decoded.DecodeFrom(&input));
+  input = Slice(encoding.data(), 2);
+  ASSERT_TRUE(!decoded.DecodeFrom(&input));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/heavy_hitters.h"
+
+#include <assert.h>
+
+namespace leveldb {
+
+HeavyHitters::HeavyHitters(size_t capacity)
+    : capacity_(capacity),
+      total_(0) {
+  assert(capacity > 0);
+}
+
+bool HeavyHitters::Add(const Slice& item, std::string* evicted) {
+  total_++;
+  const std::string key = item.ToString();
+  std::map<std::string, Counter>::iterator it = counters_.find(key);
+  if (it != counters_.end()) {
+    by_count_.erase(std::make_pair(it->second.count, key));
+    it->second.count++;
+    by_count_.insert(std::make_pair(it->second.count, key));
+    return false;
+  }
+
+  Counter counter;
+  counter.count = 1;
+  counter.error = 0;
+  bool result = false;
+  if (counters_.size() >= capacity_) {
+    // Take over the least frequent counter.
+    std::set<std::pair<uint64_t, std::string> >::iterator least =
+        by_count_.begin();
+    counter.error = least->first;
+    counter.count = least->first + 1;
+    counters_.erase(least->second);
+    evicted->assign(least->second);
+    by_count_.erase(least);
+    result = true;
+  }
+  counters_.insert(std::make_pair(key, counter));
+  by_count_.insert(std::make_pair(counter.count, key));
+  return result;
+}
+
+bool HeavyHitters::Contains(const Slice& item) const {
+  return counters_.find(item.ToString()) != counters_.end();
+}
+
+uint64_t HeavyHitters::Count(const Slice& item) const {
+  std::map<std::string, Counter>::const_iterator it =
+      counters_.find(item.ToString());
+  return it == counters_.end() ? 0 : it->second.count;
+}
+
+uint64_t HeavyHitters::Error(const Slice& item) const {
+  std::map<std::string, Counter>::const_iterator it =
+      counters_.find(item.ToString());
+  return it == counters_.end() ? 0 : it->second.error;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Space-Saving sketch of the most frequent items of a stream.  It
+// keeps at most "capacity" counters; an item that is not tracked takes
+// over the counter of the least frequent tracked item, inheriting its
+// count as an error bound.  Every item making up more than 1/capacity
+// of the stream is tracked at the end, and the count of a tracked item
+// overestimates its frequency by at most its error.
+
+#ifndef STORAGE_LEVELDB_UTIL_HEAVY_HITTERS_H_
+#define STORAGE_LEVELDB_UTIL_HEAVY_HITTERS_H_
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <string>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class HeavyHitters {
+ public:
+  // REQUIRES: capacity > 0
+  explicit HeavyHitters(size_t capacity);
+
+  // Count one occurrence of "item".  If another item had to stop being
+  // tracked to make room, store it in *evicted and return true.
+  bool Add(const Slice& item, std::string* evicted);
+
+  bool Contains(const Slice& item) const;
+
+  // The estimated count of "item" and its error bound, or zero for both
+  // if it is not tracked.
+  uint64_t Count(const Slice& item) const;
+  uint64_t Error(const Slice& item) const;
+
+  // Number of occurrences added.
+  uint64_t total() const { return total_; }
+
+  size_t capacity() const { return capacity_; }
+
+ private:
+  struct Counter {
+    uint64_t count;
+    uint64_t error;
+  };
+
+  const size_t capacity_;
+  uint64_t total_;
+  std::map<std::string, Counter> counters_;
+  std::set<std::pair<uint64_t, std::string> > by_count_;   // Least first
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_HEAVY_HITTERS_H_
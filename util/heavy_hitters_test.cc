@@ -0,0 +1,73 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/heavy_hitters.h"
+
+#include <map>
+#include "util/logging.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class HeavyHittersTest { };
+
+TEST(HeavyHittersTest, Exact) {
+  HeavyHitters sketch(3);
+  std::string evicted;
+  ASSERT_TRUE(!sketch.Add("a", &evicted));
+  ASSERT_TRUE(!sketch.Add("b", &evicted));
+  ASSERT_TRUE(!sketch.Add("a", &evicted));
+  ASSERT_TRUE(!sketch.Add("c", &evicted));
+  ASSERT_EQ(4u, sketch.total());
+  ASSERT_EQ(2u, sketch.Count("a"));
+  ASSERT_EQ(1u, sketch.Count("b"));
+  ASSERT_EQ(0u, sketch.Error("a"));
+  ASSERT_EQ(0u, sketch.Count("d"));
+
+  // "d" takes over a counter of count 1
+  ASSERT_TRUE(sketch.Add("d", &evicted));
+  ASSERT_TRUE(evicted == "b" || evicted == "c");
+  ASSERT_TRUE(!sketch.Contains(evicted));
+  ASSERT_TRUE(sketch.Contains("d"));
+  ASSERT_EQ(2u, sketch.Count("d"));
+  ASSERT_EQ(1u, sketch.Error("d"));
+  ASSERT_TRUE(sketch.Contains("a"));
+}
+
+TEST(HeavyHittersTest, Skewed) {
+  // Two values make up a third and a fifth of the stream, the rest is
+  // spread over many rare ones.
+  Random rnd(301);
+  HeavyHitters sketch(20);
+  std::map<std::string, uint64_t> counts;
+  std::string evicted;
+  for (int i = 0; i < 10000; i++) {
+    std::string item;
+    const uint32_t r = rnd.Uniform(15);
+    if (r < 5) {
+      item = "hot";
+    } else if (r < 8) {
+      item = "warm";
+    } else {
+      item = NumberToString(rnd.Uniform(5000));
+    }
+    counts[item]++;
+    sketch.Add(item, &evicted);
+  }
+  const char* frequent[] = { "hot", "warm" };
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(sketch.Contains(frequent[i]));
+    const uint64_t count = counts[frequent[i]];
+    ASSERT_GE(sketch.Count(frequent[i]), count);
+    ASSERT_LE(sketch.Count(frequent[i]) - sketch.Error(frequent[i]), count);
+    ASSERT_LE(sketch.Error(frequent[i]), sketch.total() / 20);
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -22,7 +22,19 @@ Options::Options()
       block_size(4096),
       block_restart_interval(16),
       compression(kSnappyCompression),
-      filter_policy(NULL) {
+      filter_policy(NULL),
+      secondary_index_type(kSecondaryFilterIndex),
+      secondary_heavy_hitter_fraction(0),
+      secondary_count_sketch_width(0),
+      secondary_level_summaries(false),
+      secondary_file_directory_keys(0),
+      secondary_result_cache(NULL),
+      secondary_negative_block_cache(false),
+      secondary_index_table(kNoSecondaryIndexTable),
+      secondary_key_extractor(NULL),
+      merge_operator(NULL),
+      secondary_block_stats(false),
+      binary_documents(false) {
 }
 
 
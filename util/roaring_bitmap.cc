@@ -0,0 +1,310 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/roaring_bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+#include "util/coding.h"
+
+namespace leveldb {
+
+namespace {
+
+inline uint32_t PopCount(uint64_t word) {
+#if defined(__GNUC__)
+  return __builtin_popcountll(word);
+#else
+  uint32_t n = 0;
+  for (; word != 0; word &= word - 1) {
+    n++;
+  }
+  return n;
+#endif
+}
+
+}  // namespace
+
+bool RoaringBitmap::Container::Contains(uint16_t low) const {
+  if (is_bitmap()) {
+    return (words[low >> 6] >> (low & 63)) & 1;
+  }
+  return std::binary_search(array.begin(), array.end(), low);
+}
+
+void RoaringBitmap::Container::Add(uint16_t low) {
+  if (is_bitmap()) {
+    uint64_t& word = words[low >> 6];
+    const uint64_t bit = static_cast<uint64_t>(1) << (low & 63);
+    if ((word & bit) == 0) {
+      word |= bit;
+      cardinality++;
+    }
+    return;
+  }
+  if (array.empty() || array.back() < low) {
+    array.push_back(low);
+  } else {
+    std::vector<uint16_t>::iterator pos =
+        std::lower_bound(array.begin(), array.end(), low);
+    if (*pos == low) {
+      return;
+    }
+    array.insert(pos, low);
+  }
+  cardinality++;
+  if (cardinality > kMaxArraySize) {
+    ToBitmap();
+  }
+}
+
+void RoaringBitmap::Container::ToBitmap() {
+  words.assign(kWords, 0);
+  for (size_t i = 0; i < array.size(); i++) {
+    words[array[i] >> 6] |= static_cast<uint64_t>(1) << (array[i] & 63);
+  }
+  std::vector<uint16_t>().swap(array);
+}
+
+void RoaringBitmap::Container::ToArray() {
+  array.clear();
+  array.reserve(cardinality);
+  for (uint32_t w = 0; w < kWords; w++) {
+    for (uint64_t word = words[w]; word != 0; word &= word - 1) {
+      array.push_back(static_cast<uint16_t>(
+          w * 64 + PopCount((word & -word) - 1)));
+    }
+  }
+  std::vector<uint64_t>().swap(words);
+}
+
+void RoaringBitmap::Container::Normalize() {
+  if (is_bitmap() && cardinality <= kMaxArraySize) {
+    ToArray();
+  }
+}
+
+size_t RoaringBitmap::Find(uint16_t key) const {
+  if (!containers_.empty() && containers_.back().key < key) {
+    return containers_.size();
+  }
+  size_t lo = 0, hi = containers_.size();
+  while (lo < hi) {
+    const size_t mid = (lo + hi) / 2;
+    if (containers_[mid].key < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+uint64_t RoaringBitmap::Cardinality() const {
+  uint64_t result = 0;
+  for (size_t i = 0; i < containers_.size(); i++) {
+    result += containers_[i].cardinality;
+  }
+  return result;
+}
+
+void RoaringBitmap::Add(uint32_t value) {
+  const uint16_t key = static_cast<uint16_t>(value >> 16);
+  const size_t i = Find(key);
+  if (i == containers_.size() || containers_[i].key != key) {
+    Container c;
+    c.key = key;
+    c.cardinality = 0;
+    containers_.insert(containers_.begin() + i, c);
+  }
+  containers_[i].Add(static_cast<uint16_t>(value & 0xffff));
+}
+
+bool RoaringBitmap::Contains(uint32_t value) const {
+  const uint16_t key = static_cast<uint16_t>(value >> 16);
+  const size_t i = Find(key);
+  return i < containers_.size() && containers_[i].key == key &&
+      containers_[i].Contains(static_cast<uint16_t>(value & 0xffff));
+}
+
+void RoaringBitmap::Intersect(const Container& a, const Container& b,
+                              Container* result) {
+  result->key = a.key;
+  if (a.is_bitmap() && b.is_bitmap()) {
+    result->words.resize(kWords);
+    uint32_t cardinality = 0;
+    for (uint32_t w = 0; w < kWords; w++) {
+      result->words[w] = a.words[w] & b.words[w];
+      cardinality += PopCount(result->words[w]);
+    }
+    result->cardinality = cardinality;
+    result->Normalize();
+  } else if (a.is_bitmap() || b.is_bitmap()) {
+    const Container& array = a.is_bitmap() ? b : a;
+    const Container& bitmap = a.is_bitmap() ? a : b;
+    for (size_t i = 0; i < array.array.size(); i++) {
+      if (bitmap.Contains(array.array[i])) {
+        result->array.push_back(array.array[i]);
+      }
+    }
+    result->cardinality = result->array.size();
+  } else {
+    std::set_intersection(a.array.begin(), a.array.end(),
+                          b.array.begin(), b.array.end(),
+                          std::back_inserter(result->array));
+    result->cardinality = result->array.size();
+  }
+}
+
+void RoaringBitmap::Union(const Container& a, const Container& b,
+                          Container* result) {
+  result->key = a.key;
+  if (a.is_bitmap() && b.is_bitmap()) {
+    result->words.resize(kWords);
+    uint32_t cardinality = 0;
+    for (uint32_t w = 0; w < kWords; w++) {
+      result->words[w] = a.words[w] | b.words[w];
+      cardinality += PopCount(result->words[w]);
+    }
+    result->cardinality = cardinality;
+  } else if (a.is_bitmap() || b.is_bitmap()) {
+    const Container& array = a.is_bitmap() ? b : a;
+    *result = a.is_bitmap() ? a : b;
+    for (size_t i = 0; i < array.array.size(); i++) {
+      result->Add(array.array[i]);
+    }
+  } else {
+    std::set_union(a.array.begin(), a.array.end(),
+                   b.array.begin(), b.array.end(),
+                   std::back_inserter(result->array));
+    result->cardinality = result->array.size();
+    if (result->cardinality > kMaxArraySize) {
+      result->ToBitmap();
+    }
+  }
+}
+
+void RoaringBitmap::IntersectWith(const RoaringBitmap& other) {
+  std::vector<Container> result;
+  size_t i = 0, j = 0;
+  while (i < containers_.size() && j < other.containers_.size()) {
+    const Container& a = containers_[i];
+    const Container& b = other.containers_[j];
+    if (a.key < b.key) {
+      i++;
+    } else if (b.key < a.key) {
+      j++;
+    } else {
+      result.push_back(Container());
+      Intersect(a, b, &result.back());
+      if (result.back().cardinality == 0) {
+        result.pop_back();
+      }
+      i++;
+      j++;
+    }
+  }
+  containers_.swap(result);
+}
+
+void RoaringBitmap::UnionWith(const RoaringBitmap& other) {
+  std::vector<Container> result;
+  size_t i = 0, j = 0;
+  while (i < containers_.size() || j < other.containers_.size()) {
+    if (j == other.containers_.size() ||
+        (i < containers_.size() &&
+         containers_[i].key < other.containers_[j].key)) {
+      result.push_back(Container());
+      std::swap(result.back(), containers_[i++]);
+    } else if (i == containers_.size() ||
+               other.containers_[j].key < containers_[i].key) {
+      result.push_back(other.containers_[j++]);
+    } else {
+      result.push_back(Container());
+      Union(containers_[i++], other.containers_[j++], &result.back());
+    }
+  }
+  containers_.swap(result);
+}
+
+void RoaringBitmap::GetValues(std::vector<uint32_t>* values) const {
+  for (size_t i = 0; i < containers_.size(); i++) {
+    const Container& c = containers_[i];
+    const uint32_t high = static_cast<uint32_t>(c.key) << 16;
+    if (c.is_bitmap()) {
+      for (uint32_t w = 0; w < kWords; w++) {
+        for (uint64_t word = c.words[w]; word != 0; word &= word - 1) {
+          values->push_back(high | (w * 64 + PopCount((word & -word) - 1)));
+        }
+      }
+    } else {
+      for (size_t j = 0; j < c.array.size(); j++) {
+        values->push_back(high | c.array[j]);
+      }
+    }
+  }
+}
+
+void RoaringBitmap::EncodeTo(std::string* dst) const {
+  PutVarint32(dst, containers_.size());
+  for (size_t i = 0; i < containers_.size(); i++) {
+    const Container& c = containers_[i];
+    PutVarint32(dst, c.key);
+    PutVarint32(dst, c.cardinality);
+    if (c.is_bitmap()) {
+      for (uint32_t w = 0; w < kWords; w++) {
+        PutFixed64(dst, c.words[w]);
+      }
+    } else {
+      for (size_t j = 0; j < c.array.size(); j++) {
+        dst->push_back(static_cast<char>(c.array[j] & 0xff));
+        dst->push_back(static_cast<char>(c.array[j] >> 8));
+      }
+    }
+  }
+}
+
+bool RoaringBitmap::DecodeFrom(Slice* input) {
+  containers_.clear();
+  uint32_t n;
+  if (!GetVarint32(input, &n)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t key, cardinality;
+    if (!GetVarint32(input, &key) || !GetVarint32(input, &cardinality) ||
+        key > 0xffff || cardinality == 0 || cardinality > (1u << 16) ||
+        (!containers_.empty() && key <= containers_.back().key)) {
+      return false;
+    }
+    containers_.push_back(Container());
+    Container& c = containers_.back();
+    c.key = static_cast<uint16_t>(key);
+    c.cardinality = cardinality;
+    if (cardinality > kMaxArraySize) {
+      if (input->size() < kWords * 8) {
+        return false;
+      }
+      c.words.resize(kWords);
+      for (uint32_t w = 0; w < kWords; w++) {
+        c.words[w] = DecodeFixed64(input->data() + w * 8);
+      }
+      input->remove_prefix(kWords * 8);
+    } else {
+      if (input->size() < cardinality * 2) {
+        return false;
+      }
+      const unsigned char* p =
+          reinterpret_cast<const unsigned char*>(input->data());
+      c.array.resize(cardinality);
+      for (uint32_t j = 0; j < cardinality; j++) {
+        c.array[j] = static_cast<uint16_t>(p[2 * j] | (p[2 * j + 1] << 8));
+      }
+      input->remove_prefix(cardinality * 2);
+    }
+  }
+  return true;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,92 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A compressed set of 32-bit integers in the style of Roaring bitmaps.
+// Values are split by their high 16 bits into containers, each holding
+// the low 16 bits either as a sorted array, while it has at most
+// kMaxArraySize members, or else as a 2^16-bit bitmap.  Intersections
+// and unions of two bitmap containers work a 64-bit word at a time, in
+// loops the compiler can vectorize.
+//
+// The encoding is:
+//
+//    bitmap      := num_containers:varint32 container[num_containers]
+//    container   := key:varint32 cardinality:varint32 payload
+//    payload     := low:fixed16[cardinality]   if cardinality <= 4096
+//                 | word:fixed64[1024]         otherwise
+//
+// with containers in increasing key order and array members in
+// increasing order.
+
+#ifndef STORAGE_LEVELDB_UTIL_ROARING_BITMAP_H_
+#define STORAGE_LEVELDB_UTIL_ROARING_BITMAP_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class RoaringBitmap {
+ public:
+  RoaringBitmap() { }
+
+  bool empty() const { return containers_.empty(); }
+  uint64_t Cardinality() const;
+
+  // Add "value" to the set.  Cheapest when values are added in
+  // increasing order.
+  void Add(uint32_t value);
+
+  bool Contains(uint32_t value) const;
+
+  // Replace the set by its intersection, or its union, with "other".
+  void IntersectWith(const RoaringBitmap& other);
+  void UnionWith(const RoaringBitmap& other);
+
+  // Append the members to *values in increasing order.
+  void GetValues(std::vector<uint32_t>* values) const;
+
+  void Clear() { containers_.clear(); }
+  void Swap(RoaringBitmap* other) { containers_.swap(other->containers_); }
+
+  void EncodeTo(std::string* dst) const;
+  bool DecodeFrom(Slice* input);
+
+  enum { kMaxArraySize = 4096 };
+
+ private:
+  enum { kWords = 1024 };   // 2^16 bits
+
+  struct Container {
+    uint16_t key;                   // High 16 bits of the members
+    uint32_t cardinality;
+    std::vector<uint16_t> array;    // Sorted low bits, if not a bitmap
+    std::vector<uint64_t> words;    // Bitmap of the low bits, if one
+
+    bool is_bitmap() const { return !words.empty(); }
+    bool Contains(uint16_t low) const;
+    void Add(uint16_t low);
+    void ToBitmap();
+    void ToArray();
+    // Convert a bitmap container back to an array once it is sparse.
+    void Normalize();
+  };
+
+  // Return the index of the container for "key", or of the one it would
+  // be inserted before.
+  size_t Find(uint16_t key) const;
+
+  static void Intersect(const Container& a, const Container& b,
+                        Container* result);
+  static void Union(const Container& a, const Container& b,
+                    Container* result);
+
+  std::vector<Container> containers_;   // In increasing key order
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_ROARING_BITMAP_H_
@@ -0,0 +1,144 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/roaring_bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class RoaringBitmapTest { };
+
+static std::vector<uint32_t> Values(const RoaringBitmap& bitmap) {
+  std::vector<uint32_t> values;
+  bitmap.GetValues(&values);
+  return values;
+}
+
+static std::vector<uint32_t> Values(const std::set<uint32_t>& set) {
+  return std::vector<uint32_t>(set.begin(), set.end());
+}
+
+// Fill both with "n" random values below "range", offset by "base".
+static void Fill(Random* rnd, int n, uint32_t base, uint32_t range,
+                 RoaringBitmap* bitmap, std::set<uint32_t>* set) {
+  for (int i = 0; i < n; i++) {
+    const uint32_t v = base + rnd->Uniform(range);
+    bitmap->Add(v);
+    set->insert(v);
+  }
+}
+
+static std::vector<uint32_t> RoundTrip(const RoaringBitmap& bitmap) {
+  std::string encoding;
+  bitmap.EncodeTo(&encoding);
+  Slice input(encoding);
+  RoaringBitmap decoded;
+  ASSERT_TRUE(decoded.DecodeFrom(&input));
+  ASSERT_TRUE(input.empty());
+  return Values(decoded);
+}
+
+TEST(RoaringBitmapTest, Empty) {
+  RoaringBitmap bitmap;
+  ASSERT_TRUE(bitmap.empty());
+  ASSERT_EQ(0u, bitmap.Cardinality());
+  ASSERT_TRUE(!bitmap.Contains(0));
+  ASSERT_TRUE(RoundTrip(bitmap).empty());
+}
+
+TEST(RoaringBitmapTest, AddAndContains) {
+  RoaringBitmap bitmap;
+  const uint32_t values[] = { 7, 3, 65536, 65535, 7, 0xffffffffu, 100000 };
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    bitmap.Add(values[i]);
+  }
+  ASSERT_EQ(6u, bitmap.Cardinality());
+  ASSERT_TRUE(bitmap.Contains(3));
+  ASSERT_TRUE(bitmap.Contains(65536));
+  ASSERT_TRUE(bitmap.Contains(0xffffffffu));
+  ASSERT_TRUE(!bitmap.Contains(4));
+  ASSERT_TRUE(!bitmap.Contains(65537));
+  std::vector<uint32_t> expected;
+  expected.push_back(3);
+  expected.push_back(7);
+  expected.push_back(65535);
+  expected.push_back(65536);
+  expected.push_back(100000);
+  expected.push_back(0xffffffffu);
+  ASSERT_TRUE(expected == Values(bitmap));
+  ASSERT_TRUE(expected == RoundTrip(bitmap));
+}
+
+TEST(RoaringBitmapTest, DenseContainers) {
+  // Enough members in one container to switch it to a bitmap, and back
+  // to an array once an intersection leaves it sparse
+  Random rnd(301);
+  RoaringBitmap dense, sparse;
+  std::set<uint32_t> dense_set, sparse_set;
+  Fill(&rnd, 20000, 0, 1 << 16, &dense, &dense_set);
+  Fill(&rnd, 300, 0, 1 << 17, &sparse, &sparse_set);
+  ASSERT_EQ(dense_set.size(), dense.Cardinality());
+  ASSERT_TRUE(Values(dense_set) == Values(dense));
+  ASSERT_TRUE(Values(dense_set) == RoundTrip(dense));
+
+  std::set<uint32_t> expected;
+  std::set_intersection(dense_set.begin(), dense_set.end(),
+                        sparse_set.begin(), sparse_set.end(),
+                        std::inserter(expected, expected.end()));
+  RoaringBitmap both = dense;
+  both.IntersectWith(sparse);
+  ASSERT_TRUE(Values(expected) == Values(both));
+  ASSERT_TRUE(Values(expected) == RoundTrip(both));
+}
+
+TEST(RoaringBitmapTest, RandomSetOperations) {
+  Random rnd(17);
+  for (int iter = 0; iter < 50; iter++) {
+    RoaringBitmap a, b;
+    std::set<uint32_t> sa, sb;
+    const uint32_t range = 1 + rnd.Uniform(300000);
+    Fill(&rnd, rnd.Uniform(10000), 0, range, &a, &sa);
+    Fill(&rnd, rnd.Uniform(10000), rnd.Uniform(70000), range, &b, &sb);
+
+    std::set<uint32_t> both, either;
+    std::set_intersection(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                          std::inserter(both, both.end()));
+    std::set_union(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                   std::inserter(either, either.end()));
+
+    RoaringBitmap intersection = a;
+    intersection.IntersectWith(b);
+    ASSERT_TRUE(Values(both) == Values(intersection));
+    ASSERT_EQ(both.size(), intersection.Cardinality());
+
+    RoaringBitmap merged = a;
+    merged.UnionWith(b);
+    ASSERT_TRUE(Values(either) == Values(merged));
+    ASSERT_TRUE(Values(either) == RoundTrip(merged));
+  }
+}
+
+TEST(RoaringBitmapTest, Corrupt) {
+  RoaringBitmap bitmap;
+  bitmap.Add(5);
+  bitmap.Add(70000);
+  std::string encoding;
+  bitmap.EncodeTo(&encoding);
+  for (size_t n = 0; n < encoding.size(); n++) {
+    Slice input(encoding.data(), n);
+    RoaringBitmap decoded;
+    ASSERT_TRUE(!decoded.DecodeFrom(&input));
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}